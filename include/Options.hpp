@@ -35,6 +35,7 @@
 namespace po = boost::program_options;
 
 #include <string>
+#include <vector>
 #include <iostream>
 
 namespace options {
@@ -62,8 +63,12 @@ public:
 	std::string masterBamFile;
 	std::string masterISizeFile;
 	std::string slaveBamFile;
+	std::vector< std::string > slaveBamLists;  // gam-create: lists of every slave assembly (the first one is slaveBamFile)
 	std::string slaveISizeFile;
 
+	std::string masterNameSortedBamFile;
+	std::string slaveNameSortedBamFile;
+
 	std::string masterMpBamFile;
 	std::string masterMpISizeFile;
 	std::string slaveMpBamFile;
@@ -76,17 +81,29 @@ public:
 
 	int minBlockSize;
 	int threadsNum;
+	int ioThreadsNum;       // threads decompressing each BAM file (0 = decompress on the reading thread)
 	double coverageThreshold;
 	bool noMultiplicityFilter;
 
+	int blockCacheSize;     // MB of decompressed BAM blocks shared by gam-merge's readers (0 = no cache)
+	int regionCacheSize;    // MB of region statistics memoized by gam-merge's region scans (0 = no cache)
+
+	int maxMemory;          // MB available to gam-create (0 = keep master reads in memory)
+
+	int readKeyBits;        // 0 = full read names, 64/128 = name fingerprints
+	bool verifyReadKeys;
+
+	std::string saveMasterIndexFile;   // file where master reads' index is saved
+	std::string loadMasterIndexFile;   // previously saved master reads' index
+
+	bool writePairEvidence; // gam-create: write pair-evidence files of the assemblies (<bam list>.evidence)
+
 	bool debug;
 
 	bool outputGraphs;
 
 	// unused input options
 	std::string readsPrefix;
-	std::string masterNameSortedBamFile;
-	std::string slaveNameSortedBamFile;
 
 	// output options
 	std::string outputFilePrefix;
@@ -9,6 +9,7 @@
 
 #include "api/BamAlignment.h"
 #include "api/BamConstants.h"
+#include <algorithm>
 using namespace BamTools;
 using namespace std;
 
@@ -119,6 +120,43 @@ BamAlignment::BamAlignment(const BamAlignment& other)
 */
 BamAlignment::~BamAlignment(void) { }
 
+/*! \fn void BamAlignment::Swap(BamAlignment& other)
+    \brief Exchanges the contents of this alignment with \a other.
+
+    Strings and vectors are swapped rather than copied, so this is a cheap way
+    to hand out alignments read into a buffer.
+
+    \param[in,out] other alignment to swap contents with
+*/
+void BamAlignment::Swap(BamAlignment& other) {
+
+    Name.swap(other.Name);
+    std::swap(Length, other.Length);
+    QueryBases.swap(other.QueryBases);
+    AlignedBases.swap(other.AlignedBases);
+    Qualities.swap(other.Qualities);
+    TagData.swap(other.TagData);
+    std::swap(RefID, other.RefID);
+    std::swap(Position, other.Position);
+    std::swap(Bin, other.Bin);
+    std::swap(MapQuality, other.MapQuality);
+    std::swap(AlignmentFlag, other.AlignmentFlag);
+    CigarData.swap(other.CigarData);
+    std::swap(MateRefID, other.MateRefID);
+    std::swap(MatePosition, other.MatePosition);
+    std::swap(InsertSize, other.InsertSize);
+    Filename.swap(other.Filename);
+
+    SupportData.AllCharData.swap(other.SupportData.AllCharData);
+    std::swap(SupportData.BlockLength, other.SupportData.BlockLength);
+    std::swap(SupportData.NumCigarOperations, other.SupportData.NumCigarOperations);
+    std::swap(SupportData.QueryNameLength, other.SupportData.QueryNameLength);
+    std::swap(SupportData.QuerySequenceLength, other.SupportData.QuerySequenceLength);
+    std::swap(SupportData.HasCoreOnly, other.SupportData.HasCoreOnly);
+
+    ErrorString.swap(other.ErrorString);
+}
+
 /*! \fn bool BamAlignment::BuildCharData(void)
     \brief Populates alignment string fields (read name, bases, qualities, tag data).
 
@@ -351,6 +389,90 @@ bool BamAlignment::BuildCharData(void) {
     return true;
 }
 
+/*! \fn bool BamAlignment::BuildName(void)
+    \brief Populates the read name of an alignment retrieved using BamReader::GetNextAlignmentCore().
+
+    Other string fields are left untouched, so that the name can be used (e.g. to
+    merge name-sorted files) without decoding bases, qualities and tags.
+
+    \return \c true if the name has been populated (or character data was already available)
+*/
+bool BamAlignment::BuildName(void) {
+
+    if ( !SupportData.HasCoreOnly )
+        return true;
+
+    if ( SupportData.QueryNameLength == 0 || SupportData.AllCharData.empty() )
+        return false;
+
+    Name.assign(SupportData.AllCharData.data());
+    return true;
+}
+
+/*! \fn bool BamAlignment::GetIntTag(const char* tag, int32_t& destination) const
+    \brief Retrieves the value of an integer (or single character) tag.
+
+    Unlike GetTag(), this also works on alignments retrieved using
+    BamReader::GetNextAlignmentCore(), reading the tag straight from the raw record,
+    and it does not build any temporary string. Conversion rules are the same of
+    GetTag() with an \c int32_t destination.
+
+    \param[in]  tag         2-character tag name
+    \param[out] destination retrieved value
+    \return \c true if found
+*/
+bool BamAlignment::GetIntTag(const char* tag, int32_t& destination) const {
+
+    char* pTagData;
+    unsigned int tagDataLength;
+
+    if ( SupportData.HasCoreOnly ) {
+
+        // raw tag values are little-endian
+        if ( BamTools::SystemIsBigEndian() ) {
+            BamAlignment full(*this);
+            full.BuildCharData();
+            return full.GetIntTag(tag, destination);
+        }
+
+        const unsigned int dataLength    = SupportData.BlockLength - Constants::BAM_CORE_SIZE;
+        const unsigned int tagDataOffset = SupportData.QueryNameLength + (SupportData.NumCigarOperations*4) +
+                                           (SupportData.QuerySequenceLength+1)/2 + SupportData.QuerySequenceLength;
+
+        if ( tagDataOffset >= dataLength || SupportData.AllCharData.size() < dataLength )
+            return false;
+
+        pTagData      = (char*)SupportData.AllCharData.data() + tagDataOffset;
+        tagDataLength = dataLength - tagDataOffset;
+    }
+    else {
+
+        if ( TagData.empty() )
+            return false;
+
+        pTagData      = (char*)TagData.data();
+        tagDataLength = TagData.size();
+    }
+
+    unsigned int numBytesParsed = 0;
+    if ( !FindTag(tag, pTagData, tagDataLength, numBytesParsed) )
+        return false;
+
+    const char type = *(pTagData - 1);
+    if ( !TagTypeHelper<int32_t>::CanConvertFrom(type) )
+        return false;
+
+    int destinationLength = 4;
+    if ( type == Constants::BAM_TAG_TYPE_ASCII || type == Constants::BAM_TAG_TYPE_INT8 )
+        destinationLength = 1;
+    else if ( type == Constants::BAM_TAG_TYPE_INT16 )
+        destinationLength = 2;
+
+    destination = 0;
+    memcpy(&destination, pTagData, destinationLength);
+    return true;
+}
+
 /*! \fn bool BamAlignment::FindTag(const std::string& tag, char*& pTagData, const unsigned int& tagDataLength, unsigned int& numBytesParsed) const
     \internal
 
@@ -372,6 +494,19 @@ bool BamAlignment::FindTag(const std::string& tag,
                            const unsigned int& tagDataLength,
                            unsigned int& numBytesParsed) const
 {
+    return FindTag(tag.c_str(), pTagData, tagDataLength, numBytesParsed);
+}
+
+/*! \fn bool BamAlignment::FindTag(const char* tag, char*& pTagData, const unsigned int& tagDataLength, unsigned int& numBytesParsed) const
+    \internal
+
+    Same as FindTag(const std::string&, ...), without requiring a string object.
+*/
+bool BamAlignment::FindTag(const char* tag,
+                           char*& pTagData,
+                           const unsigned int& tagDataLength,
+                           unsigned int& numBytesParsed) const
+{
 
     while ( numBytesParsed < tagDataLength ) {
 
@@ -381,7 +516,7 @@ bool BamAlignment::FindTag(const std::string& tag,
         numBytesParsed += 3;
 
         // check the current tag, return true on match
-        if ( strncmp(pTagType, tag.c_str(), 2) == 0 )
+        if ( strncmp(pTagType, tag, 2) == 0 )
             return true;
 
         // get the storage class and find the next tag
@@ -37,6 +37,9 @@ struct API_EXPORT BamAlignment {
         BamAlignment(const BamAlignment& other);
         ~BamAlignment(void);
 
+        // exchanges contents with another alignment (character data is not copied)
+        void Swap(BamAlignment& other);
+
     // queries against alignment flags
     public:
         bool IsDuplicate(void) const;         // returns true if this read is a PCR duplicate
@@ -100,6 +103,12 @@ struct API_EXPORT BamAlignment {
         // populates alignment string fields
         bool BuildCharData(void);
 
+        // populates only the read name (for alignments retrieved with GetNextAlignmentCore())
+        bool BuildName(void);
+
+        // retrieves an integer tag value, also from core-only alignments (without populating string fields)
+        bool GetIntTag(const char* tag, int32_t& destination) const;
+
         // calculates alignment end position
         int GetEndPosition(bool usePadded = false, bool closedInterval = false) const;
 
@@ -138,6 +147,10 @@ struct API_EXPORT BamAlignment {
                      char*& pTagData,
                      const unsigned int& tagDataLength,
                      unsigned int& numBytesParsed) const;
+        bool FindTag(const char* tag,
+                     char*& pTagData,
+                     const unsigned int& tagDataLength,
+                     unsigned int& numBytesParsed) const;
         bool IsValidSize(const std::string& tag, const std::string& type) const;
         void SetErrorString(const std::string& where, const std::string& what) const;
         bool SkipToNextTag(const char storageType,
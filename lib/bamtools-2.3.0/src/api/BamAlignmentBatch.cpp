@@ -0,0 +1,59 @@
+// ***************************************************************************
+// BamAlignmentBatch.cpp
+// ---------------------------------------------------------------------------
+// Provides a structure-of-arrays view of consecutive BAM alignments, holding
+// only positional data, flags, mate data and a few selected integer tags.
+// ***************************************************************************
+
+#include "api/BamAlignmentBatch.h"
+using namespace BamTools;
+using namespace std;
+
+/*! \fn BamAlignmentBatch::BamAlignmentBatch(void)
+    \brief constructor
+*/
+BamAlignmentBatch::BamAlignmentBatch(void) { }
+
+/*! \fn size_t BamAlignmentBatch::AddIntTag(const std::string& tag, const int32_t defaultValue)
+    \brief Selects an integer tag to be decoded for each alignment.
+
+    Tags stored as ASCII characters or (signed) 8, 16 or 32 bit integers are
+    decoded as BamAlignment::GetIntTag() does. Alignments that miss the tag
+    (or store it with another type) get \a defaultValue.
+
+    \param[in] tag          2-character tag name
+    \param[in] defaultValue value stored when tag is missing
+    \returns index of the tag in TagValues
+*/
+size_t BamAlignmentBatch::AddIntTag(const string& tag, const int32_t defaultValue) {
+    TagNames.push_back(tag);
+    TagDefaults.push_back(defaultValue);
+    TagValues.push_back( vector<int32_t>(Size(), defaultValue) );
+    return TagNames.size() - 1;
+}
+
+/*! \fn void BamAlignmentBatch::Clear(void)
+    \brief Removes every alignment from the batch.
+
+    Selected tags are kept, as well as the memory of the arrays,
+    so that a batch can be refilled without allocations.
+*/
+void BamAlignmentBatch::Clear(void) {
+    RefID.clear();
+    Position.clear();
+    EndPosition.clear();
+    AlignmentFlag.clear();
+    MateRefID.clear();
+    MatePosition.clear();
+    for ( size_t i = 0; i < TagValues.size(); ++i )
+        TagValues[i].clear();
+}
+
+/*! \fn void BamAlignmentBatch::ClearTags(void)
+    \brief Removes every selected tag (and their values).
+*/
+void BamAlignmentBatch::ClearTags(void) {
+    TagNames.clear();
+    TagDefaults.clear();
+    TagValues.clear();
+}
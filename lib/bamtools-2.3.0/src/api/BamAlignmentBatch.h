@@ -0,0 +1,66 @@
+// ***************************************************************************
+// BamAlignmentBatch.h
+// ---------------------------------------------------------------------------
+// Provides a structure-of-arrays view of consecutive BAM alignments, holding
+// only positional data, flags, mate data and a few selected integer tags.
+// ***************************************************************************
+
+#ifndef BAMALIGNMENTBATCH_H
+#define BAMALIGNMENTBATCH_H
+
+#include "api/api_global.h"
+#include "api/BamAux.h"
+#include <string>
+#include <vector>
+
+namespace BamTools {
+
+/*! \class BamTools::BamAlignmentBatch
+    \brief Holds the core data of consecutive alignments, one array per field.
+
+    A batch is filled by BamReader::GetNextAlignmentBatch(). Alignment \c i
+    of the batch is described by the \c i-th element of every array, so that
+    region scans can run over contiguous arrays instead of BamAlignment objects.
+
+    Integer tags to be decoded are selected once with AddIntTag(); their values
+    are stored in TagValues, in the order they have been added.
+
+    \sa BamReader::GetNextAlignmentBatch()
+*/
+
+class API_EXPORT BamAlignmentBatch {
+
+    // constructor
+    public:
+        BamAlignmentBatch(void);
+
+    // public interface
+    public:
+        // selects an integer tag to be decoded, returns its index in TagValues
+        size_t AddIntTag(const std::string& tag, const int32_t defaultValue);
+        // removes every alignment (keeping selected tags & allocated memory)
+        void Clear(void);
+        // removes every selected tag
+        void ClearTags(void);
+        // returns true if batch holds no alignment
+        bool IsEmpty(void) const { return Position.empty(); }
+        // returns the number of alignments in batch
+        size_t Size(void) const { return Position.size(); }
+
+    // public data fields (one element for each alignment)
+    public:
+        std::vector<int32_t>  RefID;           // ID number for reference sequence
+        std::vector<int32_t>  Position;        // position (0-based) where alignment starts
+        std::vector<int32_t>  EndPosition;     // position (0-based) after alignment's last base, from CIGAR (see BamAlignment::GetEndPosition())
+        std::vector<uint16_t> AlignmentFlag;   // alignment bit-flag (see BamConstants.h)
+        std::vector<int32_t>  MateRefID;       // ID number for reference sequence where alignment's mate was aligned
+        std::vector<int32_t>  MatePosition;    // position (0-based) where alignment's mate starts
+
+        std::vector<std::string> TagNames;                // selected integer tags
+        std::vector<int32_t>     TagDefaults;             // value stored when a tag is missing (or not an integer)
+        std::vector< std::vector<int32_t> > TagValues;    // TagValues[tag][alignment]
+};
+
+} // namespace BamTools
+
+#endif // BAMALIGNMENTBATCH_H
@@ -141,6 +141,7 @@ const uint8_t  BGZF_BLOCK_HEADER_LENGTH  = 18;
 const uint8_t  BGZF_BLOCK_FOOTER_LENGTH  = 8;
 const uint32_t BGZF_MAX_BLOCK_SIZE       = 65536;
 const uint32_t BGZF_DEFAULT_BLOCK_SIZE   = 65536;
+const uint32_t BGZF_READ_AHEAD_PER_THREAD = 4; // blocks read ahead for each decompression thread
 
 } // namespace Constants
 
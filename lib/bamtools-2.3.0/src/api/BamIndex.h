@@ -63,6 +63,16 @@ class API_EXPORT BamIndex {
         //     available after the jump position
         virtual bool Jump(const BamTools::BamRegion& region, bool* hasAlignmentsInRegion) =0;
 
+        // calculates the file offset where to start reading alignments of @region, without jumping there
+        // (sets the same flag as Jump()), returns success/fail
+        //   * optional: only indexes implementing it can be used by BamReader::SetRegions()
+        virtual bool GetRegionOffset(const BamTools::BamRegion& region, int64_t* offset, bool* hasAlignmentsInRegion) {
+            (void)region; (void)offset;
+            *hasAlignmentsInRegion = false;
+            SetErrorString("BamIndex::GetRegionOffset", "not supported by this index type");
+            return false;
+        }
+
         // loads existing data from file into memory
         virtual bool Load(const std::string& filename) =0;
 
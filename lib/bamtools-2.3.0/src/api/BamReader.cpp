@@ -9,6 +9,8 @@
 
 #include "api/BamReader.h"
 #include "api/internal/bam/BamReader_p.h"
+#include "api/internal/index/BamStandardIndex_p.h"
+#include "api/internal/io/BgzfBlockCache_p.h"
 using namespace BamTools;
 using namespace BamTools::Internal;
 
@@ -38,6 +40,32 @@ BamReader::~BamReader(void) {
     d = 0;
 }
 
+/*! \fn BamReader* BamReader::Clone(void) const
+    \brief Returns a new reader on the same BAM file.
+
+    The clone is positioned at the first alignment, with no region set. It
+    copies header & reference data, and uses the same index, without
+    reading them from file again: in-memory BAI data (see
+    SetSharedIndexData()) and the memory mapping of the BAM file are shared.
+    Each clone has its own file position and decompression buffers, and
+    the same decompression settings, so it can be used on another thread.
+
+    Only files opened from random-access devices can be cloned.
+
+    \returns new reader (owned by caller), or 0 if the reader could not be cloned
+    \sa GetErrorString()
+*/
+BamReader* BamReader::Clone(void) const {
+
+    BamReader* clone = new BamReader;
+    if ( clone->d->Clone(*d) )
+        return clone;
+
+    d->SetErrorString("BamReader::Clone", clone->GetErrorString());
+    delete clone;
+    return 0;
+}
+
 /*! \fn bool BamReader::Close(void)
     \brief Closes the current BAM file.
 
@@ -182,6 +210,40 @@ bool BamReader::GetNextAlignmentCore(BamAlignment& alignment) {
     return d->GetNextAlignmentCore(alignment);
 }
 
+/*! \fn bool BamReader::GetNextAlignmentCore(BamAlignment& alignment, std::vector<int>& regionIds)
+    \brief Retrieves next alignment overlapping target regions, without populating the alignment's string data fields.
+
+    Same as GetNextAlignmentCore(), also reporting the regions set by SetRegions() that
+    \a alignment overlaps. If no region set is active, \a regionIds is left empty.
+
+    \param[out] alignment destination for alignment record data
+    \param[out] regionIds indices of the overlapped regions, in the list given to SetRegions()
+    \returns \c true if a valid alignment was found
+    \sa SetRegions()
+*/
+bool BamReader::GetNextAlignmentCore(BamAlignment& alignment, std::vector<int>& regionIds) {
+    return d->GetNextAlignmentCore(alignment, regionIds);
+}
+
+/*! \fn int BamReader::GetNextAlignmentBatch(BamAlignmentBatch& batch, int maxCount)
+    \brief Retrieves core data of the next available alignments, in a single call.
+
+    Equivalent to calling GetNextAlignmentCore() up to \a maxCount times, with respect
+    to what is a valid overlapping alignment. Instead of BamAlignment objects, each
+    alignment's reference, positions (end position included), flag, mate data and
+    selected integer tags are appended to the arrays of \a batch, which is cleared first.
+
+    Records are decoded straight from the BAM data, without per-alignment allocations.
+
+    \param[out] batch    destination for alignments' core data
+    \param[in]  maxCount maximum number of alignments to be retrieved
+    \returns number of alignments retrieved (0 if none is available, or on error)
+    \sa BamAlignmentBatch::AddIntTag(), SetRegion()
+*/
+int BamReader::GetNextAlignmentBatch(BamAlignmentBatch& batch, int maxCount) {
+    return d->GetNextAlignmentBatch(batch, maxCount);
+}
+
 /*! \fn int BamReader::GetReferenceCount(void) const
     \brief Returns number of reference sequences.
 */
@@ -191,6 +253,11 @@ int BamReader::GetReferenceCount(void) const {
 
 /*! \fn const RefVector& BamReader::GetReferenceData(void) const
     \brief Returns all reference sequence entries.
+
+    Reference data is loaded once for all readers of files with the same
+    references (as alignments of several libraries on the same assembly), so
+    that the returned vector may be shared with those readers.
+
     \sa RefData
 */
 const RefVector& BamReader::GetReferenceData(void) const {
@@ -200,7 +267,8 @@ const RefVector& BamReader::GetReferenceData(void) const {
 /*! \fn int BamReader::GetReferenceID(const std::string& refName) const
     \brief Returns the ID of the reference with this name.
 
-    If \a refName is not found, returns -1.
+    If \a refName is not found, returns -1. Names are looked up in a hash
+    table, built once with the reference data.
 
     \param[in] refName name of reference to look up
 */
@@ -304,6 +372,38 @@ bool BamReader::Rewind(void) {
     return d->Rewind();
 }
 
+/*! \fn bool BamReader::SetCheckCrc(bool ok)
+    \brief Enables/disables the check of decompressed data against BGZF blocks' CRC32.
+
+    When enabled, a block whose decompressed data does not match the length
+    and CRC32 stored in its footer is reported as an error. Disabled by default.
+
+    \param[in] ok \c true to check decompressed blocks
+    \returns \c true if the setting was applied successfully
+*/
+bool BamReader::SetCheckCrc(bool ok) {
+    return d->SetCheckCrc(ok);
+}
+
+/*! \fn bool BamReader::SetDecompressionThreads(int numThreads)
+    \brief Sets the number of threads decompressing BAM data.
+
+    With \a numThreads greater than 0, compressed blocks are read ahead of
+    the current position and decompressed by a pool of \a numThreads worker
+    threads, while alignments are parsed on the calling thread. Blocks are
+    handed back in file order, so the alignments retrieved are the same.
+    With 0 (default) blocks are decompressed on the calling thread.
+
+    The setting is kept when a new BAM file is opened. Read-ahead restarts
+    after every random-access jump.
+
+    \param[in] numThreads number of decompression threads
+    \returns \c true if the setting was applied successfully
+*/
+bool BamReader::SetDecompressionThreads(int numThreads) {
+    return d->SetDecompressionThreads(numThreads);
+}
+
 /*! \fn void BamReader::SetIndex(BamIndex* index)
     \brief Sets a custom BamIndex on this reader.
 
@@ -381,3 +481,76 @@ bool BamReader::SetRegion(const int& leftRefID,
 {
     return d->SetRegion( BamRegion(leftRefID, leftBound, rightRefID, rightBound) );
 }
+
+/*! \fn bool BamReader::SetRegions(const std::vector<BamRegion>& regions)
+    \brief Sets several target regions of interest.
+
+    Requires that index data be available, and that the index type supports
+    BamIndex::GetRegionOffset() (standard ".bai" & BamTools ".bti" indexes do).
+
+    Regions may be given in any order. They are located once with the index,
+    then read in a single forward pass: data between regions is skipped only
+    when it cannot hold alignments overlapping the regions left, so that close
+    or overlapping regions are read with no further seek, and each alignment
+    is retrieved once. GetNextAlignmentCore(BamAlignment&, std::vector<int>&)
+    also reports the indices (in \a regions) of the regions an alignment overlaps.
+
+    GetNextAlignment(), GetNextAlignmentCore() and GetNextAlignmentBatch() retrieve
+    alignments overlapping any of the regions. SetRegion(), Jump() and Rewind()
+    replace the region set.
+
+    \param[in] regions desired regions-of-interest (zero-based, HALF-OPEN intervals)
+    \returns \c true if regions could be located (on failure, no alignment is retrieved)
+    \sa SetRegion(), HasIndex()
+*/
+bool BamReader::SetRegions(const std::vector<BamRegion>& regions) {
+    return d->SetRegions(regions);
+}
+
+/*! \fn void BamReader::SetSharedIndexData(bool ok)
+    \brief Enables/disables loading whole BAI files in memory.
+
+    By default a standard index (".bai") is kept open, and the bins and
+    linear offsets of a reference are read from it at every Jump() or
+    SetRegion(). When enabled, index files opened afterwards are parsed
+    once into per-reference bin/chunk arrays, and the index file is closed.
+    This data is shared read-only by every reader that opens the same index
+    file (until it is modified), so that setting a region needs no file I/O.
+
+    BamTools (".bti") indexes are not affected.
+
+    \param[in] ok \c true to load index files in memory
+*/
+void BamReader::SetSharedIndexData(bool ok) {
+    BamStandardIndex::SetSharedInMemory(ok);
+}
+
+/*! \fn void BamReader::SetBlockCacheSize(uint64_t bytes)
+    \brief Sets the memory budget of the shared decompressed-block cache.
+
+    Decompressed BGZF blocks are kept in a least-recently-used cache shared by
+    every reader in the process, keyed by file and block offset. Readers that
+    visit the same blocks (e.g. overlapping region queries, or several readers
+    on the same file) take them from the cache instead of reading and
+    decompressing them again. Only random-access files are cached.
+
+    The cache is disabled by default; setting \a bytes to 0 disables it and
+    frees the cached blocks.
+
+    \param[in] bytes memory budget, in bytes
+*/
+void BamReader::SetBlockCacheSize(uint64_t bytes) {
+    BgzfBlockCache::Instance().SetCapacity(bytes);
+}
+
+/*! \fn void BamReader::GetBlockCacheStatistics(uint64_t& hits, uint64_t& misses, uint64_t& evictions, uint64_t& bytes)
+    \brief Retrieves the counters of the shared decompressed-block cache.
+
+    \param[out] hits      blocks taken from the cache
+    \param[out] misses    blocks looked up but not found
+    \param[out] evictions blocks dropped to stay within the memory budget
+    \param[out] bytes     memory currently used by cached blocks
+*/
+void BamReader::GetBlockCacheStatistics(uint64_t& hits, uint64_t& misses, uint64_t& evictions, uint64_t& bytes) {
+    BgzfBlockCache::Instance().GetStatistics(hits, misses, evictions, bytes);
+}
@@ -12,9 +12,11 @@
 
 #include "api/api_global.h"
 #include "api/BamAlignment.h"
+#include "api/BamAlignmentBatch.h"
 #include "api/BamIndex.h"
 #include "api/SamHeader.h"
 #include <string>
+#include <vector>
 
 namespace BamTools {
   
@@ -36,6 +38,8 @@ class API_EXPORT BamReader {
         // BAM file operations
         // ----------------------
 
+        // returns a new reader on the same BAM file, sharing its header, index & file mapping
+        BamReader* Clone(void) const;
         // closes the current BAM file
         bool Close(void);
         // returns filename of current BAM file
@@ -48,6 +52,10 @@ class API_EXPORT BamReader {
         bool Open(const std::string& filename);
         // returns internal file pointer to beginning of alignment data
         bool Rewind(void);
+        // enables/disables the check of decompressed BAM data against its CRC32
+        bool SetCheckCrc(bool ok);
+        // sets the number of threads decompressing BAM data ahead of the reader
+        bool SetDecompressionThreads(int numThreads);
         // sets the target region of interest
         bool SetRegion(const BamRegion& region);
         // sets the target region of interest
@@ -55,6 +63,8 @@ class API_EXPORT BamReader {
                        const int& leftPosition,
                        const int& rightRefID,
                        const int& rightPosition);
+        // sets several target regions of interest, read in a single forward pass
+        bool SetRegions(const std::vector<BamRegion>& regions);
 
         // ----------------------
         // access alignment data
@@ -64,6 +74,11 @@ class API_EXPORT BamReader {
         bool GetNextAlignment(BamAlignment& alignment);
         // retrieves next available alignmnet (without populating the alignment's string data fields)
         bool GetNextAlignmentCore(BamAlignment& alignment);
+        // retrieves next alignment overlapping target regions (without populating string data fields),
+        // along with the indices of the overlapped regions
+        bool GetNextAlignmentCore(BamAlignment& alignment, std::vector<int>& regionIds);
+        // retrieves core data of up to maxCount next available alignments, returns the number retrieved
+        int GetNextAlignmentBatch(BamAlignmentBatch& batch, int maxCount);
 
         // ----------------------
         // access header data
@@ -101,6 +116,8 @@ class API_EXPORT BamReader {
         bool OpenIndex(const std::string& indexFilename);
         // sets a custom BamIndex on this reader
         void SetIndex(BamIndex* index);
+        // enables/disables loading whole BAI files in memory, shared by all readers of the same file
+        static void SetSharedIndexData(bool ok);
 
         // ----------------------
         // error handling
@@ -108,6 +125,15 @@ class API_EXPORT BamReader {
 
         // returns a human-readable description of the last error that occurred
         std::string GetErrorString(void) const;
+
+        // ----------------------
+        // shared block cache
+        // ----------------------
+
+        // sets the memory budget (bytes) of the decompressed-block cache shared by all readers (0 = disabled)
+        static void SetBlockCacheSize(uint64_t bytes);
+        // retrieves the counters of the shared block cache
+        static void GetBlockCacheStatistics(uint64_t& hits, uint64_t& misses, uint64_t& evictions, uint64_t& bytes);
         
     // private implementation
     private:
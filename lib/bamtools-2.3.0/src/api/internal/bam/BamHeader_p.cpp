@@ -34,7 +34,9 @@ bool isValidMagicNumber(const char* buffer) {
 // --------------------------
 
 // ctor
-BamHeader::BamHeader(void) { }
+BamHeader::BamHeader(void)
+    : m_isParsed(true)
+{ }
 
 // dtor
 BamHeader::~BamHeader(void) { }
@@ -55,11 +57,14 @@ void BamHeader::CheckMagicNumber(BgzfStream* stream) {
 
 // clear SamHeader data
 void BamHeader::Clear(void) {
+    m_headerText.clear();
     m_header.Clear();
+    m_isParsed = true;
 }
 
 // return true if SamHeader data is valid
 bool BamHeader::IsValid(void) const {
+    Parse();
     return m_header.IsValid();
 }
 
@@ -75,6 +80,14 @@ void BamHeader::Load(BgzfStream* stream) {
     ReadHeaderText(stream, length);
 }
 
+// parses header text into SamHeader object, if not done yet
+void BamHeader::Parse(void) const {
+    if ( m_isParsed )
+        return;
+    m_header.SetHeaderText(m_headerText);
+    m_isParsed = true;
+}
+
 // reads SAM header text length from BGZF stream, stores it in @length
 void BamHeader::ReadHeaderLength(BgzfStream* stream, uint32_t& length) {
 
@@ -90,7 +103,7 @@ void BamHeader::ReadHeaderLength(BgzfStream* stream, uint32_t& length) {
         BamTools::SwapEndian_32(length);
 }
 
-// reads SAM header text from BGZF stream, stores in SamHeader object
+// reads SAM header text from BGZF stream, stores it for later parsing
 void BamHeader::ReadHeaderText(BgzfStream* stream, const uint32_t& length) {
 
     // read header text
@@ -104,22 +117,27 @@ void BamHeader::ReadHeaderText(BgzfStream* stream, const uint32_t& length) {
     }
 
     // otherwise, text was read OK
-    // store & cleanup
-    m_header.SetHeaderText( (string)((const char*)headerText) );
+    // store & cleanup (text is parsed when SamHeader data is first needed)
+    m_headerText = (const char*)headerText;
+    m_header.Clear();
+    m_isParsed = false;
     free(headerText);
 }
 
 // returns const-reference to SamHeader data object
 const SamHeader& BamHeader::ToConstSamHeader(void) const {
+    Parse();
     return m_header;
 }
 
 // returns *copy* of SamHeader data object
 SamHeader BamHeader::ToSamHeader(void) const {
+    Parse();
     return m_header;
 }
 
 // returns SAM-formatted string of header data
 string BamHeader::ToString(void) const {
+    Parse();
     return m_header.ToString();
 }
@@ -57,12 +57,16 @@ class BamHeader {
         void CheckMagicNumber(BgzfStream* stream);
         // reads SAM header length from BGZF stream, stores it in @length
         void ReadHeaderLength(BgzfStream* stream, uint32_t& length);
-        // reads SAM header text from BGZF stream, stores in SamHeader object
+        // reads SAM header text from BGZF stream, stores it for later parsing
         void ReadHeaderText(BgzfStream* stream, const uint32_t& length);
+        // parses header text into SamHeader object, if not done yet
+        void Parse(void) const;
 
     // data members
     private:
-        SamHeader m_header;
+        std::string m_headerText;   // SAM header text, as read from file
+        mutable SamHeader m_header; // parsed on first use (large headers are often not needed)
+        mutable bool m_isParsed;
 };
 
 } // namespace Internal
@@ -11,10 +11,13 @@
 #include "api/internal/bam/BamRandomAccessController_p.h"
 #include "api/internal/bam/BamReader_p.h"
 #include "api/internal/index/BamIndexFactory_p.h"
+#include "api/internal/index/BamStandardIndex_p.h"
 #include "api/internal/utils/BamException_p.h"
 using namespace BamTools;
 using namespace BamTools::Internal;
 
+#include <algorithm>
+#include <limits>
 #include <cassert>
 #include <sstream>
 using namespace std;
@@ -22,6 +25,8 @@ using namespace std;
 BamRandomAccessController::BamRandomAccessController(void)
     : m_index(0)
     , m_hasAlignmentsInRegion(true)
+    , m_hasRegions(false)
+    , m_firstOpenRegion(0)
 { }
 
 BamRandomAccessController::~BamRandomAccessController(void) {
@@ -60,27 +65,47 @@ void BamRandomAccessController::AdjustRegion(const int& referenceCount) {
 BamRandomAccessController::RegionState
 BamRandomAccessController::AlignmentState(const BamAlignment& alignment) const {
 
+    // end position is only needed for alignments starting before left bound, on its reference
+    const bool needsEndPosition = ( m_region.isLeftBoundSpecified() &&
+                                    alignment.RefID == m_region.LeftRefID &&
+                                    alignment.Position < m_region.LeftPosition );
+    const int endPosition = ( needsEndPosition ? alignment.GetEndPosition() : alignment.Position );
+    return AlignmentState(alignment.RefID, alignment.Position, endPosition);
+}
+
+// same as above, for an alignment given by its reference, start & end positions
+BamRandomAccessController::RegionState
+BamRandomAccessController::AlignmentState(const int& refId, const int& position, const int& endPosition) const {
+    return StateInRegion(m_region, refId, position, endPosition);
+}
+
+// returns alignments' "RegionState": { Before|Overlaps|After } a given region
+BamRandomAccessController::RegionState
+BamRandomAccessController::StateInRegion(const BamRegion& region, const int& refId,
+                                         const int& position, const int& endPosition)
+{
+
     // if region has no left bound at all
-    if ( !m_region.isLeftBoundSpecified() )
+    if ( !region.isLeftBoundSpecified() )
         return OverlapsRegion;
 
     // handle unmapped reads - return AFTER region to halt processing
-    if ( alignment.RefID == -1 )
+    if ( refId == -1 )
         return AfterRegion;
 
     // if alignment is on any reference before left bound reference
-    if ( alignment.RefID < m_region.LeftRefID )
+    if ( refId < region.LeftRefID )
         return BeforeRegion;
 
     // if alignment is on left bound reference
-    else if ( alignment.RefID == m_region.LeftRefID ) {
+    else if ( refId == region.LeftRefID ) {
 
         // if alignment starts at or after left bound position
-        if ( alignment.Position >= m_region.LeftPosition) {
+        if ( position >= region.LeftPosition) {
 
-            if ( m_region.isRightBoundSpecified() &&             // right bound is specified AND
-                 m_region.LeftRefID == m_region.RightRefID &&    // left & right bounds on same reference AND
-                 alignment.Position >= m_region.RightPosition )  // alignment starts on or after right bound position
+            if ( region.isRightBoundSpecified() &&               // right bound is specified AND
+                 region.LeftRefID == region.RightRefID &&        // left & right bounds on same reference AND
+                 position >= region.RightPosition )              // alignment starts on or after right bound position
                 return AfterRegion;
 
             // otherwise, alignment overlaps region
@@ -91,7 +116,7 @@ BamRandomAccessController::AlignmentState(const BamAlignment& alignment) const {
         else {
 
             // if alignment overlaps left bound position
-            if ( alignment.GetEndPosition() > m_region.LeftPosition )
+            if ( endPosition > region.LeftPosition )
                 return OverlapsRegion;
             else
                 return BeforeRegion;
@@ -102,21 +127,21 @@ BamRandomAccessController::AlignmentState(const BamAlignment& alignment) const {
     else {
 
         // if region has a right bound
-        if ( m_region.isRightBoundSpecified() ) {
+        if ( region.isRightBoundSpecified() ) {
 
             // alignment is on any reference between boundaries
-            if ( alignment.RefID < m_region.RightRefID )
+            if ( refId < region.RightRefID )
                 return OverlapsRegion;
 
             // alignment is on any reference after right boundary
-            else if ( alignment.RefID > m_region.RightRefID )
+            else if ( refId > region.RightRefID )
                 return AfterRegion;
 
             // alignment is on right bound reference
             else {
 
                 // if alignment starts before right bound position
-                if ( alignment.Position < m_region.RightPosition )
+                if ( position < region.RightPosition )
                     return OverlapsRegion;
                 else
                     return AfterRegion;
@@ -138,11 +163,48 @@ void BamRandomAccessController::ClearIndex(void) {
         delete m_index;
         m_index = 0;
     }
+    m_indexFilename.clear();
+}
+
+// gives @reader the same index as another controller, sharing in-memory
+// BAI data if loaded, or loading the same index file otherwise
+bool BamRandomAccessController::CloneIndex(const BamRandomAccessController& other,
+                                           BamReaderPrivate* reader)
+{
+    ClearIndex();
+
+    // nothing to clone
+    if ( other.m_index == 0 )
+        return true;
+
+    const BamStandardIndex* standardIndex = dynamic_cast<const BamStandardIndex*>(other.m_index);
+    if ( standardIndex && standardIndex->IsInMemory() ) {
+        BamStandardIndex* index = new BamStandardIndex(reader);
+        index->ShareData(*standardIndex);
+        SetIndex(index);
+        m_indexFilename = other.m_indexFilename;
+        return true;
+    }
+
+    // custom indexes cannot be duplicated
+    if ( other.m_indexFilename.empty() ) {
+        SetErrorString("BamRandomAccessController::CloneIndex", "cannot clone an index set by client");
+        return false;
+    }
+
+    return OpenIndex(other.m_indexFilename, reader);
 }
 
 void BamRandomAccessController::ClearRegion(void) {
     m_region.clear();
     m_hasAlignmentsInRegion = true;
+
+    m_hasRegions = false;
+    m_regions.clear();
+    m_regionIds.clear();
+    m_regionOffsets.clear();
+    m_isRegionDone.clear();
+    m_firstOpenRegion = 0;
 }
 
 bool BamRandomAccessController::CreateIndex(BamReaderPrivate* reader,
@@ -175,6 +237,7 @@ bool BamRandomAccessController::CreateIndex(BamReaderPrivate* reader,
 
     // save new index & return success
     SetIndex(newIndex);
+    m_indexFilename = BamIndexFactory::CreateIndexFilename(reader->Filename(), type);
     return true;
 }
 
@@ -190,6 +253,14 @@ bool BamRandomAccessController::HasRegion(void) const  {
     return ( !m_region.isNull() );
 }
 
+bool BamRandomAccessController::HasRegions(void) const {
+    return m_hasRegions;
+}
+
+bool BamRandomAccessController::HasOpenRegions(void) const {
+    return ( m_firstOpenRegion < m_regions.size() );
+}
+
 bool BamRandomAccessController::IndexHasAlignmentsForReference(const int& refId) {
     return m_index->HasAlignments(refId);
 }
@@ -233,6 +304,7 @@ bool BamRandomAccessController::OpenIndex(const string& indexFilename, BamReader
 
     // save new index & return success
     SetIndex(index);
+    m_indexFilename = indexFilename;
     return true;
 }
 
@@ -248,11 +320,13 @@ void BamRandomAccessController::SetIndex(BamIndex* index) {
     if ( m_index )
         ClearIndex();
     m_index = index;
+    m_indexFilename.clear();
 }
 
 bool BamRandomAccessController::SetRegion(const BamRegion& region, const int& referenceCount) {
 
     // store region
+    ClearRegion();
     m_region = region;
 
     // cannot jump when no index is available
@@ -287,3 +361,144 @@ bool BamRandomAccessController::SetRegion(const BamRegion& region, const int& re
     else
         return true;
 }
+
+namespace {
+
+// orders region indices by regions' left bound
+struct RegionLeftBoundLessThan {
+
+    const vector<BamRegion>& Regions;
+    RegionLeftBoundLessThan(const vector<BamRegion>& regions) : Regions(regions) { }
+
+    bool operator()(const int lhs, const int rhs) const {
+        const BamRegion& l = Regions[lhs];
+        const BamRegion& r = Regions[rhs];
+        if ( l.LeftRefID != r.LeftRefID ) return ( l.LeftRefID < r.LeftRefID );
+        return ( l.LeftPosition < r.LeftPosition );
+    }
+};
+
+} // namespace
+
+// returns alignment's "RegionState" with respect to the region set:
+//   Overlaps (with the indices of overlapped regions), Before (keep reading) or After (all regions done)
+BamRandomAccessController::RegionState
+BamRandomAccessController::RegionsState(const int& refId,
+                                        const int& position,
+                                        const int& endPosition,
+                                        vector<int>& regionIds)
+{
+    regionIds.clear();
+
+    // regions are sorted by left bound: stop at first one lying after alignment
+    for ( size_t i = m_firstOpenRegion; i < m_regions.size(); ++i ) {
+        if ( m_isRegionDone[i] )
+            continue;
+
+        const RegionState state = StateInRegion(m_regions[i], refId, position, endPosition);
+        if ( state == BeforeRegion )
+            break;
+        if ( state == AfterRegion )
+            m_isRegionDone[i] = true;
+        else
+            regionIds.push_back(m_regionIds[i]);
+    }
+
+    while ( m_firstOpenRegion < m_regions.size() && m_isRegionDone[m_firstOpenRegion] )
+        ++m_firstOpenRegion;
+
+    if ( !regionIds.empty() )
+        return OverlapsRegion;
+    return ( HasOpenRegions() ? BeforeRegion : AfterRegion );
+}
+
+// returns the file offset where reading should resume, if data between
+// current file position and it cannot overlap any open region (-1 otherwise)
+int64_t BamRandomAccessController::RegionsResumeOffset(const int64_t& position) const {
+    if ( !HasOpenRegions() )
+        return -1;
+    const int64_t offset = m_regionOffsets[m_firstOpenRegion];
+    return ( offset > position ? offset : -1 );
+}
+
+// sets several regions of interest, to be read in a single forward pass:
+// reading starts at the offset of the first region, then it skips data only
+// when no alignment before the following regions' offsets can overlap them
+bool BamRandomAccessController::SetRegions(const vector<BamRegion>& regions, BamReaderPrivate* reader) {
+
+    // on failure, region set is left empty (no alignment will be read)
+    ClearRegion();
+    m_hasRegions = true;
+
+    // cannot locate regions when no index is available
+    if ( !HasIndex() ) {
+        SetErrorString("BamRandomAccessController::SetRegions", "cannot set regions if no index data available");
+        return false;
+    }
+
+    const int referenceCount = reader->GetReferenceCount();
+    for ( size_t i = 0; i < regions.size(); ++i ) {
+        if ( regions[i].LeftRefID < 0 || regions[i].LeftRefID >= referenceCount ) {
+            SetErrorString("BamRandomAccessController::SetRegions", "invalid region requested");
+            return false;
+        }
+    }
+
+    // sort regions by left bound
+    m_regionIds.resize(regions.size());
+    for ( size_t i = 0; i < regions.size(); ++i )
+        m_regionIds[i] = i;
+    stable_sort(m_regionIds.begin(), m_regionIds.end(), RegionLeftBoundLessThan(regions));
+
+    // locate where each region's data begins (regions without data are done already)
+    const int64_t noOffset = numeric_limits<int64_t>::max();
+    m_regions.resize(regions.size());
+    m_regionOffsets.assign(regions.size(), noOffset);
+    m_isRegionDone.assign(regions.size(), true);
+
+    for ( size_t i = 0; i < regions.size(); ++i ) {
+
+        m_region = regions[m_regionIds[i]];
+        AdjustRegion(referenceCount);
+        m_regions[i] = m_region;
+        if ( !m_hasAlignmentsInRegion )
+            continue;
+
+        int64_t offset = 0;
+        bool hasAlignments = false;
+        if ( !m_index->GetRegionOffset(m_region, &offset, &hasAlignments) ) {
+            const string indexError = m_index->GetErrorString();
+            ClearRegion();
+            m_hasRegions = true;
+            SetErrorString("BamRandomAccessController::SetRegions", string("could not set regions\n\t") + indexError);
+            return false;
+        }
+        if ( hasAlignments ) {
+            m_regionOffsets[i] = offset;
+            m_isRegionDone[i]  = false;
+        }
+    }
+
+    m_region.clear();
+    m_hasAlignmentsInRegion = true;
+
+    // each region's offset becomes the smallest among it & the following ones,
+    // so that reading never moves backwards
+    for ( size_t i = regions.size(); i > 1; --i )
+        m_regionOffsets[i-2] = min(m_regionOffsets[i-2], m_regionOffsets[i-1]);
+
+    m_firstOpenRegion = 0;
+    while ( m_firstOpenRegion < m_regions.size() && m_isRegionDone[m_firstOpenRegion] )
+        ++m_firstOpenRegion;
+
+    // jump to the first data to be read
+    if ( HasOpenRegions() && !reader->Seek(m_regionOffsets[m_firstOpenRegion]) ) {
+        const string readerError = reader->GetErrorString();
+        ClearRegion();
+        m_hasRegions = true;
+        SetErrorString("BamRandomAccessController::SetRegions", string("could not seek in BAM file\n\t") + readerError);
+        return false;
+    }
+
+    return true;
+}
@@ -22,6 +22,7 @@
 
 #include "api/BamAux.h"
 #include "api/BamIndex.h"
+#include <vector>
 
 namespace BamTools {
 
@@ -49,6 +50,7 @@ class BamRandomAccessController {
 
         // index methods
         void ClearIndex(void);
+        bool CloneIndex(const BamRandomAccessController& other, BamReaderPrivate* reader);
         bool CreateIndex(BamReaderPrivate* reader, const BamIndex::IndexType& type);
         bool HasIndex(void) const;
         bool IndexHasAlignmentsForReference(const int& refId);
@@ -60,9 +62,18 @@ class BamRandomAccessController {
         void ClearRegion(void);
         bool HasRegion(void) const;
         RegionState AlignmentState(const BamAlignment& alignment) const;
+        RegionState AlignmentState(const int& refId, const int& position, const int& endPosition) const;
         bool RegionHasAlignments(void) const;
         bool SetRegion(const BamRegion& region, const int& referenceCount);
 
+        // region set methods (several regions read in a single pass)
+        bool HasRegions(void) const;
+        bool HasOpenRegions(void) const;
+        RegionState RegionsState(const int& refId, const int& position, const int& endPosition,
+                                 std::vector<int>& regionIds);
+        int64_t RegionsResumeOffset(const int64_t& position) const;
+        bool SetRegions(const std::vector<BamRegion>& regions, BamReaderPrivate* reader);
+
         // general methods
         void Close(void);
         std::string GetErrorString(void) const;
@@ -71,6 +82,9 @@ class BamRandomAccessController {
     private:
         // adjusts requested region if necessary (depending on where data actually begins)
         void AdjustRegion(const int& referenceCount);
+        // returns alignment's state with respect to a region
+        static RegionState StateInRegion(const BamRegion& region, const int& refId,
+                                         const int& position, const int& endPosition);
         // error-string handling
         void SetErrorString(const std::string& where, const std::string& what);
 
@@ -79,11 +93,20 @@ class BamRandomAccessController {
 
         // index data
         BamIndex* m_index;  // owns the index, not a copy - responsible for deleting
+        std::string m_indexFilename;    // file the index was loaded from (empty if set by client)
 
         // region data
         BamRegion m_region;
         bool m_hasAlignmentsInRegion;
 
+        // region set data
+        bool m_hasRegions;
+        std::vector<BamRegion> m_regions;       // sorted by left bound
+        std::vector<int> m_regionIds;           // index of each region in the client's list
+        std::vector<int64_t> m_regionOffsets;   // file offset to read from for each region & the following ones
+        std::vector<bool> m_isRegionDone;       // no more alignments can overlap region
+        size_t m_firstOpenRegion;               // every region before it is done
+
         // general data
         std::string m_errorString;
 };
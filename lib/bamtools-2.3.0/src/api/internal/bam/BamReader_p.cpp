@@ -21,6 +21,7 @@ using namespace BamTools;
 using namespace BamTools::Internal;
 
 #include <algorithm>
+#include <cstring>
 #include <cassert>
 #include <iostream>
 #include <iterator>
@@ -30,6 +31,7 @@ using namespace std;
 // constructor
 BamReaderPrivate::BamReaderPrivate(BamReader* parent)
     : m_alignmentsBeginOffset(0)
+    , m_references(0)
     , m_parent(parent)
 {
     m_isBigEndian = BamTools::SystemIsBigEndian();
@@ -41,10 +43,52 @@ BamReaderPrivate::~BamReaderPrivate(void) {
 }
 
 // closes the BAM file
+// opens the same BAM file as another reader, copying its header & reference data
+// and sharing its index data (and memory mapping) instead of loading them again
+bool BamReaderPrivate::Clone(const BamReaderPrivate& other) {
+
+    try {
+
+        // make sure we're starting with fresh state
+        Close();
+
+        // open BgzfStream on the same file, using the same settings
+        m_stream.OpenClone(other.m_stream, other.m_filename);
+
+        // copy BAM metadata
+        m_header     = other.m_header;
+        m_references = other.m_references;
+        m_filename   = other.m_filename;
+        BamReferenceDictionary::Retain(m_references);
+        m_alignmentsBeginOffset = other.m_alignmentsBeginOffset;
+
+        // move to first alignment
+        m_stream.Seek(m_alignmentsBeginOffset);
+
+    } catch ( BamException& e ) {
+        const string error = e.what();
+        const string message = string("could not clone reader of file: ") + other.m_filename +
+                               "\n\t" + error;
+        SetErrorString("BamReader::Clone", message);
+        return false;
+    }
+
+    // use the same index
+    if ( !m_randomAccessController.CloneIndex(other.m_randomAccessController, this) ) {
+        const string bracError = m_randomAccessController.GetErrorString();
+        const string message = string("could not clone index: \n\t") + bracError;
+        SetErrorString("BamReader::Clone", message);
+        return false;
+    }
+
+    return true;
+}
+
 bool BamReaderPrivate::Close(void) {
 
     // clear BAM metadata
-    m_references.clear();
+    BamReferenceDictionary::Release(m_references);
+    m_references = 0;
     m_header.Clear();
 
     // clear filename
@@ -146,6 +190,10 @@ bool BamReaderPrivate::GetNextAlignmentCore(BamAlignment& alignment) {
     if ( !m_stream.IsOpen() )
         return false;
 
+    // alignments overlapping regions of a region set
+    if ( m_randomAccessController.HasRegions() )
+        return GetNextAlignmentCore(alignment, m_regionIds);
+
     try {
 
         // skip if region is set but has no alignments
@@ -194,28 +242,101 @@ bool BamReaderPrivate::GetNextAlignmentCore(BamAlignment& alignment) {
     }
 }
 
+// retrieves next alignment overlapping the region set, with the indices of the overlapped regions
+// (same as above if no region set is active, regionIds being left empty)
+bool BamReaderPrivate::GetNextAlignmentCore(BamAlignment& alignment, vector<int>& regionIds) {
+
+    regionIds.clear();
+
+    // skip if stream not opened
+    if ( !m_stream.IsOpen() )
+        return false;
+
+    if ( !m_randomAccessController.HasRegions() )
+        return GetNextAlignmentCore(alignment);
+
+    try {
+
+        while ( m_randomAccessController.HasOpenRegions() ) {
+
+            // skip data that cannot overlap any region left
+            SkipToOpenRegions();
+
+            // if can't read next alignment
+            if ( !LoadNextAlignment(alignment) )
+                return false;
+
+            // check alignment against regions
+            const BamRandomAccessController::RegionState state =
+                    m_randomAccessController.RegionsState(alignment.RefID, alignment.Position,
+                                                          alignment.GetEndPosition(), regionIds);
+            if ( state == BamRandomAccessController::AfterRegion )
+                return false;
+
+            if ( state == BamRandomAccessController::OverlapsRegion ) {
+                alignment.SupportData.HasCoreOnly = true;
+                return true;
+            }
+        }
+
+        // every region is done
+        return false;
+
+    } catch ( BamException& e ) {
+        const string streamError = e.what();
+        const string message = string("encountered error reading BAM alignment: \n\t") + streamError;
+        SetErrorString("BamReader::GetNextAlignmentCore", message);
+        return false;
+    }
+}
+
+// retrieves core data of up to maxCount next available alignments (returns number retrieved)
+// ** records are decoded straight from a reused buffer into the batch's arrays,
+//    without building BamAlignment objects
+int BamReaderPrivate::GetNextAlignmentBatch(BamAlignmentBatch& batch, int maxCount) {
+
+    batch.Clear();
+
+    // skip if stream not opened
+    if ( !m_stream.IsOpen() )
+        return 0;
+
+    try {
+
+        // skip if region is set but has no alignments
+        if ( m_randomAccessController.HasRegion() &&
+             !m_randomAccessController.RegionHasAlignments() )
+        {
+            return 0;
+        }
+
+        // read until batch is full, data ends or alignments start after region
+        while ( (int)batch.Size() < maxCount ) {
+            if ( !LoadNextBatchRecord(batch) )
+                break;
+        }
+
+    } catch ( BamException& e ) {
+        const string streamError = e.what();
+        const string message = string("encountered error reading BAM alignment: \n\t") + streamError;
+        SetErrorString("BamReader::GetNextAlignmentBatch", message);
+    }
+
+    return batch.Size();
+}
+
 int BamReaderPrivate::GetReferenceCount(void) const {
-    return m_references.size();
+    return ( m_references ? m_references->Size() : 0 );
 }
 
 const RefVector& BamReaderPrivate::GetReferenceData(void) const {
-    return m_references;
+    static const RefVector noReferences;
+    return ( m_references ? m_references->References() : noReferences );
 }
 
-// returns RefID for given RefName (returns References.size() if not found)
+// returns RefID for given RefName (returns -1 if not found)
 int BamReaderPrivate::GetReferenceID(const string& refName) const {
-
-    // retrieve names from reference data
-    vector<string> refNames;
-    RefVector::const_iterator refIter = m_references.begin();
-    RefVector::const_iterator refEnd  = m_references.end();
-    for ( ; refIter != refEnd; ++refIter)
-        refNames.push_back( (*refIter).RefName );
-
-    // return 'index-of' refName (or -1 if not found)
-    int index = distance(refNames.begin(), find(refNames.begin(), refNames.end(), refName));
-    if ( index == (int)m_references.size() ) return -1;
-    else return index;
+    return ( m_references ? m_references->Find(refName) : -1 );
 }
 
 bool BamReaderPrivate::HasIndex(void) const {
@@ -314,39 +435,122 @@ bool BamReaderPrivate::LoadNextAlignment(BamAlignment& alignment) {
     return readCharDataOK;
 }
 
-// loads reference data from BAM file
-bool BamReaderPrivate::LoadReferenceData(void) {
+// appends core data of the alignment under file pointer to batch, if it overlaps current region
+// (returns false at end of data, or when alignment starts after region)
+bool BamReaderPrivate::LoadNextBatchRecord(BamAlignmentBatch& batch) {
+
+    // with a region set, skip data that cannot overlap any region left
+    const bool hasRegions = m_randomAccessController.HasRegions();
+    if ( hasRegions ) {
+        if ( !m_randomAccessController.HasOpenRegions() )
+            return false;
+        SkipToOpenRegions();
+    }
 
-    // get number of reference sequences
+    // read in the 'block length' value, make sure it's not zero
     char buffer[sizeof(uint32_t)];
+    fill_n(buffer, sizeof(uint32_t), 0);
     m_stream.Read(buffer, sizeof(uint32_t));
-    uint32_t numberRefSeqs = BamTools::UnpackUnsignedInt(buffer);
-    if ( m_isBigEndian ) BamTools::SwapEndian_32(numberRefSeqs);
-    m_references.reserve((int)numberRefSeqs);
-
-    // iterate over all references in header
-    for ( unsigned int i = 0; i != numberRefSeqs; ++i ) {
-
-        // get length of reference name
-        m_stream.Read(buffer, sizeof(uint32_t));
-        uint32_t refNameLength = BamTools::UnpackUnsignedInt(buffer);
-        if ( m_isBigEndian ) BamTools::SwapEndian_32(refNameLength);
-        RaiiBuffer refName(refNameLength);
-
-        // get reference name and reference sequence length
-        m_stream.Read(refName.Buffer, refNameLength);
-        m_stream.Read(buffer, sizeof(int32_t));
-        int32_t refLength = BamTools::UnpackSignedInt(buffer);
-        if ( m_isBigEndian ) BamTools::SwapEndian_32(refLength);
-
-        // store data for reference
-        RefData aReference;
-        aReference.RefName   = (string)((const char*)refName.Buffer);
-        aReference.RefLength = refLength;
-        m_references.push_back(aReference);
+    uint32_t blockLength = BamTools::UnpackUnsignedInt(buffer);
+    if ( m_isBigEndian ) BamTools::SwapEndian_32(blockLength);
+    if ( blockLength < Constants::BAM_CORE_SIZE )
+        return false;
+
+    // read in whole record (buffer only grows, so it is allocated once)
+    if ( m_recordBuffer.size() < blockLength )
+        m_recordBuffer.resize(blockLength);
+    char* x = &m_recordBuffer[0];
+    if ( m_stream.Read(x, blockLength) != blockLength )
+        return false;
+
+    // swap core endian-ness if necessary
+    if ( m_isBigEndian ) {
+        for ( unsigned int i = 0; i < Constants::BAM_CORE_SIZE; i+=sizeof(uint32_t) )
+            BamTools::SwapEndian_32p(&x[i]);
+    }
+
+    const int32_t refId    = BamTools::UnpackSignedInt(&x[0]);
+    const int32_t position = BamTools::UnpackSignedInt(&x[4]);
+    const unsigned int queryNameLength    = BamTools::UnpackUnsignedInt(&x[8]) & 0xff;
+    const unsigned int flagAndCigar       = BamTools::UnpackUnsignedInt(&x[12]);
+    const unsigned int numCigarOperations = flagAndCigar & 0xffff;
+    const unsigned int querySequenceLength = BamTools::UnpackUnsignedInt(&x[16]);
+
+    const unsigned int dataLength  = blockLength - Constants::BAM_CORE_SIZE;
+    const unsigned int cigarOffset = queryNameLength;
+    const unsigned int tagOffset   = cigarOffset + numCigarOperations*sizeof(uint32_t) +
+                                     (querySequenceLength+1)/2 + querySequenceLength;
+    if ( tagOffset > dataLength )
+        throw BamException("BamReader::GetNextAlignmentBatch", "invalid alignment record lengths");
+
+    // calculate end position from CIGAR ops (as BamAlignment::GetEndPosition() does)
+    int32_t endPosition = position;
+    char* cigarData = x + Constants::BAM_CORE_SIZE + cigarOffset;
+    for ( unsigned int i = 0; i < numCigarOperations; ++i ) {
+        uint32_t cigarValue = BamTools::UnpackUnsignedInt(cigarData + i*sizeof(uint32_t));
+        if ( m_isBigEndian ) BamTools::SwapEndian_32(cigarValue);
+        switch ( Constants::BAM_CIGAR_LOOKUP[ (cigarValue & Constants::BAM_CIGAR_MASK) ] ) {
+            case ( Constants::BAM_CIGAR_MATCH_CHAR )    :
+            case ( Constants::BAM_CIGAR_DEL_CHAR )      :
+            case ( Constants::BAM_CIGAR_REFSKIP_CHAR )  :
+            case ( Constants::BAM_CIGAR_SEQMATCH_CHAR ) :
+            case ( Constants::BAM_CIGAR_MISMATCH_CHAR ) :
+                endPosition += (cigarValue >> Constants::BAM_CIGAR_SHIFT);
+                break;
+            default :
+                break;
+        }
+    }
+
+    // check alignment's region-overlap state
+    const BamRandomAccessController::RegionState state = ( hasRegions ?
+            m_randomAccessController.RegionsState(refId, position, endPosition, m_regionIds) :
+            m_randomAccessController.AlignmentState(refId, position, endPosition) );
+    if ( state == BamRandomAccessController::AfterRegion )
+        return false;
+    if ( state == BamRandomAccessController::BeforeRegion )
+        return true;
+
+    // store alignment's core data
+    batch.RefID.push_back(refId);
+    batch.Position.push_back(position);
+    batch.EndPosition.push_back(endPosition);
+    batch.AlignmentFlag.push_back( flagAndCigar >> 16 );
+    batch.MateRefID.push_back( BamTools::UnpackSignedInt(&x[20]) );
+    batch.MatePosition.push_back( BamTools::UnpackSignedInt(&x[24]) );
+
+    // look up selected tags (conversions as in BamAlignment::GetIntTag())
+    const unsigned int tagDataLength = dataLength - tagOffset;
+    for ( size_t t = 0; t < batch.TagNames.size(); ++t ) {
+
+        int32_t value = batch.TagDefaults[t];
+        char* pTagData = x + Constants::BAM_CORE_SIZE + tagOffset;
+        unsigned int numBytesParsed = 0;
+
+        if ( tagDataLength > 0 &&
+             m_tagReader.FindTag(batch.TagNames[t].c_str(), pTagData, tagDataLength, numBytesParsed) )
+        {
+            const char type = *(pTagData - 1);
+            if ( TagTypeHelper<int32_t>::CanConvertFrom(type) ) {
+                int destinationLength = 4;
+                if ( type == Constants::BAM_TAG_TYPE_ASCII || type == Constants::BAM_TAG_TYPE_INT8 )
+                    destinationLength = 1;
+                else if ( type == Constants::BAM_TAG_TYPE_INT16 )
+                    destinationLength = 2;
+                value = 0;
+                memcpy(&value, pTagData, destinationLength);
+            }
+        }
+
+        batch.TagValues[t].push_back(value);
     }
 
-    // return success
+    return true;
+}
+
+// loads reference data from BAM file
+bool BamReaderPrivate::LoadReferenceData(void) {
+    m_references = BamReferenceDictionary::Load(&m_stream);
     return true;
 }
 
@@ -442,6 +646,34 @@ bool BamReaderPrivate::Seek(const int64_t& position) {
     }
 }
 
+bool BamReaderPrivate::SetCheckCrc(bool ok) {
+
+    try {
+        m_stream.SetCheckCrc(ok);
+        return true;
+    }
+    catch ( BamException& e ) {
+        const string streamError = e.what();
+        const string message = string("could not set CRC check: \n\t") + streamError;
+        SetErrorString("BamReader::SetCheckCrc", message);
+        return false;
+    }
+}
+
+bool BamReaderPrivate::SetDecompressionThreads(int numThreads) {
+
+    try {
+        m_stream.SetThreads(numThreads);
+        return true;
+    }
+    catch ( BamException& e ) {
+        const string streamError = e.what();
+        const string message = string("could not set decompression threads: \n\t") + streamError;
+        SetErrorString("BamReader::SetDecompressionThreads", message);
+        return false;
+    }
+}
+
 void BamReaderPrivate::SetErrorString(const string& where, const string& what) {
     static const string SEPARATOR = ": ";
     m_errorString = where + SEPARATOR + what;
@@ -455,7 +687,7 @@ void BamReaderPrivate::SetIndex(BamIndex* index) {
 // returns success/failure
 bool BamReaderPrivate::SetRegion(const BamRegion& region) {
 
-    if ( m_randomAccessController.SetRegion(region, m_references.size()) )
+    if ( m_randomAccessController.SetRegion(region, GetReferenceCount()) )
         return true;
     else {
         const string bracError = m_randomAccessController.GetErrorString();
@@ -465,6 +697,25 @@ bool BamReaderPrivate::SetRegion(const BamRegion& region) {
     }
 }
 
+bool BamReaderPrivate::SetRegions(const vector<BamRegion>& regions) {
+
+    if ( m_randomAccessController.SetRegions(regions, this) )
+        return true;
+    else {
+        const string bracError = m_randomAccessController.GetErrorString();
+        const string message = string("could not set regions: \n\t") + bracError;
+        SetErrorString("BamReader::SetRegions", message);
+        return false;
+    }
+}
+
+// moves file pointer forward, past data that cannot overlap the regions left in region set
+void BamReaderPrivate::SkipToOpenRegions(void) {
+    const int64_t offset = m_randomAccessController.RegionsResumeOffset(m_stream.Tell());
+    if ( offset >= 0 )
+        m_stream.Seek(offset);
+}
+
 int64_t BamReaderPrivate::Tell(void) const {
     return m_stream.Tell();
 }
@@ -26,8 +26,10 @@
 #include "api/SamHeader.h"
 #include "api/internal/bam/BamHeader_p.h"
 #include "api/internal/bam/BamRandomAccessController_p.h"
+#include "api/internal/bam/BamReferenceDictionary_p.h"
 #include "api/internal/io/BgzfStream_p.h"
 #include <string>
+#include <vector>
 
 namespace BamTools {
 namespace Internal {
@@ -43,16 +45,22 @@ class BamReaderPrivate {
     public:
 
         // file operations
+        bool Clone(const BamReaderPrivate& other);
         bool Close(void);
         const std::string Filename(void) const;
         bool IsOpen(void) const;
         bool Open(const std::string& filename);
         bool Rewind(void);
+        bool SetCheckCrc(bool ok);
+        bool SetDecompressionThreads(int numThreads);
         bool SetRegion(const BamRegion& region);
+        bool SetRegions(const std::vector<BamRegion>& regions);
 
         // access alignment data
         bool GetNextAlignment(BamAlignment& alignment);
         bool GetNextAlignmentCore(BamAlignment& alignment);
+        bool GetNextAlignmentCore(BamAlignment& alignment, std::vector<int>& regionIds);
+        int GetNextAlignmentBatch(BamAlignmentBatch& batch, int maxCount);
 
         // access auxiliary data
         std::string GetHeaderText(void) const;
@@ -83,7 +91,12 @@ class BamReaderPrivate {
         // retrieves BAM alignment under file pointer
         // (does no overlap checking or character data parsing)
         bool LoadNextAlignment(BamAlignment& alignment);
-        // builds reference data structure from BAM file
+        // appends the alignment under file pointer to batch, if it overlaps current region
+        // (returns false at end of data, or when alignment starts after region)
+        bool LoadNextBatchRecord(BamAlignmentBatch& batch);
+        // moves file pointer past data that cannot overlap the regions left in region set
+        void SkipToOpenRegions(void);
+        // loads reference data from BAM file (shared by readers of files with the same references)
         bool LoadReferenceData(void);
         // seek reader to file position
         bool Seek(const int64_t& position);
@@ -96,7 +109,7 @@ class BamReaderPrivate {
         // general BAM file data
         int64_t     m_alignmentsBeginOffset;
         std::string m_filename;
-        RefVector   m_references;
+        const BamReferenceDictionary* m_references;
 
         // system data
         bool m_isBigEndian;
@@ -109,6 +122,13 @@ class BamReaderPrivate {
         BamRandomAccessController m_randomAccessController;
         BgzfStream m_stream;
 
+        // raw record buffer, reused across batched alignments
+        std::vector<char> m_recordBuffer;
+        // only used to look up tags in raw records of batched alignments
+        BamAlignment m_tagReader;
+        // regions overlapped by last alignment, when the caller does not ask for them
+        std::vector<int> m_regionIds;
+
         // error handling
         std::string m_errorString;
 };
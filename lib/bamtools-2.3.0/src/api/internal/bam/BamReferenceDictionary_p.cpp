@@ -0,0 +1,229 @@
+// ***************************************************************************
+// BamReferenceDictionary_p.cpp
+// ---------------------------------------------------------------------------
+// Provides the reference data of BAM files (names & lengths) with a hashed
+// name lookup, shared read-only by every reader of files with the same
+// references (e.g. alignments of several libraries on the same assembly)
+// ***************************************************************************
+
+#include "api/internal/bam/BamReferenceDictionary_p.h"
+#include "api/internal/io/BgzfStream_p.h"
+#include "api/internal/utils/BamException_p.h"
+using namespace BamTools;
+using namespace BamTools::Internal;
+
+#include <cstring>
+#include <map>
+#include <pthread.h>
+using namespace std;
+
+// ----------------------------------
+// shared dictionaries registry
+// ----------------------------------
+
+namespace BamTools {
+namespace Internal {
+
+struct BamReferenceRegistry {
+    multimap<uint64_t, BamReferenceDictionary*> Dictionaries;   // by hash value of raw data
+    pthread_mutex_t Mutex;
+
+    BamReferenceRegistry(void) { pthread_mutex_init(&Mutex, NULL); }
+};
+
+} // namespace Internal
+} // namespace BamTools
+
+// never destroyed: readers with static storage may release their dictionaries at exit
+static BamReferenceRegistry& referenceRegistry(void) {
+    static BamReferenceRegistry* registry = new BamReferenceRegistry;
+    return *registry;
+}
+
+// ----------------------------------------
+// BamReferenceDictionary implementation
+// ----------------------------------------
+
+BamReferenceDictionary::BamReferenceDictionary(vector<char>& data, const uint64_t hash)
+    : m_hash(hash)
+    , m_refCount(0)
+{
+    m_data.swap(data);
+    Build();
+}
+
+BamReferenceDictionary::~BamReferenceDictionary(void) { }
+
+void BamReferenceDictionary::Build(void) {
+
+    const bool isBigEndian = BamTools::SystemIsBigEndian();
+
+    // locate names (data holds name length, name & reference length of each reference)
+    size_t offset = 0;
+    while ( offset < m_data.size() ) {
+        uint32_t nameLength = BamTools::UnpackUnsignedInt(&m_data[offset]);
+        if ( isBigEndian ) BamTools::SwapEndian_32(nameLength);
+        offset += sizeof(uint32_t);
+        m_nameOffsets.push_back(offset);
+        offset += nameLength + sizeof(int32_t);
+    }
+
+    // size lookup table for a load factor of at most 1/2
+    const size_t numReferences = m_nameOffsets.size();
+    size_t numSlots = 16;
+    while ( numSlots < 2*numReferences )
+        numSlots *= 2;
+    m_slots.assign(numSlots, -1);
+
+    m_references.reserve(numReferences);
+    for ( size_t i = 0; i < numReferences; ++i ) {
+
+        const char* name = &m_data[m_nameOffsets[i]];
+        const size_t nameLength = strlen(name);
+
+        // store data for reference (its length follows the name)
+        uint32_t storedNameLength = BamTools::UnpackUnsignedInt(name - sizeof(uint32_t));
+        if ( isBigEndian ) BamTools::SwapEndian_32(storedNameLength);
+        int32_t refLength = BamTools::UnpackSignedInt(name + storedNameLength);
+        if ( isBigEndian ) BamTools::SwapEndian_32(refLength);
+        m_references.push_back( RefData(string(name, nameLength), refLength) );
+
+        // add name to lookup table (if a name is repeated, its first reference is found)
+        size_t slot = Hash(name, nameLength) & (numSlots - 1);
+        for ( ; m_slots[slot] != -1; slot = (slot + 1) & (numSlots - 1) ) {
+            if ( strcmp(&m_data[m_nameOffsets[m_slots[slot]]], name) == 0 )
+                break;
+        }
+        if ( m_slots[slot] == -1 )
+            m_slots[slot] = (int)i;
+    }
+}
+
+int BamReferenceDictionary::Find(const string& name) const {
+
+    const size_t mask = m_slots.size() - 1;
+    size_t slot = Hash(name.data(), name.size()) & mask;
+    for ( ; m_slots[slot] != -1; slot = (slot + 1) & mask ) {
+        const int id = m_slots[slot];
+        if ( name == &m_data[m_nameOffsets[id]] )
+            return id;
+    }
+    return -1;
+}
+
+// FNV-1a hash
+uint64_t BamReferenceDictionary::Hash(const char* data, const size_t length) {
+    uint64_t hash = 14695981039346656037ULL;
+    for ( size_t i = 0; i < length; ++i ) {
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+const BamReferenceDictionary* BamReferenceDictionary::Load(BgzfStream* stream) {
+
+    const bool isBigEndian = BamTools::SystemIsBigEndian();
+
+    // get number of reference sequences
+    char buffer[sizeof(uint32_t)];
+    if ( stream->Read(buffer, sizeof(uint32_t)) != sizeof(uint32_t) )
+        throw BamException("BamReferenceDictionary::Load", "could not read reference count");
+    uint32_t numberRefSeqs = BamTools::UnpackUnsignedInt(buffer);
+    if ( isBigEndian ) BamTools::SwapEndian_32(numberRefSeqs);
+
+    // read raw data of each reference (name length, name & reference length)
+    vector<char> data;
+    for ( uint32_t i = 0; i < numberRefSeqs; ++i ) {
+        const size_t offset = data.size();
+        ReadData(stream, data, sizeof(uint32_t));
+        uint32_t refNameLength = BamTools::UnpackUnsignedInt(&data[offset]);
+        if ( isBigEndian ) BamTools::SwapEndian_32(refNameLength);
+        if ( refNameLength == 0 )
+            throw BamException("BamReferenceDictionary::Load", "invalid reference name length");
+        ReadData(stream, data, refNameLength + sizeof(int32_t));
+
+        // make sure name is NUL-terminated
+        data[offset + sizeof(uint32_t) + refNameLength - 1] = '\0';
+    }
+    const uint64_t hash = ( data.empty() ? 0 : Hash(&data[0], data.size()) );
+
+    BamReferenceRegistry& registry = referenceRegistry();
+    typedef multimap<uint64_t, BamReferenceDictionary*>::iterator DictionaryIterator;
+
+    // use dictionary of another file with the same references, if any
+    pthread_mutex_lock(&registry.Mutex);
+    pair<DictionaryIterator, DictionaryIterator> range = registry.Dictionaries.equal_range(hash);
+    for ( DictionaryIterator it = range.first; it != range.second; ++it ) {
+        if ( it->second->m_data == data ) {
+            ++(it->second->m_refCount);
+            pthread_mutex_unlock(&registry.Mutex);
+            return it->second;
+        }
+    }
+    pthread_mutex_unlock(&registry.Mutex);
+
+    // otherwise build a new one (out of lock, as it may take a while)
+    BamReferenceDictionary* dictionary = new BamReferenceDictionary(data, hash);
+
+    pthread_mutex_lock(&registry.Mutex);
+
+    // another reader may have built the same dictionary meanwhile
+    range = registry.Dictionaries.equal_range(hash);
+    for ( DictionaryIterator it = range.first; it != range.second; ++it ) {
+        if ( it->second->m_data == dictionary->m_data ) {
+            delete dictionary;
+            dictionary = it->second;
+            break;
+        }
+    }
+    if ( dictionary->m_refCount == 0 )
+        registry.Dictionaries.insert( make_pair(hash, dictionary) );
+    ++(dictionary->m_refCount);
+
+    pthread_mutex_unlock(&registry.Mutex);
+    return dictionary;
+}
+
+void BamReferenceDictionary::ReadData(BgzfStream* stream, vector<char>& buffer, const size_t length) {
+    const size_t offset = buffer.size();
+    buffer.resize(offset + length);
+    if ( stream->Read(&buffer[offset], length) != length )
+        throw BamException("BamReferenceDictionary::Load", "could not read reference data");
+}
+
+void BamReferenceDictionary::Release(const BamReferenceDictionary* dictionary) {
+
+    if ( dictionary == 0 )
+        return;
+
+    BamReferenceRegistry& registry = referenceRegistry();
+    BamReferenceDictionary* entry = const_cast<BamReferenceDictionary*>(dictionary);
+
+    pthread_mutex_lock(&registry.Mutex);
+
+    if ( --(entry->m_refCount) == 0 ) {
+        typedef multimap<uint64_t, BamReferenceDictionary*>::iterator DictionaryIterator;
+        pair<DictionaryIterator, DictionaryIterator> range = registry.Dictionaries.equal_range(entry->m_hash);
+        for ( DictionaryIterator it = range.first; it != range.second; ++it ) {
+            if ( it->second == entry ) {
+                registry.Dictionaries.erase(it);
+                break;
+            }
+        }
+        delete entry;
+    }
+
+    pthread_mutex_unlock(&registry.Mutex);
+}
+
+void BamReferenceDictionary::Retain(const BamReferenceDictionary* dictionary) {
+
+    if ( dictionary == 0 )
+        return;
+
+    BamReferenceRegistry& registry = referenceRegistry();
+    pthread_mutex_lock(&registry.Mutex);
+    ++(const_cast<BamReferenceDictionary*>(dictionary)->m_refCount);
+    pthread_mutex_unlock(&registry.Mutex);
+}
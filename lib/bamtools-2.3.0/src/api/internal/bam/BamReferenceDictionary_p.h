@@ -0,0 +1,79 @@
+// ***************************************************************************
+// BamReferenceDictionary_p.h
+// ---------------------------------------------------------------------------
+// Provides the reference data of BAM files (names & lengths) with a hashed
+// name lookup, shared read-only by every reader of files with the same
+// references (e.g. alignments of several libraries on the same assembly)
+// ***************************************************************************
+
+#ifndef BAMREFERENCEDICTIONARY_P_H
+#define BAMREFERENCEDICTIONARY_P_H
+
+//  -------------
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the BamTools API.  It exists purely as an
+// implementation detail. This header file may change from version to version
+// without notice, or even be removed.
+//
+// We mean it.
+
+#include "api/api_global.h"
+#include "api/BamAux.h"
+#include <string>
+#include <vector>
+
+namespace BamTools {
+namespace Internal {
+
+class BgzfStream;
+
+class BamReferenceDictionary {
+
+    // shared dictionaries
+    public:
+        // reads reference data from BGZF stream, returns the dictionary of these references
+        // (loaded only by the first reader of files with the same references)
+        // the dictionary is held until released
+        static const BamReferenceDictionary* Load(BgzfStream* stream);
+        // holds a dictionary returned by Load() once more (for another reader)
+        static void Retain(const BamReferenceDictionary* dictionary);
+        // releases a dictionary returned by Load(), freeing it when no longer used
+        static void Release(const BamReferenceDictionary* dictionary);
+
+    // main interface methods
+    public:
+        // returns ID of reference with given name (-1 if not found)
+        int Find(const std::string& name) const;
+        // returns names & lengths of references
+        const RefVector& References(void) const { return m_references; }
+        // returns number of references
+        int Size(void) const { return (int)m_nameOffsets.size(); }
+
+    // internal methods
+    private:
+        BamReferenceDictionary(std::vector<char>& data, const uint64_t hash);
+        ~BamReferenceDictionary(void);
+
+        // builds name table, name lookup & RefVector from raw reference data
+        void Build(void);
+        // returns hash value of a byte string
+        static uint64_t Hash(const char* data, const size_t length);
+        // reads data from BGZF stream, appending it to buffer
+        static void ReadData(BgzfStream* stream, std::vector<char>& buffer, const size_t length);
+
+    // data members
+    private:
+        std::vector<char> m_data;           // raw reference data (each name stored contiguously, NUL-terminated)
+        uint64_t m_hash;                    // hash value of m_data
+        std::vector<size_t> m_nameOffsets;  // position of each reference's name in m_data
+        std::vector<int> m_slots;           // open-addressing table of reference IDs, by name (-1 if empty)
+        RefVector m_references;
+        int m_refCount;                     // readers using the dictionary
+};
+
+} // namespace Internal
+} // namespace BamTools
+
+#endif // BAMREFERENCEDICTIONARY_P_H
@@ -0,0 +1,127 @@
+// ***************************************************************************
+// BaiIndexRegistry_p.cpp
+// ---------------------------------------------------------------------------
+// Provides a process-wide registry of fully loaded BAI index data, shared
+// read-only by every BamStandardIndex opened on the same index file
+// ***************************************************************************
+
+#include "api/internal/index/BaiIndexRegistry_p.h"
+using namespace BamTools;
+using namespace BamTools::Internal;
+
+#include <sys/stat.h>
+using namespace std;
+
+// never destroyed: readers with static storage may release their data at exit
+BaiIndexRegistry& BaiIndexRegistry::Instance(void) {
+    static BaiIndexRegistry* registry = new BaiIndexRegistry;
+    return *registry;
+}
+
+BaiIndexRegistry::BaiIndexRegistry(void)
+    : m_isEnabled(false)
+{
+    pthread_mutex_init(&m_mutex, NULL);
+}
+
+BaiIndexRegistry::~BaiIndexRegistry(void) {
+    pthread_mutex_destroy(&m_mutex);
+}
+
+bool BaiIndexRegistry::GetFileStamp(const string& filename, int64_t& size, int64_t& time) {
+    struct stat st;
+    if ( stat(filename.c_str(), &st) != 0 )
+        return false;
+    size = st.st_size;
+    time = st.st_mtime;
+    return true;
+}
+
+const BaiIndexData* BaiIndexRegistry::Acquire(const string& filename) {
+
+    int64_t size, time;
+    if ( !GetFileStamp(filename, size, time) )
+        return 0;
+
+    pthread_mutex_lock(&m_mutex);
+
+    const BaiIndexData* data = 0;
+    map<string, Entry>::iterator it = m_files.find(filename);
+    if ( it != m_files.end() ) {
+
+        // file rewritten since it was loaded: readers still using old data keep it
+        if ( it->second.FileSize != size || it->second.FileTime != time )
+            m_files.erase(it);
+        else {
+            data = it->second.Data;
+            ++m_refCounts[data];
+        }
+    }
+
+    pthread_mutex_unlock(&m_mutex);
+    return data;
+}
+
+const BaiIndexData* BaiIndexRegistry::Register(const string& filename, BaiIndexData* data) {
+
+    Entry entry;
+    entry.Data = data;
+    if ( !GetFileStamp(filename, entry.FileSize, entry.FileTime) ) {
+        entry.FileSize = -1;
+        entry.FileTime = -1;
+    }
+
+    pthread_mutex_lock(&m_mutex);
+
+    // another reader loaded the same file meanwhile: use its data
+    map<string, Entry>::iterator it = m_files.find(filename);
+    if ( it != m_files.end() &&
+         it->second.FileSize == entry.FileSize &&
+         it->second.FileTime == entry.FileTime )
+    {
+        delete data;
+        entry.Data = it->second.Data;
+    }
+    else
+        m_files[filename] = entry;
+
+    ++m_refCounts[entry.Data];
+
+    pthread_mutex_unlock(&m_mutex);
+    return entry.Data;
+}
+
+void BaiIndexRegistry::Retain(const BaiIndexData* data) {
+
+    if ( data == 0 )
+        return;
+
+    pthread_mutex_lock(&m_mutex);
+    ++m_refCounts[data];
+    pthread_mutex_unlock(&m_mutex);
+}
+
+void BaiIndexRegistry::Release(const BaiIndexData* data) {
+
+    if ( data == 0 )
+        return;
+
+    pthread_mutex_lock(&m_mutex);
+
+    map<const BaiIndexData*, int>::iterator refIt = m_refCounts.find(data);
+    if ( refIt != m_refCounts.end() && --(refIt->second) == 0 ) {
+
+        m_refCounts.erase(refIt);
+
+        // drop the file entry, unless it has been replaced by newer data
+        for ( map<string, Entry>::iterator it = m_files.begin(); it != m_files.end(); ++it ) {
+            if ( it->second.Data == data ) {
+                m_files.erase(it);
+                break;
+            }
+        }
+        delete data;
+    }
+
+    pthread_mutex_unlock(&m_mutex);
+}
@@ -0,0 +1,80 @@
+// ***************************************************************************
+// BaiIndexRegistry_p.h
+// ---------------------------------------------------------------------------
+// Provides a process-wide registry of fully loaded BAI index data, shared
+// read-only by every BamStandardIndex opened on the same index file
+// ***************************************************************************
+
+#ifndef BAIINDEXREGISTRY_P_H
+#define BAIINDEXREGISTRY_P_H
+
+//  -------------
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the BamTools API.  It exists purely as an
+// implementation detail. This header file may change from version to version
+// without notice, or even be removed.
+//
+// We mean it.
+
+#include "api/api_global.h"
+#include "api/internal/index/BamStandardIndex_p.h"
+#include <map>
+#include <string>
+#include <pthread.h>
+
+namespace BamTools {
+namespace Internal {
+
+class BaiIndexRegistry {
+
+    // singleton access
+    public:
+        static BaiIndexRegistry& Instance(void);
+
+    // main interface methods
+    public:
+        // enables/disables loading (and sharing) whole index files in memory
+        void SetEnabled(const bool ok) { m_isEnabled = ok; }
+        bool IsEnabled(void) const { return m_isEnabled; }
+
+        // returns the data loaded from an index file, if still up to date (0 otherwise)
+        // the data is held until released
+        const BaiIndexData* Acquire(const std::string& filename);
+        // registers the data just loaded from an index file, taking its ownership
+        // returns the registered data (which may have been loaded meanwhile by another reader)
+        const BaiIndexData* Register(const std::string& filename, BaiIndexData* data);
+        // holds data returned by Acquire() or Register() once more (for another reader)
+        void Retain(const BaiIndexData* data);
+        // releases data returned by Acquire() or Register(), freeing it when no longer used
+        void Release(const BaiIndexData* data);
+
+    // internal types
+    private:
+        struct Entry {
+            const BaiIndexData* Data;
+            int64_t FileSize;
+            int64_t FileTime;
+        };
+
+    // internal methods
+    private:
+        BaiIndexRegistry(void);
+        ~BaiIndexRegistry(void);
+
+        // retrieves size & modification time of a file, returns false if unavailable
+        static bool GetFileStamp(const std::string& filename, int64_t& size, int64_t& time);
+
+    // data members
+    private:
+        volatile bool m_isEnabled;
+        std::map<std::string, Entry> m_files;           // current data of each index file
+        std::map<const BaiIndexData*, int> m_refCounts; // readers using each data
+        pthread_mutex_t m_mutex;
+};
+
+} // namespace Internal
+} // namespace BamTools
+
+#endif // BAIINDEXREGISTRY_P_H
@@ -9,6 +9,7 @@
 
 #include "api/BamAlignment.h"
 #include "api/internal/bam/BamReader_p.h"
+#include "api/internal/index/BaiIndexRegistry_p.h"
 #include "api/internal/index/BamStandardIndex_p.h"
 #include "api/internal/io/BamDeviceFactory_p.h"
 #include "api/internal/utils/BamException_p.h"
@@ -57,6 +58,146 @@ BamStandardIndex::RaiiWrapper::~RaiiWrapper(void) {
     }
 }
 
+// -----------------------------
+// BaiIndexData implementation
+// -----------------------------
+
+BaiIndexData::BaiIndexData(void)
+    : m_isBigEndian(false)
+{
+    pthread_mutex_init(&m_mutex, NULL);
+}
+
+BaiIndexData::~BaiIndexData(void) {
+    for ( size_t i = 0; i < m_references.size(); ++i )
+        delete m_references[i];
+    pthread_mutex_destroy(&m_mutex);
+}
+
+// decodes bins (sorted by ID) & linear offsets of a reference from raw index data
+void BaiIndexData::DecodeReference(const int& refId, BaiReferenceData& refData) const {
+
+    // locate bins in file order
+    size_t offset = m_referenceOffsets[refId];
+    const int32_t numBins = ReadInt32(offset);
+
+    vector< pair<uint32_t, size_t> > bins;      // (bin ID, position of bin's chunk count)
+    bins.reserve(numBins);
+    size_t numChunks = 0;
+    for ( int i = 0; i < numBins; ++i ) {
+        const uint32_t binId = (uint32_t)ReadInt32(offset);
+        bins.push_back( make_pair(binId, offset) );
+        const int32_t numBinChunks = ReadInt32(offset);
+        offset += numBinChunks*2*sizeof(uint64_t);
+        numChunks += numBinChunks;
+    }
+
+    // store bins sorted by ID (if a bin is repeated, only its first occurrence
+    // is used, as when bins are looked up in the file)
+    sort( bins.begin(), bins.end() );
+
+    refData.BinIds.reserve(bins.size());
+    refData.BinChunks.reserve(bins.size() + 1);
+    refData.Chunks.reserve(numChunks);
+    for ( size_t i = 0; i < bins.size(); ++i ) {
+        if ( !refData.BinIds.empty() && refData.BinIds.back() == bins[i].first )
+            continue;
+        refData.BinIds.push_back(bins[i].first);
+        refData.BinChunks.push_back(refData.Chunks.size());
+
+        size_t chunkOffset = bins[i].second;
+        const int32_t numBinChunks = ReadInt32(chunkOffset);
+        BaiAlignmentChunk chunk;
+        for ( int j = 0; j < numBinChunks; ++j ) {
+            chunk.Start = ReadUInt64(chunkOffset);
+            chunk.Stop  = ReadUInt64(chunkOffset);
+            refData.Chunks.push_back(chunk);
+        }
+    }
+    refData.BinChunks.push_back(refData.Chunks.size());
+
+    // load linear offsets
+    const int32_t numLinearOffsets = ReadInt32(offset);
+    refData.LinearOffsets.resize(numLinearOffsets);
+    for ( int i = 0; i < numLinearOffsets; ++i )
+        refData.LinearOffsets[i] = ReadUInt64(offset);
+}
+
+bool BaiIndexData::HasAlignments(const int& refId) const {
+    size_t offset = m_referenceOffsets.at(refId);
+    return ( ReadInt32(offset) > 0 );
+}
+
+void BaiIndexData::Load(vector<char>& contents, const bool isBigEndian) {
+
+    m_contents.swap(contents);
+    m_isBigEndian = isBigEndian;
+
+    // load number of reference sequences
+    size_t offset = 0;
+    const int32_t numReferences = ReadInt32(offset);
+    if ( numReferences < 0 )
+        throw BamException("BaiIndexData::Load", "invalid reference count");
+
+    // skip over each reference entry, storing its position
+    m_referenceOffsets.reserve(numReferences);
+    for ( int i = 0; i < numReferences; ++i ) {
+        m_referenceOffsets.push_back(offset);
+
+        const int32_t numBins = ReadInt32(offset);
+        for ( int j = 0; j < numBins; ++j ) {
+            offset += sizeof(uint32_t);
+            const int32_t numAlignmentChunks = ReadInt32(offset);
+            if ( numAlignmentChunks < 0 )
+                throw BamException("BaiIndexData::Load", "invalid alignment chunk count");
+            offset += numAlignmentChunks*2*sizeof(uint64_t);
+        }
+
+        const int32_t numLinearOffsets = ReadInt32(offset);
+        if ( numBins < 0 || numLinearOffsets < 0 )
+            throw BamException("BaiIndexData::Load", "invalid bin or linear offset count");
+        offset += numLinearOffsets*sizeof(uint64_t);
+    }
+
+    if ( offset > m_contents.size() )
+        throw BamException("BaiIndexData::Load", "unexpected end of BAI file");
+
+    m_references.assign(numReferences, (BaiReferenceData*)0);
+}
+
+int32_t BaiIndexData::ReadInt32(size_t& offset) const {
+    if ( offset + sizeof(int32_t) > m_contents.size() )
+        throw BamException("BaiIndexData::Load", "unexpected end of BAI file");
+    int32_t value;
+    memcpy((char*)&value, &m_contents[offset], sizeof(value));
+    if ( m_isBigEndian ) SwapEndian_32(value);
+    offset += sizeof(value);
+    return value;
+}
+
+uint64_t BaiIndexData::ReadUInt64(size_t& offset) const {
+    uint64_t value;
+    memcpy((char*)&value, &m_contents[offset], sizeof(value));
+    if ( m_isBigEndian ) SwapEndian_64(value);
+    offset += sizeof(value);
+    return value;
+}
+
+const BaiReferenceData& BaiIndexData::Reference(const int& refId) const {
+
+    pthread_mutex_lock(&m_mutex);
+
+    BaiReferenceData* refData = m_references.at(refId);
+    if ( refData == 0 ) {
+        refData = new BaiReferenceData;
+        DecodeReference(refId, *refData);
+        m_references[refId] = refData;
+    }
+
+    pthread_mutex_unlock(&m_mutex);
+    return *refData;
+}
+
 // ---------------------------------
 // BamStandardIndex implementation
 // ---------------------------------
@@ -64,6 +205,9 @@ BamStandardIndex::RaiiWrapper::~RaiiWrapper(void) {
 // ctor
 BamStandardIndex::BamStandardIndex(Internal::BamReaderPrivate* reader)
     : BamIndex(reader)
+    , m_numSummarized(0)
+    , m_summaryEndPosition(0)
+    , m_indexData(0)
     , m_bufferLength(0)
 {
      m_isBigEndian = BamTools::SystemIsBigEndian();
@@ -174,6 +318,46 @@ void BamStandardIndex::CalculateCandidateOffsets(const BaiReferenceSummary& refS
     }
 }
 
+// looks candidate bins up in in-memory index data
+void BamStandardIndex::CalculateCandidateOffsets(const BaiReferenceData& refData,
+                                                 const uint64_t& minOffset,
+                                                 const set<uint16_t>& candidateBins,
+                                                 vector<int64_t>& offsets)
+{
+    set<uint16_t>::const_iterator candidateBinIter = candidateBins.begin();
+    set<uint16_t>::const_iterator candidateBinEnd  = candidateBins.end();
+    for ( ; candidateBinIter != candidateBinEnd; ++candidateBinIter ) {
+
+        // skip bins not in reference
+        vector<uint32_t>::const_iterator binIter =
+            lower_bound(refData.BinIds.begin(), refData.BinIds.end(), (uint32_t)(*candidateBinIter));
+        if ( binIter == refData.BinIds.end() || *binIter != *candidateBinIter )
+            continue;
+
+        // store start offsets of chunks whose stop offset is beyond 'minOffset'
+        const size_t binIndex = binIter - refData.BinIds.begin();
+        for ( uint32_t j = refData.BinChunks[binIndex]; j < refData.BinChunks[binIndex+1]; ++j ) {
+            const BaiAlignmentChunk& chunk = refData.Chunks[j];
+            if ( chunk.Stop >= minOffset )
+                offsets.push_back(chunk.Start);
+        }
+    }
+}
+
+uint64_t BamStandardIndex::CalculateMinOffset(const BaiReferenceData& refData, const uint32_t& begin) {
+
+    // if no linear offsets exist, return 0
+    if ( refData.LinearOffsets.empty() )
+        return 0;
+
+    // if 'begin' starts beyond last linear offset, use the last linear offset as minimum
+    const size_t shiftedBegin = begin>>BamStandardIndex::BAM_LIDX_SHIFT;
+    if ( shiftedBegin >= refData.LinearOffsets.size() )
+        return refData.LinearOffsets.back();
+    else
+        return refData.LinearOffsets[shiftedBegin];
+}
+
 uint64_t BamStandardIndex::CalculateMinOffset(const BaiReferenceSummary& refSummary,
                                               const uint32_t& begin)
 {
@@ -254,6 +438,11 @@ void BamStandardIndex::CloseFile(void) {
 
     // clear index file summary data
     m_indexFileSummary.clear();
+    m_numSummarized = 0;
+
+    // release in-memory index data
+    BaiIndexRegistry::Instance().Release(m_indexData);
+    m_indexData = 0;
 
     // clean up I/O buffer
     delete[] m_resources.Buffer;
@@ -427,12 +616,9 @@ const string BamStandardIndex::Extension(void) {
 void BamStandardIndex::GetOffset(const BamRegion& region, int64_t& offset, bool* hasAlignmentsInRegion) {
 
     // cannot calculate offsets if unknown/invalid reference ID requested
-    if ( region.LeftRefID < 0 || region.LeftRefID >= (int)m_indexFileSummary.size() )
+    if ( region.LeftRefID < 0 || region.LeftRefID >= NumReferences() )
         throw BamException("BamStandardIndex::GetOffset", "invalid reference ID requested");
 
-    // retrieve index summary for left bound reference
-    const BaiReferenceSummary& refSummary = m_indexFileSummary.at(region.LeftRefID);
-
     // set up region boundaries based on actual BamReader data
     uint32_t begin;
     uint32_t end;
@@ -443,13 +629,20 @@ void BamStandardIndex::GetOffset(const BamRegion& region, int64_t& offset, bool*
     CalculateCandidateBins(begin, end, candidateBins);
 
     // use reference's linear offsets to calculate the minimum offset
-    // that must be considered to find overlap
-    const uint64_t& minOffset = CalculateMinOffset(refSummary, begin);
+    // that must be considered to find overlap, then use it & candidateBins
+    // to calculate offsets (in memory, or reading reference's data from file)
+    vector<int64_t> offsets;
+    if ( m_indexData ) {
+        const BaiReferenceData& refData = m_indexData->Reference(region.LeftRefID);
+        const uint64_t minOffset = CalculateMinOffset(refData, begin);
+        CalculateCandidateOffsets(refData, minOffset, candidateBins, offsets);
+    } else {
+        const BaiReferenceSummary& refSummary = ReferenceSummary(region.LeftRefID);
+        const uint64_t minOffset = CalculateMinOffset(refSummary, begin);
+        CalculateCandidateOffsets(refSummary, minOffset, candidateBins, offsets);
+    }
 
-    // attempt to use reference summary, minOffset, & candidateBins to calculate offsets
     // no data should not be error, just bail
-    vector<int64_t> offsets;
-    CalculateCandidateOffsets(refSummary, minOffset, candidateBins, offsets);
     if ( offsets.empty() )
         return;
     
@@ -495,10 +688,19 @@ void BamStandardIndex::GetOffset(const BamRegion& region, int64_t& offset, bool*
 
 // returns whether reference has alignments or no
 bool BamStandardIndex::HasAlignments(const int& referenceID) const {
-    if ( referenceID < 0 || referenceID >= (int)m_indexFileSummary.size() )
+    if ( referenceID < 0 || referenceID >= NumReferences() )
         return false;
-    const BaiReferenceSummary& refSummary = m_indexFileSummary.at(referenceID);
-    return ( refSummary.NumBins > 0 );
+    if ( m_indexData )
+        return m_indexData->HasAlignments(referenceID);
+
+    // summaries are loaded on demand, but are not part of index's visible state
+    try {
+        const BaiReferenceSummary& refSummary =
+            const_cast<BamStandardIndex*>(this)->ReferenceSummary(referenceID);
+        return ( refSummary.NumBins > 0 );
+    } catch ( BamException& ) {
+        return false;
+    }
 }
 
 bool BamStandardIndex::IsDeviceOpen(void) const {
@@ -507,11 +709,10 @@ bool BamStandardIndex::IsDeviceOpen(void) const {
     return m_resources.Device->IsOpen();
 }
 
-// attempts to use index data to jump to @region, returns success/fail
-// a "successful" jump indicates no error, but not whether this region has data
-//   * thus, the method sets a flag to indicate whether there are alignments
-//     available after the jump position
-bool BamStandardIndex::Jump(const BamRegion& region, bool* hasAlignmentsInRegion) {
+// calculates the file offset to jump to for @region, without moving the reader
+// (sets a flag to indicate whether there are alignments in region), returns success/fail
+//   * the reader's file position is not preserved (offsets are checked against alignment data)
+bool BamStandardIndex::GetRegionOffset(const BamRegion& region, int64_t* offset, bool* hasAlignmentsInRegion) {
 
     // clear out flag
     *hasAlignmentsInRegion = false;
@@ -523,14 +724,27 @@ bool BamStandardIndex::Jump(const BamRegion& region, bool* hasAlignmentsInRegion
     }
 
     // calculate nearest offset to jump to
-    int64_t offset;
     try {
-        GetOffset(region, offset, hasAlignmentsInRegion);
+        GetOffset(region, *offset, hasAlignmentsInRegion);
     } catch ( BamException& e ) {
         m_errorString = e.what();
         return false;
     }
 
+    return true;
+}
+
+// attempts to use index data to jump to @region, returns success/fail
+// a "successful" jump indicates no error, but not whether this region has data
+//   * thus, the method sets a flag to indicate whether there are alignments
+//     available after the jump position
+bool BamStandardIndex::Jump(const BamRegion& region, bool* hasAlignmentsInRegion) {
+
+    // calculate nearest offset to jump to
+    int64_t offset;
+    if ( !GetRegionOffset(region, &offset, hasAlignmentsInRegion) )
+        return false;
+
     // if region has alignments, return success/fail of seeking there
     if ( *hasAlignmentsInRegion )
         return m_reader->Seek(offset);
@@ -545,13 +759,36 @@ bool BamStandardIndex::Load(const std::string& filename) {
 
     try {
 
+        // use index data already loaded by another reader, if any
+        BaiIndexRegistry& registry = BaiIndexRegistry::Instance();
+        if ( registry.IsEnabled() ) {
+            CloseFile();
+            m_indexData = registry.Acquire(filename);
+            if ( m_indexData )
+                return true;
+        }
+
         // attempt to open file (read-only)
         OpenFile(filename, IBamIODevice::ReadOnly);
 
         // validate format
         CheckMagicNumber();
 
-        // load in-memory summary of index data
+        // load whole index data, sharing it with other readers (file is no longer needed)
+        if ( registry.IsEnabled() ) {
+            BaiIndexData* data = new BaiIndexData;
+            try {
+                LoadIndexData(*data);
+            } catch ( ... ) {
+                delete data;
+                throw;
+            }
+            CloseFile();
+            m_indexData = registry.Register(filename, data);
+            return true;
+        }
+
+        // prepare in-memory summary of index data (filled on demand)
         SummarizeIndexFile();
 
         // return success
@@ -563,6 +800,27 @@ bool BamStandardIndex::Load(const std::string& filename) {
     }
 }
 
+// loads whole index data from file (references are decoded when first used)
+void BamStandardIndex::LoadIndexData(BaiIndexData& data) {
+
+    // read the rest of index file
+    const size_t chunkSize = 1 << 20;
+    vector<char> contents;
+    for ( ; ; ) {
+        const size_t size = contents.size();
+        contents.resize(size + chunkSize);
+        const int64_t numBytesRead = m_resources.Device->Read(&contents[size], chunkSize);
+        if ( numBytesRead < 0 )
+            throw BamException("BamStandardIndex::LoadIndexData", "could not read BAI file");
+        contents.resize(size + numBytesRead);
+        if ( numBytesRead < (int64_t)chunkSize )
+            break;
+    }
+
+    // locate reference entries
+    data.Load(contents, m_isBigEndian);
+}
+
 uint64_t BamStandardIndex::LookupLinearOffset(const BaiReferenceSummary& refSummary, const int& index) {
 
     // attempt seek to proper index file position
@@ -617,6 +875,12 @@ void BamStandardIndex::MergeAlignmentChunks(BaiAlignmentChunkVector& chunks) {
     chunks = mergedChunks;
 }
 
+int BamStandardIndex::NumReferences(void) const {
+    if ( m_indexData )
+        return m_indexData->NumReferences();
+    return (int)m_indexFileSummary.size();
+}
+
 void BamStandardIndex::OpenFile(const std::string& filename, IBamIODevice::OpenMode mode) {
 
     // make sure any previous index file is closed
@@ -704,9 +968,24 @@ void BamStandardIndex::ReadNumReferences(int& numReferences) {
         throw BamException("BamStandardIndex::ReadNumReferences", "could not read reference count");
 }
 
+// returns summary of a reference's index data, summarizing index file up to it if needed
+const BaiReferenceSummary& BamStandardIndex::ReferenceSummary(const int& refId) {
+
+    if ( refId >= m_numSummarized && refId < (int)m_indexFileSummary.size() ) {
+        Seek(m_summaryEndPosition, SEEK_SET);
+        for ( ; m_numSummarized <= refId; ++m_numSummarized )
+            SummarizeReference(m_indexFileSummary[m_numSummarized]);
+        m_summaryEndPosition = Tell();
+    }
+
+    return m_indexFileSummary.at(refId);
+}
+
+// (summaries are filled while index is created)
 void BamStandardIndex::ReserveForSummary(const int& numReferences) {
     m_indexFileSummary.clear();
     m_indexFileSummary.assign( numReferences, BaiReferenceSummary() );
+    m_numSummarized = numReferences;
 }
 
 void BamStandardIndex::SaveAlignmentChunkToBin(BaiBinMap& binMap,
@@ -772,6 +1051,16 @@ void BamStandardIndex::Seek(const int64_t& position, const int origin) {
         throw BamException("BamStandardIndex::Seek", "could not seek in BAI file");
 }
 
+void BamStandardIndex::SetSharedInMemory(const bool ok) {
+    BaiIndexRegistry::Instance().SetEnabled(ok);
+}
+
+void BamStandardIndex::ShareData(const BamStandardIndex& other) {
+    CloseFile();
+    m_indexData = other.m_indexData;
+    BaiIndexRegistry::Instance().Retain(m_indexData);
+}
+
 void BamStandardIndex::SkipBins(const int& numBins) {
     uint32_t binId;
     int32_t numAlignmentChunks;
@@ -808,14 +1097,10 @@ void BamStandardIndex::SummarizeIndexFile(void) {
     int numReferences;
     ReadNumReferences(numReferences);
 
-    // initialize file summary data
+    // initialize file summary data, references are summarized when first used
     ReserveForSummary(numReferences);
-
-    // iterate over reference entries
-    BaiFileSummary::iterator summaryIter = m_indexFileSummary.begin();
-    BaiFileSummary::iterator summaryEnd  = m_indexFileSummary.end();
-    for ( int i = 0; summaryIter != summaryEnd; ++summaryIter, ++i )
-        SummarizeReference(*summaryIter);
+    m_numSummarized = 0;
+    m_summaryEndPosition = Tell();
 }
 
 void BamStandardIndex::SummarizeLinearOffsets(BaiReferenceSummary& refSummary) {
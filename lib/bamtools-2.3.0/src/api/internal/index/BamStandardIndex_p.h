@@ -27,6 +27,7 @@
 #include <set>
 #include <string>
 #include <vector>
+#include <pthread.h>
 
 namespace BamTools {
 namespace Internal {
@@ -100,6 +101,57 @@ struct BaiReferenceSummary {
 // convenience typedef for describing a full BAI index file summary
 typedef std::vector<BaiReferenceSummary> BaiFileSummary;
 
+// contains the (read-only) index data of a single reference, loaded in memory
+struct BaiReferenceData {
+
+    // data members
+    std::vector<uint32_t> BinIds;               // sorted bin IDs
+    std::vector<uint32_t> BinChunks;            // first chunk of each bin (BinIds.size()+1 entries)
+    BaiAlignmentChunkVector Chunks;             // chunks of all bins, grouped by bin
+    BaiLinearOffsetVector LinearOffsets;        // linear offsets (one for each 16kbp window)
+};
+
+// contains the full index data of a BAI file, loaded in memory
+//   * raw file contents are kept, each reference's data is decoded the first time
+//     it is used (data may be shared by readers on several threads)
+class BaiIndexData {
+
+    // ctor & dtor
+    public:
+        BaiIndexData(void);
+        ~BaiIndexData(void);
+
+    // main interface methods
+    public:
+        // stores raw index data (following the magic number), locating each reference in it
+        void Load(std::vector<char>& contents, const bool isBigEndian);
+        // returns the number of references in index
+        int NumReferences(void) const { return (int)m_referenceOffsets.size(); }
+        // returns whether reference has alignments or no
+        bool HasAlignments(const int& refId) const;
+        // returns the data of a reference, decoding it on first use
+        const BaiReferenceData& Reference(const int& refId) const;
+
+    // internal methods
+    private:
+        void DecodeReference(const int& refId, BaiReferenceData& refData) const;
+        int32_t ReadInt32(size_t& offset) const;
+        uint64_t ReadUInt64(size_t& offset) const;
+
+    // not copyable
+    private:
+        BaiIndexData(const BaiIndexData& other);
+        BaiIndexData& operator=(const BaiIndexData& other);
+
+    // data members
+    private:
+        std::vector<char> m_contents;               // raw index data
+        std::vector<size_t> m_referenceOffsets;     // position of each reference's data in m_contents
+        bool m_isBigEndian;
+        mutable std::vector<BaiReferenceData*> m_references;    // decoded references (0 until used)
+        mutable pthread_mutex_t m_mutex;
+};
+
 // end BamStandardIndex data structures
 // -----------------------------------------------------------------------------
 
@@ -121,12 +173,23 @@ class BamStandardIndex : public BamIndex {
         //   * thus, the method sets a flag to indicate whether there are alignments
         //     available after the jump position
         bool Jump(const BamTools::BamRegion& region, bool* hasAlignmentsInRegion);
+        // calculates the file offset to jump to for @region, without moving the reader
+        bool GetRegionOffset(const BamTools::BamRegion& region, int64_t* offset, bool* hasAlignmentsInRegion);
         // loads existing data from file into memory
         bool Load(const std::string& filename);
         BamIndex::IndexType Type(void) const { return BamIndex::STANDARD; }
     public:
         // returns format's file extension
         static const std::string Extension(void);
+        // enables/disables loading whole index files in memory, shared by all readers
+        static void SetSharedInMemory(const bool ok);
+
+    // in-memory index data
+    public:
+        // returns true if the whole index data is loaded in memory
+        bool IsInMemory(void) const { return m_indexData != 0; }
+        // uses the in-memory index data of another index (for a reader on the same BAM file)
+        void ShareData(const BamStandardIndex& other);
 
     // internal methods
     private:
@@ -162,6 +225,18 @@ class BamStandardIndex : public BamIndex {
         uint64_t CalculateMinOffset(const BaiReferenceSummary& refSummary, const uint32_t& begin);
         void GetOffset(const BamRegion& region, int64_t& offset, bool* hasAlignmentsInRegion);
         uint64_t LookupLinearOffset(const BaiReferenceSummary& refSummary, const int& index);
+        const BaiReferenceSummary& ReferenceSummary(const int& refId);
+
+        // random-access methods (in-memory index data)
+        void CalculateCandidateOffsets(const BaiReferenceData& refData,
+                                       const uint64_t& minOffset,
+                                       const std::set<uint16_t>& candidateBins,
+                                       std::vector<int64_t>& offsets);
+        uint64_t CalculateMinOffset(const BaiReferenceData& refData, const uint32_t& begin);
+        int NumReferences(void) const;
+
+        // BAI in-memory index input methods
+        void LoadIndexData(BaiIndexData& data);
 
         // BAI summary (create/load) methods
         void ReserveForSummary(const int& numReferences);
@@ -199,6 +274,9 @@ class BamStandardIndex : public BamIndex {
     private:
         bool m_isBigEndian;
         BaiFileSummary m_indexFileSummary;
+        int m_numSummarized;                // references summarized so far (summaries are loaded on demand)
+        int64_t m_summaryEndPosition;       // index file position after last reference summarized
+        const BaiIndexData* m_indexData;    // whole index in memory (shared with other readers), if loaded
 
         // our input buffer
         unsigned int m_bufferLength;
@@ -366,11 +366,9 @@ bool BamToolsIndex::IsDeviceOpen(void) const {
     return m_resources.Device->IsOpen();
 }
 
-// attempts to use index data to jump to @region, returns success/fail
-// a "successful" jump indicates no error, but not whether this region has data
-//   * thus, the method sets a flag to indicate whether there are alignments
-//     available after the jump position
-bool BamToolsIndex::Jump(const BamTools::BamRegion& region, bool* hasAlignmentsInRegion) {
+// calculates the file offset to jump to for @region, without moving the reader
+// (sets a flag to indicate whether there are alignments in region), returns success/fail
+bool BamToolsIndex::GetRegionOffset(const BamTools::BamRegion& region, int64_t* offset, bool* hasAlignmentsInRegion) {
 
     // clear flag
     *hasAlignmentsInRegion = false;
@@ -389,14 +387,27 @@ bool BamToolsIndex::Jump(const BamTools::BamRegion& region, bool* hasAlignmentsI
     }
 
     // calculate nearest offset to jump to
-    int64_t offset;
     try {
-        GetOffset(region, offset, hasAlignmentsInRegion);
+        GetOffset(region, *offset, hasAlignmentsInRegion);
     } catch ( BamException& e ) {
         m_errorString = e.what();
         return false;
     }
 
+    return true;
+}
+
+// attempts to use index data to jump to @region, returns success/fail
+// a "successful" jump indicates no error, but not whether this region has data
+//   * thus, the method sets a flag to indicate whether there are alignments
+//     available after the jump position
+bool BamToolsIndex::Jump(const BamTools::BamRegion& region, bool* hasAlignmentsInRegion) {
+
+    // calculate nearest offset to jump to
+    int64_t offset;
+    if ( !GetRegionOffset(region, &offset, hasAlignmentsInRegion) )
+        return false;
+
     // return success/failure of seek
     return m_reader->Seek(offset);
 }
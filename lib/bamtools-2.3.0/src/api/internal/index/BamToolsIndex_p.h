@@ -116,6 +116,8 @@ class BamToolsIndex : public BamIndex {
         //   * thus, the method sets a flag to indicate whether there are alignments
         //     available after the jump position
         bool Jump(const BamTools::BamRegion& region, bool* hasAlignmentsInRegion);
+        // calculates the file offset to jump to for @region, without moving the reader
+        bool GetRegionOffset(const BamTools::BamRegion& region, int64_t* offset, bool* hasAlignmentsInRegion);
         // loads existing data from file into memory
         bool Load(const std::string& filename);
         BamIndex::IndexType Type(void) const { return BamIndex::BAMTOOLS; }
@@ -11,6 +11,7 @@
 #include "api/internal/io/BamFile_p.h"
 #include "api/internal/io/BamFtp_p.h"
 #include "api/internal/io/BamHttp_p.h"
+#include "api/internal/io/BamMappedFile_p.h"
 #include "api/internal/io/BamPipe_p.h"
 using namespace BamTools;
 using namespace BamTools::Internal;
@@ -18,7 +19,7 @@ using namespace BamTools::Internal;
 #include <iostream>
 using namespace std;
 
-IBamIODevice* BamDeviceFactory::CreateDevice(const string& source) {
+IBamIODevice* BamDeviceFactory::CreateDevice(const string& source, const IBamIODevice::OpenMode mode) {
 
     // check for requested pipe
     if ( source == "-" || source == "stdin" || source == "stdout" )
@@ -32,6 +33,12 @@ IBamIODevice* BamDeviceFactory::CreateDevice(const string& source) {
     if ( source.find("ftp://") == 0 )
         return new BamFtp(source);
 
+#ifndef _WIN32
+    // local files that are only read are memory-mapped
+    if ( mode == IBamIODevice::ReadOnly )
+        return new BamMappedFile(source);
+#endif
+
     // otherwise assume a "normal" file
     return new BamFile(source);
 }
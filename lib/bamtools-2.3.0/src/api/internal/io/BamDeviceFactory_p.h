@@ -28,7 +28,8 @@ namespace Internal {
 
 class BamDeviceFactory {
     public:
-        static IBamIODevice* CreateDevice(const std::string& source);
+        static IBamIODevice* CreateDevice(const std::string& source,
+                                          const IBamIODevice::OpenMode mode = IBamIODevice::NotOpen);
 };
 
 } // namespace Internal
@@ -13,11 +13,15 @@ using namespace BamTools::Internal;
 
 #include <cstdio>
 #include <iostream>
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
 using namespace std;
 
 BamFile::BamFile(const string& filename)
     : ILocalIODevice()
     , m_filename(filename)
+    , m_isRandomAccess(true)
 { }
 
 BamFile::~BamFile(void) { }
@@ -30,7 +34,7 @@ void BamFile::Close(void) {
 }
 
 bool BamFile::IsRandomAccess(void) const {
-    return true;
+    return m_isRandomAccess;
 }
 
 bool BamFile::Open(const IBamIODevice::OpenMode mode) {
@@ -58,6 +62,14 @@ bool BamFile::Open(const IBamIODevice::OpenMode mode) {
         return false;
     }
 
+    // named pipes (or other special files) are read sequentially
+    m_isRandomAccess = true;
+#ifndef _WIN32
+    struct stat st;
+    if ( fstat(fileno(m_stream), &st) == 0 && !S_ISREG(st.st_mode) )
+        m_isRandomAccess = false;
+#endif
+
     // store current IO mode & return success
     m_mode = mode;
     return true;
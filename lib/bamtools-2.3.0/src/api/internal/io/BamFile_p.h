@@ -43,6 +43,7 @@ class BamFile : public ILocalIODevice {
     // data members
     private:
         std::string m_filename;
+        bool m_isRandomAccess;  // false for files that cannot seek (e.g. named pipes)
 };
 
 } // namespace Internal
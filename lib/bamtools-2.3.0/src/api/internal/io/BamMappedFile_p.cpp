@@ -0,0 +1,177 @@
+// ***************************************************************************
+// BamMappedFile_p.cpp
+// ---------------------------------------------------------------------------
+// Provides read-only access to a local BAM file through a memory mapping of
+// the whole file, so that compressed blocks can be used in place
+// ***************************************************************************
+
+#include "api/internal/io/BamMappedFile_p.h"
+using namespace BamTools;
+using namespace BamTools::Internal;
+
+#include <cstring>
+#include <algorithm>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+using namespace std;
+
+// bytes read ahead (through madvise) after every seek
+static const int64_t SEEK_READ_AHEAD = 256 * 1024;
+
+// protects reference counts of mappings shared by clones (possibly on different threads)
+static pthread_mutex_t g_mappingMutex = PTHREAD_MUTEX_INITIALIZER;
+
+BamMappedFile::BamMappedFile(const string& filename)
+    : IBamIODevice()
+    , m_filename(filename)
+    , m_mapping(0)
+    , m_data(0)
+    , m_size(0)
+    , m_position(0)
+{ }
+
+BamMappedFile::~BamMappedFile(void) {
+    Close();
+}
+
+void BamMappedFile::Close(void) {
+
+    // skip if not open
+    if ( !IsOpen() )
+        return;
+
+    pthread_mutex_lock(&g_mappingMutex);
+    const bool isLast = ( --m_mapping->RefCount == 0 );
+    pthread_mutex_unlock(&g_mappingMutex);
+
+    if ( isLast ) {
+        munmap(const_cast<char*>(m_mapping->Data), m_mapping->Size);
+        delete m_mapping;
+    }
+
+    m_mapping = 0;
+    m_data = 0;
+    m_size = 0;
+    m_position = 0;
+
+    // reset other device state
+    m_mode = IBamIODevice::NotOpen;
+}
+
+BamMappedFile* BamMappedFile::Clone(void) const {
+
+    BT_ASSERT_X( m_mapping, "BamMappedFile::Clone: trying to clone unmapped file" );
+
+    pthread_mutex_lock(&g_mappingMutex);
+    ++m_mapping->RefCount;
+    pthread_mutex_unlock(&g_mappingMutex);
+
+    BamMappedFile* clone = new BamMappedFile(m_filename);
+    clone->m_mapping = m_mapping;
+    clone->m_data = m_data;
+    clone->m_size = m_size;
+    clone->m_mode = IBamIODevice::ReadOnly;
+    return clone;
+}
+
+bool BamMappedFile::IsRandomAccess(void) const {
+    return true;
+}
+
+bool BamMappedFile::Open(const IBamIODevice::OpenMode mode) {
+
+    // make sure we're starting with a fresh mapping
+    Close();
+
+    if ( mode != IBamIODevice::ReadOnly ) {
+        SetErrorString("BamMappedFile::Open", "memory-mapped files can only be read");
+        return false;
+    }
+
+    const int fd = open(m_filename.c_str(), O_RDONLY);
+    if ( fd < 0 ) {
+        SetErrorString("BamMappedFile::Open", string("could not open file handle for ") + m_filename);
+        return false;
+    }
+
+    // only regular, non-empty files can be mapped
+    struct stat st;
+    if ( fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0 ) {
+        close(fd);
+        SetErrorString("BamMappedFile::Open", string("cannot map ") + m_filename);
+        return false;
+    }
+
+    void* data = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // the mapping keeps its own reference to the file
+
+    if ( data == MAP_FAILED ) {
+        SetErrorString("BamMappedFile::Open", string("could not map ") + m_filename);
+        return false;
+    }
+
+    m_mapping = new Mapping;
+    m_mapping->Data = static_cast<const char*>(data);
+    m_mapping->Size = st.st_size;
+    m_mapping->RefCount = 1;
+
+    m_data = m_mapping->Data;
+    m_size = m_mapping->Size;
+    m_position = 0;
+
+    // store current IO mode & return success
+    m_mode = mode;
+    return true;
+}
+
+int64_t BamMappedFile::Read(char* data, const unsigned int numBytes) {
+    BT_ASSERT_X( m_data, "BamMappedFile::Read: trying to read from unmapped file" );
+    const int64_t numBytesRead = max( min(static_cast<int64_t>(numBytes), m_size - m_position), static_cast<int64_t>(0) );
+    memcpy(data, m_data + m_position, numBytesRead);
+    m_position += numBytesRead;
+    return numBytesRead;
+}
+
+bool BamMappedFile::Seek(const int64_t& position, const int origin) {
+
+    BT_ASSERT_X( m_data, "BamMappedFile::Seek: trying to seek on unmapped file" );
+
+    int64_t target = position;
+    if ( origin == SEEK_CUR ) target += m_position;
+    else if ( origin == SEEK_END ) target += m_size;
+    if ( target < 0 )
+        return false;
+
+    // a jump is likely followed by reading the blocks that follow it
+    if ( target != m_position )
+        WillNeed(target, SEEK_READ_AHEAD);
+
+    m_position = target;
+    return true;
+}
+
+int64_t BamMappedFile::Tell(void) const {
+    return m_position;
+}
+
+void BamMappedFile::WillNeed(const int64_t& position, const int64_t& length) const {
+
+    if ( position >= m_size || length <= 0 )
+        return;
+
+    // madvise requires a page-aligned address
+    static const int64_t pageSize = sysconf(_SC_PAGESIZE);
+    const int64_t begin = position - (position % pageSize);
+    const int64_t end   = min(position + length, m_size);
+
+    madvise(const_cast<char*>(m_data + begin), end - begin, MADV_WILLNEED);
+}
+
+int64_t BamMappedFile::Write(const char* data, const unsigned int numBytes) {
+    (void)data; (void)numBytes;
+    BT_ASSERT_X( false, "BamMappedFile::Write: memory-mapped files are read-only" );
+    return -1;
+}
@@ -0,0 +1,77 @@
+// ***************************************************************************
+// BamMappedFile_p.h
+// ---------------------------------------------------------------------------
+// Provides read-only access to a local BAM file through a memory mapping of
+// the whole file, so that compressed blocks can be used in place
+// ***************************************************************************
+
+#ifndef BAMMAPPEDFILE_P_H
+#define BAMMAPPEDFILE_P_H
+
+//  -------------
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the BamTools API.  It exists purely as an
+// implementation detail. This header file may change from version to version
+// without notice, or even be removed.
+//
+// We mean it.
+
+#include "api/IBamIODevice.h"
+#include <string>
+
+namespace BamTools {
+namespace Internal {
+
+class BamMappedFile : public IBamIODevice {
+
+    // ctor & dtor
+    public:
+        BamMappedFile(const std::string& filename);
+        ~BamMappedFile(void);
+
+    // IBamIODevice implementation
+    public:
+        void Close(void);
+        bool IsRandomAccess(void) const;
+        bool Open(const IBamIODevice::OpenMode mode);
+        int64_t Read(char* data, const unsigned int numBytes);
+        bool Seek(const int64_t& position, const int origin = SEEK_SET);
+        int64_t Tell(void) const;
+        int64_t Write(const char* data, const unsigned int numBytes);
+
+    // mapped data access
+    public:
+        // returns a new device, already open, that shares this file's mapping
+        // and has its own position (at the beginning of the file)
+        BamMappedFile* Clone(void) const;
+        // returns the mapped file contents
+        const char* Data(void) const { return m_data; }
+        // returns the size of the file
+        int64_t Size(void) const { return m_size; }
+        // hints the kernel that the given range of the file will be read soon
+        void WillNeed(const int64_t& position, const int64_t& length) const;
+
+    // internal types
+    private:
+        // mapping shared by a file and its clones, unmapped by the last one closed
+        struct Mapping {
+            const char* Data;
+            int64_t Size;
+            int RefCount;
+        };
+
+    // data members
+    private:
+        std::string m_filename;
+        Mapping* m_mapping;
+        const char* m_data;
+        int64_t m_size;
+        int64_t m_position;
+};
+
+} // namespace Internal
+} // namespace BamTools
+
+#endif // BAMMAPPEDFILE_P_H
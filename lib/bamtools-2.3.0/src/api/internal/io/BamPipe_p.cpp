@@ -15,7 +15,10 @@ using namespace BamTools::Internal;
 #include <iostream>
 using namespace std;
 
-BamPipe::BamPipe(void) : ILocalIODevice() { }
+BamPipe::BamPipe(void)
+    : ILocalIODevice()
+    , m_position(0)
+{ }
 
 BamPipe::~BamPipe(void) { }
 
@@ -60,10 +63,29 @@ bool BamPipe::Open(const IBamIODevice::OpenMode mode) {
 
     // store current IO mode & return success
     m_mode = mode;
+    m_position = 0;
     return true;
 }
 
+int64_t BamPipe::Read(char* data, const unsigned int numBytes) {
+    const int64_t numBytesRead = ILocalIODevice::Read(data, numBytes);
+    if ( numBytesRead > 0 )
+        m_position += numBytesRead;
+    return numBytesRead;
+}
+
 bool BamPipe::Seek(const int64_t&, const int) {
     SetErrorString("BamPipe::Seek", "random access not allowed in FIFO pipe");
     return false;
 }
+
+int64_t BamPipe::Tell(void) const {
+    return m_position;
+}
+
+int64_t BamPipe::Write(const char* data, const unsigned int numBytes) {
+    const int64_t numBytesWritten = ILocalIODevice::Write(data, numBytes);
+    if ( numBytesWritten > 0 )
+        m_position += numBytesWritten;
+    return numBytesWritten;
+}
@@ -37,7 +37,14 @@ class BamPipe : public ILocalIODevice {
     public:
         bool IsRandomAccess(void) const;
         bool Open(const IBamIODevice::OpenMode mode);
+        int64_t Read(char* data, const unsigned int numBytes);
         bool Seek(const int64_t& position, const int origin = SEEK_SET);
+        int64_t Tell(void) const;
+        int64_t Write(const char* data, const unsigned int numBytes);
+
+    // data members
+    private:
+        int64_t m_position;     // bytes read or written so far (pipes cannot tell their position)
 };
 
 } // namespace Internal
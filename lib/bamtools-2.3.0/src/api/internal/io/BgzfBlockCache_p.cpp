@@ -0,0 +1,157 @@
+// ***************************************************************************
+// BgzfBlockCache_p.cpp
+// ---------------------------------------------------------------------------
+// Provides a process-wide, thread-safe LRU cache of decompressed BGZF blocks,
+// keyed by (file, compressed block offset), shared by every BgzfStream
+// ***************************************************************************
+
+#include "api/internal/io/BgzfBlockCache_p.h"
+using namespace BamTools;
+using namespace BamTools::Internal;
+
+#include <cstring>
+using namespace std;
+
+// bookkeeping memory of a cached block (list node, index node & vector header)
+static const uint64_t ENTRY_OVERHEAD = 128;
+
+BgzfBlockCache& BgzfBlockCache::Instance(void) {
+    static BgzfBlockCache cache;
+    return cache;
+}
+
+BgzfBlockCache::BgzfBlockCache(void)
+    : m_capacity(0)
+{
+    for ( size_t i = 0; i < SHARDS; ++i ) {
+        pthread_mutex_init(&m_shards[i].Mutex, NULL);
+        m_shards[i].Bytes     = 0;
+        m_shards[i].Capacity  = 0;
+        m_shards[i].Hits      = 0;
+        m_shards[i].Misses    = 0;
+        m_shards[i].Evictions = 0;
+    }
+    pthread_mutex_init(&m_filesMutex, NULL);
+}
+
+BgzfBlockCache::~BgzfBlockCache(void) {
+    for ( size_t i = 0; i < SHARDS; ++i )
+        pthread_mutex_destroy(&m_shards[i].Mutex);
+    pthread_mutex_destroy(&m_filesMutex);
+}
+
+void BgzfBlockCache::SetCapacity(const uint64_t bytes) {
+
+    m_capacity = bytes;
+
+    for ( size_t i = 0; i < SHARDS; ++i ) {
+        Shard& shard = m_shards[i];
+        pthread_mutex_lock(&shard.Mutex);
+        shard.Capacity = bytes / SHARDS;
+        Evict(shard);
+        pthread_mutex_unlock(&shard.Mutex);
+    }
+}
+
+uint32_t BgzfBlockCache::FileId(const string& filename) {
+
+    pthread_mutex_lock(&m_filesMutex);
+    map<string, uint32_t>::iterator it = m_files.find(filename);
+    if ( it == m_files.end() )
+        it = m_files.insert( make_pair(filename, static_cast<uint32_t>(m_files.size())) ).first;
+    const uint32_t id = it->second;
+    pthread_mutex_unlock(&m_filesMutex);
+
+    return id;
+}
+
+BgzfBlockCache::Shard& BgzfBlockCache::ShardOf(const Key& key) {
+    const uint64_t h = ( static_cast<uint64_t>(key.Address) ^ (static_cast<uint64_t>(key.File) << 48) ) * 0x9E3779B97F4A7C15ULL;
+    return m_shards[ h >> 60 ];
+}
+
+// drops least recently used blocks until the shard fits its capacity
+void BgzfBlockCache::Evict(Shard& shard) {
+    while ( shard.Bytes > shard.Capacity && !shard.Entries.empty() ) {
+        const Entry& last = shard.Entries.back();
+        shard.Bytes -= last.Data.size() + ENTRY_OVERHEAD;
+        shard.Index.erase(last.Id);
+        shard.Entries.pop_back();
+        ++shard.Evictions;
+    }
+}
+
+bool BgzfBlockCache::Lookup(const uint32_t file, const int64_t address,
+                            char* data, size_t& length, int64_t& nextAddress)
+{
+    Key key;
+    key.File    = file;
+    key.Address = address;
+
+    Shard& shard = ShardOf(key);
+    pthread_mutex_lock(&shard.Mutex);
+
+    map<Key, EntryList::iterator>::iterator it = shard.Index.find(key);
+    if ( it == shard.Index.end() ) {
+        ++shard.Misses;
+        pthread_mutex_unlock(&shard.Mutex);
+        return false;
+    }
+
+    // move block to the front of the LRU list
+    shard.Entries.splice(shard.Entries.begin(), shard.Entries, it->second);
+
+    const Entry& entry = *(it->second);
+    length = entry.Data.size();
+    nextAddress = entry.NextAddress;
+    if ( length > 0 )
+        memcpy(data, &entry.Data[0], length);
+    ++shard.Hits;
+
+    pthread_mutex_unlock(&shard.Mutex);
+    return true;
+}
+
+void BgzfBlockCache::Insert(const uint32_t file, const int64_t address,
+                            const char* data, const size_t length, const int64_t nextAddress)
+{
+    Key key;
+    key.File    = file;
+    key.Address = address;
+
+    Shard& shard = ShardOf(key);
+    pthread_mutex_lock(&shard.Mutex);
+
+    // skip blocks already cached (e.g. by another reader) or larger than the shard
+    if ( shard.Index.find(key) != shard.Index.end() || length + ENTRY_OVERHEAD > shard.Capacity ) {
+        pthread_mutex_unlock(&shard.Mutex);
+        return;
+    }
+
+    shard.Entries.push_front(Entry());
+    Entry& entry = shard.Entries.front();
+    entry.Id = key;
+    entry.NextAddress = nextAddress;
+    entry.Data.assign(data, data + length);
+
+    shard.Index[key] = shard.Entries.begin();
+    shard.Bytes += length + ENTRY_OVERHEAD;
+    Evict(shard);
+
+    pthread_mutex_unlock(&shard.Mutex);
+}
+
+void BgzfBlockCache::GetStatistics(uint64_t& hits, uint64_t& misses, uint64_t& evictions, uint64_t& bytes) const {
+
+    hits = misses = evictions = bytes = 0;
+
+    for ( size_t i = 0; i < SHARDS; ++i ) {
+        const Shard& shard = m_shards[i];
+        pthread_mutex_lock(&shard.Mutex);
+        hits      += shard.Hits;
+        misses    += shard.Misses;
+        evictions += shard.Evictions;
+        bytes     += shard.Bytes;
+        pthread_mutex_unlock(&shard.Mutex);
+    }
+}
@@ -0,0 +1,110 @@
+// ***************************************************************************
+// BgzfBlockCache_p.h
+// ---------------------------------------------------------------------------
+// Provides a process-wide, thread-safe LRU cache of decompressed BGZF blocks,
+// keyed by (file, compressed block offset), shared by every BgzfStream
+// ***************************************************************************
+
+#ifndef BGZFBLOCKCACHE_P_H
+#define BGZFBLOCKCACHE_P_H
+
+//  -------------
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the BamTools API.  It exists purely as an
+// implementation detail. This header file may change from version to version
+// without notice, or even be removed.
+//
+// We mean it.
+
+#include "api/api_global.h"
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+#include <pthread.h>
+
+namespace BamTools {
+namespace Internal {
+
+class BgzfBlockCache {
+
+    // singleton access
+    public:
+        static BgzfBlockCache& Instance(void);
+
+    // main interface methods
+    public:
+        // sets the memory budget (bytes) of the cache; 0 disables it and drops every block
+        void SetCapacity(const uint64_t bytes);
+        // returns true if blocks are cached
+        bool IsEnabled(void) const { return m_capacity > 0; }
+
+        // returns the identifier of a file in cache keys
+        uint32_t FileId(const std::string& filename);
+
+        // looks a block up, copying its decompressed data in data (BGZF_DEFAULT_BLOCK_SIZE bytes)
+        // returns false if the block is not cached
+        bool Lookup(const uint32_t file, const int64_t address,
+                    char* data, size_t& length, int64_t& nextAddress);
+        // stores a decompressed block (evicting the least recently used ones beyond capacity)
+        void Insert(const uint32_t file, const int64_t address,
+                    const char* data, const size_t length, const int64_t nextAddress);
+
+        // retrieves cache counters
+        void GetStatistics(uint64_t& hits, uint64_t& misses, uint64_t& evictions, uint64_t& bytes) const;
+
+    // internal types
+    private:
+        struct Key {
+            uint32_t File;
+            int64_t  Address;
+
+            bool operator<(const Key& other) const {
+                return ( File < other.File || (File == other.File && Address < other.Address) );
+            }
+        };
+
+        struct Entry {
+            Key Id;
+            int64_t NextAddress;
+            std::vector<char> Data;
+        };
+
+        typedef std::list<Entry> EntryList;  // most recently used first
+
+        struct Shard {
+            mutable pthread_mutex_t Mutex;
+            EntryList Entries;
+            std::map<Key, EntryList::iterator> Index;
+            uint64_t Bytes;
+            uint64_t Capacity;
+            uint64_t Hits;
+            uint64_t Misses;
+            uint64_t Evictions;
+        };
+
+        static const size_t SHARDS = 16;
+
+    // internal methods
+    private:
+        BgzfBlockCache(void);
+        ~BgzfBlockCache(void);
+
+        Shard& ShardOf(const Key& key);
+        static void Evict(Shard& shard);
+
+    // data members
+    private:
+        volatile uint64_t m_capacity;
+        Shard m_shards[SHARDS];
+
+        pthread_mutex_t m_filesMutex;
+        std::map<std::string, uint32_t> m_files;
+};
+
+} // namespace Internal
+} // namespace BamTools
+
+#endif // BGZFBLOCKCACHE_P_H
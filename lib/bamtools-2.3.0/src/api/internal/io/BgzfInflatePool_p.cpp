@@ -0,0 +1,226 @@
+// ***************************************************************************
+// BgzfInflatePool_p.cpp
+// ---------------------------------------------------------------------------
+// Provides a pool of worker threads that decompress BGZF blocks read ahead
+// of the consumer. Blocks are kept in a ring and handed back in file order.
+// ***************************************************************************
+
+#include "api/BamConstants.h"
+#include "api/internal/io/BgzfInflatePool_p.h"
+#include "api/internal/io/BgzfInflater_p.h"
+#include "api/internal/utils/BamException_p.h"
+using namespace BamTools;
+using namespace BamTools::Internal;
+
+using namespace std;
+
+static const size_t WORKER_STACK_SIZE = 256 * 1024;
+
+// ---------------------------------
+// BgzfInflatePool implementation
+// ---------------------------------
+
+BgzfInflatePool::Block::Block(void)
+    : Compressed(Constants::BGZF_MAX_BLOCK_SIZE)
+    , CompressedData(0)
+    , Uncompressed(Constants::BGZF_DEFAULT_BLOCK_SIZE)
+    , CompressedLength(0)
+    , Length(0)
+    , Address(0)
+    , NextAddress(0)
+    , IsEof(false)
+    , IsDone(true)
+    , IsCached(false)
+{ }
+
+// constructor
+BgzfInflatePool::BgzfInflatePool(const int numThreads, const int readAhead, const bool checkCrc)
+    : m_head(0)
+    , m_count(0)
+    , m_nextInflater(0)
+    , m_jobHead(0)
+    , m_jobCount(0)
+    , m_running(0)
+    , m_stop(false)
+{
+    BT_ASSERT_X( (numThreads > 0 && readAhead > 0), "BgzfInflatePool - invalid number of threads or blocks" );
+
+    pthread_mutex_init(&m_mutex, NULL);
+    pthread_cond_init(&m_jobReady, NULL);
+    pthread_cond_init(&m_jobDone, NULL);
+
+    m_blocks.resize(readAhead);
+    m_jobs.resize(readAhead);
+    for ( int i = 0; i < readAhead; ++i )
+        m_blocks[i] = new Block;
+
+    // inflaters are set up here, so that workers never allocate memory
+    m_inflaters.resize(numThreads);
+    for ( int i = 0; i < numThreads; ++i ) {
+        m_inflaters[i] = BgzfInflater::Create();
+        m_inflaters[i]->SetCheckCrc(checkCrc);
+    }
+
+    // workers only run the inflater, which keeps its state on the heap
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, WORKER_STACK_SIZE);
+
+    m_threads.reserve(numThreads);
+    for ( int i = 0; i < numThreads; ++i ) {
+        pthread_t thread;
+        if ( pthread_create(&thread, &attr, BgzfInflatePool::WorkerMain, this) != 0 )
+            break;
+        m_threads.push_back(thread);
+    }
+
+    pthread_attr_destroy(&attr);
+
+    if ( m_threads.empty() )
+        throw BamException("BgzfInflatePool", "could not start decompression threads");
+}
+
+// destructor
+BgzfInflatePool::~BgzfInflatePool(void) {
+
+    Clear();
+
+    pthread_mutex_lock(&m_mutex);
+    m_stop = true;
+    pthread_cond_broadcast(&m_jobReady);
+    pthread_mutex_unlock(&m_mutex);
+
+    for ( size_t i = 0; i < m_threads.size(); ++i )
+        pthread_join(m_threads[i], NULL);
+
+    for ( size_t i = 0; i < m_blocks.size(); ++i )
+        delete m_blocks[i];
+    for ( size_t i = 0; i < m_inflaters.size(); ++i )
+        delete m_inflaters[i];
+
+    pthread_cond_destroy(&m_jobDone);
+    pthread_cond_destroy(&m_jobReady);
+    pthread_mutex_destroy(&m_mutex);
+}
+
+BgzfInflatePool::Block* BgzfInflatePool::Back(void) {
+    BT_ASSERT_X( (m_count < m_blocks.size()), "BgzfInflatePool::Back() - read-ahead ring is full" );
+    Block* block = m_blocks[(m_head + m_count) % m_blocks.size()];
+    block->IsEof = false;
+    block->IsCached = false;
+    block->Error.clear();
+    return block;
+}
+
+void BgzfInflatePool::Push(void) {
+
+    BT_ASSERT_X( (m_count < m_blocks.size()), "BgzfInflatePool::Push() - read-ahead ring is full" );
+    Block* block = m_blocks[(m_head + m_count) % m_blocks.size()];
+    ++m_count;
+
+    // nothing to decompress
+    if ( block->IsCached ) {
+        block->IsDone = true;
+        return;
+    }
+    if ( block->IsEof || !block->Error.empty() ) {
+        block->Length = 0;
+        block->IsDone = true;
+        return;
+    }
+
+    pthread_mutex_lock(&m_mutex);
+    block->IsDone = false;
+    m_jobs[(m_jobHead + m_jobCount) % m_jobs.size()] = block;
+    ++m_jobCount;
+    pthread_cond_signal(&m_jobReady);
+    pthread_mutex_unlock(&m_mutex);
+}
+
+BgzfInflatePool::Block* BgzfInflatePool::WaitFront(void) {
+
+    BT_ASSERT_X( (m_count > 0), "BgzfInflatePool::WaitFront() - read-ahead ring is empty" );
+    Block* block = m_blocks[m_head];
+
+    pthread_mutex_lock(&m_mutex);
+    while ( !block->IsDone )
+        pthread_cond_wait(&m_jobDone, &m_mutex);
+    pthread_mutex_unlock(&m_mutex);
+
+    return block;
+}
+
+size_t BgzfInflatePool::Find(const int64_t& address) const {
+    for ( size_t i = 0; i < m_count; ++i ) {
+        if ( m_blocks[(m_head + i) % m_blocks.size()]->Address == address )
+            return i;
+    }
+    return m_count;
+}
+
+void BgzfInflatePool::Pop(void) {
+    BT_ASSERT_X( (m_count > 0), "BgzfInflatePool::Pop() - read-ahead ring is empty" );
+    m_head = (m_head + 1) % m_blocks.size();
+    --m_count;
+}
+
+void BgzfInflatePool::Clear(void) {
+
+    // drop queued blocks and wait for the ones being decompressed
+    pthread_mutex_lock(&m_mutex);
+    m_jobHead  = 0;
+    m_jobCount = 0;
+    while ( m_running > 0 )
+        pthread_cond_wait(&m_jobDone, &m_mutex);
+    pthread_mutex_unlock(&m_mutex);
+
+    for ( size_t i = 0; i < m_blocks.size(); ++i )
+        m_blocks[i]->IsDone = true;
+
+    m_head  = 0;
+    m_count = 0;
+}
+
+void* BgzfInflatePool::WorkerMain(void* pool) {
+    static_cast<BgzfInflatePool*>(pool)->Work();
+    return NULL;
+}
+
+void BgzfInflatePool::Work(void) {
+
+    pthread_mutex_lock(&m_mutex);
+
+    // each worker takes its own inflater
+    BgzfInflater* inflater = m_inflaters[m_nextInflater++];
+
+    while ( true ) {
+
+        while ( !m_stop && m_jobCount == 0 )
+            pthread_cond_wait(&m_jobReady, &m_mutex);
+        if ( m_stop )
+            break;
+
+        Block* block = m_jobs[m_jobHead];
+        m_jobHead = (m_jobHead + 1) % m_jobs.size();
+        --m_jobCount;
+        ++m_running;
+        pthread_mutex_unlock(&m_mutex);
+
+        // decompress outside the lock
+        try {
+            block->Length = inflater->InflateBlock(block->CompressedData,
+                                                   block->CompressedLength,
+                                                   block->Uncompressed.Buffer);
+        } catch ( BamException& e ) {
+            block->Length = 0;
+            block->Error  = e.what();
+        }
+
+        pthread_mutex_lock(&m_mutex);
+        block->IsDone = true;
+        --m_running;
+        pthread_cond_broadcast(&m_jobDone);
+    }
+
+    pthread_mutex_unlock(&m_mutex);
+}
@@ -0,0 +1,108 @@
+// ***************************************************************************
+// BgzfInflatePool_p.h
+// ---------------------------------------------------------------------------
+// Provides a pool of worker threads that decompress BGZF blocks read ahead
+// of the consumer. Blocks are kept in a ring and handed back in file order.
+// ***************************************************************************
+
+#ifndef BGZFINFLATEPOOL_P_H
+#define BGZFINFLATEPOOL_P_H
+
+//  -------------
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the BamTools API.  It exists purely as an
+// implementation detail. This header file may change from version to version
+// without notice, or even be removed.
+//
+// We mean it.
+
+#include "api/api_global.h"
+#include "api/BamAux.h"
+#include <string>
+#include <vector>
+#include <pthread.h>
+
+namespace BamTools {
+namespace Internal {
+
+class BgzfInflater;
+
+class BgzfInflatePool {
+
+    // read-ahead block
+    public:
+        struct Block {
+
+            RaiiBuffer Compressed;
+            const char* CompressedData; // compressed block (in Compressed, or in a memory-mapped file)
+            RaiiBuffer Uncompressed;
+            size_t  CompressedLength;   // length of the compressed block
+            size_t  Length;             // length of the decompressed data
+            int64_t Address;            // file offset of the block
+            int64_t NextAddress;        // file offset of the following block
+            bool IsEof;                 // no block could be read (end of file)
+            bool IsDone;                // decompression is finished
+            bool IsCached;              // decompressed data has been taken from the block cache
+            std::string Error;          // non-empty if the block could not be read/decompressed
+
+            Block(void);
+        };
+
+    // constructor & destructor
+    public:
+        BgzfInflatePool(const int numThreads, const int readAhead, const bool checkCrc);
+        ~BgzfInflatePool(void);
+
+    // main interface methods
+    public:
+        // returns the number of blocks in the ring
+        size_t Count(void) const { return m_count; }
+        // returns the maximum number of blocks in the ring
+        size_t Capacity(void) const { return m_blocks.size(); }
+        // returns the number of worker threads
+        int NumThreads(void) const { return m_threads.size(); }
+
+        // returns the free block at the end of the ring (ring must not be full)
+        Block* Back(void);
+        // appends the back block to the ring, queueing it for decompression if needed
+        void Push(void);
+        // waits until the first block of the ring is decompressed, and returns it (ring must not be empty)
+        Block* WaitFront(void);
+        // returns the position in the ring of the block at a file offset (Count() if not found)
+        size_t Find(const int64_t& address) const;
+        // removes the first block from the ring
+        void Pop(void);
+        // drops every block of the ring, waiting for running decompressions
+        void Clear(void);
+
+    // internal methods
+    private:
+        static void* WorkerMain(void* pool);
+        void Work(void);
+
+    // data members
+    private:
+        std::vector<Block*> m_blocks;
+        size_t m_head;
+        size_t m_count;
+
+        std::vector<pthread_t> m_threads;
+        std::vector<BgzfInflater*> m_inflaters;    // one for each thread
+        size_t m_nextInflater;                      // next inflater to be taken by a starting thread
+        std::vector<Block*> m_jobs;     // circular queue of blocks to be decompressed (no allocations)
+        size_t m_jobHead;
+        size_t m_jobCount;
+        int  m_running;
+        bool m_stop;
+
+        pthread_mutex_t m_mutex;
+        pthread_cond_t  m_jobReady;
+        pthread_cond_t  m_jobDone;
+};
+
+} // namespace Internal
+} // namespace BamTools
+
+#endif // BGZFINFLATEPOOL_P_H
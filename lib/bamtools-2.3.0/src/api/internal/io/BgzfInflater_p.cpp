@@ -0,0 +1,186 @@
+// ***************************************************************************
+// BgzfInflater_p.cpp
+// ---------------------------------------------------------------------------
+// Provides the decompression of BGZF blocks. The DEFLATE implementation is a
+// backend: zlib (always available) or libdeflate (when built with
+// BAMTOOLS_USE_LIBDEFLATE). Backends keep their state between blocks.
+// ***************************************************************************
+
+#include "api/BamAux.h"
+#include "api/BamConstants.h"
+#include "api/internal/io/BgzfInflater_p.h"
+#include "api/internal/utils/BamException_p.h"
+using namespace BamTools;
+using namespace BamTools::Internal;
+
+#include "zlib.h"
+#ifdef BAMTOOLS_USE_LIBDEFLATE
+#include "libdeflate.h"
+#endif
+
+#include <sstream>
+using namespace std;
+
+namespace BamTools {
+namespace Internal {
+
+// -------------------------------
+// zlib backend
+// -------------------------------
+
+class ZlibInflater : public BgzfInflater {
+
+    public:
+        ZlibInflater(void) {
+            m_stream.zalloc   = NULL;
+            m_stream.zfree    = NULL;
+            m_stream.opaque   = NULL;
+            m_stream.next_in  = NULL;
+            m_stream.avail_in = 0;
+
+            // state is allocated once, and reset between blocks
+            if ( inflateInit2(&m_stream, Constants::GZIP_WINDOW_BITS) != Z_OK )
+                throw BamException("BgzfInflater", "zlib inflateInit failed");
+        }
+
+        ~ZlibInflater(void) {
+            inflateEnd(&m_stream);
+        }
+
+        const char* Name(void) const { return "zlib"; }
+
+    protected:
+        size_t Inflate(const char* data, const size_t dataLength, char* output, const size_t outputLength) {
+
+            if ( inflateReset(&m_stream) != Z_OK )
+                throw BamException("BgzfStream::InflateBlock", "zlib inflateReset failed");
+
+            m_stream.next_in   = (Bytef*)data;
+            m_stream.avail_in  = dataLength;
+            m_stream.next_out  = (Bytef*)output;
+            m_stream.avail_out = outputLength;
+
+            if ( inflate(&m_stream, Z_FINISH) != Z_STREAM_END )
+                throw BamException("BgzfStream::InflateBlock", "zlib inflate failed");
+
+            return m_stream.total_out;
+        }
+
+    private:
+        z_stream m_stream;
+};
+
+// -------------------------------
+// libdeflate backend
+// -------------------------------
+
+#ifdef BAMTOOLS_USE_LIBDEFLATE
+
+class LibdeflateInflater : public BgzfInflater {
+
+    public:
+        LibdeflateInflater(void)
+            : m_decompressor( libdeflate_alloc_decompressor() )
+        {
+            if ( m_decompressor == 0 )
+                throw BamException("BgzfInflater", "libdeflate_alloc_decompressor failed");
+        }
+
+        ~LibdeflateInflater(void) {
+            libdeflate_free_decompressor(m_decompressor);
+        }
+
+        const char* Name(void) const { return "libdeflate"; }
+
+    protected:
+        size_t Inflate(const char* data, const size_t dataLength, char* output, const size_t outputLength) {
+
+            size_t length = 0;
+            const libdeflate_result result =
+                libdeflate_deflate_decompress(m_decompressor, data, dataLength, output, outputLength, &length);
+            if ( result != LIBDEFLATE_SUCCESS )
+                throw BamException("BgzfStream::InflateBlock", "libdeflate decompression failed");
+
+            return length;
+        }
+
+    private:
+        libdeflate_decompressor* m_decompressor;
+};
+
+#endif // BAMTOOLS_USE_LIBDEFLATE
+
+} // namespace Internal
+} // namespace BamTools
+
+// -------------------------------
+// BgzfInflater implementation
+// -------------------------------
+
+BgzfInflater::BgzfInflater(void)
+    : m_isCheckCrc(false)
+{ }
+
+BgzfInflater* BgzfInflater::Create(const Backend backend) {
+    switch ( backend ) {
+        case ( ZLIB ) :
+            return new ZlibInflater;
+#ifdef BAMTOOLS_USE_LIBDEFLATE
+        case ( LIBDEFLATE ) :
+            return new LibdeflateInflater;
+#endif
+        default :
+            throw BamException("BgzfInflater::Create", "requested backend has not been compiled in");
+    }
+}
+
+BgzfInflater::Backend BgzfInflater::DefaultBackend(void) {
+#ifdef BAMTOOLS_USE_LIBDEFLATE
+    return LIBDEFLATE;
+#else
+    return ZLIB;
+#endif
+}
+
+bool BgzfInflater::IsAvailable(const Backend backend) {
+#ifdef BAMTOOLS_USE_LIBDEFLATE
+    return ( backend == ZLIB || backend == LIBDEFLATE );
+#else
+    return ( backend == ZLIB );
+#endif
+}
+
+// decompresses a whole BGZF block
+size_t BgzfInflater::InflateBlock(const char* compressed, const size_t blockLength, char* uncompressed) {
+
+    if ( blockLength <= static_cast<size_t>(Constants::BGZF_BLOCK_HEADER_LENGTH + Constants::BGZF_BLOCK_FOOTER_LENGTH) )
+        throw BamException("BgzfStream::InflateBlock", "invalid block length");
+
+    const size_t dataLength = blockLength
+                            - Constants::BGZF_BLOCK_HEADER_LENGTH
+                            - Constants::BGZF_BLOCK_FOOTER_LENGTH;
+
+    const size_t length = Inflate(compressed + Constants::BGZF_BLOCK_HEADER_LENGTH, dataLength,
+                                  uncompressed, Constants::BGZF_DEFAULT_BLOCK_SIZE);
+
+    // check decompressed data against block's footer
+    if ( m_isCheckCrc ) {
+
+        const char* footer = compressed + blockLength - Constants::BGZF_BLOCK_FOOTER_LENGTH;
+        const uint32_t expectedCrc    = BamTools::UnpackUnsignedInt(footer);
+        const uint32_t expectedLength = BamTools::UnpackUnsignedInt(footer + 4);
+
+        if ( expectedLength != length ) {
+            stringstream s("");
+            s << "decompressed " << length << " bytes, block footer declares " << expectedLength;
+            throw BamException("BgzfStream::InflateBlock", s.str());
+        }
+
+        uint32_t crc = crc32(0, NULL, 0);
+        crc = crc32(crc, (const Bytef*)uncompressed, length);
+        if ( crc != expectedCrc )
+            throw BamException("BgzfStream::InflateBlock", "CRC32 mismatch in decompressed block");
+    }
+
+    return length;
+}
@@ -0,0 +1,75 @@
+// ***************************************************************************
+// BgzfInflater_p.h
+// ---------------------------------------------------------------------------
+// Provides the decompression of BGZF blocks. The DEFLATE implementation is a
+// backend: zlib (always available) or libdeflate (when built with
+// BAMTOOLS_USE_LIBDEFLATE). Backends keep their state between blocks.
+// ***************************************************************************
+
+#ifndef BGZFINFLATER_P_H
+#define BGZFINFLATER_P_H
+
+//  -------------
+//  W A R N I N G
+//  -------------
+//
+// This file is not part of the BamTools API.  It exists purely as an
+// implementation detail. This header file may change from version to version
+// without notice, or even be removed.
+//
+// We mean it.
+
+#include "api/api_global.h"
+#include <cstddef>
+
+namespace BamTools {
+namespace Internal {
+
+class BgzfInflater {
+
+    // enums
+    public:
+        enum Backend { ZLIB = 0
+                     , LIBDEFLATE
+                     };
+
+    // constructor & destructor
+    public:
+        BgzfInflater(void);
+        virtual ~BgzfInflater(void) { }
+
+    // main interface methods
+    public:
+        // decompresses a whole BGZF block (header included) into uncompressed,
+        // which must hold BGZF_DEFAULT_BLOCK_SIZE bytes; returns the length of decompressed data
+        size_t InflateBlock(const char* compressed, const size_t blockLength, char* uncompressed);
+        // enables/disables the check of decompressed data against block's CRC32 & length
+        void SetCheckCrc(bool ok) { m_isCheckCrc = ok; }
+        bool IsCheckCrc(void) const { return m_isCheckCrc; }
+        // returns the name of the backend
+        virtual const char* Name(void) const = 0;
+
+    // backend interface
+    protected:
+        // decompresses raw DEFLATE data, returns the length of decompressed data
+        virtual size_t Inflate(const char* data, const size_t dataLength,
+                               char* output, const size_t outputLength) = 0;
+
+    // static 'utility' methods
+    public:
+        // creates an inflater using the given backend
+        static BgzfInflater* Create(const Backend backend = DefaultBackend());
+        // returns the backend used by default (the fastest one available)
+        static Backend DefaultBackend(void);
+        // returns true if the backend has been compiled in
+        static bool IsAvailable(const Backend backend);
+
+    // data members
+    private:
+        bool m_isCheckCrc;
+};
+
+} // namespace Internal
+} // namespace BamTools
+
+#endif // BGZFINFLATER_P_H
@@ -12,6 +12,11 @@
 #include "api/BamAux.h"
 #include "api/BamConstants.h"
 #include "api/internal/io/BamDeviceFactory_p.h"
+#include "api/internal/io/BamFile_p.h"
+#include "api/internal/io/BamMappedFile_p.h"
+#include "api/internal/io/BgzfBlockCache_p.h"
+#include "api/internal/io/BgzfInflatePool_p.h"
+#include "api/internal/io/BgzfInflater_p.h"
 #include "api/internal/io/BgzfStream_p.h"
 #include "api/internal/utils/BamException_p.h"
 using namespace BamTools;
@@ -34,15 +39,27 @@ BgzfStream::BgzfStream(void)
   : m_blockLength(0)
   , m_blockOffset(0)
   , m_blockAddress(0)
+  , m_nextBlockAddress(0)
   , m_isWriteCompressed(true)
   , m_device(0)
+  , m_mappedFile(0)
+  , m_cacheFileId(0)
+  , m_pendingPosition(-1)
   , m_uncompressedBlock(Constants::BGZF_DEFAULT_BLOCK_SIZE)
   , m_compressedBlock(Constants::BGZF_MAX_BLOCK_SIZE)
+  , m_inflater(0)
+  , m_isCheckCrc(false)
+  , m_numThreads(0)
+  , m_inflatePool(0)
+  , m_readAheadLimit(1)
+  , m_isReadAheadDone(false)
 { }
 
 // destructor
 BgzfStream::~BgzfStream(void) {
     Close();
+    delete m_inflatePool;
+    delete m_inflater;
 }
 
 // checks BGZF block header
@@ -71,10 +88,18 @@ void BgzfStream::Close(void) {
         m_device->Write(m_compressedBlock.Buffer, blockLength);
     }
 
+    // stop decompressing blocks read ahead (threads are kept for the next file)
+    if ( m_inflatePool )
+        m_inflatePool->Clear();
+    m_readAheadLimit  = 1;
+    m_isReadAheadDone = false;
+
     // close device
     m_device->Close();
     delete m_device;
     m_device = 0;
+    m_mappedFile = 0;
+    m_pendingPosition = -1;
 
     // ensure our buffers are cleared out
     m_uncompressedBlock.Clear();
@@ -84,6 +109,7 @@ void BgzfStream::Close(void) {
     m_blockLength = 0;
     m_blockOffset = 0;
     m_blockAddress = 0;
+    m_nextBlockAddress = 0;
     m_isWriteCompressed = true;
 }
 
@@ -227,41 +253,6 @@ void BgzfStream::FlushBlock(void) {
     }
 }
 
-// decompresses the current block
-size_t BgzfStream::InflateBlock(const size_t& blockLength) {
-
-    // setup zlib stream object
-    z_stream zs;
-    zs.zalloc    = NULL;
-    zs.zfree     = NULL;
-    zs.next_in   = (Bytef*)m_compressedBlock.Buffer + 18;
-    zs.avail_in  = blockLength - 16;
-    zs.next_out  = (Bytef*)m_uncompressedBlock.Buffer;
-    zs.avail_out = Constants::BGZF_DEFAULT_BLOCK_SIZE;
-
-    // initialize
-    int status = inflateInit2(&zs, Constants::GZIP_WINDOW_BITS);
-    if ( status != Z_OK )
-        throw BamException("BgzfStream::InflateBlock", "zlib inflateInit failed");
-
-    // decompress
-    status = inflate(&zs, Z_FINISH);
-    if ( status != Z_STREAM_END ) {
-        inflateEnd(&zs);
-        throw BamException("BgzfStream::InflateBlock", "zlib inflate failed");
-    }
-
-    // finalize
-    status = inflateEnd(&zs);
-    if ( status != Z_OK ) {
-        inflateEnd(&zs);
-        throw BamException("BgzfStream::InflateBlock", "zlib inflateEnd failed");
-    }
-
-    // return result
-    return zs.total_out;
-}
-
 bool BgzfStream::IsOpen(void) const {
     if ( m_device == 0 )
         return false;
@@ -275,15 +266,51 @@ void BgzfStream::Open(const string& filename, const IBamIODevice::OpenMode mode)
     BT_ASSERT_X( (m_device == 0), "BgzfStream::Open() - unable to properly close previous IO device" );
 
     // retrieve new IO device depending on filename
-    m_device = BamDeviceFactory::CreateDevice(filename);
+    m_device = BamDeviceFactory::CreateDevice(filename, mode);
     BT_ASSERT_X( m_device, "BgzfStream::Open() - unable to create IO device from filename" );
 
+    // compressed blocks of memory-mapped files are used in place
+    m_mappedFile = dynamic_cast<BamMappedFile*>(m_device);
+
+    // files that cannot be mapped (e.g. named pipes) are read as usual
+    if ( m_mappedFile && !m_mappedFile->Open(mode) ) {
+        delete m_device;
+        m_device = new BamFile(filename);
+        m_mappedFile = 0;
+    }
+
     // if device fails to open
-    if ( !m_device->Open(mode) ) {
+    if ( !m_device->IsOpen() && !m_device->Open(mode) ) {
         const string deviceError = m_device->GetErrorString();
         const string message = string("could not open BGZF stream: \n\t") + deviceError;
         throw BamException("BgzfStream::Open", message);
     }
+
+    // identifies the file in the shared block cache
+    if ( mode == IBamIODevice::ReadOnly )
+        m_cacheFileId = BgzfBlockCache::Instance().FileId(filename);
+}
+
+// opens, for reading, the same file as another stream: the memory mapping of
+// the file is shared, while device position and buffers are this stream's own
+void BgzfStream::OpenClone(const BgzfStream& other, const string& filename) {
+
+    if ( !other.IsOpen() || other.m_device->Mode() != IBamIODevice::ReadOnly || !other.m_device->IsRandomAccess() )
+        throw BamException("BgzfStream::OpenClone", "only random-access files opened for reading can be cloned");
+
+    // same decompression settings (applied while closed, nothing to reset)
+    Close();
+    SetCheckCrc(other.m_isCheckCrc);
+    SetThreads(other.m_numThreads);
+
+    if ( other.m_mappedFile == 0 ) {
+        Open(filename, IBamIODevice::ReadOnly);
+        return;
+    }
+
+    m_mappedFile = other.m_mappedFile->Clone();
+    m_device = m_mappedFile;
+    m_cacheFileId = other.m_cacheFileId;
 }
 
 // reads BGZF data into a byte buffer
@@ -325,7 +352,7 @@ size_t BgzfStream::Read(char* data, const size_t dataLength) {
 
     // update block data
     if ( m_blockOffset == m_blockLength ) {
-        m_blockAddress = m_device->Tell();
+        m_blockAddress = m_nextBlockAddress;
         m_blockOffset  = 0;
         m_blockLength  = 0;
     }
@@ -334,13 +361,14 @@ size_t BgzfStream::Read(char* data, const size_t dataLength) {
     return numBytesRead;
 }
 
-// reads a BGZF block
-void BgzfStream::ReadBlock(void) {
+// reads the next compressed block from device into buffer
+// (blocks of memory-mapped files are not copied: a pointer to the mapping is returned)
+// returns the compressed block, or 0 if there is no block left
+const char* BgzfStream::ReadCompressedBlock(char* buffer, size_t& blockLength) {
 
-    BT_ASSERT_X( m_device, "BgzfStream::ReadBlock() - trying to read from null IO device");
-
-    // store block's starting address
-    const int64_t blockAddress = m_device->Tell();
+    // memory-mapped file
+    if ( m_mappedFile )
+        return MapCompressedBlock(blockLength);
 
     // read block header from file
     char header[Constants::BGZF_BLOCK_HEADER_LENGTH];
@@ -353,10 +381,8 @@ void BgzfStream::ReadBlock(void) {
     }
 
     // if block header empty
-    if ( numBytesRead == 0 ) {
-        m_blockLength = 0;
-        return;
-    }
+    if ( numBytesRead == 0 )
+        return 0;
 
     // if block header invalid size
     if ( numBytesRead != static_cast<int8_t>(Constants::BGZF_BLOCK_HEADER_LENGTH) )
@@ -367,12 +393,12 @@ void BgzfStream::ReadBlock(void) {
         throw BamException("BgzfStream::ReadBlock", "invalid block header contents");
 
     // copy header contents to compressed buffer
-    const size_t blockLength = BamTools::UnpackUnsignedShort(&header[16]) + 1;
-    memcpy(m_compressedBlock.Buffer, header, Constants::BGZF_BLOCK_HEADER_LENGTH);
+    blockLength = BamTools::UnpackUnsignedShort(&header[16]) + 1;
+    memcpy(buffer, header, Constants::BGZF_BLOCK_HEADER_LENGTH);
 
     // read remainder of block
     const size_t remaining = blockLength - Constants::BGZF_BLOCK_HEADER_LENGTH;
-    numBytesRead = m_device->Read(&m_compressedBlock.Buffer[Constants::BGZF_BLOCK_HEADER_LENGTH], remaining);
+    numBytesRead = m_device->Read(&buffer[Constants::BGZF_BLOCK_HEADER_LENGTH], remaining);
 
     // check for device error
     if ( numBytesRead < 0 ) {
@@ -384,14 +410,217 @@ void BgzfStream::ReadBlock(void) {
     if ( numBytesRead != static_cast<int64_t>(remaining) )
         throw BamException("BgzfStream::ReadBlock", "could not read data from block");
 
+    return buffer;
+}
+
+// locates the next compressed block in the mapped file, and moves past it
+// returns the compressed block, or 0 if there is no block left
+const char* BgzfStream::MapCompressedBlock(size_t& blockLength) {
+
+    const int64_t position  = m_mappedFile->Tell();
+    const int64_t available = m_mappedFile->Size() - position;
+
+    // end of file
+    if ( available <= 0 )
+        return 0;
+
+    // if block header invalid size
+    if ( available < static_cast<int64_t>(Constants::BGZF_BLOCK_HEADER_LENGTH) )
+        throw BamException("BgzfStream::ReadBlock", "invalid block header size");
+
+    // validate block header contents
+    const char* block = m_mappedFile->Data() + position;
+    if ( !BgzfStream::CheckBlockHeader(const_cast<char*>(block)) )
+        throw BamException("BgzfStream::ReadBlock", "invalid block header contents");
+
+    // check that the whole block is in the file
+    blockLength = BamTools::UnpackUnsignedShort(block + 16) + 1;
+    if ( available < static_cast<int64_t>(blockLength) )
+        throw BamException("BgzfStream::ReadBlock", "could not read data from block");
+
+    m_mappedFile->Seek(position + blockLength);
+    return block;
+}
+
+// reads a BGZF block
+void BgzfStream::ReadBlock(void) {
+
+    BT_ASSERT_X( m_device, "BgzfStream::ReadBlock() - trying to read from null IO device");
+
+    // decompress on worker threads, if requested
+    if ( m_numThreads > 0 ) {
+        ReadBlockFromPool();
+        return;
+    }
+
+    // store block's starting address
+    const int64_t blockAddress = DeviceTell();
+
+    // take block from the shared cache, if there
+    BgzfBlockCache& cache = BgzfBlockCache::Instance();
+    const bool isCached = ( cache.IsEnabled() && m_device->IsRandomAccess() );
+
+    if ( isCached ) {
+        size_t length = 0;
+        int64_t nextAddress = 0;
+        if ( cache.Lookup(m_cacheFileId, blockAddress, m_uncompressedBlock.Buffer, length, nextAddress) ) {
+            if ( m_blockLength != 0 )
+                m_blockOffset = 0;
+            m_blockAddress = blockAddress;
+            m_blockLength  = length;
+            m_nextBlockAddress = nextAddress;
+            m_pendingPosition  = nextAddress; // device is moved when a block is actually read
+            return;
+        }
+    }
+
+    // read compressed block
+    SyncDevicePosition();
+    size_t blockLength = 0;
+    const char* compressed = ReadCompressedBlock(m_compressedBlock.Buffer, blockLength);
+    if ( compressed == 0 ) {
+        m_blockLength = 0;
+        m_nextBlockAddress = blockAddress;
+        return;
+    }
+
     // decompress block data
-    const size_t newBlockLength = InflateBlock(blockLength);
+    if ( m_inflater == 0 ) {
+        m_inflater = BgzfInflater::Create();
+        m_inflater->SetCheckCrc(m_isCheckCrc);
+    }
+    const size_t newBlockLength = m_inflater->InflateBlock(compressed, blockLength, m_uncompressedBlock.Buffer);
 
     // update block data
     if ( m_blockLength != 0 )
         m_blockOffset = 0;
     m_blockAddress = blockAddress;
     m_blockLength  = newBlockLength;
+    m_nextBlockAddress = m_device->Tell();
+
+    if ( isCached )
+        cache.Insert(m_cacheFileId, blockAddress, m_uncompressedBlock.Buffer, m_blockLength, m_nextBlockAddress);
+}
+
+// reads ahead compressed blocks (handing them to decompression threads)
+// and takes the next block, in file order, once it is decompressed
+void BgzfStream::ReadBlockFromPool(void) {
+
+    if ( m_inflatePool == 0 )
+        m_inflatePool = new BgzfInflatePool(m_numThreads, m_numThreads * Constants::BGZF_READ_AHEAD_PER_THREAD, m_isCheckCrc);
+
+    BgzfBlockCache& cache = BgzfBlockCache::Instance();
+    const bool isCached = ( cache.IsEnabled() && m_device->IsRandomAccess() );
+
+    // fill read-ahead ring up to current limit
+    while ( !m_isReadAheadDone && m_inflatePool->Count() < m_readAheadLimit ) {
+
+        BgzfInflatePool::Block* block = m_inflatePool->Back();
+        block->Address = DeviceTell();
+
+        // blocks in the shared cache are not decompressed again
+        if ( isCached && cache.Lookup(m_cacheFileId, block->Address, block->Uncompressed.Buffer,
+                                      block->Length, block->NextAddress) )
+        {
+            block->IsCached   = true;
+            m_pendingPosition = block->NextAddress;
+            m_inflatePool->Push();
+            continue;
+        }
+
+        // read errors are reported when the consumer reaches the block
+        SyncDevicePosition();
+        try {
+            block->CompressedData = ReadCompressedBlock(block->Compressed.Buffer, block->CompressedLength);
+            block->IsEof = ( block->CompressedData == 0 );
+        } catch ( BamException& e ) {
+            block->Error = e.what();
+        }
+
+        block->NextAddress = ( block->Error.empty() ? m_device->Tell() : block->Address );
+        m_isReadAheadDone  = ( block->IsEof || !block->Error.empty() );
+        m_inflatePool->Push();
+    }
+
+    // nothing left to read
+    if ( m_inflatePool->Count() == 0 ) {
+        m_blockLength = 0;
+        return;
+    }
+
+    // sequential reading: read further ahead at next call
+    m_readAheadLimit = min(2 * m_readAheadLimit, m_inflatePool->Capacity());
+
+    // wait for next block
+    BgzfInflatePool::Block* block = m_inflatePool->WaitFront();
+    if ( !block->Error.empty() ) {
+        const string error = block->Error;
+        m_inflatePool->Pop();
+        throw BamException("BgzfStream::ReadBlock", error);
+    }
+
+    if ( block->IsEof ) {
+        m_blockLength = 0;
+        m_nextBlockAddress = block->Address;
+        m_inflatePool->Pop();
+        return;
+    }
+
+    if ( isCached && !block->IsCached )
+        cache.Insert(m_cacheFileId, block->Address, block->Uncompressed.Buffer, block->Length, block->NextAddress);
+
+    // take decompressed data, leaving our buffer to the pool
+    std::swap(m_uncompressedBlock.Buffer, block->Uncompressed.Buffer);
+
+    // update block data
+    if ( m_blockLength != 0 )
+        m_blockOffset = 0;
+    m_blockAddress = block->Address;
+    m_blockLength  = block->Length;
+    m_nextBlockAddress = block->NextAddress;
+    m_inflatePool->Pop();
+}
+
+// returns the position of the next block to be read from device
+int64_t BgzfStream::DeviceTell(void) const {
+    return ( m_pendingPosition >= 0 ? m_pendingPosition : m_device->Tell() );
+}
+
+// moves device past the blocks taken from the shared cache
+void BgzfStream::SyncDevicePosition(void) {
+
+    if ( m_pendingPosition < 0 )
+        return;
+
+    const int64_t position = m_pendingPosition;
+    m_pendingPosition = -1;
+
+    if ( !m_device->Seek(position) ) {
+        stringstream s("");
+        s << "unable to seek to position: " << position;
+        throw BamException("BgzfStream::ReadBlock", s.str());
+    }
+}
+
+// drops blocks read ahead, moving device back to the first of them
+void BgzfStream::ResetReadAhead(void) {
+
+    if ( m_inflatePool == 0 || m_inflatePool->Count() == 0 ) {
+        m_isReadAheadDone = false;
+        return;
+    }
+
+    const int64_t address = m_inflatePool->WaitFront()->Address;
+    m_inflatePool->Clear();
+    m_pendingPosition = -1;
+    m_readAheadLimit  = 1;
+    m_isReadAheadDone = false;
+
+    if ( !m_device->IsRandomAccess() || !m_device->Seek(address) ) {
+        stringstream s("");
+        s << "unable to seek back to block read ahead: " << address;
+        throw BamException("BgzfStream::ResetReadAhead", s.str());
+    }
 }
 
 // seek to position in BGZF file
@@ -406,7 +635,26 @@ void BgzfStream::Seek(const int64_t& position) {
     int     blockOffset  = (position & 0xFFFF);
     int64_t blockAddress = (position >> 16) & 0xFFFFFFFFFFFFLL;
 
+    // skip seek if position is in current block, or in a block already read ahead
+    if ( SeekInReadBlocks(blockAddress, blockOffset) )
+        return;
+
+    // streams that cannot seek are left untouched (blocks read ahead are kept)
+    if ( !m_device->IsRandomAccess() ) {
+        stringstream s("");
+        s << "unable to seek to position: " << position << " (device is not random access)";
+        throw BamException("BgzfStream::Seek", s.str());
+    }
+
+    // drop blocks read ahead
+    if ( m_inflatePool ) {
+        m_inflatePool->Clear();
+        m_readAheadLimit  = 1;
+        m_isReadAheadDone = false;
+    }
+
     // attempt seek in file
+    m_pendingPosition = -1;
     if ( m_device->IsRandomAccess() && m_device->Seek(blockAddress) ) {
 
         // update block data & return success
@@ -421,6 +669,80 @@ void BgzfStream::Seek(const int64_t& position) {
     }
 }
 
+// moves to position without touching device, if it is in the current block
+// or in a block read ahead (the blocks before it are dropped), returns success/fail
+bool BgzfStream::SeekInReadBlocks(const int64_t& blockAddress, const int blockOffset) {
+
+    if ( m_device->Mode() != IBamIODevice::ReadOnly )
+        return false;
+
+    // position is in current (decompressed) block
+    if ( m_blockLength > 0 && blockAddress == m_blockAddress ) {
+        if ( blockOffset > m_blockLength )
+            return false;
+        m_blockOffset = blockOffset;
+        return true;
+    }
+
+    // position is in a block read ahead
+    if ( m_inflatePool == 0 )
+        return false;
+
+    const size_t index = m_inflatePool->Find(blockAddress);
+    if ( index == m_inflatePool->Count() )
+        return false;
+
+    // blocks are dropped once decompressed (workers may still be using them)
+    for ( size_t i = 0; i < index; ++i ) {
+        m_inflatePool->WaitFront();
+        m_inflatePool->Pop();
+    }
+
+    m_blockLength  = 0;
+    m_blockAddress = blockAddress;
+    m_blockOffset  = blockOffset;
+    return true;
+}
+
+// enable/disable the check of decompressed blocks against their CRC32
+void BgzfStream::SetCheckCrc(bool ok) {
+
+    if ( ok == m_isCheckCrc )
+        return;
+
+    // blocks already read ahead are decompressed again
+    if ( IsOpen() && m_device->Mode() == IBamIODevice::ReadOnly )
+        ResetReadAhead();
+
+    delete m_inflatePool;
+    m_inflatePool = 0;
+    m_readAheadLimit  = 1;
+    m_isReadAheadDone = false;
+
+    m_isCheckCrc = ok;
+    if ( m_inflater )
+        m_inflater->SetCheckCrc(ok);
+}
+
+// sets the number of threads decompressing blocks read ahead
+// (0 to decompress on the calling thread)
+void BgzfStream::SetThreads(const int numThreads) {
+
+    const int threads = max(numThreads, 0);
+    if ( threads == m_numThreads )
+        return;
+
+    // blocks already read ahead are read again
+    if ( IsOpen() && m_device->Mode() == IBamIODevice::ReadOnly )
+        ResetReadAhead();
+
+    delete m_inflatePool;
+    m_inflatePool = 0;
+    m_numThreads  = threads;
+    m_readAheadLimit  = 1;
+    m_isReadAheadDone = false;
+}
+
 void BgzfStream::SetWriteCompressed(bool ok) {
     m_isWriteCompressed = ok;
 }
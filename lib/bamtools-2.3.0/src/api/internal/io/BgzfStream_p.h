@@ -30,6 +30,10 @@
 namespace BamTools {
 namespace Internal {
 
+class BgzfInflatePool;
+class BgzfInflater;
+class BamMappedFile;
+
 class BgzfStream {
 
     // constructor & destructor
@@ -45,12 +49,18 @@ class BgzfStream {
         bool IsOpen(void) const;
         // opens the BGZF file
         void Open(const std::string& filename, const IBamIODevice::OpenMode mode);
+        // opens, for reading, the same file as another stream (sharing its memory mapping, if any)
+        void OpenClone(const BgzfStream& other, const std::string& filename);
         // reads BGZF data into a byte buffer
         size_t Read(char* data, const size_t dataLength);
         // seek to position in BGZF file
         void Seek(const int64_t& position);
         // sets IO device (closes previous, if any, but does not attempt to open)
         void SetIODevice(IBamIODevice* device);
+        // enable/disable the check of decompressed blocks against their CRC32
+        void SetCheckCrc(bool ok);
+        // sets the number of threads decompressing blocks read ahead (0 to decompress on the calling thread)
+        void SetThreads(const int numThreads);
         // enable/disable compressed output
         void SetWriteCompressed(bool ok);
         // get file position in BGZF file
@@ -64,10 +74,22 @@ class BgzfStream {
         size_t DeflateBlock(int32_t blockLength);
         // flushes the data in the BGZF block
         void FlushBlock(void);
-        // de-compresses the current block
-        size_t InflateBlock(const size_t& blockLength);
+        // reads the next compressed block from device (returns 0 at end of file)
+        const char* ReadCompressedBlock(char* buffer, size_t& blockLength);
+        // locates the next compressed block of a memory-mapped file (returns 0 at end of file)
+        const char* MapCompressedBlock(size_t& blockLength);
         // reads a BGZF block
         void ReadBlock(void);
+        // reads ahead compressed blocks & takes the next decompressed one from the pool
+        void ReadBlockFromPool(void);
+        // drops blocks read ahead, moving device back to the first of them
+        void ResetReadAhead(void);
+        // returns the position of the next block to be read from device
+        int64_t DeviceTell(void) const;
+        // moves device past the blocks taken from the shared cache
+        void SyncDevicePosition(void);
+        // moves to position in current block or in a block read ahead, without seeking device
+        bool SeekInReadBlocks(const int64_t& blockAddress, const int blockOffset);
 
     // static 'utility' methods
     public:
@@ -79,12 +101,24 @@ class BgzfStream {
         int32_t m_blockLength;
         int32_t m_blockOffset;
         int64_t m_blockAddress;
+        int64_t m_nextBlockAddress;
 
         bool m_isWriteCompressed;
         IBamIODevice* m_device;
+        BamMappedFile* m_mappedFile;    // same as m_device, if it is a memory-mapped file
+        uint32_t m_cacheFileId;         // file identifier in the shared block cache
+        int64_t m_pendingPosition;      // device position after blocks taken from the cache (-1 if none)
 
         RaiiBuffer m_uncompressedBlock;
         RaiiBuffer m_compressedBlock;
+
+        BgzfInflater* m_inflater;   // decompresses blocks on the calling thread
+        bool m_isCheckCrc;
+
+        int m_numThreads;
+        BgzfInflatePool* m_inflatePool;
+        size_t m_readAheadLimit;    // blocks read ahead (grows after each seek up to pool's capacity)
+        bool m_isReadAheadDone;     // end of file (or an error) has been read ahead
 };
 
 } // namespace Internal
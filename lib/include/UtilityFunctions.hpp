@@ -67,4 +67,7 @@ void loadFileNames(
 	std::vector< std::string > &names
 );
 
+// compares read names following the order of name-sorted BAM files (samtools sort -n)
+int compareReadNames( const std::string &a, const std::string &b );
+
 #endif	/* UTILITYFUNCTIONS_HPP */
@@ -47,6 +47,9 @@
 
 #include "bam/MultiBamReader.hpp"
 #include "assembly/Read.hpp"
+#include "assembly/ReadIndex.hpp"
+#include "assembly/PartitionedReadIndex.hpp"
+#include "assembly/CoverageTrack.hpp"
 #include "assembly/Frame.hpp"
 #include "assembly/RefSequence.hpp"
 
@@ -195,25 +198,99 @@ public:
      * \param outblocks         (output) vector of blocks found.
      * \param bamReader         BamReader object of the slave assembly.
      * \param minBlockSize      minimum reads required to form a block.
-     * \param readsMap_1        hash table of the master's reads (pair 1)
-     * \param readsMap_2        hash table of the master's reads (pair 2)
-     * \param coverage          vector of coverages of the slave assembly (output)
-     * \param assemblyId        slave assembly identifier
-     * \return vector of blocks found.
+     * \param readIndex         index of the master's reads (only read, so that it can be
+     *                          reused for several slave assemblies)
+     * \param coverage          coverage of the slave assembly (output, finalized)
+     * \param noMultFilter      whether reads with multiple alignments should be kept
+     * \param threads           number of threads; if greater than 1, slave contigs are split
+     *                          in shards processed in parallel with their own BAM readers
      */
     static void findBlocks(
         std::vector<Block> &outblocks,
         MultiBamReader &bamReader,
         const int minBlockSize,
-        sparse_hash_map< std::string, Read > &readsMap_1,
-        sparse_hash_map< std::string, Read > &readsMap_2,
-        std::vector< std::vector< uint32_t > > &coverage,
+        const ReadIndex &readIndex,
+        CoverageTrack &coverage,
+        bool noMultFilter = false,
+        int threads = 1 );
+
+    //! Finds the blocks over two assemblies, given name-sorted alignments.
+    /*!
+     * Master and slave alignments are joined by read name in a single pass;
+     * joined pairs are then sorted by slave coordinates (using temporary files
+     * if they don't fit in memory) and used to build blocks.
+     *
+     * \param outblocks         (output) vector of blocks found.
+     * \param masterBam         name-sorted BAM reader of the master assembly.
+     * \param slaveBam          name-sorted BAM reader of the slave assembly.
+     * \param minBlockSize      minimum reads required to form a block.
+     * \param masterCoverage    coverage of the master assembly (output, finalized)
+     * \param slaveCoverage     coverage of the slave assembly (output, finalized)
+     * \param noMultFilter      whether reads with multiple alignments should be kept
+     * \param tmpPrefix         prefix of temporary files
+     * \param maxMemory         memory used to sort joined reads in memory (bytes)
+     */
+    static void findBlocksByName(
+        std::vector<Block> &outblocks,
+        MultiBamReader &masterBam,
+        MultiBamReader &slaveBam,
+        const int minBlockSize,
+        CoverageTrack &masterCoverage,
+        CoverageTrack &slaveCoverage,
+        bool noMultFilter,
+        const std::string &tmpPrefix,
+        uint64_t maxMemory );
+
+    //! Finds the blocks over two assemblies, with master's reads partitioned on disk.
+    /*!
+     * Slave reads are streamed once and spilled to the files of the index' groups;
+     * then each group is loaded in memory and joined with its slave reads. Joined
+     * reads are sorted back in slave's order, so blocks are the same built by findBlocks().
+     *
+     * \param outblocks         (output) vector of blocks found.
+     * \param bamReader         BamReader object of the slave assembly.
+     * \param minBlockSize      minimum reads required to form a block.
+     * \param readIndex         partitioned index of the master's reads (cleared when done)
+     * \param coverage          coverage of the slave assembly (output, finalized)
+     * \param noMultFilter      whether reads with multiple alignments should be kept
+     * \param tmpPrefix         prefix of temporary files
+     * \param maxMemory         memory used to sort joined reads in memory (bytes)
+     */
+    static void findBlocksPartitioned(
+        std::vector<Block> &outblocks,
+        MultiBamReader &bamReader,
+        const int minBlockSize,
+        PartitionedReadIndex &readIndex,
+        CoverageTrack &coverage,
+        bool noMultFilter,
+        const std::string &tmpPrefix,
+        uint64_t maxMemory );
+
+    //! Builds the blocks from the (remaining) alignments of a slave BAM reader.
+    /*!
+     * Used by findBlocks() on the whole slave BAM or on a region of it.
+     * The coverage must be already initialized (it is not finalized).
+     *
+     * \return the maximum number of blocks that could be extended at the same time.
+     */
+    static uint64_t findBlocksInStream(
+        std::vector<Block> &outblocks,
+        MultiBamReader &bamReader,
+        const int minBlockSize,
+        const ReadIndex &readIndex,
+        CoverageTrack &coverage,
         bool noMultFilter = false );
 
+    //! Sets the reads' length (sum of the coverage) of blocks' frames.
+    /*!
+     * \param blocks            blocks to update
+     * \param masterCoverage    finalized coverage of the master assembly
+     * \param slaveCoverage     finalized coverage of the slave assembly
+     */
     static void updateCoverages(
         std::vector<Block> &blocks,
-        const std::vector< std::vector<uint32_t> > &masterCoverage,
-        std::vector< std::vector<uint32_t> > &slaveCoverage );
+        const CoverageTrack &masterCoverage,
+        const CoverageTrack &slaveCoverage );
 
     //! Returns whether two block share the master contig.
     /*!
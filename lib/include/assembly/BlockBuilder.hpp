@@ -0,0 +1,122 @@
+/*
+ *  This file is part of GAM-NGS.
+ *  Copyright (c) 2011 by Riccardo Vicedomini <rvicedomini@appliedgenomics.org>,
+ *  Francesco Vezzi <vezzi@appliedgenomics.org>,
+ *  Simone Scalabrin <scalabrin@appliedgenomics.org>,
+ *  Lars Arverstad <lars.arvestad@scilifelab.se>,
+ *  Alberto Policriti <policriti@appliedgenomics.org>,
+ *  Alberto Casagrande <casagrande@appliedgenomics.org>
+ *
+ *  GAM-NGS is an evolution of a previous work (GAM) done by Alberto Casagrande,
+ *  Cristian Del Fabbro, Simone Scalabrin, and Alberto Policriti.
+ *  In particular, GAM-NGS has been adapted to work on NGS data sets and it has
+ *  been written using GAM's software as starting point. Thus, it shares part of
+ *  GAM's source code.
+ *
+ *  GAM-NGS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GAM-NGS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GAM-NGS.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*!
+ * \file BlockBuilder.hpp
+ * \brief Definition of BlockBuilder class.
+ * \details This file contains the definition of the class that builds blocks
+ *          from pairs of master/slave reads, sorted by slave's coordinates.
+ */
+
+#ifndef BLOCKBUILDER_HPP
+#define	BLOCKBUILDER_HPP
+
+#include <map>
+#include <set>
+#include <queue>
+#include <vector>
+
+#include "assembly/Read.hpp"
+#include "assembly/Block.hpp"
+
+//! Class that builds blocks from a stream of (master,slave) read pairs.
+/*!
+ * Pairs must be provided following the order of slave reads' coordinates.
+ * A pair is added to the first block (in creation order) it overlaps on both
+ * assemblies, otherwise a new block is created. Blocks that can be extended
+ * are indexed by master's (contig, begin), while a min-heap on slave's ends
+ * retires the blocks that are out of scope (i.e. no more slave reads can be
+ * added to them). Retired blocks are output in the same order as a linear
+ * scan of the blocks in creation order would output them.
+ */
+class BlockBuilder
+{
+private:
+    struct ActiveBlock
+    {
+        Block block;
+        std::pair<uint64_t,uint64_t> evid;  // strand evidences (concordant, discordant)
+        bool active;                        // whether the block is in the master/slave indexes
+        int32_t heapEnd;                    // slave's end of the latest heap entry of the block
+
+        ActiveBlock( const Block &b ) : block(b), evid(0,0), active(false), heapEnd(-1) {}
+    };
+
+    struct MasterKey
+    {
+        int32_t ctg;
+        int64_t begin;
+        uint64_t id;
+
+        MasterKey( int32_t c, int64_t b, uint64_t i ) : ctg(c), begin(b), id(i) {}
+
+        bool operator<( const MasterKey &k ) const
+        {
+            if( ctg != k.ctg ) return ctg < k.ctg;
+            if( begin != k.begin ) return begin < k.begin;
+            return id < k.id;
+        }
+    };
+
+    typedef std::pair< int32_t, uint64_t > SlaveEnd; // (slave's end, block id)
+
+    std::vector< Block > &_outblocks;
+    int _minBlockSize;
+
+    uint64_t _nextId;
+    std::map< uint64_t, ActiveBlock > _blocks;     // blocks not yet output, by creation order
+    std::set< MasterKey > _masterIndex;            // blocks that can still be extended
+    std::vector< int64_t > _maxMasterLength;       // upper bound of master frames' length in the index (per contig)
+    std::priority_queue< SlaveEnd, std::vector<SlaveEnd>, std::greater<SlaveEnd> > _slaveEnds;
+    std::set< uint64_t > _expired;                 // out of scope blocks, not yet output
+    std::set< uint64_t > _empty;                   // blocks without reads (they accept any read)
+    int32_t _slaveCtg;                             // slave contig of the last reads added
+
+    uint64_t _peakActive;
+
+    void closeBlock( Block &block, const std::pair<uint64_t,uint64_t> &evid );
+    void indexBlock( uint64_t id, ActiveBlock &ab );
+    void unindexBlock( uint64_t id, ActiveBlock &ab );
+    void expireBlocks( const Read &slaveRead );
+
+public:
+    BlockBuilder( std::vector< Block > &outblocks, int minBlockSize );
+
+    //! Adds a pair of reads aligned on both assemblies.
+    void addReads( Read &masterRead, Read &slaveRead );
+
+    //! Outputs the blocks still open (to be called when all pairs have been added).
+    void flush();
+
+    //! Returns the maximum number of blocks that could be extended at the same time.
+    inline uint64_t peakActiveBlocks() const { return _peakActive; }
+};
+
+#endif	/* BLOCKBUILDER_HPP */
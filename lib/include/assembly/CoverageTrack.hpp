@@ -0,0 +1,172 @@
+/*
+ *  This file is part of GAM-NGS.
+ *  Copyright (c) 2011 by Riccardo Vicedomini <rvicedomini@appliedgenomics.org>,
+ *  Francesco Vezzi <vezzi@appliedgenomics.org>,
+ *  Simone Scalabrin <scalabrin@appliedgenomics.org>,
+ *  Lars Arverstad <lars.arvestad@scilifelab.se>,
+ *  Alberto Policriti <policriti@appliedgenomics.org>,
+ *  Alberto Casagrande <casagrande@appliedgenomics.org>
+ *
+ *  GAM-NGS is an evolution of a previous work (GAM) done by Alberto Casagrande,
+ *  Cristian Del Fabbro, Simone Scalabrin, and Alberto Policriti.
+ *  In particular, GAM-NGS has been adapted to work on NGS data sets and it has
+ *  been written using GAM's software as starting point. Thus, it shares part of
+ *  GAM's source code.
+ *
+ *  GAM-NGS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GAM-NGS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GAM-NGS.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*!
+ * \file CoverageTrack.hpp
+ * \brief Definition of CoverageTrack class.
+ * \details This file contains the definition of the class used to compute
+ *          the read coverage of an assembly's contigs.
+ */
+
+#ifndef COVERAGETRACK_HPP
+#define	COVERAGETRACK_HPP
+
+#include <vector>
+
+#include "api/BamAux.h"
+#include "types.hpp"
+
+using namespace BamTools;
+
+#define COVERAGE_CHECKPOINT_BITS 8 // a checkpoint every 256 bases
+#define COVERAGE_NARROW_BLOCK 0xFFFFFFFF
+
+//! Read coverage of the contigs of an assembly.
+/*!
+ * Reads are recorded as difference events (+1 at their start, -1 past their end),
+ * so that adding a read takes constant time. Once finalized, each contig keeps
+ * exact 64-bit prefix sums of its per-base coverage every 256 bases (checkpoints)
+ * and, for each base, the 16-bit difference between its prefix sum and the
+ * previous checkpoint; the sum of the coverage over any frame takes constant time.
+ * Blocks of 256 bases whose coverage sum does not fit in 16 bits (average coverage
+ * above 256) also keep the high 16 bits of their differences (provided that the
+ * coverage of 256 consecutive bases does not exceed 2^32).
+ * Memory used is about 2 bytes per base (4 bytes per base before finalize()).
+ */
+class CoverageTrack
+{
+private:
+    //! Arrays of a finalized contig (owned by the track or attached).
+    struct ContigCoverage
+    {
+        const uint16_t *deltas;         // prefix sums minus block's checkpoint (low 16 bits)
+        const uint64_t *checkpoints;    // exact prefix sums every 2^COVERAGE_CHECKPOINT_BITS bases
+        const uint32_t *wideIndex;      // index in wideDeltas of each block (COVERAGE_NARROW_BLOCK if none)
+        const uint16_t *wideDeltas;     // high 16 bits of the differences of wide blocks
+        uint32_t wideBlocks;
+    };
+
+    std::vector< std::vector< uint32_t > > _events;         // difference events (until finalized)
+    std::vector< std::vector< uint16_t > > _deltas;
+    std::vector< std::vector< uint64_t > > _checkpoints;
+    std::vector< std::vector< uint32_t > > _wideIndex;
+    std::vector< std::vector< uint16_t > > _wideDeltas;
+    std::vector< ContigCoverage > _contigs;
+    std::vector< uint32_t > _lengths;
+    bool _finalized;
+
+    inline uint64_t prefixSum( int32_t ctg, uint32_t pos ) const
+    {
+        const ContigCoverage &contig = _contigs[ctg];
+        uint32_t block = pos >> COVERAGE_CHECKPOINT_BITS;
+        uint32_t delta = contig.deltas[pos];
+        uint32_t wide = contig.wideIndex[block];
+
+        if( wide != COVERAGE_NARROW_BLOCK )
+            delta |= uint32_t( contig.wideDeltas[ (wide << COVERAGE_CHECKPOINT_BITS) + (pos & ((1 << COVERAGE_CHECKPOINT_BITS) - 1)) ] ) << 16;
+
+        return contig.checkpoints[block] + delta;
+    }
+
+public:
+    CoverageTrack();
+
+    //! Initializes an empty coverage for the given references.
+    void init( const RefVector &refs );
+
+    //! Records a read aligned on bases [start,end) of a contig.
+    /*!
+     * Reads of different contigs can be added concurrently.
+     */
+    inline void addRead( int32_t ctg, int32_t start, int32_t end )
+    {
+        std::vector< uint32_t > &events = _events[ctg];
+        uint32_t len = events.size() - 1;
+
+        if( start < 0 ) start = 0;
+        if( (uint32_t)end > len ) end = len;
+        if( start >= end ) return;
+
+        events[start] += 1;
+        events[end] -= 1;
+    }
+
+    //! Computes prefix sums; reads cannot be added afterwards.
+    void finalize();
+
+    inline bool isFinalized() const { return _finalized; }
+
+    //! Returns the sum of the coverage of bases [begin,end] of a contig.
+    uint64_t sum( int32_t ctg, int32_t begin, int32_t end ) const;
+
+    //! Returns the number of contigs.
+    inline size_t size() const { return _lengths.size(); }
+
+    //! Returns the memory (bytes) used by the coverage.
+    uint64_t memoryUsage() const;
+
+    //! Returns the length of a contig.
+    inline uint32_t length( int32_t ctg ) const { return _lengths[ctg]; }
+
+    //! Differences of a contig (contig length + 1 values; the track must be finalized).
+    inline const uint16_t* deltas( int32_t ctg ) const { return _contigs[ctg].deltas; }
+
+    //! Checkpoints of a contig ((contig length >> COVERAGE_CHECKPOINT_BITS) + 1 values).
+    inline const uint64_t* checkpoints( int32_t ctg ) const { return _contigs[ctg].checkpoints; }
+
+    //! Wide blocks' indexes of a contig (one value per checkpoint).
+    inline const uint32_t* wideIndex( int32_t ctg ) const { return _contigs[ctg].wideIndex; }
+
+    //! High bits of wide blocks' differences of a contig (2^COVERAGE_CHECKPOINT_BITS values per wide block).
+    inline const uint16_t* wideDeltas( int32_t ctg ) const { return _contigs[ctg].wideDeltas; }
+
+    //! Number of wide blocks of a contig.
+    inline uint32_t wideBlocks( int32_t ctg ) const { return _contigs[ctg].wideBlocks; }
+
+    //! Initializes a finalized coverage whose contigs are attached with attachContig().
+    void attach( const RefVector &refs );
+
+    //! Uses the read-only arrays of a finalized contig (e.g. from a memory-mapped file).
+    /*!
+     * Arrays are not copied: they must remain valid until the track is initialized
+     * again or destroyed.
+     *
+     * \param ctg           contig
+     * \param deltas        differences (contig length + 1 values)
+     * \param checkpoints   checkpoints
+     * \param wideIndex     wide blocks' indexes (one per checkpoint)
+     * \param wideDeltas    high bits of wide blocks' differences
+     * \param wideBlocks    number of wide blocks
+     */
+    void attachContig( int32_t ctg, const uint16_t *deltas, const uint64_t *checkpoints,
+                       const uint32_t *wideIndex, const uint16_t *wideDeltas, uint32_t wideBlocks );
+};
+
+#endif	/* COVERAGETRACK_HPP */
@@ -0,0 +1,129 @@
+/*
+ *  This file is part of GAM-NGS.
+ *  Copyright (c) 2011 by Riccardo Vicedomini <rvicedomini@appliedgenomics.org>,
+ *  Francesco Vezzi <vezzi@appliedgenomics.org>,
+ *  Simone Scalabrin <scalabrin@appliedgenomics.org>,
+ *  Lars Arverstad <lars.arvestad@scilifelab.se>,
+ *  Alberto Policriti <policriti@appliedgenomics.org>,
+ *  Alberto Casagrande <casagrande@appliedgenomics.org>
+ *
+ *  GAM-NGS is an evolution of a previous work (GAM) done by Alberto Casagrande,
+ *  Cristian Del Fabbro, Simone Scalabrin, and Alberto Policriti.
+ *  In particular, GAM-NGS has been adapted to work on NGS data sets and it has
+ *  been written using GAM's software as starting point. Thus, it shares part of
+ *  GAM's source code.
+ *
+ *  GAM-NGS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GAM-NGS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GAM-NGS.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*!
+ * \file MasterIndexFile.hpp
+ * \brief Definition of MasterIndexFile class.
+ * \details This file contains the definition of the class that saves the index
+ *          of master's reads (along with coverages and libraries' statistics)
+ *          on a binary file, which can be memory-mapped by later runs.
+ */
+
+#ifndef MASTERINDEXFILE_HPP
+#define	MASTERINDEXFILE_HPP
+
+#include <string>
+#include <vector>
+
+#include "bam/MultiBamReader.hpp"
+#include "assembly/ReadIndex.hpp"
+#include "assembly/CoverageTrack.hpp"
+
+#define MASTER_INDEX_MAGIC "GAMRIDX"
+#define MASTER_INDEX_VERSION 5
+
+#define MASTER_INDEX_NO_MULT_FILTER 1   // master reads selected without multiplicity filter
+
+//! Binary file storing the master's reads index.
+/*!
+ * The file contains, in order: a header; for each library its BAM file (name,
+ * size and modification time) and insert size statistics; reference names and
+ * lengths; coverages (checkpoints and differences of a CoverageTrack); the table
+ * of slots of a HashedReadIndex, aligned to a page boundary so that it can be
+ * used in place from a read-only mapping; the reads of its overflow table.
+ */
+class MasterIndexFile
+{
+private:
+    struct Header
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t flags;         // options selecting master reads (MASTER_INDEX_* flags)
+        uint32_t keyWords;      // 64-bit words of read keys
+        uint32_t ctgBits;       // packing of reads in slots
+        uint32_t startBits;
+        uint32_t unused;
+        uint64_t slotSize;
+        uint64_t slotsNum;
+        uint64_t reads;
+        uint64_t overflowNum;   // reads not packed in slots
+        uint32_t libs;
+        uint32_t refs;
+        uint64_t slotsOffset;   // offset of the table of slots
+        uint64_t fileSize;
+    };
+
+    std::string _filename;
+    void *_data;
+    uint64_t _size;
+
+public:
+    MasterIndexFile();
+    ~MasterIndexFile();
+
+    //! Saves an index of master's reads.
+    /*!
+     * \param filename      output file
+     * \param index         index of reads (must be a hashed index)
+     * \param masterBam     master's BAM reader (with libraries' statistics already computed)
+     * \param coverage      finalized coverage of master's contigs
+     * \param noMultFilter  whether reads have been indexed without multiplicity filter
+     */
+    static void save(
+        const std::string &filename,
+        const ReadIndex &index,
+        MultiBamReader &masterBam,
+        const CoverageTrack &coverage,
+        bool noMultFilter );
+
+    //! Maps a saved index.
+    /*!
+     * The file is checked against the master's BAM files (same files, sizes,
+     * modification times and references) and against the options selecting
+     * master's reads (multiplicity filter); libraries' statistics of \c masterBam
+     * are restored and \c coverage is attached to the mapped file.
+     *
+     * \param filename      index file
+     * \param masterBam     master's BAM reader
+     * \param coverage      coverage of master's contigs (output, valid until this object is destroyed)
+     * \param noMultFilter  whether reads are expected without multiplicity filter
+     * \return the index of reads, using the mapped file (valid until this object is destroyed).
+     */
+    ReadIndex* load(
+        const std::string &filename,
+        MultiBamReader &masterBam,
+        CoverageTrack &coverage,
+        bool noMultFilter );
+
+    void close();
+};
+
+#endif	/* MASTERINDEXFILE_HPP */
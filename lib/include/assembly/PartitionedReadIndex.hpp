@@ -0,0 +1,151 @@
+/*
+ *  This file is part of GAM-NGS.
+ *  Copyright (c) 2011 by Riccardo Vicedomini <rvicedomini@appliedgenomics.org>,
+ *  Francesco Vezzi <vezzi@appliedgenomics.org>,
+ *  Simone Scalabrin <scalabrin@appliedgenomics.org>,
+ *  Lars Arverstad <lars.arvestad@scilifelab.se>,
+ *  Alberto Policriti <policriti@appliedgenomics.org>,
+ *  Alberto Casagrande <casagrande@appliedgenomics.org>
+ *
+ *  GAM-NGS is an evolution of a previous work (GAM) done by Alberto Casagrande,
+ *  Cristian Del Fabbro, Simone Scalabrin, and Alberto Policriti.
+ *  In particular, GAM-NGS has been adapted to work on NGS data sets and it has
+ *  been written using GAM's software as starting point. Thus, it shares part of
+ *  GAM's source code.
+ *
+ *  GAM-NGS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GAM-NGS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GAM-NGS.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*!
+ * \file PartitionedReadIndex.hpp
+ * \brief Definition of PartitionedReadIndex class.
+ * \details This file contains the definition of the index of master reads
+ *          stored on disk, in buckets loaded in memory one group at a time.
+ */
+
+#ifndef PARTITIONEDREADINDEX_HPP
+#define	PARTITIONEDREADINDEX_HPP
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "assembly/Read.hpp"
+#include "assembly/ReadIndex.hpp"
+#include "assembly/ReadPairSorter.hpp"
+
+#define READ_INDEX_BUCKETS 512
+
+//! Index of reads hash-partitioned on disk by their (128-bit) fingerprints.
+/*!
+ * Reads are appended to READ_INDEX_BUCKETS bucket files. Once all reads have
+ * been inserted, buckets are grouped so that the reads of each group fit in
+ * the given amount of memory; only one group at a time is loaded in memory
+ * (and can be looked up with find()). Buffers of the files open at the same
+ * time (all buckets, or the spill file of each group) are sized from the
+ * same amount of memory (about 1/8 of it, 1-64 KB each) and counted in it.
+ * Reads to be searched in the index can be spilled to per-group files and
+ * joined with the index one group at a time.
+ */
+class PartitionedReadIndex : public ReadIndex
+{
+private:
+    struct MasterRecord
+    {
+        uint64_t hi, lo;
+        int32_t ctg;
+        int32_t start;
+        uint32_t len_rev;   // read length (bit 31 set if reverse complemented)
+    } __attribute__((packed));
+
+    struct SlaveRecord
+    {
+        uint64_t hi, lo;
+        ReadPair pair;
+    };
+
+    std::string _tmpPrefix;
+    uint64_t _maxMemory;
+    uint64_t _ioBuffer;                                 // buffer of each open bucket (or spill) file
+
+    std::vector< std::string > _bucketFiles;
+    std::vector< FILE* > _buckets;
+    std::vector< uint64_t > _bucketSize;
+
+    std::vector< std::vector< uint32_t > > _groups;     // buckets of each group
+    std::vector< uint32_t > _bucketGroup;               // group of each bucket
+
+    std::vector< std::string > _spillFiles;
+    std::vector< FILE* > _spills;
+
+    HashedReadIndex<2> _resident;                       // reads of the group currently loaded
+    int64_t _residentGroup;
+
+    uint64_t _size;
+    bool _partitioned;
+
+    static uint32_t bucketOf( const ReadKey &key );
+    FILE* openFile( const std::string &filename, const char *mode ) const;
+    void openBuckets();
+
+public:
+    //! Creates an empty index.
+    /*!
+     * \param tmpPrefix     prefix of bucket files
+     * \param maxMemory     memory available to load a group of buckets and for file buffers (bytes)
+     * \param refs          references reads are aligned to
+     */
+    PartitionedReadIndex( const std::string &tmpPrefix, uint64_t maxMemory, const BamTools::RefVector &refs );
+    ~PartitionedReadIndex();
+
+    void insert( const std::string &name, bool firstMate, const Read &read );
+
+    //! Looks up a read of the group currently loaded.
+    /*!
+     * \throws std::logic_error if the group of the read is not loaded (see loadGroup())
+     */
+    bool find( const std::string &name, bool firstMate, Read &read ) const;
+
+    //! Returns the number of inserted records (unlike other indexes, a read inserted twice is counted twice).
+    uint64_t size() const;
+
+    uint64_t memoryUsage() const;
+    void clear();
+
+    //! Ends the insertion of reads and groups buckets according to the available memory.
+    void partition();
+
+    //! Returns the number of groups of buckets (after partition() has been called).
+    size_t groups() const { return _groups.size(); }
+
+    //! Loads in memory the reads of a group.
+    void loadGroup( size_t group );
+
+    //! Stores a (slave) read, to be later joined with the index.
+    /*!
+     * \param name      read's name
+     * \param firstMate \c true for single reads and first mates of a pair
+     * \param pair      pair whose slave fields are already set
+     */
+    void spill( const std::string &name, bool firstMate, const ReadPair &pair );
+
+    //! Joins spilled reads of a group with the index, sending found pairs to a sorter.
+    /*!
+     * \return number of pairs found.
+     */
+    uint64_t join( size_t group, ReadPairSorter &sorter );
+};
+
+#endif	/* PARTITIONEDREADINDEX_HPP */
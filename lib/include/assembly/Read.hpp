@@ -48,6 +48,9 @@
 using namespace BamTools;
 using google::sparse_hash_map;
 
+class ReadIndex;
+class CoverageTrack;
+
 //! Class implementing a read.
 class Read
 {
@@ -106,7 +109,7 @@ public:
     /*!
      * \return \c true if the read is reverse complemented, \c false otherwise.
      */
-    bool isReverse();
+    bool isReverse() const;
 
     bool overlaps( Read &read, int minOverlap = 0 ) const;
 
@@ -115,19 +118,15 @@ public:
      * Reads with multiple alignments or unmapped are discarded.
      *
      * \param bamReader BamReader object.
-     * \param readMap_1 map where the first uniquely mapped pairs are loaded (output)
-	 * \param readMap_2 map where the second uniquely mapped pairs are loaded (output)
-     * \param coverage vector of coverages of the contigs (output)
-	 * \param dupReadMap_1 map where the first mutiple mapped pairs are loaded (output)
-	 * \param dupReadMap_2 map where the second mutiple mapped pairs are loaded (output)
-	 * \param loadDupReads whether duplicate reads maps should be filled
+     * \param readIndex index where the uniquely mapped reads are loaded (output)
+     * \param coverage coverage of the contigs (output, finalized)
+     * \param noMultFilter whether reads with multiple alignments should be kept
 	 *
      */
     static void loadReadsMap(
         MultiBamReader &bamReader,
-        sparse_hash_map< std::string, Read > &readMap_1,
-        sparse_hash_map< std::string, Read > &readMap_2,
-        std::vector< std::vector<uint32_t> > &coverage,
+        ReadIndex &readIndex,
+        CoverageTrack &coverage,
         bool noMultFilter = false
 	);
 };
@@ -0,0 +1,307 @@
+/*
+ *  This file is part of GAM-NGS.
+ *  Copyright (c) 2011 by Riccardo Vicedomini <rvicedomini@appliedgenomics.org>,
+ *  Francesco Vezzi <vezzi@appliedgenomics.org>,
+ *  Simone Scalabrin <scalabrin@appliedgenomics.org>,
+ *  Lars Arverstad <lars.arvestad@scilifelab.se>,
+ *  Alberto Policriti <policriti@appliedgenomics.org>,
+ *  Alberto Casagrande <casagrande@appliedgenomics.org>
+ *
+ *  GAM-NGS is an evolution of a previous work (GAM) done by Alberto Casagrande,
+ *  Cristian Del Fabbro, Simone Scalabrin, and Alberto Policriti.
+ *  In particular, GAM-NGS has been adapted to work on NGS data sets and it has
+ *  been written using GAM's software as starting point. Thus, it shares part of
+ *  GAM's source code.
+ *
+ *  GAM-NGS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GAM-NGS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GAM-NGS.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*!
+ * \file ReadIndex.hpp
+ * \brief Definition of the master reads' index.
+ * \details This file contains the classes used to store the uniquely mapped
+ *          reads of the master assembly, which are looked up by name while
+ *          building blocks.
+ */
+
+#ifndef READINDEX_HPP
+#define	READINDEX_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "api/BamAux.h"
+#include "assembly/Read.hpp"
+
+#include "types.hpp"
+#include "google/sparse_hash_map"
+
+using google::sparse_hash_map;
+
+//! Fingerprint of a read name (and of its mate number).
+struct ReadKey
+{
+    uint64_t hi;
+    uint64_t lo;
+
+    //! Computes the 128-bit fingerprint of a read.
+    /*!
+     * \param name      read's name
+     * \param firstMate \c true for single reads and first mates of a pair
+     */
+    ReadKey( const std::string &name, bool firstMate );
+
+    ReadKey( uint64_t h, uint64_t l ) : hi(h), lo(l) {}
+};
+
+//! Interface of an index of reads, keyed by name and mate number.
+class ReadIndex
+{
+public:
+    typedef enum
+    {
+        NAME_KEYS = 0,      //!< full read names (sparse hash maps)
+        HASH64_KEYS = 64,   //!< 64-bit name fingerprints
+        HASH128_KEYS = 128  //!< 128-bit name fingerprints
+    } key_type_t;
+
+    virtual ~ReadIndex() {}
+
+    //! Inserts a read in the index (replacing any previous read with the same name/mate).
+    virtual void insert( const std::string &name, bool firstMate, const Read &read ) = 0;
+
+    //! Looks up a read.
+    /*!
+     * \param name      read's name
+     * \param firstMate \c true for single reads and first mates of a pair
+     * \param read      (output) the read found
+     * \return \c true if the read is in the index, \c false otherwise.
+     */
+    virtual bool find( const std::string &name, bool firstMate, Read &read ) const = 0;
+
+    //! Returns the number of reads in the index.
+    virtual uint64_t size() const = 0;
+
+    //! Returns an estimate of the memory (in bytes) used by the index.
+    virtual uint64_t memoryUsage() const = 0;
+
+    virtual void clear() = 0;
+
+    //! Creates an empty index.
+    /*!
+     * \param keys          type of the keys used to identify reads
+     * \param refs          references reads are aligned to
+     * \param verifyFile    if not empty, file where read names are stored in order
+     *                      to verify fingerprint matches (ignored with full name keys)
+     */
+    static ReadIndex* create( key_type_t keys, const BamTools::RefVector &refs, const std::string &verifyFile = "" );
+};
+
+
+//! Index of reads keyed by their full names.
+class NameReadIndex : public ReadIndex
+{
+private:
+    sparse_hash_map< std::string, Read > _readMap_1; //!< single reads and first mates
+    sparse_hash_map< std::string, Read > _readMap_2; //!< second mates
+
+public:
+    void insert( const std::string &name, bool firstMate, const Read &read );
+    bool find( const std::string &name, bool firstMate, Read &read ) const;
+    uint64_t size() const;
+    uint64_t memoryUsage() const;
+    void clear();
+};
+
+
+//! Word of a slot without read.
+#define PACKED_READ_EMPTY (~0ULL)
+//! Word of a slot whose read does not fit in a word (kept in the overflow table).
+#define PACKED_READ_OVERFLOW (~0ULL - 1)
+
+//! Packing of a read (contig, start, length and strand) in a 64-bit word.
+/*!
+ * Field widths depend on the references: contig identifiers take the bits needed
+ * to number the contigs, starting positions the bits needed by the longest contig
+ * and read lengths the remaining ones (but the lowest, which holds the strand).
+ * Words whose contig field is all ones are not reads (see PACKED_READ_EMPTY and
+ * PACKED_READ_OVERFLOW).
+ */
+class ReadPacking
+{
+private:
+    uint32_t _ctgBits;
+    uint32_t _startBits;
+    uint32_t _lenBits;
+
+public:
+    ReadPacking();
+    ReadPacking( const BamTools::RefVector &refs );
+    ReadPacking( uint32_t ctgBits, uint32_t startBits );
+
+    //! Packs a read, returning \c false if it does not fit in a word.
+    bool pack( const Read &read, uint64_t &word ) const;
+
+    //! Unpacks a word returned by pack().
+    Read unpack( uint64_t word ) const;
+
+    inline uint32_t ctgBits() const { return _ctgBits; }
+    inline uint32_t startBits() const { return _startBits; }
+};
+
+
+//! Read that does not fit in a packed word, as saved on file.
+struct OverflowRead
+{
+    uint64_t hi, lo;    // key words of the slot (lo is 0 with 64-bit keys)
+    int32_t ctg;
+    int32_t start;
+    int32_t end;
+    int32_t rev;
+};
+
+
+//! Flat open-addressing table of reads keyed by \c KEY_WORDS x 64-bit fingerprints.
+/*!
+ * Each slot holds the key and the read packed in a 64-bit word (16 bytes with
+ * 64-bit keys, 24 with 128-bit keys); reads too long to be packed are kept in a
+ * small overflow table. Collisions are resolved by Robin Hood linear probing, so
+ * that the table can be filled up to 85% and misses stop early; the table
+ * size is not a power of two (keys are mapped to slots by multiply-shift), so it
+ * grows by half of its size at a time and can be sized exactly with reserve().
+ *
+ * Read names are not kept in memory. If a verification file is given, names are
+ * appended to it and fingerprint matches are checked against the stored names,
+ * which makes the index exact at the cost of one file read per match and of the
+ * name offsets (8 bytes per slot, kept apart from the table).
+ */
+template< int KEY_WORDS >
+class HashedReadIndex : public ReadIndex
+{
+private:
+    struct Slot
+    {
+        uint64_t key[KEY_WORDS];
+        uint64_t read;      //!< packed read (PACKED_READ_EMPTY if the slot is empty)
+    };
+
+    struct OverflowKey
+    {
+        uint64_t hi, lo, name;
+
+        bool operator<( const OverflowKey &other ) const
+        {
+            return hi < other.hi || ( hi == other.hi && ( lo < other.lo || ( lo == other.lo && name < other.name ) ) );
+        }
+    };
+
+    ReadPacking _packing;
+
+    std::vector< Slot > _slots;
+    uint64_t _capacity;
+    uint64_t _size;
+
+    const Slot *_mapped;                    //!< read-only table of slots (if not NULL, used in place of _slots)
+
+    std::map< OverflowKey, Read > _overflow;
+
+    // exact verification of fingerprint matches
+    std::string _verifyFile;
+    int _verifyFd;
+    uint64_t _verifyFlushed;                //!< bytes already written to the verification file
+    std::string _verifyBuffer;              //!< names not yet written to the verification file
+    std::vector< uint64_t > _nameOffset;    //!< offset of slot's name in the verification file
+
+    void initSlots( uint64_t capacity );
+    void grow( uint64_t capacity );
+    void setKey( Slot &slot, const ReadKey &key ) const;
+    bool matchKey( const Slot &slot, const ReadKey &key ) const;
+    bool matchName( uint64_t offset, const std::string &name ) const;
+    uint64_t appendName( const std::string &name );
+    void flushNames();
+
+    inline uint64_t home( uint64_t hash ) const { return (uint64_t)( ( (__uint128_t)hash * _capacity ) >> 64 ); }
+    inline uint64_t distance( uint64_t slot, uint64_t home ) const { return slot >= home ? slot - home : slot + _capacity - home; }
+    inline uint64_t next( uint64_t slot ) const { return slot + 1 < _capacity ? slot + 1 : 0; }
+
+    OverflowKey overflowKey( const Slot &slot, uint64_t nameOffset ) const;
+    void placeSlot( Slot slot, uint64_t nameOffset, uint64_t i, uint64_t dist );
+    void setRead( Slot &slot, uint64_t nameOffset, const Read &read );
+
+    inline const Slot* table() const { return _mapped != NULL ? _mapped : &_slots[0]; }
+
+    void insertRead( const ReadKey &key, const std::string *name, const Read &read );
+    bool findRead( const ReadKey &key, const std::string *name, Read &read ) const;
+
+public:
+    //! Creates an empty index of reads aligned to the given references.
+    HashedReadIndex( const BamTools::RefVector &refs, const std::string &verifyFile = "" );
+
+    //! Creates an empty index, to be attached to a saved table.
+    HashedReadIndex();
+
+    ~HashedReadIndex();
+
+    //! Preallocates space for (exactly) \c reads reads.
+    void reserve( uint64_t reads );
+
+    //! Returns the memory (bytes) of a table sized for \c reads reads with reserve().
+    static uint64_t tableBytes( uint64_t reads );
+
+    void insert( const std::string &name, bool firstMate, const Read &read );
+    bool find( const std::string &name, bool firstMate, Read &read ) const;
+    uint64_t size() const;
+    uint64_t memoryUsage() const;
+    void clear();
+
+    //! Inserts a read given its fingerprint (the index must not verify names).
+    void insert( const ReadKey &key, const Read &read );
+
+    //! Looks up a read given its fingerprint (the index must not verify names).
+    bool find( const ReadKey &key, Read &read ) const;
+
+    //! Returns the raw table of slots (e.g. to save it on file).
+    const void* slotsData() const { return this->table(); }
+
+    //! Returns the number of slots of the table.
+    uint64_t slotsNum() const { return _capacity; }
+
+    //! Returns the size of a slot (bytes).
+    static size_t slotSize() { return sizeof(Slot); }
+
+    //! Returns the packing of reads in slots.
+    const ReadPacking& packing() const { return _packing; }
+
+    //! Returns the reads of the overflow table (e.g. to save them on file).
+    void overflowReads( std::vector< OverflowRead > &reads ) const;
+
+    //! Uses a read-only table of slots previously saved (e.g. a memory-mapped file).
+    /*!
+     * The table must remain valid until the index is cleared or destroyed.
+     * Reads cannot be inserted in an index attached to a table.
+     *
+     * \param slots         table of slots, as returned by slotsData()
+     * \param slotsNum      number of slots of the table
+     * \param size          number of reads in the table
+     * \param packing       packing of the reads in the table
+     * \param overflow      reads of the overflow table
+     * \param overflowNum   number of reads of the overflow table
+     */
+    void attach( const void *slots, uint64_t slotsNum, uint64_t size, const ReadPacking &packing,
+                 const OverflowRead *overflow, uint64_t overflowNum );
+};
+
+#endif	/* READINDEX_HPP */
@@ -0,0 +1,123 @@
+/*
+ *  This file is part of GAM-NGS.
+ *  Copyright (c) 2011 by Riccardo Vicedomini <rvicedomini@appliedgenomics.org>,
+ *  Francesco Vezzi <vezzi@appliedgenomics.org>,
+ *  Simone Scalabrin <scalabrin@appliedgenomics.org>,
+ *  Lars Arverstad <lars.arvestad@scilifelab.se>,
+ *  Alberto Policriti <policriti@appliedgenomics.org>,
+ *  Alberto Casagrande <casagrande@appliedgenomics.org>
+ *
+ *  GAM-NGS is an evolution of a previous work (GAM) done by Alberto Casagrande,
+ *  Cristian Del Fabbro, Simone Scalabrin, and Alberto Policriti.
+ *  In particular, GAM-NGS has been adapted to work on NGS data sets and it has
+ *  been written using GAM's software as starting point. Thus, it shares part of
+ *  GAM's source code.
+ *
+ *  GAM-NGS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GAM-NGS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GAM-NGS.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*!
+ * \file ReadPairSorter.hpp
+ * \brief Definition of ReadPairSorter class.
+ * \details This file contains the definition of the external sorter of read
+ *          pairs (the same read aligned on master and slave assemblies).
+ */
+
+#ifndef READPAIRSORTER_HPP
+#define	READPAIRSORTER_HPP
+
+#include <cstdio>
+#include <queue>
+#include <string>
+#include <vector>
+
+#include "types.hpp"
+
+#define READ_PAIR_SORTER_MEMORY (256 * 1024 * 1024) // default memory used to sort pairs (bytes)
+
+//! A read aligned on both master and slave assemblies.
+struct ReadPair
+{
+    int32_t s_ctg, s_start, s_end;  //!< slave alignment (end excluded)
+    int32_t m_ctg, m_start, m_end;  //!< master alignment (end excluded)
+    uint32_t lib;                   //!< slave library
+    uint32_t rev;                   //!< bit 0: master read reversed, bit 1: slave read reversed
+    uint64_t order;                 //!< insertion order (used to break ties)
+
+    //! Order by slave's coordinates.
+    inline bool operator<( const ReadPair &p ) const
+    {
+        if( s_ctg != p.s_ctg ) return s_ctg < p.s_ctg;
+        if( s_start != p.s_start ) return s_start < p.s_start;
+        if( lib != p.lib ) return lib < p.lib;
+        return order < p.order;
+    }
+};
+
+//! External sorter of read pairs, by slave's coordinates.
+/*!
+ * Pairs are kept in memory up to a given amount of memory; then they are
+ * sorted and spilled in temporary files (runs), which are merged when pairs
+ * are read back.
+ */
+class ReadPairSorter
+{
+private:
+    typedef std::pair< ReadPair, size_t > RunHead;
+
+    struct RunHeadGreater
+    {
+        inline bool operator()( const RunHead &a, const RunHead &b ) const { return b.first < a.first; }
+    };
+
+    std::string _tmpPrefix;
+    size_t _bufferSize;                 // max number of pairs kept in memory
+
+    std::vector< ReadPair > _buffer;
+    size_t _bufferPos;
+
+    std::vector< std::string > _runFiles;
+    std::vector< FILE* > _runs;
+    std::priority_queue< RunHead, std::vector<RunHead>, RunHeadGreater > _heads;
+
+    uint64_t _size;
+    bool _sorted;
+
+    void spill();
+    bool readPair( size_t run, ReadPair &pair );
+
+public:
+    //! Creates an empty sorter.
+    /*!
+     * \param tmpPrefix     prefix of temporary files
+     * \param maxMemory     memory used for the in-memory buffer (bytes)
+     */
+    ReadPairSorter( const std::string &tmpPrefix, uint64_t maxMemory = READ_PAIR_SORTER_MEMORY );
+    ~ReadPairSorter();
+
+    //! Adds a pair (only before sort() is called).
+    void push( const ReadPair &pair );
+
+    //! Ends the insertion of pairs and prepares them to be read in order.
+    void sort();
+
+    //! Retrieves the next pair in order (after sort() has been called).
+    bool next( ReadPair &pair );
+
+    uint64_t size() const { return _size; }
+    size_t runs() const { return _runFiles.size(); }
+};
+
+#endif	/* READPAIRSORTER_HPP */
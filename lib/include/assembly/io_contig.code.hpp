@@ -36,6 +36,7 @@
 #include<sstream>
 #include<vector>
 #include<stdexcept>
+#include<cstdlib>
 
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -566,7 +567,7 @@ void readNextSequence( std::istream &is, Contig &ctg )
 
 
 size_t
-loadSequences( const std::string &file, RefSequence &refSequence, const std::map< std::string, int32_t > &ctg2Id )
+loadSequences( const std::string &file, RefSequence &refSequence, const BamTools::BamReader &bamReader )
 {
 	std::ifstream ifs( file.c_str(), std::ifstream::in );
 
@@ -580,12 +581,17 @@ loadSequences( const std::string &file, RefSequence &refSequence, const std::map
 		std::string ctg_name;
 		readNextContigID( ifs, ctg_name );
 
-		std::map< std::string, int32_t >::const_iterator it = ctg2Id.find( ctg_name );
+		int32_t id = bamReader.GetReferenceID( ctg_name );
+		if( id < 0 || (size_t)id >= refSequence.size() )
+		{
+			std::cerr << "[error] contig " << ctg_name << " of file " << file << " is not in bam headers" << std::endl;
+			exit(1);
+		}
 
-		Contig *ctg = new Contig( ctg_name, refSequence[it->second].RefLength );
+		Contig *ctg = new Contig( ctg_name, refSequence[id].RefLength );
 		readNextSequence( ifs, *ctg );
 
-		refSequence[it->second].Sequence = ctg;
+		refSequence[id].Sequence = ctg;
 		
 		++num;
 	}
@@ -34,6 +34,8 @@
 #include <map>
 #include <string>
 
+#include "api/BamReader.h"
+
 #include "assembly/contig.hpp"
 #include "assembly/RefSequence.hpp"
 
@@ -113,6 +115,6 @@ void
 readNextSequence( std::istream &is, Contig &ctg );
 
 size_t
-loadSequences( const std::string &file, RefSequence &refSequence, const std::map< std::string, int32_t > &ctg2Id );
+loadSequences( const std::string &file, RefSequence &refSequence, const BamTools::BamReader &bamReader );
 
 #endif // _IO_CONTIG_
@@ -38,8 +38,13 @@
 #include <pthread.h>
 
 #include "api/BamAux.h"
+#include "api/BamConstants.h"
 #include "api/BamReader.h"
 #include "api/BamAlignment.h"
+#include "api/BamAlignmentBatch.h"
+
+class PairEvidenceCollector;
+class PairEvidenceFile;
 
 #define MIN_ISIZE 100
 #define MAX_ISIZE 1000000
@@ -60,41 +65,123 @@ public:
 };
 
 
+//! Partial statistics of the libraries (inserts' mean, sum of squared deviations and reads' length)
+struct LibStatistics
+{
+    std::vector< double > isize_mean;
+    std::vector< double > isize_m2;
+    std::vector< uint64_t > isize_count;
+    std::vector< uint64_t > reads_len;
+};
+
+
+//! Returns whether an alignment has a unique mapping according to NH (standard) and XT (bwa) tags.
+/*!
+ * Missing tags are assumed to mean a unique mapping. Tags are read from the raw record,
+ * so this works on alignments retrieved with GetNextAlignmentCore() as well.
+ */
+inline bool hasUniqueMapping( const BamAlignment &align )
+{
+    int32_t nh, xt;
+
+    if( !align.GetIntTag( "NH", nh ) ) nh = 1;  // standard SAM format field
+    if( !align.GetIntTag( "XT", xt ) ) xt = 'U'; // bwa field
+
+    return nh == 1 && xt == 'U';
+}
+
+
+//! Number of alignments decoded at once by region scans using BamReader::GetNextAlignmentBatch()
+#define ALIGNMENT_BATCH_SIZE 256
+
+//! Flags of alignments discarded by region scans (unmapped, secondary, failing quality checks or duplicate reads)
+#define BAD_ALIGNMENT_FLAGS ( Constants::BAM_ALIGNMENT_UNMAPPED | Constants::BAM_ALIGNMENT_SECONDARY | \
+                              Constants::BAM_ALIGNMENT_QC_FAILED | Constants::BAM_ALIGNMENT_DUPLICATE )
+
+//! Selects on a batch the tags needed by hasUniqueMapping( const BamAlignmentBatch&, size_t ).
+inline void selectUniqueMappingTags( BamAlignmentBatch &batch )
+{
+    batch.ClearTags();
+    batch.AddIntTag( "NH", 1 );   // standard SAM format field
+    batch.AddIntTag( "XT", 'U' ); // bwa field
+}
+
+//! Returns whether the i-th alignment of a batch has a unique mapping (see selectUniqueMappingTags).
+inline bool hasUniqueMapping( const BamAlignmentBatch &batch, size_t i )
+{
+    return batch.TagValues[0][i] == 1 && batch.TagValues[1][i] == 'U';
+}
+
 //! class that can handle multiple bam files of different libraries aligned on the same assembly
 class MultiBamReader
 {
 private:
 	bool _is_open;								// whether every bam file has been opened successfully
+	int _sort_order;							// order used to merge the alignments of the bam files
+	uint32_t _last_lib;							// library of the last alignment retrieved
+	int _decompression_threads;					// threads decompressing each bam file (0 = on the reading thread)
 
     std::vector< BamReader* > _bam_readers; 	// pointers to BAM readers
+    std::vector< std::string > _filenames;		// BAM filenames
     std::vector< BamAlignment > _bam_aligns; 	// Next alignment to be processed for each reader
     std::vector< bool > _valid_aligns;			// Whether an alignment is valid (to be processed)
+    std::vector< bool > _first_aligns;			// Whether the alignment loaded is the first one of the file
 
-    std::vector< pthread_mutex_t > _bam_mutex;	// mutexes associated to each BAM reader
+    std::vector< uint32_t > _heap;				// min-heap of readers with a valid alignment (by alignments' order)
+    bool _heap_valid;							// whether the heap reflects current alignments
+
+    std::vector< std::vector< BamReader* > > _reader_pools;	// idle clones of each BAM reader, for region queries
+    pthread_mutex_t _pool_mutex;				// mutex guarding the pools
 
     std::vector< int32_t > _minInsert;			// min insert size to compute mean/std
     std::vector< int32_t > _maxInsert;			// max insert size to compute mean/std
 
     std::vector< double > _isize_mean;			// mean insert size for the libraries
     std::vector< double > _isize_std;			// standard deviation of insert sizes for the libraries
+    std::vector< double > _isize_m2;			// sum of squared deviations from the mean insert size
     std::vector< uint64_t > _isize_count;
 
     uint64_t _asm_size;							// assembly size
     std::vector< uint64_t > _reads_len;			// sum of libraries' reads length
     std::vector< double > _coverage;			// libraries' mean coverage
 
+    PairEvidenceCollector *_evidence_collector;	// records alignments retrieved while updating statistics (if not NULL)
+    const PairEvidenceFile *_evidence;			// pair evidence answering region queries in place of BAM files (if not NULL)
+
+    bool precedes( uint32_t a, uint32_t b ) const; // whether next alignment of reader a precedes the one of reader b
+    void buildHeap();
+    void siftDown( size_t pos );
+    void loadNextAlignment( uint32_t lib );		// loads (core fields and name of) the next alignment of a reader
+
+    void allocate( size_t bams );				// sizes per-library vectors
+    void startReading();						// loads the first alignment of each reader
+
 public:
+    typedef enum
+    {
+        SORT_BY_COORDINATE = 0,	// (RefID,Position) order of coordinate-sorted bam files
+        SORT_BY_NAME = 1		// read names' order of name-sorted bam files
+    } sort_order_t;
+
     MultiBamReader();
     ~MultiBamReader();
 
-    bool Open( const std::vector< std::string > &filenames );
+    bool Open( const std::vector< std::string > &filenames, bool loadIndex = true );
     bool Open( const std::string &filename );
+    bool Open( const MultiBamReader &reader ); // opens clones of another reader's files (sharing header, index and mapping), with its min/max insert sizes
     void Close();
 
     inline uint32_t size() const { return (this->_bam_readers).size(); }
 	inline BamReader& at( const size_t &index ) const { return *(this->_bam_readers.at(index)); }
     inline BamReader& operator[]( const size_t &index ) const { return *(this->_bam_readers[index]); }
 
+	void setSortOrder( sort_order_t order );
+
+	// sets the number of threads that read ahead and decompress each bam file (0 = none).
+	// It is kept when files are (re)opened and copied by Open( const MultiBamReader& ).
+	void setDecompressionThreads( int threads );
+	inline int getDecompressionThreads() const { return _decompression_threads; }
+
 	void setMinMaxInsertSizes( const std::vector<int32_t> &minInsert, const std::vector<int32_t> &maxInsert );
 
     BamReader* getBamReader( uint32_t idx );
@@ -106,20 +193,59 @@ public:
     double getMeanCoverage();
     double getGlobCoverage();
 
-    void lockBamReader( uint32_t idx );
-    void unlockBamReader( uint32_t idx );
+    // returns a reader of library idx that is used only by the caller (it can be positioned
+    // with SetRegion), taken from the pool or cloned; it has to be returned with checkinBamReader
+    BamReader* checkoutBamReader( uint32_t idx );
+    void checkinBamReader( uint32_t idx, BamReader* reader );
 
-    bool Rewind();
+    // alignments retrieved while updating statistics are recorded by the collector (NULL = none).
+    // It is kept when files are (re)opened and copied by Open( const MultiBamReader& ).
+    void setEvidenceCollector( PairEvidenceCollector *collector );
+
+    // pair evidence of the libraries (NULL = none), used by region queries in place of BAM files
+    void setEvidence( const PairEvidenceFile *evidence );
+    inline const PairEvidenceFile* getEvidence() const { return _evidence; }
+
+    bool Rewind(); // files that cannot seek (e.g. "-" for stdin) can only be rewound before their alignments are read
     bool Jump( uint32_t refID, uint32_t position = 0 );
     bool SetRegion ( const uint32_t &leftRefID, const uint32_t &leftPosition, const uint32_t &rightRefID, const uint32_t &rightPosition );
 
     bool computeStatistics();
 
+    void resetStatistics();
+    void finalizeStatistics(); // computes standard deviations and coverages from the partial statistics
+    void getStatistics( LibStatistics &stats ) const;
+    void mergeStatistics( const LibStatistics &stats );
+
     bool GetNextAlignment( BamAlignment &align, bool update_stats = false );
+    bool GetNextAlignmentCore( BamAlignment &align, bool update_stats = false ); // only core fields and read name are decoded (tags can be read with BamAlignment::GetIntTag)
+    inline uint32_t getLastLibraryId() const { return _last_lib; } // library of the last alignment retrieved
     const RefVector& GetReferenceData() const;
 
     void writeStatsToFile( const std::string &filename ) const;
     uint32_t readStatsFromFile( const std::string &filename );
 };
 
+
+//! Reader of a library checked out from the pool of a MultiBamReader for the lifetime of the object.
+class PooledBamReader
+{
+private:
+	MultiBamReader &_multi_reader;
+	uint32_t _lib;
+	BamReader *_reader;
+
+	PooledBamReader( const PooledBamReader& );				// non-copyable
+	PooledBamReader& operator=( const PooledBamReader& );
+
+public:
+	PooledBamReader( MultiBamReader &multiReader, uint32_t lib ) :
+		_multi_reader(multiReader), _lib(lib), _reader( multiReader.checkoutBamReader(lib) ) {}
+
+	~PooledBamReader() { _multi_reader.checkinBamReader( _lib, _reader ); }
+
+	inline BamReader* operator->() const { return _reader; }
+	inline BamReader& operator*() const { return *_reader; }
+};
+
 #endif /* MULTI_BAM_READER_H_ */
@@ -0,0 +1,202 @@
+/*
+ *  This file is part of GAM-NGS.
+ *  Copyright (c) 2011 by Riccardo Vicedomini <rvicedomini@appliedgenomics.org>,
+ *  Francesco Vezzi <vezzi@appliedgenomics.org>,
+ *  Simone Scalabrin <scalabrin@appliedgenomics.org>,
+ *  Lars Arverstad <lars.arvestad@scilifelab.se>,
+ *  Alberto Policriti <policriti@appliedgenomics.org>,
+ *  Alberto Casagrande <casagrande@appliedgenomics.org>
+ *
+ *  GAM-NGS is an evolution of a previous work (GAM) done by Alberto Casagrande,
+ *  Cristian Del Fabbro, Simone Scalabrin, and Alberto Policriti.
+ *  In particular, GAM-NGS has been adapted to work on NGS data sets and it has
+ *  been written using GAM's software as starting point. Thus, it shares part of
+ *  GAM's source code.
+ *
+ *  GAM-NGS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GAM-NGS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GAM-NGS.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*!
+ * \file PairEvidence.hpp
+ * \brief Definition of PairEvidenceCollector and PairEvidenceFile classes.
+ * \details This file contains the definition of the classes that save the core
+ *          fields of the alignments of an assembly's libraries (as columns sorted
+ *          by position) on a binary file, so that gam-merge can answer region
+ *          queries from a memory mapping instead of decoding BAM files.
+ */
+
+#ifndef PAIREVIDENCE_HPP
+#define	PAIREVIDENCE_HPP
+
+#include <string>
+#include <vector>
+
+#include "api/BamAux.h"
+#include "api/BamAlignment.h"
+
+using namespace BamTools;
+
+class MultiBamReader;
+
+#define PAIR_EVIDENCE_MAGIC "GAMPEVD"
+#define PAIR_EVIDENCE_VERSION 1
+
+//! SAM flags kept for each alignment.
+#define EVIDENCE_SAM_FLAGS 0x0fff
+//! Flag set when the mate is aligned on another reference (or is unmapped without a reference).
+#define EVIDENCE_MATE_OTHER_REF 0x4000
+//! Flag set when the alignment has a unique mapping (see hasUniqueMapping).
+#define EVIDENCE_UNIQUE_MAPPING 0x8000
+
+
+//! Alignments of a library that may overlap a region of a contig, as columns sorted by position.
+/*!
+ * Candidates are the alignments with index in [Begin,End): those starting before the
+ * region may not overlap it, and have to be checked with overlaps().
+ */
+struct EvidenceRegion
+{
+    const int32_t *Position;        // 0-based start
+    const int32_t *EndPosition;     // position following the last aligned base
+    const int32_t *MatePosition;
+    const uint16_t *Flag;           // SAM flags (EVIDENCE_SAM_FLAGS) and EVIDENCE_* flags
+
+    size_t Begin;
+    size_t End;
+    int32_t Left;                   // left bound of the region
+
+    //! Whether the i-th candidate overlaps the region (as BamReader::SetRegion would select it).
+    inline bool overlaps( size_t i ) const { return Position[i] >= Left || EndPosition[i] > Left; }
+};
+
+
+//! Collects the alignments of the libraries of an assembly while they are read.
+/*!
+ * Unmapped, secondary, duplicate and failing quality checks alignments are discarded.
+ * Memory used is about 14 bytes per alignment.
+ */
+class PairEvidenceCollector
+{
+private:
+    struct Columns
+    {
+        std::vector< int32_t > position;
+        std::vector< int32_t > endPosition;
+        std::vector< int32_t > matePosition;
+        std::vector< uint16_t > flag;
+        int32_t maxSpan;                    // max length of alignments (on the reference)
+
+        Columns() : maxSpan(0) {}
+    };
+
+    std::vector< std::vector< Columns > > _columns; // by library and contig
+
+public:
+    //! Initializes empty columns for the libraries of an assembly, with the given references.
+    void init( uint32_t libs, const RefVector &refs );
+
+    //! Records an alignment of a library.
+    /*!
+     * Alignments of different contigs can be added concurrently. Tags are read from
+     * the raw record, so alignments retrieved with GetNextAlignmentCore() can be added.
+     */
+    void add( uint32_t lib, const BamAlignment &align );
+
+    //! Returns the number of alignments recorded.
+    uint64_t size() const;
+
+    //! Sorts alignments by position and saves them.
+    /*!
+     * \param filename      output file
+     * \param bamReader     BAM reader of the assembly, whose files and references are saved to check the file when loaded
+     */
+    void write( const std::string &filename, const MultiBamReader &bamReader );
+
+    //! Releases memory.
+    void clear();
+};
+
+
+//! Pair-evidence file, memory-mapped.
+/*!
+ * The file contains, in order: a header; for each library its BAM file (name, size and
+ * modification time); reference names and lengths; for each library and contig the
+ * number of alignments, the max alignment length and the offset of its columns
+ * (positions, end positions, mate positions and flags).
+ *
+ * A region query takes O(log n) time to find the alignments starting in it (or less
+ * than the max alignment length before it), plus the time to visit them.
+ */
+class PairEvidenceFile
+{
+private:
+    struct Header
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t libs;
+        uint32_t refs;
+        uint32_t reserved;
+        uint64_t alignments;
+        uint64_t contigsOffset;     // offset of the table of contigs
+        uint64_t fileSize;
+    };
+
+    struct ContigEntry
+    {
+        uint64_t offset;            // offset of the columns
+        uint64_t alignments;
+        int32_t maxSpan;
+        int32_t reserved;
+    };
+
+    std::string _filename;
+    void *_data;
+    uint64_t _size;
+
+    uint32_t _libs;
+    uint32_t _refs;
+    uint64_t _alignments;
+    const ContigEntry *_contigs;
+
+    friend class PairEvidenceCollector;
+
+public:
+    PairEvidenceFile();
+    ~PairEvidenceFile();
+
+    //! Maps a pair-evidence file.
+    /*!
+     * The file is checked against the BAM files of an assembly (same files, sizes,
+     * modification times and references).
+     *
+     * \param filename      pair-evidence file
+     * \param bamReader     BAM reader of the assembly
+     * \return whether the file has been loaded (otherwise a warning tells why).
+     */
+    bool load( const std::string &filename, const MultiBamReader &bamReader );
+
+    void close();
+
+    inline bool isLoaded() const { return _data != NULL; }
+
+    //! Returns the number of alignments of the file.
+    inline uint64_t size() const { return _alignments; }
+
+    //! Returns the alignments of a library that may overlap bases [begin,end) of a contig.
+    EvidenceRegion getRegion( uint32_t lib, int32_t refID, int32_t begin, int32_t end ) const;
+};
+
+#endif	/* PAIREVIDENCE_HPP */
@@ -0,0 +1,118 @@
+/*
+ *  This file is part of GAM-NGS.
+ *  Copyright (c) 2011 by Riccardo Vicedomini <rvicedomini@appliedgenomics.org>,
+ *  Francesco Vezzi <vezzi@appliedgenomics.org>,
+ *  Simone Scalabrin <scalabrin@appliedgenomics.org>,
+ *  Lars Arverstad <lars.arvestad@scilifelab.se>,
+ *  Alberto Policriti <policriti@appliedgenomics.org>,
+ *  Alberto Casagrande <casagrande@appliedgenomics.org>
+ *
+ *  GAM-NGS is an evolution of a previous work (GAM) done by Alberto Casagrande,
+ *  Cristian Del Fabbro, Simone Scalabrin, and Alberto Policriti.
+ *  In particular, GAM-NGS has been adapted to work on NGS data sets and it has
+ *  been written using GAM's software as starting point. Thus, it shares part of
+ *  GAM's source code.
+ *
+ *  GAM-NGS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GAM-NGS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GAM-NGS.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+/*!
+ * \file RegionMetricsCache.hpp
+ * \brief Definition of RegionMetricsCache class.
+ * \details This file contains the definition of the cache memoizing the statistics
+ *          of the regions scanned by RegionScanner.
+ */
+
+#ifndef REGIONMETRICSCACHE_HPP
+#define	REGIONMETRICSCACHE_HPP
+
+#include <list>
+#include <map>
+#include <pthread.h>
+
+#include "bam/RegionScan.hpp"
+
+//! Thread-safe LRU cache of region statistics, shared by every RegionScanner.
+/*!
+ * Entries are keyed by assembly (BAM reader), library and query (contig, bounds,
+ * statistics and their parameters). The cache is split in shards, each with its own
+ * lock and its share of the memory budget, so that merge threads rarely contend.
+ */
+class RegionMetricsCache
+{
+private:
+    struct Key
+    {
+        const MultiBamReader *assembly;
+        uint32_t lib;
+        RegionQuery query;
+
+        bool operator<( const Key &other ) const;
+    };
+
+    struct Entry
+    {
+        Key key;
+        RegionMetrics metrics;
+    };
+
+    typedef std::list< Entry > EntryList;   // most recently used first
+
+    struct Shard
+    {
+        pthread_mutex_t mutex;
+        EntryList entries;
+        std::map< Key, EntryList::iterator > index;
+        uint64_t size;          // entries
+        uint64_t capacity;      // max entries
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t evictions;
+    };
+
+    static const size_t SHARDS = 16;
+
+    Shard _shards[SHARDS];
+    volatile uint64_t _capacity;    // max entries (0 = disabled)
+
+    RegionMetricsCache();
+    ~RegionMetricsCache();
+
+    Shard& shardOf( const Key &key );
+    static void evict( Shard &shard );
+
+public:
+    //! Returns the cache shared by the region scanners.
+    static RegionMetricsCache& instance();
+
+    //! Sets the memory (bytes) available to the cache; 0 disables it and drops every entry.
+    void setCapacity( uint64_t bytes );
+
+    //! Returns whether region statistics are cached.
+    inline bool isEnabled() const { return _capacity > 0; }
+
+    //! Looks the statistics of a region up (returns false if not cached).
+    bool lookup( const MultiBamReader *assembly, uint32_t lib, const RegionQuery &query, RegionMetrics &metrics );
+
+    //! Stores the statistics of a region, evicting the least recently used ones beyond capacity.
+    void insert( const MultiBamReader *assembly, uint32_t lib, const RegionQuery &query, const RegionMetrics &metrics );
+
+    //! Retrieves cache counters (bytes is the memory used by cached entries).
+    void getStatistics( uint64_t &hits, uint64_t &misses, uint64_t &evictions, uint64_t &bytes );
+
+    //! Memory (bytes) used by an entry.
+    static uint64_t entryBytes();
+};
+
+#endif	/* REGIONMETRICSCACHE_HPP */
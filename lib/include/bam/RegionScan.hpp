@@ -0,0 +1,134 @@
+/*
+ *  This file is part of GAM-NGS.
+ *  Copyright (c) 2011 by Riccardo Vicedomini <rvicedomini@appliedgenomics.org>,
+ *  Francesco Vezzi <vezzi@appliedgenomics.org>,
+ *  Simone Scalabrin <scalabrin@appliedgenomics.org>,
+ *  Lars Arverstad <lars.arvestad@scilifelab.se>,
+ *  Alberto Policriti <policriti@appliedgenomics.org>,
+ *  Alberto Casagrande <casagrande@appliedgenomics.org>
+ *
+ *  GAM-NGS is an evolution of a previous work (GAM) done by Alberto Casagrande,
+ *  Cristian Del Fabbro, Simone Scalabrin, and Alberto Policriti.
+ *  In particular, GAM-NGS has been adapted to work on NGS data sets and it has
+ *  been written using GAM's software as starting point. Thus, it shares part of
+ *  GAM's source code.
+ *
+ *  GAM-NGS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GAM-NGS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GAM-NGS.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+/*!
+ * \file RegionScan.hpp
+ * \brief Definition of RegionScanner class.
+ * \details This file contains the definition of the class that reads the alignments
+ *          of a library overlapping regions of an assembly's contigs and computes
+ *          the statistics (inserts, pairs crossing a gap, coverage) of each region.
+ */
+
+#ifndef REGIONSCAN_HPP
+#define	REGIONSCAN_HPP
+
+#include <vector>
+
+#include "bam/MultiBamReader.hpp"
+
+//! Statistics of the inserts of the read pairs included in a region.
+#define REGION_INSERTS 0x1
+//! Statistics of the read pairs crossing the gap following a region.
+#define REGION_GAP 0x2
+//! Read coverage of the bases of a region.
+#define REGION_COVERAGE 0x4
+
+
+//! Region [start,end] of a contig to be scanned with a library, and the statistics to be computed.
+struct RegionQuery
+{
+    int32_t refID;
+    int32_t start;
+    int32_t end;            // last base of the region
+    uint32_t metrics;       // REGION_* flags
+
+    int32_t minInsert;      // inserts accepted (REGION_INSERTS)
+    int32_t maxInsert;      // max insert, for inserts and gap statistics
+
+    int32_t gapPos;         // position of the gap (REGION_GAP)
+    int32_t seqLen;         // length of the contig (REGION_GAP)
+
+    RegionQuery();
+    RegionQuery( int32_t refID, int32_t start, int32_t end, uint32_t metrics );
+};
+
+
+//! Statistics of a region, computed by RegionScanner.
+struct RegionMetrics
+{
+    uint64_t reads;         // good quality alignments overlapping the region
+
+    // REGION_INSERTS: pairs (counted on first mates) included in the region, with insert in [minInsert,maxInsert]
+    uint64_t inserts;
+    uint64_t insertSum;
+
+    // REGION_GAP: bases of forward reads starting in the region whose mate is expected to cross the gap,
+    // bases of those whose mate is correctly aligned across the gap and number of reads considered
+    uint64_t expGapBases;
+    uint64_t goodGapBases;
+    uint64_t gapReads;
+
+    // REGION_COVERAGE
+    uint64_t coverageSum;   // sum of the coverage of the bases of the region
+    uint32_t minCoverage;
+    uint32_t maxCoverage;
+
+    RegionMetrics();
+};
+
+
+//! Computes statistics of regions of a contig with the alignments of a library.
+/*!
+ * Alignments are read from the pair evidence of the library, when loaded, or decoded in
+ * batches from the BAM file. Regions are visited in coordinate order, with a single pass
+ * over the alignments overlapping any of them, and each alignment is counted for all the
+ * regions it overlaps (as BamReader::SetRegion() would select it). Bad quality alignments
+ * are discarded; multiple mappings are ignored unless multiplicity filter is disabled.
+ *
+ * Coverage is computed with a difference array, so each alignment is recorded in constant time.
+ *
+ * When RegionMetricsCache is enabled, statistics of regions already scanned (with the same
+ * assembly, library and parameters) are taken from the cache.
+ */
+class RegionScanner
+{
+private:
+    MultiBamReader &_bamReader;
+
+    struct Sweep;
+
+    //! Scans a set of regions (see scan()), without looking them up in the cache.
+    void scanRegions( uint32_t lib, const std::vector< RegionQuery > &queries, std::vector< RegionMetrics > &metrics );
+
+public:
+    RegionScanner( MultiBamReader &bamReader );
+
+    //! Computes the statistics of a set of regions with a library.
+    /*!
+     * \param lib       library index
+     * \param queries   regions (in any order)
+     * \param metrics   statistics of the regions, in the order of the queries
+     */
+    void scan( uint32_t lib, const std::vector< RegionQuery > &queries, std::vector< RegionMetrics > &metrics );
+
+    //! Computes the statistics of a region with a library.
+    RegionMetrics scan( uint32_t lib, const RegionQuery &query );
+};
+
+#endif	/* REGIONSCAN_HPP */
@@ -107,12 +107,6 @@ private:
 
     void bubbleDFS( Vertex v, std::vector<char> &colors, bool &found );
 
-    void getRegionScore( MultiBamReader &peBamReader, MultiBamReader &mpBamReader, EdgeKindType kind,
-            std::list<Block>& b1, std::list<Block>& b2, double &weight, int32_t &rnum, bool &min_cov );
-
-    void getLibRegionScore( MultiBamReader &bamReader, EdgeKindType kind, std::list<Block> &b1, std::list<Block> &b2,
-            double &weight, int32_t &rnum, bool &min_cov );
-
 public:
 
     //! A constructor.
@@ -0,0 +1,114 @@
+/*
+ *  This file is part of GAM-NGS.
+ *  Copyright (c) 2011 by Riccardo Vicedomini <rvicedomini@appliedgenomics.org>,
+ *  Francesco Vezzi <vezzi@appliedgenomics.org>,
+ *  Simone Scalabrin <scalabrin@appliedgenomics.org>,
+ *  Lars Arverstad <lars.arvestad@scilifelab.se>,
+ *  Alberto Policriti <policriti@appliedgenomics.org>,
+ *  Alberto Casagrande <casagrande@appliedgenomics.org>
+ *
+ *  GAM-NGS is an evolution of a previous work (GAM) done by Alberto Casagrande,
+ *  Cristian Del Fabbro, Simone Scalabrin, and Alberto Policriti.
+ *  In particular, GAM-NGS has been adapted to work on NGS data sets and it has
+ *  been written using GAM's software as starting point. Thus, it shares part of
+ *  GAM's source code.
+ *
+ *  GAM-NGS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GAM-NGS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GAM-NGS.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*!
+ * \file EdgeWeightPlanner.hpp
+ * \brief Definition of EdgeWeightPlanner class.
+ * \details This file contains the definition of the class computing the weights
+ *          of the edges of compact assembly graphs with one scan of each library.
+ */
+
+#ifndef EDGEWEIGHTPLANNER_HPP
+#define	EDGEWEIGHTPLANNER_HPP
+
+#include <vector>
+
+#include "bam/MultiBamReader.hpp"
+#include "bam/RegionScan.hpp"
+#include "graphs/CompactAssemblyGraph.hpp"
+
+//! Computes the weights of the edges of several compact assembly graphs at once.
+/*!
+ * The weight of an edge is given by the read pairs crossing the gap between the
+ * regions of its blocks, counted for each library on a window of the contig preceding
+ * the gap. Windows of every edge added are collected first; then each library is read
+ * once, with a single RegionScanner pass over all its windows.
+ */
+class EdgeWeightPlanner
+{
+private:
+    typedef CompactAssemblyGraph::Edge Edge;
+
+    //! Libraries scanned for the edges of a kind (PE or MP alignments of master or slave).
+    enum { MASTER_PE = 0, MASTER_MP, SLAVE_PE, SLAVE_MP, LIBRARY_SETS };
+
+    //! Region [s1,s2] of a contig preceding the gap at position t, scanned for an edge with a library.
+    struct GapWindow
+    {
+        RegionQuery query;
+        size_t edge;            // index of the planned edge
+    };
+
+    //! Scores of a planned edge with the libraries of a set.
+    struct LibScores
+    {
+        bool included;                  // whether a region includes the other one (no window is scanned)
+        std::vector< double > score;    // by library
+        std::vector< int32_t > rnum;
+    };
+
+    struct PlannedEdge
+    {
+        CompactAssemblyGraph *graph;
+        Edge edge;
+        EdgeKindType kind;
+        LibScores scores[2];            // PE and MP libraries
+    };
+
+    MultiBamReader* _bamReaders[LIBRARY_SETS];
+    std::vector< PlannedEdge > _edges;
+    std::vector< std::vector< GapWindow > > _windows[LIBRARY_SETS];    // by library set and library
+
+    void planWindows( size_t edgeIdx, int set, LibScores &scores );
+    void scanLibrary( int set, uint32_t lib );
+
+    //! Weight of an edge with the libraries of a set (the library with most evidences is chosen).
+    static void libSetWeight( const LibScores &scores, double &weight, int32_t &rnum, bool &min_cov );
+
+    //! Weight of an edge given its weights with PE and MP libraries.
+    static void combineScores( double pe_weight, int32_t pe_rnum, bool pe_min_cov,
+                               double mp_weight, int32_t mp_rnum, bool mp_min_cov,
+                               double &weight, int32_t &rnum, bool &min_cov );
+
+public:
+    EdgeWeightPlanner( MultiBamReader &masterBamReader, MultiBamReader &masterMpBamReader,
+                       MultiBamReader &slaveBamReader, MultiBamReader &slaveMpBamReader );
+
+    //! Plans the windows to be scanned for the edges of a graph.
+    void addGraph( CompactAssemblyGraph *graph );
+
+    //! Returns the number of windows planned.
+    uint64_t windows() const;
+
+    //! Scans every library once and sets the weights of the edges of the graphs added.
+    void run();
+};
+
+#endif	/* EDGEWEIGHTPLANNER_HPP */
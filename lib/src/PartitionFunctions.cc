@@ -44,10 +44,13 @@
 
 #include "OptionsMerge.hpp"
 
+#include "bam/RegionScan.hpp"
+
 #include "PartitionFunctions.hpp"
 #include "graphs/PairedGraph.code.hpp"
 #include "graphs/AssemblyGraph.hpp"
 #include "graphs/CompactAssemblyGraph.hpp"
+#include "graphs/EdgeWeightPlanner.hpp"
 #include "pctg/PairedContig.hpp"
 
 #include "UtilityFunctions.hpp"
@@ -78,11 +81,19 @@ partitionBlocks( const std::list<Block> &blocks )
 
     uint32_t ag_forks = 0, ag_linears = 0, ag_cycles = 0, ag_bubbles = 0; // counters for the different types of assemblies's graphs.
 
+	// edge weights of all the graphs are computed at once, scanning each library a single time
+	EdgeWeightPlanner planner( masterBam, masterMpBam, slaveBam, slaveMpBam );
+
+	std::vector< CompactAssemblyGraph* > compactGraphs;
+	std::vector< std::string > compactGraphFiles;
+	std::vector< bool > compactGraphCyclic;
+
     // for each partition of blocks
     std::vector< std::list<Block> >::iterator pcb;
     for( pcb = pairedContigsBlocks.begin(); pcb != pairedContigsBlocks.end(); ++pcb )
     {
 		std::stringstream ff1,ff2,ff3;
+		bool is_cyclic = false;
 
         // create an assembly graph
         AssemblyGraph *ag = new AssemblyGraph( *pcb, agId );
@@ -90,8 +101,7 @@ partitionBlocks( const std::list<Block> &blocks )
 		// collapse paths which shares the same master/slave contigs
 		CompactAssemblyGraph *cg = new CompactAssemblyGraph(*ag);
 		//std::cerr << "CompactAssemblyGraph_" << agId << " created." << std::endl;
-		cg->computeEdgeWeights( masterBam, masterMpBam, slaveBam, slaveMpBam );
-		//std::cerr << "CompactAssemblyGraph_" << agId << " weights computed." << std::endl;
+		planner.addGraph( cg );
 
 		try
 		{
@@ -131,6 +141,7 @@ partitionBlocks( const std::list<Block> &blocks )
 		catch( boost::not_a_dag ) // if the graph is cyclic.
 		{
 			ag_cycles++;
+			is_cyclic = true;
 
 			ff1 << "./gam_graphs/AssemblyGraph_" << agId << "_cyclic.dot";
 			ff2 << "./gam_graphs/CompactGraph_" << agId << "_cyclic.dot";
@@ -145,19 +156,35 @@ partitionBlocks( const std::list<Block> &blocks )
 				ag->writeGraphviz(ss);
 				ss.close();
 			}
+		}
+
+		compactGraphs.push_back( cg );
+		compactGraphFiles.push_back( ff2.str() );
+		compactGraphCyclic.push_back( is_cyclic );
+
+        agId++; // increase assembly graph counter
+		delete ag; // free AssemblyGraph
+    }
 
-			boost::filesystem::path p2(ff2.str().c_str());
+	planner.run();
+	//std::cerr << "CompactAssemblyGraph weights computed." << std::endl;
+
+	// compact graphs are written once their edges have been weighted
+	for( size_t i=0; i < compactGraphs.size(); i++ )
+	{
+		if( g_options.outputGraphs )
+		{
+			boost::filesystem::path p2(compactGraphFiles[i].c_str());
 			if( not boost::filesystem::exists(p2) )
 			{
-				std::ofstream ss( ff2.str().c_str() );
-				cg->writeGraphviz(ss);
+				std::ofstream ss( compactGraphFiles[i].c_str() );
+				compactGraphs[i]->writeGraphviz(ss);
 				ss.close();
 			}
 		}
 
-        agId++; // increase assembly graph counter
-		delete ag; // free AssemblyGraph
-    }
+		if( compactGraphCyclic[i] ) delete compactGraphs[i]; // cyclic graphs are not merged
+	}
 
     _g_statsFile << "[graphs stats]\n"
 		<< "Linears = " << ag_linears << "\n"
@@ -173,7 +200,6 @@ partitionBlocks( const std::list<Block> &blocks )
 std::vector<double> computeZScore( MultiBamReader &multiBamReader, const uint64_t &refID, uint32_t start, uint32_t end )
 {
 	uint32_t libs;
-	BamReader* bamReader;
 	double lib_isize_mean, lib_isize_std;
 
 	uint32_t minInsertNum = 5;
@@ -184,73 +210,25 @@ std::vector<double> computeZScore( MultiBamReader &multiBamReader, const uint64_
 	if( libs == 0 ) return z_score;
 
 	unsigned int times_std = 3;
+	RegionScanner scanner( multiBamReader );
 
 	for( int i=0; i<libs; i++ )
 	{
 		lib_isize_mean = multiBamReader.getISizeMean(i);
 		lib_isize_std = multiBamReader.getISizeStd(i);
-		bamReader = multiBamReader.getBamReader(i);
 
 		if( lib_isize_std == 0 ) continue;
 
-		uint32_t min_insert = ( lib_isize_mean > times_std*lib_isize_std ) ? lib_isize_mean - times_std*lib_isize_std : 0;
-		uint32_t max_insert = lib_isize_mean + times_std*lib_isize_std;
-
-		BamAlignment align;
-		uint64_t inserts=0, spanCov=0;
-		int32_t nh, xt; // molteplicità delle read (nh->standard, xt->bwa)
-
-		multiBamReader.lockBamReader(i);
-
-		bamReader->SetRegion( refID, start, refID, end+1 );
-		while( bamReader->GetNextAlignmentCore(align) ) // for each read in the region
-		{
-			if( !align.IsMapped() || align.Position < 0 || align.IsDuplicate() || !align.IsPrimaryAlignment() || align.IsFailedQC() ||
-				!align.IsMateMapped() || align.RefID != align.MateRefID ) continue;
-
-			int32_t read_start = align.Position;
-			int32_t read_end = align.GetEndPosition() - 1;
-			int32_t read_len = read_end - read_start + 1;
-			int32_t mate_start = align.MatePosition;
-			int32_t mate_end = align.MatePosition + read_len - 1;
-
-			if( read_start < start || read_end > end ) continue;
-			if( mate_start < start || mate_end > end ) continue;
-
-			align.BuildCharData();
-			if( !align.GetTag(std::string("NH"),nh) ) nh = 1;	// standard SAM format field
-			if( !align.GetTag(std::string("XT"),xt) ) xt = 'U'; // bwa field
-			bool is_uniq_mapped = g_options.noMultiplicityFilter || (nh == 1 && xt == 'U');
-
-			if( !is_uniq_mapped ) continue;
-
-			if( align.IsFirstMate() )
-			{
-				if( read_start < mate_start )
-				{
-					int32_t i_size = (mate_start + read_len) - read_start;
-					if( i_size < min_insert || i_size > max_insert ) continue;
-
-					inserts++;
-					spanCov += i_size;
-				}
-				else
-				{
-					int32_t i_size = read_end - mate_start + 1;
-					if( i_size < min_insert || i_size > max_insert ) continue;
-
-					inserts++;
-					spanCov += i_size;
-				}
-			}
-		} // end while
+		RegionQuery query( refID, start, end, REGION_INSERTS );
+		query.minInsert = (uint32_t)( ( lib_isize_mean > times_std*lib_isize_std ) ? lib_isize_mean - times_std*lib_isize_std : 0 );
+		query.maxInsert = (uint32_t)( lib_isize_mean + times_std*lib_isize_std );
 
-		multiBamReader.unlockBamReader(i);
+		RegionMetrics metrics = scanner.scan( i, query );
 
-		if( inserts > minInsertNum )
+		if( metrics.inserts > minInsertNum )
 		{
-			double localMean = spanCov/(double)inserts;
-			z_score[i] = (localMean - lib_isize_mean)/(double)(lib_isize_std/sqrt(inserts));
+			double localMean = metrics.insertSum/(double)metrics.inserts;
+			z_score[i] = (localMean - lib_isize_mean)/(double)(lib_isize_std/sqrt(metrics.inserts));
 		}
 	}
 
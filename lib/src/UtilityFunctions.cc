@@ -30,6 +30,8 @@
 
 #include "UtilityFunctions.hpp"
 
+#include <ctype.h>
+
 #include <boost/algorithm/string.hpp>
 
 char * getPathBaseName( char *path )
@@ -122,6 +124,42 @@ void loadFileNames( const std::string &input_file, std::vector< std::string > &n
 }
 
 
+int compareReadNames( const std::string &a, const std::string &b )
+{
+	// "natural" order used by samtools: digit runs are compared by their numeric value
+	const unsigned char *pa = (const unsigned char*) a.c_str();
+	const unsigned char *pb = (const unsigned char*) b.c_str();
+	const unsigned char *sa = pa, *sb = pb;
+
+	while( *pa && *pb )
+	{
+		if( isdigit(*pa) && isdigit(*pb) )
+		{
+			while( *pa == '0' ) ++pa;
+			while( *pb == '0' ) ++pb;
+			while( isdigit(*pa) && isdigit(*pb) && *pa == *pb ) { ++pa; ++pb; }
+
+			if( isdigit(*pa) && isdigit(*pb) )
+			{
+				int i = 0;
+				while( isdigit(pa[i]) && isdigit(pb[i]) ) ++i;
+				return isdigit(pa[i]) ? 1 : ( isdigit(pb[i]) ? -1 : (int)*pa - (int)*pb );
+			}
+			else if( isdigit(*pa) ) return 1;
+			else if( isdigit(*pb) ) return -1;
+			else if( pa - sa != pb - sb ) return ( pa - sa < pb - sb ) ? 1 : -1;
+		}
+		else
+		{
+			if( *pa != *pb ) return (int)*pa - (int)*pb;
+			++pa; ++pb;
+		}
+	}
+
+	return *pa ? 1 : ( *pb ? -1 : 0 );
+}
+
+
 int getMaxRSS(int64_t *maxrsskb)
 {
 	int len = 0;
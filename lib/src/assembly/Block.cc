@@ -28,14 +28,18 @@
  *
  */
 
+#include <algorithm>
 #include <cstdlib>
 #include <iostream>
 #include <fstream>
 #include <list>
 #include <unistd.h>
+#include <pthread.h>
 #include <boost/detail/container_fwd.hpp>
 
 #include "assembly/Block.hpp"
+#include "assembly/BlockBuilder.hpp"
+#include "assembly/ReadPairSorter.hpp"
 #include "OrderingFunctions.hpp"
 #include "UtilityFunctions.hpp"
 
@@ -467,173 +471,434 @@ void Block::filterBlocksByLength(
 */
 
 
+// shard of slave contigs [firstRef,lastRef) processed by a thread
+typedef struct find_blocks_shard
+{
+	int32_t firstRef;
+	int32_t lastRef;
+	std::vector< Block > blocks;
+	LibStatistics stats;
+	uint64_t peakActive;
+
+} find_blocks_shard_t;
+
+typedef struct find_blocks_arg
+{
+	MultiBamReader *slaveBam;
+	const ReadIndex *readIndex;
+	CoverageTrack *coverage;
+	int minBlockSize;
+	bool noMultFilter;
+
+	std::vector< find_blocks_shard_t > *shards;
+	size_t *nextShard;
+	pthread_mutex_t *mutex;
+
+} find_blocks_arg_t;
+
+static void* findBlocksThread( void *argv )
+{
+	find_blocks_arg_t *arg = (find_blocks_arg_t*) argv;
+	std::vector< find_blocks_shard_t > &shards = *(arg->shards);
+
+	// each thread reads the slave alignments with its own readers
+	MultiBamReader bamReader;
+	bamReader.Open( *(arg->slaveBam) );
+
+	const RefVector& refVect = bamReader.GetReferenceData();
+
+	while( true )
+	{
+		pthread_mutex_lock( arg->mutex );
+		size_t s = *(arg->nextShard);
+		(*(arg->nextShard))++;
+		pthread_mutex_unlock( arg->mutex );
+
+		if( s >= shards.size() ) break;
+
+		find_blocks_shard_t &shard = shards[s];
+
+		// region ends with the last contig of the shard (mapped reads start before the end of their contig)
+		int32_t rightRef = shard.lastRef - 1;
+		bamReader.SetRegion( shard.firstRef, 0, rightRef, std::max( refVect[rightRef].RefLength, 1 ) );
+
+		bamReader.resetStatistics();
+		shard.peakActive = Block::findBlocksInStream( shard.blocks, bamReader, arg->minBlockSize, *(arg->readIndex), *(arg->coverage), arg->noMultFilter );
+		bamReader.getStatistics( shard.stats );
+	}
+
+	bamReader.Close();
+
+	pthread_exit(NULL);
+}
+
+
 void Block::findBlocks(
         std::vector< Block > &outblocks,
         MultiBamReader &bamReader,
         const int minBlockSize,
-        sparse_hash_map< std::string, Read > &readsMap_1,
-        sparse_hash_map< std::string, Read > &readsMap_2,
-        std::vector< std::vector< uint32_t > > &coverage,
-        bool noMultFilter )
+        const ReadIndex &readIndex,
+        CoverageTrack &coverage,
+        bool noMultFilter,
+        int threads )
 {
-    typedef sparse_hash_map< std::string, Read > ReadMap;
-    typedef std::list< std::string > ReadNameList;
-    typedef std::vector< Block > BlockVector;
+    // initialize slave coverage
+    const RefVector& refVect = bamReader.GetReferenceData();
+    coverage.init( refVect );
 
-    BamAlignment align;
-	std::list< Block > cur_blocks;
-	std::list< std::pair<uint64_t,uint64_t> > cur_evid;
+	if( threads <= 1 || refVect.size() <= 1 )
+	{
+		uint64_t peakActive = findBlocksInStream( outblocks, bamReader, minBlockSize, readIndex, coverage, noMultFilter );
+		coverage.finalize();
 
-    // initialize slave coverage vector
-    const RefVector& refVect = bamReader.GetReferenceData();
-    coverage.resize( refVect.size() );
-    for( uint32_t i=0; i < refVect.size(); i++ ) coverage[i].resize( refVect[i].RefLength, 0 );
+		std::cout << "[main] max active blocks = " << peakActive << std::endl;
+		return;
+	}
 
-    int32_t nh, xt; // molteplicità delle read (nh->standard, xt->bwa)
+	// blocks never span two slave contigs: split contigs in shards of similar total length
+	// (more shards than threads, so that threads can balance the load dynamically)
+	uint64_t totLength = 0;
+	for( size_t i=0; i < refVect.size(); i++ ) totLength += refVect[i].RefLength;
 
-    // process reads to build blocks (updating inserts statistics) by coordinate order
-    while( bamReader.GetNextAlignment(align,true) )
-    {
-		// skip unmapped or bad-quality reads
-		if( !align.IsMapped() || align.Position < 0 || align.IsDuplicate() || !align.IsPrimaryAlignment() || align.IsFailedQC() ) continue;
+	uint64_t shardsNum = std::min( (uint64_t) refVect.size(), (uint64_t) 8 * threads );
+	uint64_t shardLength = totLength / shardsNum + 1;
 
-        // load read's moltiplicity (if the field is missing, assume it as uniquely mapped)
-        if( !align.GetTag(std::string("NH"),nh) ) nh = 1;	// standard SAM format field
-        if( !align.GetTag(std::string("XT"),xt) ) xt = 'U'; // bwa field
-		bool uniqMapRead = noMultFilter || (nh == 1 && xt == 'U');
+	std::vector< find_blocks_shard_t > shards;
+	uint64_t curLength = 0;
 
-		if( !uniqMapRead ) continue; // skip reads mapped in multiple positions
+	for( size_t i=0; i < refVect.size(); i++ )
+	{
+		if( shards.empty() || curLength >= shardLength )
+		{
+			if( !shards.empty() ) shards.back().lastRef = i;
+
+			shards.push_back( find_blocks_shard_t() );
+			shards.back().firstRef = i;
+			curLength = 0;
+		}
+
+		curLength += refVect[i].RefLength;
+	}
+	shards.back().lastRef = refVect.size();
+
+	size_t nextShard = 0;
+	pthread_mutex_t mutex;
+	pthread_mutex_init( &mutex, NULL );
+
+	find_blocks_arg_t arg;
+	arg.slaveBam = &bamReader;
+	arg.readIndex = &readIndex;
+	arg.coverage = &coverage;
+	arg.minBlockSize = minBlockSize;
+	arg.noMultFilter = noMultFilter;
+	arg.shards = &shards;
+	arg.nextShard = &nextShard;
+	arg.mutex = &mutex;
+
+	std::vector< pthread_t > tids( threads );
+
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+
+	for( int i=0; i < threads; i++ ) pthread_create( &tids[i], &attr, findBlocksThread, (void*)&arg );
+
+	pthread_attr_destroy(&attr);
+
+	for( int i=0; i < threads; i++ ) pthread_join( tids[i], NULL );
+
+	pthread_mutex_destroy( &mutex );
+
+	// concatenate blocks and merge inserts statistics following contigs' order
+	bamReader.resetStatistics();
+	uint64_t peakActive = 0;
+
+	for( size_t s=0; s < shards.size(); s++ )
+	{
+		peakActive = std::max( peakActive, shards[s].peakActive );
+
+		outblocks.insert( outblocks.end(), shards[s].blocks.begin(), shards[s].blocks.end() );
+		std::vector< Block >().swap( shards[s].blocks );
+
+		bamReader.mergeStatistics( shards[s].stats );
+	}
+
+	bamReader.finalizeStatistics();
+	coverage.finalize();
+
+	std::cout << "[main] max active blocks = " << peakActive << " (per thread)" << std::endl;
+}
+
+
+// whether an alignment is mapped with good quality in a unique position
+static bool isUniqueAlignment( BamAlignment &align, bool noMultFilter )
+{
+	if( !align.IsMapped() || align.Position < 0 || align.IsDuplicate() || !align.IsPrimaryAlignment() || align.IsFailedQC() ) return false;
+
+	// load read's moltiplicity (if the field is missing, assume it as uniquely mapped)
+	return noMultFilter || hasUniqueMapping( align );
+}
+
+static void checkNameOrder( std::string &lastName, const std::string &name, const char *assembly )
+{
+	if( compareReadNames( name, lastName ) < 0 )
+	{
+		std::cerr << "[error] " << assembly << " BAM files are not sorted by read name (found \"" << name
+			<< "\" after \"" << lastName << "\")" << std::endl;
+		exit(1);
+	}
+
+	lastName = name;
+}
+
+
+// builds blocks from read pairs sorted by slave's coordinates
+static void buildBlocksFromPairs( std::vector< Block > &outblocks, ReadPairSorter &sorter, int minBlockSize )
+{
+	sorter.sort();
+
+	ReadPair pair;
+	BlockBuilder builder( outblocks, minBlockSize );
+
+	while( sorter.next( pair ) )
+	{
+		Read masterRead( pair.m_ctg, pair.m_start, pair.m_end, (pair.rev & 1) != 0 );
+		Read slaveRead( pair.s_ctg, pair.s_start, pair.s_end, (pair.rev & 2) != 0 );
+
+		builder.addReads( masterRead, slaveRead );
+	}
+
+	builder.flush();
+
+	std::cout << "[main] max active blocks = " << builder.peakActiveBlocks() << std::endl;
+}
 
-        Read slaveRead(align.RefID, align.Position, align.GetEndPosition(), align.IsReverseStrand());
 
-        // update slave vector coverage
-        uint32_t read_len = align.GetEndPosition() - align.Position;
-        for( int i=0; i < read_len; i++ ) coverage[align.RefID][align.Position+i] += 1;
+void Block::findBlocksByName(
+        std::vector< Block > &outblocks,
+        MultiBamReader &masterBam,
+        MultiBamReader &slaveBam,
+        const int minBlockSize,
+        CoverageTrack &masterCoverage,
+        CoverageTrack &slaveCoverage,
+        bool noMultFilter,
+        const std::string &tmpPrefix,
+        uint64_t maxMemory )
+{
+	// initialize coverages
+	masterCoverage.init( masterBam.GetReferenceData() );
+	slaveCoverage.init( slaveBam.GetReferenceData() );
+
+	ReadPairSorter sorter( tmpPrefix, maxMemory );
+
+	BamAlignment malign, salign;
+	std::string name, lastMasterName, lastSlaveName;
+	Read mate[2]; // master reads of current name (first/second mate)
+	bool found[2];
+	uint64_t order = 0;
 
-		ReadMap::iterator ref;
+	bool mvalid = masterBam.GetNextAlignmentCore( malign, true );
+	bool svalid = slaveBam.GetNextAlignmentCore( salign, true );
 
-		if( !align.IsPaired() || align.IsFirstMate() ) // find the read in the first map
+	// join master and slave alignments by read name
+	while( svalid )
+	{
+		name = salign.Name;
+		found[0] = found[1] = false;
+
+		// consume master alignments up to current name
+		int cmp;
+		while( mvalid && (cmp = compareReadNames( malign.Name, name )) <= 0 )
 		{
-			ref = readsMap_1.find(align.Name);
-			if( ref == readsMap_1.end() ) continue; // skip the read if it has not been mapped on the other assembly
+			checkNameOrder( lastMasterName, malign.Name, "master" );
+
+			if( isUniqueAlignment( malign, noMultFilter ) )
+			{
+				masterCoverage.addRead( malign.RefID, malign.Position, malign.GetEndPosition() );
+
+				if( cmp == 0 && malign.Name == name )
+				{
+					int m = ( !malign.IsPaired() || malign.IsFirstMate() ) ? 0 : 1;
+					mate[m] = Read( malign.RefID, malign.Position, malign.GetEndPosition(), malign.IsReverseStrand() );
+					found[m] = true;
+				}
+			}
+
+			mvalid = masterBam.GetNextAlignmentCore( malign, true );
 		}
-		else // if second mate, find the read in the second map
+
+		// slave alignments with current name
+		do
 		{
-			ref = readsMap_2.find(align.Name);
-			if( ref == readsMap_2.end() ) continue; // skip the read if it has not been mapped on the other assembly
-		}
+			checkNameOrder( lastSlaveName, salign.Name, "slave" );
 
-        // try to extend one of the memorized blocks
-        bool readsAdded = false;
-		std::list< Block >::iterator block = cur_blocks.begin();
-		std::list< std::pair<uint64_t,uint64_t> >::iterator evid = cur_evid.begin();
+			if( isUniqueAlignment( salign, noMultFilter ) )
+			{
+				slaveCoverage.addRead( salign.RefID, salign.Position, salign.GetEndPosition() );
 
-        while( block != cur_blocks.end() ) // for each memorized block
-        {
-			if( block->addReads( ref->second, slaveRead ) ) // if read has been succesfully added to the current block
-            {
-                readsAdded = true;
+				int m = ( !salign.IsPaired() || salign.IsFirstMate() ) ? 0 : 1;
 
-				// update evidences of frames to be oriented in the same strand
-				if( (ref->second).isReverse() == slaveRead.isReverse() ) (evid->first)++;
-				else (evid->second)++;
+				if( found[m] )
+				{
+					ReadPair pair;
+
+					pair.s_ctg = salign.RefID;
+					pair.s_start = salign.Position;
+					pair.s_end = salign.GetEndPosition();
+					pair.m_ctg = mate[m].getContigId();
+					pair.m_start = mate[m].getStartPos();
+					pair.m_end = mate[m].getStartPos() + mate[m].getLength();
+					pair.lib = slaveBam.getLastLibraryId();
+					pair.rev = (mate[m].isReverse() ? 1 : 0) | (salign.IsReverseStrand() ? 2 : 0);
+					pair.order = order++;
+
+					sorter.push( pair );
+				}
+			}
 
-				// readlist->push_back(ref->first); // aggiungo un riferimento alla read in posizione corrispondente al blocco
-                break;
-            }
+			svalid = slaveBam.GetNextAlignmentCore( salign, true );
+		}
+		while( svalid && salign.Name == name );
+	}
 
-            bool blockOutOfScope = block->getSlaveFrame().getEnd() + 1 < slaveRead.getStartPos() ||
-				block->getSlaveFrame().getContigId() < slaveRead.getContigId();
+	// remaining master alignments only contribute to coverage
+	while( mvalid )
+	{
+		checkNameOrder( lastMasterName, malign.Name, "master" );
 
-			if( !readsAdded && blockOutOfScope ) // block out of scope
-            {
-                Frame& mf = block->getMasterFrame();
-				Frame& sf = block->getSlaveFrame();
+		if( isUniqueAlignment( malign, noMultFilter ) )
+		{
+			masterCoverage.addRead( malign.RefID, malign.Position, malign.GetEndPosition() );
+		}
 
-				// set frames' strand according to the numbero of concordant/discordant reads in the block
-				mf.setStrand('+');
-				sf.setStrand( evid->first >= evid->second ? '+' : '-' );
+		mvalid = masterBam.GetNextAlignmentCore( malign, true );
+	}
 
-				if( block->getReadsNumber() >= minBlockSize ) outblocks.push_back( *block );
+	masterCoverage.finalize();
+	slaveCoverage.finalize();
 
-                // remove block and its strand evidences
-				block = cur_blocks.erase(block);
-				evid = cur_evid.erase(evid);
+	std::cout << "[main] reads aligned on both assemblies = " << sorter.size() << std::endl;
+	if( sorter.runs() > 0 ) std::cout << "[main] sorting reads using " << sorter.runs() << " temporary files" << std::endl;
 
-                continue;
-            }
+	// build blocks following slave's coordinates
+	buildBlocksFromPairs( outblocks, sorter, minBlockSize );
+}
 
-            ++block;
-			++evid;
-        }
 
-        // if the read has not been added to any existing block, create a new block.
-        if( !readsAdded )
-        {
-			Block new_block( ref->second, slaveRead, minBlockSize );
-			std::pair<uint64_t,uint64_t> strand_evid(0,0);
+void Block::findBlocksPartitioned(
+        std::vector< Block > &outblocks,
+        MultiBamReader &bamReader,
+        const int minBlockSize,
+        PartitionedReadIndex &readIndex,
+        CoverageTrack &coverage,
+        bool noMultFilter,
+        const std::string &tmpPrefix,
+        uint64_t maxMemory )
+{
+    // initialize slave coverage
+    const RefVector& refVect = bamReader.GetReferenceData();
+    coverage.init( refVect );
 
-			cur_blocks.push_back(new_block);
-			cur_evid.push_back(strand_evid);
-		}
-    }
+	readIndex.partition();
 
-    // after all reads have been processed, save or delete remaining blocks
-    std::list< Block >::iterator block = cur_blocks.begin();
-	std::list< std::pair<uint64_t,uint64_t> >::iterator evid = cur_evid.begin();
+	// spill slave reads to the groups of the index (recording their order in the slave BAM)
+	BamAlignment align;
+	uint64_t order = 0;
 
-	while( block != cur_blocks.end() )
+	while( bamReader.GetNextAlignmentCore(align,true) )
 	{
-		Frame& mf = block->getMasterFrame();
-		Frame& sf = block->getSlaveFrame();
+		if( !isUniqueAlignment( align, noMultFilter ) ) continue;
 
-		// set frames' strand according to the numbero of concordant/discordant reads in the block
-		mf.setStrand('+');
-		sf.setStrand( evid->first >= evid->second ? '+' : '-' );
+		coverage.addRead( align.RefID, align.Position, align.GetEndPosition() );
 
-		if( block->getReadsNumber() >= minBlockSize ) outblocks.push_back( *block );
+		ReadPair pair;
+		pair.s_ctg = align.RefID;
+		pair.s_start = align.Position;
+		pair.s_end = align.GetEndPosition();
+		pair.m_ctg = pair.m_start = pair.m_end = 0;
+		pair.lib = bamReader.getLastLibraryId();
+		pair.rev = align.IsReverseStrand() ? 2 : 0;
+		pair.order = order++;
 
-		// remove block and its strand evidences
-		block = cur_blocks.erase(block);
-		evid = cur_evid.erase(evid);
+		readIndex.spill( align.Name, !align.IsPaired() || align.IsFirstMate(), pair );
 	}
 
-    readsMap_1.clear();
-    readsMap_2.clear();
+	coverage.finalize();
+
+	// join groups one at a time
+	ReadPairSorter sorter( tmpPrefix, maxMemory );
+
+	for( size_t g=0; g < readIndex.groups(); g++ ) readIndex.join( g, sorter );
+
+	readIndex.clear();
+
+	std::cout << "[main] reads aligned on both assemblies = " << sorter.size() << std::endl;
+
+	// build blocks following slave's order
+	buildBlocksFromPairs( outblocks, sorter, minBlockSize );
+}
+
+
+uint64_t Block::findBlocksInStream(
+        std::vector< Block > &outblocks,
+        MultiBamReader &bamReader,
+        const int minBlockSize,
+        const ReadIndex &readIndex,
+        CoverageTrack &coverage,
+        bool noMultFilter )
+{
+    BamAlignment align;
+	Read masterRead;
+	BlockBuilder builder( outblocks, minBlockSize );
+
+    // process reads to build blocks (updating inserts statistics) by coordinate order
+    // (only core fields, name and tags are needed)
+    while( bamReader.GetNextAlignmentCore(align,true) )
+    {
+		// skip unmapped or bad-quality reads
+		if( !align.IsMapped() || align.Position < 0 || align.IsDuplicate() || !align.IsPrimaryAlignment() || align.IsFailedQC() ) continue;
+
+        // load read's moltiplicity (if the field is missing, assume it as uniquely mapped)
+		bool uniqMapRead = noMultFilter || hasUniqueMapping( align );
+
+		if( !uniqMapRead ) continue; // skip reads mapped in multiple positions
+
+        Read slaveRead(align.RefID, align.Position, align.GetEndPosition(), align.IsReverseStrand());
+
+        // update slave coverage
+        coverage.addRead( align.RefID, align.Position, align.GetEndPosition() );
+
+		// find the read (first or second mate) in the master's index
+		bool firstMate = !align.IsPaired() || align.IsFirstMate();
+		if( !readIndex.find( align.Name, firstMate, masterRead ) ) continue; // skip the read if it has not been mapped on the other assembly
+
+		builder.addReads( masterRead, slaveRead );
+    }
+
+    // after all reads have been processed, save or delete remaining blocks
+    builder.flush();
+
+    return builder.peakActiveBlocks();
 }
 
 
 void Block::updateCoverages(
         std::vector<Block> &blocks,
-        const std::vector< std::vector<uint32_t> > &masterCoverage,
-        std::vector< std::vector<uint32_t> > &slaveCoverage )
+        const CoverageTrack &masterCoverage,
+        const CoverageTrack &slaveCoverage )
 {
-    int32_t ctgId, begin, end;
     uint64_t masterReadsLen, slaveReadsLen;
     Frame newFrame;
 
     for( size_t i=0; i < blocks.size(); i++ )
     {
-        masterReadsLen = 0;
-        slaveReadsLen = 0;
-
         // update master coverage
-
         const Frame& masterFrame = blocks[i].getMasterFrame();
-        ctgId = masterFrame.getContigId();
-        begin = masterFrame.getBegin();
-        end = masterFrame.getEnd();
-
-        for( size_t pos = begin; pos <= end; pos++ ) masterReadsLen += masterCoverage.at(ctgId).at(pos);
+        masterReadsLen = masterCoverage.sum( masterFrame.getContigId(), masterFrame.getBegin(), masterFrame.getEnd() );
 
         // update slave coverage
-
         const Frame& slaveFrame = blocks[i].getSlaveFrame();
-        ctgId = slaveFrame.getContigId();
-        begin = slaveFrame.getBegin();
-        end = slaveFrame.getEnd();
-
-        for( size_t pos = begin; pos <= end; pos++ ) slaveReadsLen += slaveCoverage[ctgId][pos];
+        slaveReadsLen = slaveCoverage.sum( slaveFrame.getContigId(), slaveFrame.getBegin(), slaveFrame.getEnd() );
 
         // update current block
 
@@ -0,0 +1,194 @@
+/*
+ *  This file is part of GAM-NGS.
+ *  Copyright (c) 2011 by Riccardo Vicedomini <rvicedomini@appliedgenomics.org>,
+ *  Francesco Vezzi <vezzi@appliedgenomics.org>,
+ *  Simone Scalabrin <scalabrin@appliedgenomics.org>,
+ *  Lars Arverstad <lars.arvestad@scilifelab.se>,
+ *  Alberto Policriti <policriti@appliedgenomics.org>,
+ *  Alberto Casagrande <casagrande@appliedgenomics.org>
+ *
+ *  GAM-NGS is an evolution of a previous work (GAM) done by Alberto Casagrande,
+ *  Cristian Del Fabbro, Simone Scalabrin, and Alberto Policriti.
+ *  In particular, GAM-NGS has been adapted to work on NGS data sets and it has
+ *  been written using GAM's software as starting point. Thus, it shares part of
+ *  GAM's source code.
+ *
+ *  GAM-NGS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GAM-NGS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GAM-NGS.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <limits>
+
+#include "assembly/BlockBuilder.hpp"
+
+#define NO_BLOCK std::numeric_limits<uint64_t>::max()
+
+BlockBuilder::BlockBuilder( std::vector< Block > &outblocks, int minBlockSize ) :
+	_outblocks(outblocks), _minBlockSize(minBlockSize), _nextId(0), _slaveCtg(-1), _peakActive(0)
+{}
+
+
+void BlockBuilder::closeBlock( Block &block, const std::pair<uint64_t,uint64_t> &evid )
+{
+	Frame& mf = block.getMasterFrame();
+	Frame& sf = block.getSlaveFrame();
+
+	// set frames' strand according to the numbero of concordant/discordant reads in the block
+	mf.setStrand('+');
+	sf.setStrand( evid.first >= evid.second ? '+' : '-' );
+
+	if( block.getReadsNumber() >= _minBlockSize ) _outblocks.push_back( block );
+}
+
+
+void BlockBuilder::indexBlock( uint64_t id, ActiveBlock &ab )
+{
+	const Frame &mf = ab.block.getMasterFrame();
+	const Frame &sf = ab.block.getSlaveFrame();
+
+	_masterIndex.insert( MasterKey( mf.getContigId(), mf.getBegin(), id ) );
+
+	if( mf.getContigId() >= (int32_t)_maxMasterLength.size() ) _maxMasterLength.resize( mf.getContigId()+1, 0 );
+	_maxMasterLength[ mf.getContigId() ] = std::max( _maxMasterLength[ mf.getContigId() ], int64_t(mf.getEnd()) - mf.getBegin() );
+
+	// stale heap entries (smaller ends) are discarded when popped
+	if( sf.getEnd() != ab.heapEnd )
+	{
+		_slaveEnds.push( SlaveEnd( sf.getEnd(), id ) );
+		ab.heapEnd = sf.getEnd();
+	}
+
+	ab.active = true;
+}
+
+
+void BlockBuilder::unindexBlock( uint64_t id, ActiveBlock &ab )
+{
+	const Frame &mf = ab.block.getMasterFrame();
+
+	_masterIndex.erase( MasterKey( mf.getContigId(), mf.getBegin(), id ) );
+	ab.active = false;
+}
+
+
+void BlockBuilder::expireBlocks( const Read &slaveRead )
+{
+	// blocks of previous slave contigs are all out of scope
+	if( slaveRead.getContigId() != _slaveCtg )
+	{
+		for( std::set< MasterKey >::iterator it = _masterIndex.begin(); it != _masterIndex.end(); ++it )
+		{
+			_blocks.find( it->id )->second.active = false;
+			_expired.insert( it->id );
+		}
+
+		_masterIndex.clear();
+		_maxMasterLength.clear();
+		while( !_slaveEnds.empty() ) _slaveEnds.pop();
+
+		_slaveCtg = slaveRead.getContigId();
+		return;
+	}
+
+	// blocks ending before the read (and not adjacent to it) are out of scope
+	while( !_slaveEnds.empty() && int64_t(_slaveEnds.top().first) + 1 < slaveRead.getStartPos() )
+	{
+		SlaveEnd top = _slaveEnds.top();
+		_slaveEnds.pop();
+
+		std::map< uint64_t, ActiveBlock >::iterator ab = _blocks.find( top.second );
+		if( ab == _blocks.end() || !ab->second.active || ab->second.heapEnd != top.first ) continue; // stale entry
+
+		this->unindexBlock( top.second, ab->second );
+		_expired.insert( top.second );
+	}
+}
+
+
+void BlockBuilder::addReads( Read &masterRead, Read &slaveRead )
+{
+	this->expireBlocks( slaveRead );
+
+	// find the first block (in creation order) which the reads can be added to;
+	// blocks without reads accept any read
+	uint64_t target = _empty.empty() ? NO_BLOCK : *(_empty.begin());
+
+	int32_t mCtg = masterRead.getContigId();
+
+	if( mCtg >= 0 && mCtg < (int32_t)_maxMasterLength.size() )
+	{
+		// master frames overlapping the read begin in [start-1-maxLength, end+1]
+		int64_t from = int64_t(masterRead.getStartPos()) - 1 - _maxMasterLength[mCtg];
+		int64_t to = int64_t(masterRead.getEndPos()) + 1;
+
+		std::set< MasterKey >::iterator it = _masterIndex.lower_bound( MasterKey( mCtg, from, 0 ) );
+
+		for( ; it != _masterIndex.end() && it->ctg == mCtg && it->begin <= to; ++it )
+		{
+			if( it->id < target && _blocks.find( it->id )->second.block.overlaps( masterRead, slaveRead ) ) target = it->id;
+		}
+	}
+
+	// out of scope blocks created before the target one are output
+	while( !_expired.empty() && *(_expired.begin()) < target )
+	{
+		std::map< uint64_t, ActiveBlock >::iterator ab = _blocks.find( *(_expired.begin()) );
+
+		this->closeBlock( ab->second.block, ab->second.evid );
+
+		_blocks.erase( ab );
+		_expired.erase( _expired.begin() );
+	}
+
+	if( target != NO_BLOCK ) // extend the block
+	{
+		ActiveBlock &ab = _blocks.find( target )->second;
+
+		if( ab.block.isEmpty() ) _empty.erase( target );
+		else this->unindexBlock( target, ab );
+
+		ab.block.addReads( masterRead, slaveRead );
+
+		// update evidences of frames to be oriented in the same strand
+		if( masterRead.isReverse() == slaveRead.isReverse() ) (ab.evid.first)++;
+		else (ab.evid.second)++;
+
+		this->indexBlock( target, ab );
+	}
+	else // if the read has not been added to any existing block, create a new block.
+	{
+		uint64_t id = _nextId++;
+		ActiveBlock &ab = _blocks.insert( std::make_pair( id, ActiveBlock( Block( masterRead, slaveRead, _minBlockSize ) ) ) ).first->second;
+
+		if( ab.block.isEmpty() ) _empty.insert( id );
+		else this->indexBlock( id, ab );
+	}
+
+	_peakActive = std::max( _peakActive, (uint64_t)( _masterIndex.size() + _empty.size() ) );
+}
+
+
+void BlockBuilder::flush()
+{
+	// after all reads have been processed, save or delete remaining blocks (in creation order)
+	for( std::map< uint64_t, ActiveBlock >::iterator ab = _blocks.begin(); ab != _blocks.end(); ++ab )
+		this->closeBlock( ab->second.block, ab->second.evid );
+
+	_blocks.clear();
+	_masterIndex.clear();
+	_maxMasterLength.clear();
+	_expired.clear();
+	_empty.clear();
+	while( !_slaveEnds.empty() ) _slaveEnds.pop();
+}
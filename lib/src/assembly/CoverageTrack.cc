@@ -0,0 +1,196 @@
+/*
+ *  This file is part of GAM-NGS.
+ *  Copyright (c) 2011 by Riccardo Vicedomini <rvicedomini@appliedgenomics.org>,
+ *  Francesco Vezzi <vezzi@appliedgenomics.org>,
+ *  Simone Scalabrin <scalabrin@appliedgenomics.org>,
+ *  Lars Arverstad <lars.arvestad@scilifelab.se>,
+ *  Alberto Policriti <policriti@appliedgenomics.org>,
+ *  Alberto Casagrande <casagrande@appliedgenomics.org>
+ *
+ *  GAM-NGS is an evolution of a previous work (GAM) done by Alberto Casagrande,
+ *  Cristian Del Fabbro, Simone Scalabrin, and Alberto Policriti.
+ *  In particular, GAM-NGS has been adapted to work on NGS data sets and it has
+ *  been written using GAM's software as starting point. Thus, it shares part of
+ *  GAM's source code.
+ *
+ *  GAM-NGS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GAM-NGS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GAM-NGS.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "assembly/CoverageTrack.hpp"
+
+CoverageTrack::CoverageTrack() :
+	_finalized(false)
+{}
+
+
+void CoverageTrack::init( const RefVector &refs )
+{
+	_events.clear();
+	_deltas.clear();
+	_checkpoints.clear();
+	_wideIndex.clear();
+	_wideDeltas.clear();
+	_contigs.clear();
+	_lengths.clear();
+
+	_events.resize( refs.size() );
+	_deltas.resize( refs.size() );
+	_checkpoints.resize( refs.size() );
+	_wideIndex.resize( refs.size() );
+	_wideDeltas.resize( refs.size() );
+	_contigs.resize( refs.size() );
+	_lengths.resize( refs.size() );
+
+	for( size_t i=0; i < refs.size(); i++ )
+	{
+		_lengths[i] = refs[i].RefLength > 0 ? refs[i].RefLength : 0;
+		_events[i].resize( _lengths[i]+1, 0 );
+	}
+
+	_finalized = false;
+}
+
+
+void CoverageTrack::attach( const RefVector &refs )
+{
+	this->init( RefVector() );
+
+	_contigs.resize( refs.size() );
+	_lengths.resize( refs.size() );
+
+	for( size_t i=0; i < refs.size(); i++ )
+	{
+		_lengths[i] = refs[i].RefLength > 0 ? refs[i].RefLength : 0;
+		memset( &_contigs[i], 0, sizeof(ContigCoverage) );
+	}
+
+	_finalized = true;
+}
+
+
+void CoverageTrack::finalize()
+{
+	if( _finalized ) return;
+
+	const uint32_t blockMask = (1 << COVERAGE_CHECKPOINT_BITS) - 1;
+
+	for( size_t ctg=0; ctg < _events.size(); ctg++ )
+	{
+		std::vector< uint32_t > &events = _events[ctg];
+		std::vector< uint16_t > &deltas = _deltas[ctg];
+		std::vector< uint64_t > &checkpoints = _checkpoints[ctg];
+		std::vector< uint32_t > &wideIndex = _wideIndex[ctg];
+		std::vector< uint16_t > &wideDeltas = _wideDeltas[ctg];
+
+		size_t blocks = ((events.size()-1) >> COVERAGE_CHECKPOINT_BITS) + 1;
+
+		deltas.resize( events.size() );
+		checkpoints.resize( blocks );
+		wideIndex.assign( blocks, COVERAGE_NARROW_BLOCK );
+		wideDeltas.clear();
+
+		uint32_t coverage = 0;
+		uint64_t prefix = 0;
+
+		for( size_t block=0; block < blocks; block++ )
+		{
+			size_t begin = block << COVERAGE_CHECKPOINT_BITS;
+			size_t end = std::min( begin + blockMask + 1, events.size() );
+
+			checkpoints[block] = prefix;
+
+			// deltas[x] becomes the sum of the coverage of bases [begin,x)
+			for( size_t x=begin; x < end; x++ )
+			{
+				uint32_t delta = (uint32_t)( prefix - checkpoints[block] );
+				uint32_t event = events[x];
+
+				events[x] = delta;
+				deltas[x] = (uint16_t) delta;
+
+				coverage += event;
+				prefix += coverage;
+			}
+
+			// block's differences do not fit in 16 bits: keep their high bits as well
+			if( events[end-1] > 0xFFFF )
+			{
+				wideIndex[block] = wideDeltas.size() >> COVERAGE_CHECKPOINT_BITS;
+				wideDeltas.resize( wideDeltas.size() + blockMask + 1, 0 );
+
+				for( size_t x=begin; x < end; x++ )
+					wideDeltas[ (wideIndex[block] << COVERAGE_CHECKPOINT_BITS) + (x & blockMask) ] = (uint16_t)( events[x] >> 16 );
+			}
+		}
+
+		std::vector< uint32_t >().swap( events );
+
+		ContigCoverage &contig = _contigs[ctg];
+		contig.deltas = &deltas[0];
+		contig.checkpoints = &checkpoints[0];
+		contig.wideIndex = &wideIndex[0];
+		contig.wideDeltas = wideDeltas.empty() ? NULL : &wideDeltas[0];
+		contig.wideBlocks = wideDeltas.size() >> COVERAGE_CHECKPOINT_BITS;
+	}
+
+	_events.clear();
+	_finalized = true;
+}
+
+
+uint64_t CoverageTrack::sum( int32_t ctg, int32_t begin, int32_t end ) const
+{
+	if( !_finalized ) throw std::logic_error( "CoverageTrack::sum() called before finalize()" );
+
+	uint32_t len = _lengths.at(ctg);
+
+	if( begin < 0 ) begin = 0;
+	if( end >= (int32_t)len ) end = len-1;
+	if( begin > end ) return 0;
+
+	return this->prefixSum( ctg, end+1 ) - this->prefixSum( ctg, begin );
+}
+
+
+uint64_t CoverageTrack::memoryUsage() const
+{
+	uint64_t bytes = 0;
+
+	for( size_t i=0; i < _events.size(); i++ )
+		bytes += _events[i].capacity() * sizeof(uint32_t);
+
+	for( size_t i=0; i < _deltas.size(); i++ )
+		bytes += _deltas[i].capacity() * sizeof(uint16_t) + _checkpoints[i].capacity() * sizeof(uint64_t) +
+		         _wideIndex[i].capacity() * sizeof(uint32_t) + _wideDeltas[i].capacity() * sizeof(uint16_t);
+
+	return bytes;
+}
+
+
+void CoverageTrack::attachContig( int32_t ctg, const uint16_t *deltas, const uint64_t *checkpoints,
+                                  const uint32_t *wideIndex, const uint16_t *wideDeltas, uint32_t wideBlocks )
+{
+	ContigCoverage &contig = _contigs.at(ctg);
+
+	contig.deltas = deltas;
+	contig.checkpoints = checkpoints;
+	contig.wideIndex = wideIndex;
+	contig.wideDeltas = wideDeltas;
+	contig.wideBlocks = wideBlocks;
+}
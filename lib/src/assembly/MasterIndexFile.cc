@@ -0,0 +1,449 @@
+/*
+ *  This file is part of GAM-NGS.
+ *  Copyright (c) 2011 by Riccardo Vicedomini <rvicedomini@appliedgenomics.org>,
+ *  Francesco Vezzi <vezzi@appliedgenomics.org>,
+ *  Simone Scalabrin <scalabrin@appliedgenomics.org>,
+ *  Lars Arverstad <lars.arvestad@scilifelab.se>,
+ *  Alberto Policriti <policriti@appliedgenomics.org>,
+ *  Alberto Casagrande <casagrande@appliedgenomics.org>
+ *
+ *  GAM-NGS is an evolution of a previous work (GAM) done by Alberto Casagrande,
+ *  Cristian Del Fabbro, Simone Scalabrin, and Alberto Policriti.
+ *  In particular, GAM-NGS has been adapted to work on NGS data sets and it has
+ *  been written using GAM's software as starting point. Thus, it shares part of
+ *  GAM's source code.
+ *
+ *  GAM-NGS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GAM-NGS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GAM-NGS.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "assembly/MasterIndexFile.hpp"
+
+#define INDEX_PAGE_SIZE 4096
+
+static void writeData( FILE *out, const void *data, size_t size, const std::string &filename )
+{
+	if( size > 0 && fwrite( data, 1, size, out ) != size )
+	{
+		std::cerr << "[error] unable to write master index \"" << filename << "\"" << std::endl;
+		exit(1);
+	}
+}
+
+static void writePadding( FILE *out, size_t alignment, const std::string &filename )
+{
+	static const char zeros[INDEX_PAGE_SIZE] = { 0 };
+	uint64_t pos = ftello(out);
+
+	writeData( out, zeros, (alignment - pos % alignment) % alignment, filename );
+}
+
+static void writeString( FILE *out, const std::string &str, const std::string &filename )
+{
+	uint32_t len = str.size();
+	writeData( out, &len, sizeof(uint32_t), filename );
+	writeData( out, str.data(), len, filename );
+}
+
+static void bamFileInfo( const std::string &bamFile, uint64_t &size, int64_t &mtime )
+{
+	struct stat st;
+	size = 0;
+	mtime = 0;
+
+	if( stat( bamFile.c_str(), &st ) == 0 )
+	{
+		size = st.st_size;
+		mtime = st.st_mtime;
+	}
+}
+
+
+// sequential reader of the mapped file, checking bounds
+class IndexCursor
+{
+	const char *_data;
+	uint64_t _size;
+	uint64_t _pos;
+	const std::string &_filename;
+
+public:
+	IndexCursor( const void *data, uint64_t size, uint64_t pos, const std::string &filename ) :
+		_data((const char*)data), _size(size), _pos(pos), _filename(filename)
+	{}
+
+	const void* get( uint64_t len )
+	{
+		if( _pos + len > _size )
+		{
+			std::cerr << "[error] master index \"" << _filename << "\" is truncated" << std::endl;
+			exit(1);
+		}
+
+		const void *ptr = _data + _pos;
+		_pos += len;
+		return ptr;
+	}
+
+	void align( uint64_t alignment ) { this->get( (alignment - _pos % alignment) % alignment ); }
+
+	template< class T > T read() { T value; memcpy( &value, this->get(sizeof(T)), sizeof(T) ); return value; }
+
+	std::string readString()
+	{
+		uint32_t len = this->read<uint32_t>();
+		return std::string( (const char*) this->get(len), len );
+	}
+};
+
+
+MasterIndexFile::MasterIndexFile() :
+	_data(NULL), _size(0)
+{}
+
+
+MasterIndexFile::~MasterIndexFile()
+{
+	this->close();
+}
+
+
+void MasterIndexFile::close()
+{
+	if( _data != NULL ) munmap( _data, _size );
+
+	_data = NULL;
+	_size = 0;
+}
+
+
+void MasterIndexFile::save(
+	const std::string &filename,
+	const ReadIndex &index,
+	MultiBamReader &masterBam,
+	const CoverageTrack &coverage,
+	bool noMultFilter )
+{
+	const void *slots = NULL;
+	std::vector< OverflowRead > overflow;
+	Header header;
+
+	memset( &header, 0, sizeof(Header) );
+	strncpy( header.magic, MASTER_INDEX_MAGIC, sizeof(header.magic) );
+	header.version = MASTER_INDEX_VERSION;
+	header.flags = noMultFilter ? MASTER_INDEX_NO_MULT_FILTER : 0;
+
+	if( const HashedReadIndex<1> *idx = dynamic_cast< const HashedReadIndex<1>* >(&index) )
+	{
+		header.keyWords = 1;
+		header.ctgBits = idx->packing().ctgBits();
+		header.startBits = idx->packing().startBits();
+		header.slotSize = idx->slotSize();
+		header.slotsNum = idx->slotsNum();
+		slots = idx->slotsData();
+		idx->overflowReads( overflow );
+	}
+	else if( const HashedReadIndex<2> *idx = dynamic_cast< const HashedReadIndex<2>* >(&index) )
+	{
+		header.keyWords = 2;
+		header.ctgBits = idx->packing().ctgBits();
+		header.startBits = idx->packing().startBits();
+		header.slotSize = idx->slotSize();
+		header.slotsNum = idx->slotsNum();
+		slots = idx->slotsData();
+		idx->overflowReads( overflow );
+	}
+	else
+	{
+		std::cerr << "[error] only indexes with hashed read keys can be saved" << std::endl;
+		exit(1);
+	}
+
+	const RefVector& refs = masterBam.GetReferenceData();
+
+	header.reads = index.size();
+	header.overflowNum = overflow.size();
+	header.libs = masterBam.size();
+	header.refs = refs.size();
+
+	FILE *out = fopen( filename.c_str(), "wb" );
+	if( out == NULL )
+	{
+		std::cerr << "[error] unable to create master index \"" << filename << "\"" << std::endl;
+		exit(1);
+	}
+
+	writeData( out, &header, sizeof(Header), filename ); // rewritten at the end
+
+	// libraries
+	LibStatistics stats;
+	masterBam.getStatistics( stats );
+
+	for( uint32_t i=0; i < header.libs; i++ )
+	{
+		std::string bamFile = masterBam.getBamReader(i)->GetFilename();
+		uint64_t bamSize;
+		int64_t bamTime;
+
+		bamFileInfo( bamFile, bamSize, bamTime );
+
+		writeString( out, bamFile, filename );
+		writeData( out, &bamSize, sizeof(uint64_t), filename );
+		writeData( out, &bamTime, sizeof(int64_t), filename );
+		writeData( out, &stats.isize_mean[i], sizeof(double), filename );
+		writeData( out, &stats.isize_m2[i], sizeof(double), filename );
+		writeData( out, &stats.isize_count[i], sizeof(uint64_t), filename );
+		writeData( out, &stats.reads_len[i], sizeof(uint64_t), filename );
+	}
+
+	// references
+	for( uint32_t i=0; i < header.refs; i++ )
+	{
+		writeString( out, refs[i].RefName, filename );
+		writeData( out, &refs[i].RefLength, sizeof(int32_t), filename );
+	}
+
+	// coverages
+	if( !coverage.isFinalized() || coverage.size() != header.refs )
+	{
+		std::cerr << "[error] coverage of master contigs has not been computed" << std::endl;
+		exit(1);
+	}
+
+	writePadding( out, sizeof(uint64_t), filename );
+
+	for( uint32_t i=0; i < header.refs; i++ )
+	{
+		uint64_t len = coverage.length(i);
+		uint64_t blocks = (len >> COVERAGE_CHECKPOINT_BITS) + 1;
+		uint64_t wideBlocks = coverage.wideBlocks(i);
+
+		// 8-byte aligned, so that arrays can be used in place
+		writeData( out, &wideBlocks, sizeof(uint64_t), filename );
+		writeData( out, coverage.checkpoints(i), blocks * sizeof(uint64_t), filename );
+		writeData( out, coverage.wideIndex(i), blocks * sizeof(uint32_t), filename );
+		writeData( out, coverage.deltas(i), (len+1) * sizeof(uint16_t), filename );
+		writeData( out, coverage.wideDeltas(i), (wideBlocks << COVERAGE_CHECKPOINT_BITS) * sizeof(uint16_t), filename );
+		writePadding( out, sizeof(uint64_t), filename );
+	}
+
+	// table of slots (page aligned)
+	uint64_t pos = ftello(out);
+	header.slotsOffset = ((pos + INDEX_PAGE_SIZE - 1) / INDEX_PAGE_SIZE) * INDEX_PAGE_SIZE;
+
+	writePadding( out, INDEX_PAGE_SIZE, filename );
+	writeData( out, slots, header.slotsNum * header.slotSize, filename );
+
+	// overflow reads
+	writeData( out, overflow.empty() ? NULL : &overflow[0], overflow.size() * sizeof(OverflowRead), filename );
+
+	header.fileSize = header.slotsOffset + header.slotsNum * header.slotSize + header.overflowNum * sizeof(OverflowRead);
+
+	fseeko( out, 0, SEEK_SET );
+	writeData( out, &header, sizeof(Header), filename );
+
+	if( fclose(out) != 0 )
+	{
+		std::cerr << "[error] unable to write master index \"" << filename << "\"" << std::endl;
+		exit(1);
+	}
+}
+
+
+ReadIndex* MasterIndexFile::load(
+	const std::string &filename,
+	MultiBamReader &masterBam,
+	CoverageTrack &coverage,
+	bool noMultFilter )
+{
+	this->close();
+	_filename = filename;
+
+	int fd = open( filename.c_str(), O_RDONLY );
+	struct stat st;
+
+	if( fd < 0 || fstat( fd, &st ) != 0 )
+	{
+		std::cerr << "[error] unable to open master index \"" << filename << "\"" << std::endl;
+		exit(1);
+	}
+
+	_size = st.st_size;
+	_data = ( _size > 0 ) ? mmap( NULL, _size, PROT_READ, MAP_SHARED, fd, 0 ) : MAP_FAILED;
+	::close(fd);
+
+	if( _data == MAP_FAILED )
+	{
+		_data = NULL;
+		std::cerr << "[error] unable to map master index \"" << filename << "\"" << std::endl;
+		exit(1);
+	}
+
+	IndexCursor cursor( _data, _size, 0, filename );
+	Header header = cursor.read<Header>();
+
+	if( strncmp( header.magic, MASTER_INDEX_MAGIC, sizeof(header.magic) ) != 0 )
+	{
+		std::cerr << "[error] \"" << filename << "\" is not a master index file" << std::endl;
+		exit(1);
+	}
+
+	if( header.version != MASTER_INDEX_VERSION )
+	{
+		std::cerr << "[error] master index \"" << filename << "\" has version " << header.version
+			<< " (expected " << MASTER_INDEX_VERSION << "); please rebuild it" << std::endl;
+		exit(1);
+	}
+
+	if( ((header.flags & MASTER_INDEX_NO_MULT_FILTER) != 0) != noMultFilter )
+	{
+		std::cerr << "[error] master index \"" << filename << "\" was built " << (noMultFilter ? "with" : "without")
+			<< " the multiplicity filter (--no-mult-filter " << (noMultFilter ? "not " : "") << "given); please rebuild it" << std::endl;
+		exit(1);
+	}
+
+	if( header.fileSize != _size )
+	{
+		std::cerr << "[error] master index \"" << filename << "\" is truncated" << std::endl;
+		exit(1);
+	}
+
+	// check libraries
+	if( header.libs != masterBam.size() )
+	{
+		std::cerr << "[error] master index \"" << filename << "\" refers to " << header.libs << " libraries, but "
+			<< masterBam.size() << " master BAM files have been provided" << std::endl;
+		exit(1);
+	}
+
+	LibStatistics stats;
+	stats.isize_mean.resize( header.libs );
+	stats.isize_m2.resize( header.libs );
+	stats.isize_count.resize( header.libs );
+	stats.reads_len.resize( header.libs );
+
+	for( uint32_t i=0; i < header.libs; i++ )
+	{
+		std::string bamFile = cursor.readString();
+		uint64_t bamSize = cursor.read<uint64_t>();
+		int64_t bamTime = cursor.read<int64_t>();
+
+		uint64_t curSize;
+		int64_t curTime;
+		bamFileInfo( masterBam.getBamReader(i)->GetFilename(), curSize, curTime );
+
+		if( bamFile != masterBam.getBamReader(i)->GetFilename() || bamSize != curSize || bamTime != curTime )
+		{
+			std::cerr << "[error] master index \"" << filename << "\" was built from a different (or modified) BAM file:\n        "
+				<< bamFile << std::endl;
+			exit(1);
+		}
+
+		stats.isize_mean[i] = cursor.read<double>();
+		stats.isize_m2[i] = cursor.read<double>();
+		stats.isize_count[i] = cursor.read<uint64_t>();
+		stats.reads_len[i] = cursor.read<uint64_t>();
+	}
+
+	// check references
+	const RefVector& refs = masterBam.GetReferenceData();
+	bool sameRefs = ( header.refs == refs.size() );
+
+	for( uint32_t i=0; sameRefs && i < header.refs; i++ )
+	{
+		std::string name = cursor.readString();
+		int32_t length = cursor.read<int32_t>();
+
+		sameRefs = ( name == refs[i].RefName && length == refs[i].RefLength );
+	}
+
+	if( !sameRefs )
+	{
+		std::cerr << "[error] references of master index \"" << filename << "\" do not match master BAM files" << std::endl;
+		exit(1);
+	}
+
+	// restore coverages (used in place from the mapping) and libraries' statistics
+	coverage.attach( refs );
+	cursor.align( sizeof(uint64_t) );
+
+	for( uint32_t i=0; i < refs.size(); i++ )
+	{
+		uint64_t len = refs[i].RefLength > 0 ? refs[i].RefLength : 0;
+		uint64_t blocks = (len >> COVERAGE_CHECKPOINT_BITS) + 1;
+		uint64_t wideBlocks = cursor.read<uint64_t>();
+
+		const uint64_t *checkpoints = (const uint64_t*) cursor.get( blocks * sizeof(uint64_t) );
+		const uint32_t *wideIndex = (const uint32_t*) cursor.get( blocks * sizeof(uint32_t) );
+		const uint16_t *deltas = (const uint16_t*) cursor.get( (len+1) * sizeof(uint16_t) );
+		const uint16_t *wideDeltas = (const uint16_t*) cursor.get( (wideBlocks << COVERAGE_CHECKPOINT_BITS) * sizeof(uint16_t) );
+		cursor.align( sizeof(uint64_t) );
+
+		for( uint64_t b=0; b < blocks; b++ )
+		{
+			if( wideIndex[b] != COVERAGE_NARROW_BLOCK && wideIndex[b] >= wideBlocks )
+			{
+				std::cerr << "[error] master index \"" << filename << "\" is corrupted" << std::endl;
+				exit(1);
+			}
+		}
+
+		coverage.attachContig( i, deltas, checkpoints, wideIndex, wideDeltas, wideBlocks );
+	}
+
+	masterBam.resetStatistics();
+	masterBam.mergeStatistics( stats );
+	masterBam.finalizeStatistics();
+
+	// attach the table of slots
+	IndexCursor slotsCursor( _data, _size, header.slotsOffset, filename );
+	const void *slots = slotsCursor.get( header.slotsNum * header.slotSize );
+
+	const OverflowRead *overflow = (const OverflowRead*) slotsCursor.get( header.overflowNum * sizeof(OverflowRead) );
+
+	madvise( (char*)_data + header.slotsOffset, header.slotsNum * header.slotSize, MADV_RANDOM );
+
+	if( header.ctgBits < 1 || header.ctgBits > 32 || header.ctgBits + header.startBits > 63 )
+	{
+		std::cerr << "[error] master index \"" << filename << "\" is corrupted" << std::endl;
+		exit(1);
+	}
+
+	ReadPacking packing( header.ctgBits, header.startBits );
+
+	if( header.keyWords == 1 && header.slotSize == HashedReadIndex<1>::slotSize() )
+	{
+		HashedReadIndex<1> *index = new HashedReadIndex<1>();
+		index->attach( slots, header.slotsNum, header.reads, packing, overflow, header.overflowNum );
+		return index;
+	}
+
+	if( header.keyWords == 2 && header.slotSize == HashedReadIndex<2>::slotSize() )
+	{
+		HashedReadIndex<2> *index = new HashedReadIndex<2>();
+		index->attach( slots, header.slotsNum, header.reads, packing, overflow, header.overflowNum );
+		return index;
+	}
+
+	std::cerr << "[error] master index \"" << filename << "\" has an unsupported key size" << std::endl;
+	exit(1);
+}
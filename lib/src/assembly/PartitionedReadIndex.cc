@@ -0,0 +1,314 @@
+/*
+ *  This file is part of GAM-NGS.
+ *  Copyright (c) 2011 by Riccardo Vicedomini <rvicedomini@appliedgenomics.org>,
+ *  Francesco Vezzi <vezzi@appliedgenomics.org>,
+ *  Simone Scalabrin <scalabrin@appliedgenomics.org>,
+ *  Lars Arverstad <lars.arvestad@scilifelab.se>,
+ *  Alberto Policriti <policriti@appliedgenomics.org>,
+ *  Alberto Casagrande <casagrande@appliedgenomics.org>
+ *
+ *  GAM-NGS is an evolution of a previous work (GAM) done by Alberto Casagrande,
+ *  Cristian Del Fabbro, Simone Scalabrin, and Alberto Policriti.
+ *  In particular, GAM-NGS has been adapted to work on NGS data sets and it has
+ *  been written using GAM's software as starting point. Thus, it shares part of
+ *  GAM's source code.
+ *
+ *  GAM-NGS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GAM-NGS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GAM-NGS.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <unistd.h>
+
+#include "assembly/PartitionedReadIndex.hpp"
+
+#define BUCKET_IO_BUFFER_MAX (64 * 1024)
+#define BUCKET_IO_BUFFER_MIN 1024
+
+PartitionedReadIndex::PartitionedReadIndex( const std::string &tmpPrefix, uint64_t maxMemory, const BamTools::RefVector &refs ) :
+	_tmpPrefix(tmpPrefix), _maxMemory(maxMemory), _resident(refs), _residentGroup(-1), _size(0), _partitioned(false)
+{
+	// buffers of bucket (or spill) files, one more for the file being read, take about 1/8 of the memory
+	_ioBuffer = std::min<uint64_t>( std::max<uint64_t>( _maxMemory / 8 / (READ_INDEX_BUCKETS+1), BUCKET_IO_BUFFER_MIN ), BUCKET_IO_BUFFER_MAX );
+
+	this->openBuckets();
+}
+
+
+void PartitionedReadIndex::openBuckets()
+{
+	_bucketFiles.resize( READ_INDEX_BUCKETS );
+	_buckets.resize( READ_INDEX_BUCKETS, NULL );
+	_bucketSize.assign( READ_INDEX_BUCKETS, 0 );
+
+	for( size_t b=0; b < READ_INDEX_BUCKETS; b++ )
+	{
+		std::stringstream ss;
+		ss << _tmpPrefix << ".bucket." << b << ".tmp";
+
+		_bucketFiles[b] = ss.str();
+		_buckets[b] = openFile( _bucketFiles[b], "wb" );
+	}
+}
+
+
+PartitionedReadIndex::~PartitionedReadIndex()
+{
+	this->clear();
+}
+
+
+FILE* PartitionedReadIndex::openFile( const std::string &filename, const char *mode ) const
+{
+	FILE *file = fopen( filename.c_str(), mode );
+
+	if( file == NULL )
+	{
+		std::cerr << "[error] unable to open temporary file \"" << filename << "\"" << std::endl;
+		exit(1);
+	}
+
+	setvbuf( file, NULL, _IOFBF, _ioBuffer );
+	return file;
+}
+
+
+uint32_t PartitionedReadIndex::bucketOf( const ReadKey &key )
+{
+	// high word of the key is used by the in-memory table
+	return uint32_t( key.lo % READ_INDEX_BUCKETS );
+}
+
+
+void PartitionedReadIndex::insert( const std::string &name, bool firstMate, const Read &read )
+{
+	if( _partitioned ) throw std::logic_error( "PartitionedReadIndex: insert called after partition" );
+	if( _buckets.empty() ) this->openBuckets(); // cleared index
+
+	ReadKey key( name, firstMate );
+	uint32_t b = bucketOf(key);
+
+	MasterRecord rec;
+	rec.hi = key.hi;
+	rec.lo = key.lo;
+	rec.ctg = read.getContigId();
+	rec.start = read.getStartPos();
+	rec.len_rev = uint32_t(read.getLength()) & 0x7FFFFFFF;
+	if( read.isReverse() ) rec.len_rev |= 0x80000000;
+
+	if( fwrite( &rec, sizeof(MasterRecord), 1, _buckets[b] ) != 1 )
+	{
+		std::cerr << "[error] unable to write temporary file \"" << _bucketFiles[b] << "\"" << std::endl;
+		exit(1);
+	}
+
+	_bucketSize[b]++;
+	_size++; // reads inserted twice are counted twice
+}
+
+
+bool PartitionedReadIndex::find( const std::string &name, bool firstMate, Read &read ) const
+{
+	ReadKey key( name, firstMate );
+
+	// reads of other groups are not in memory: they cannot be reported as missing
+	if( _residentGroup < 0 || _bucketGroup[bucketOf(key)] != _residentGroup )
+		throw std::logic_error( "PartitionedReadIndex: find called for a read whose group is not loaded" );
+
+	return _resident.find( key, read );
+}
+
+
+uint64_t PartitionedReadIndex::size() const
+{
+	return _size;
+}
+
+
+uint64_t PartitionedReadIndex::memoryUsage() const
+{
+	uint64_t files = 0;
+	for( size_t b=0; b < _buckets.size(); b++ ) if( _buckets[b] != NULL ) files++;
+	for( size_t g=0; g < _spills.size(); g++ ) if( _spills[g] != NULL ) files++;
+
+	return _resident.memoryUsage() + files * _ioBuffer;
+}
+
+
+void PartitionedReadIndex::clear()
+{
+	for( size_t b=0; b < _buckets.size(); b++ ) if( _buckets[b] != NULL ) fclose( _buckets[b] );
+	for( size_t b=0; b < _bucketFiles.size(); b++ ) unlink( _bucketFiles[b].c_str() );
+
+	for( size_t g=0; g < _spills.size(); g++ ) if( _spills[g] != NULL ) fclose( _spills[g] );
+	for( size_t g=0; g < _spillFiles.size(); g++ ) unlink( _spillFiles[g].c_str() );
+
+	_buckets.clear();
+	_bucketFiles.clear();
+	_bucketSize.clear();
+	_spills.clear();
+	_spillFiles.clear();
+
+	_groups.clear();
+	_bucketGroup.clear();
+	_partitioned = false;
+
+	_resident.clear();
+	_residentGroup = -1;
+	_size = 0;
+}
+
+
+void PartitionedReadIndex::partition()
+{
+	if( _partitioned ) return;
+	_partitioned = true;
+
+	if( _buckets.empty() ) this->openBuckets(); // cleared index
+
+	for( size_t b=0; b < _buckets.size(); b++ )
+	{
+		fclose( _buckets[b] );
+		_buckets[b] = NULL;
+	}
+
+	// group consecutive buckets whose reads' table fits in memory, along with spill files' buffers
+	uint64_t buffers = (READ_INDEX_BUCKETS + 1) * _ioBuffer;
+	uint64_t groupMemory = ( _maxMemory > 2 * buffers ) ? _maxMemory - buffers : _maxMemory / 2;
+
+	_bucketGroup.resize( READ_INDEX_BUCKETS );
+	uint64_t groupReads = 0;
+
+	for( size_t b=0; b < READ_INDEX_BUCKETS; b++ )
+	{
+		uint64_t reads = groupReads + _bucketSize[b];
+
+		if( _groups.empty() || (HashedReadIndex<2>::tableBytes(reads) > groupMemory && groupReads > 0) )
+		{
+			_groups.push_back( std::vector< uint32_t >() );
+			reads = _bucketSize[b];
+		}
+
+		_groups.back().push_back( b );
+		_bucketGroup[b] = _groups.size() - 1;
+		groupReads = reads;
+	}
+
+	// spill files of the reads to be joined with each group
+	_spillFiles.resize( _groups.size() );
+	_spills.resize( _groups.size(), NULL );
+
+	for( size_t g=0; g < _groups.size(); g++ )
+	{
+		std::stringstream ss;
+		ss << _tmpPrefix << ".spill." << g << ".tmp";
+
+		_spillFiles[g] = ss.str();
+		_spills[g] = openFile( _spillFiles[g], "w+b" );
+	}
+}
+
+
+void PartitionedReadIndex::loadGroup( size_t group )
+{
+	if( !_partitioned ) this->partition();
+	if( _residentGroup == (int64_t) group ) return;
+
+	_resident.clear();
+	_residentGroup = -1;
+
+	uint64_t reads = 0;
+	for( size_t i=0; i < _groups[group].size(); i++ ) reads += _bucketSize[ _groups[group][i] ];
+
+	_resident.reserve( reads );
+
+	MasterRecord rec;
+
+	for( size_t i=0; i < _groups[group].size(); i++ )
+	{
+		uint32_t b = _groups[group][i];
+		FILE *in = openFile( _bucketFiles[b], "rb" );
+
+		while( fread( &rec, sizeof(MasterRecord), 1, in ) == 1 )
+		{
+			ReadKey key( rec.hi, rec.lo );
+			int32_t len = rec.len_rev & 0x7FFFFFFF;
+
+			_resident.insert( key, Read( rec.ctg, rec.start, rec.start + len, (rec.len_rev & 0x80000000) != 0 ) );
+		}
+
+		fclose(in);
+	}
+
+	_residentGroup = group;
+}
+
+
+void PartitionedReadIndex::spill( const std::string &name, bool firstMate, const ReadPair &pair )
+{
+	if( !_partitioned ) this->partition();
+
+	ReadKey key( name, firstMate );
+	uint32_t g = _bucketGroup[ bucketOf(key) ];
+
+	SlaveRecord rec;
+	rec.hi = key.hi;
+	rec.lo = key.lo;
+	rec.pair = pair;
+
+	if( fwrite( &rec, sizeof(SlaveRecord), 1, _spills[g] ) != 1 )
+	{
+		std::cerr << "[error] unable to write temporary file \"" << _spillFiles[g] << "\"" << std::endl;
+		exit(1);
+	}
+}
+
+
+uint64_t PartitionedReadIndex::join( size_t group, ReadPairSorter &sorter )
+{
+	this->loadGroup( group );
+
+	FILE *in = _spills[group];
+	fflush(in);
+	rewind(in);
+
+	SlaveRecord rec;
+	Read masterRead;
+	uint64_t found = 0;
+
+	while( fread( &rec, sizeof(SlaveRecord), 1, in ) == 1 )
+	{
+		if( !_resident.find( ReadKey(rec.hi,rec.lo), masterRead ) ) continue;
+
+		ReadPair &pair = rec.pair;
+		pair.m_ctg = masterRead.getContigId();
+		pair.m_start = masterRead.getStartPos();
+		pair.m_end = masterRead.getStartPos() + masterRead.getLength();
+		pair.rev = (pair.rev & 2) | (masterRead.isReverse() ? 1 : 0);
+
+		sorter.push( pair );
+		found++;
+	}
+
+	// spilled reads are no longer needed
+	fclose(in);
+	_spills[group] = NULL;
+	unlink( _spillFiles[group].c_str() );
+
+	return found;
+}
@@ -31,6 +31,8 @@
 #include "OrderingFunctions.hpp"
 
 #include "assembly/Read.hpp"
+#include "assembly/ReadIndex.hpp"
+#include "assembly/CoverageTrack.hpp"
 
 Read::Read():
         _contigId(0), _startPos(0), _endPos(0), _isRev(false)
@@ -65,7 +67,7 @@ int32_t Read::getLength() const
     return _endPos - _startPos;
 }
 
-bool Read::isReverse()
+bool Read::isReverse() const
 {
     return _isRev;
 }
@@ -82,41 +84,36 @@ bool Read::overlaps(Read& read, int minOverlap) const
 
 void Read::loadReadsMap(
 		MultiBamReader &bamReader,
-		sparse_hash_map< std::string, Read > &readMap_1,
-		sparse_hash_map< std::string, Read > &readMap_2,
-		std::vector< std::vector<uint32_t> > &coverage,
+		ReadIndex &readIndex,
+		CoverageTrack &coverage,
         bool noMultFilter )
 {
-    // initialize coverage vector
-    const RefVector& refVect = bamReader.GetReferenceData();
-    coverage.resize( refVect.size() );
-    for( uint32_t i=0; i < refVect.size(); i++ ) coverage.at(i).resize( refVect.at(i).RefLength, 0 );
+    // initialize coverage
+    coverage.init( bamReader.GetReferenceData() );
 
-    int32_t nh, xt;
     BamAlignment align;
 
 	bamReader.Rewind();
 
-    while( bamReader.GetNextAlignment(align,true) )
+    while( bamReader.GetNextAlignmentCore(align,true) ) // name and tags are read from the raw record
     {
         // discard unmapped reads and reads that have a bad quality
         if( !align.IsMapped() || align.Position < 0 || align.IsDuplicate() || !align.IsPrimaryAlignment() || align.IsFailedQC() ) continue;
 
         // se la molteplicità non è stata definita, assumo che sia pari ad 1
-        if( !align.GetTag(std::string("NH"),nh) ) nh = 1;
-        if( !align.GetTag(std::string("XT"),xt) ) xt = 'U';
-        bool uniqMapRead = noMultFilter || (nh == 1 && xt == 'U');
+        bool uniqMapRead = noMultFilter || hasUniqueMapping( align );
 
 		if( !uniqMapRead ) continue; // read mappata in modo molteplice
 
 		Read curRead( align.RefID, align.Position, align.GetEndPosition(), align.IsReverseStrand() );
 
-		// insert reads one of the reads hash-tables depending on whether it is the first or second pair
-		if( !align.IsPaired() || align.IsFirstMate() ) readMap_1[align.Name] = curRead; else readMap_2[align.Name] = curRead;
+		// insert read in the index, together with whether it is the first or second pair
+		readIndex.insert( align.Name, !align.IsPaired() || align.IsFirstMate(), curRead );
 
-		// update vector coverage
-		uint32_t read_len = align.GetEndPosition() - align.Position;
-		for( int i=0; i < read_len; i++ ) coverage.at(align.RefID).at(align.Position+i) += 1;
+		// update coverage
+		coverage.addRead( align.RefID, align.Position, align.GetEndPosition() );
     }
+
+    coverage.finalize();
 }
 
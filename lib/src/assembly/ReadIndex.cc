@@ -0,0 +1,572 @@
+/*
+ *  This file is part of GAM-NGS.
+ *  Copyright (c) 2011 by Riccardo Vicedomini <rvicedomini@appliedgenomics.org>,
+ *  Francesco Vezzi <vezzi@appliedgenomics.org>,
+ *  Simone Scalabrin <scalabrin@appliedgenomics.org>,
+ *  Lars Arverstad <lars.arvestad@scilifelab.se>,
+ *  Alberto Policriti <policriti@appliedgenomics.org>,
+ *  Alberto Casagrande <casagrande@appliedgenomics.org>
+ *
+ *  GAM-NGS is an evolution of a previous work (GAM) done by Alberto Casagrande,
+ *  Cristian Del Fabbro, Simone Scalabrin, and Alberto Policriti.
+ *  In particular, GAM-NGS has been adapted to work on NGS data sets and it has
+ *  been written using GAM's software as starting point. Thus, it shares part of
+ *  GAM's source code.
+ *
+ *  GAM-NGS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GAM-NGS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GAM-NGS.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "assembly/ReadIndex.hpp"
+
+#define READ_INDEX_INIT_CAPACITY (1 << 16)
+#define READ_INDEX_VERIFY_BUFFER (1 << 20)
+
+// MurmurHash64A by Austin Appleby (public domain)
+static uint64_t murmurHash64A( const void *key, size_t len, uint64_t seed )
+{
+	const uint64_t m = 0xc6a4a7935bd1e995ULL;
+	const int r = 47;
+
+	uint64_t h = seed ^ (len * m);
+
+	const unsigned char *data = (const unsigned char*) key;
+	const unsigned char *end = data + (len / 8) * 8;
+
+	while( data != end )
+	{
+		uint64_t k;
+		memcpy( &k, data, 8 );
+		data += 8;
+
+		k *= m;
+		k ^= k >> r;
+		k *= m;
+
+		h ^= k;
+		h *= m;
+	}
+
+	switch( len & 7 )
+	{
+		case 7: h ^= uint64_t(data[6]) << 48; /* fall through */
+		case 6: h ^= uint64_t(data[5]) << 40; /* fall through */
+		case 5: h ^= uint64_t(data[4]) << 32; /* fall through */
+		case 4: h ^= uint64_t(data[3]) << 24; /* fall through */
+		case 3: h ^= uint64_t(data[2]) << 16; /* fall through */
+		case 2: h ^= uint64_t(data[1]) << 8;  /* fall through */
+		case 1: h ^= uint64_t(data[0]);
+				h *= m;
+	}
+
+	h ^= h >> r;
+	h *= m;
+	h ^= h >> r;
+
+	return h;
+}
+
+
+ReadKey::ReadKey( const std::string &name, bool firstMate )
+{
+	// mate number is part of the key, so that both mates can be stored in the same table
+	hi = murmurHash64A( name.data(), name.size(), firstMate ? 0x9e3779b97f4a7c15ULL : 0xc2b2ae3d27d4eb4fULL );
+	lo = murmurHash64A( name.data(), name.size(), firstMate ? 0x165667b19e3779f9ULL : 0x27d4eb2f165667c5ULL );
+}
+
+
+ReadIndex* ReadIndex::create( key_type_t keys, const BamTools::RefVector &refs, const std::string &verifyFile )
+{
+	switch( keys )
+	{
+		case HASH64_KEYS:
+			return new HashedReadIndex<1>( refs, verifyFile );
+		case HASH128_KEYS:
+			return new HashedReadIndex<2>( refs, verifyFile );
+		default:
+			return new NameReadIndex();
+	}
+}
+
+
+void NameReadIndex::insert( const std::string &name, bool firstMate, const Read &read )
+{
+	if( firstMate ) _readMap_1[name] = read; else _readMap_2[name] = read;
+}
+
+bool NameReadIndex::find( const std::string &name, bool firstMate, Read &read ) const
+{
+	const sparse_hash_map< std::string, Read > &readMap = firstMate ? _readMap_1 : _readMap_2;
+
+	sparse_hash_map< std::string, Read >::const_iterator it = readMap.find(name);
+	if( it == readMap.end() ) return false;
+
+	read = it->second;
+	return true;
+}
+
+uint64_t NameReadIndex::size() const
+{
+	return _readMap_1.size() + _readMap_2.size();
+}
+
+uint64_t NameReadIndex::memoryUsage() const
+{
+	// rough estimate: key object, value and (short) name buffer for each entry
+	return this->size() * ( sizeof(std::string) + sizeof(Read) + 32 );
+}
+
+void NameReadIndex::clear()
+{
+	_readMap_1.clear();
+	_readMap_2.clear();
+}
+
+
+// number of bits needed to represent a value
+static uint32_t bitsFor( uint64_t value )
+{
+	uint32_t bits = 0;
+	while( value > 0 ) { bits++; value >>= 1; }
+	return bits;
+}
+
+
+ReadPacking::ReadPacking() :
+	_ctgBits(32), _startBits(31), _lenBits(0)
+{ }
+
+ReadPacking::ReadPacking( const BamTools::RefVector &refs )
+{
+	uint64_t maxLength = 0;
+	for( size_t i=0; i < refs.size(); i++ )
+		if( refs[i].RefLength > 0 && (uint64_t) refs[i].RefLength > maxLength ) maxLength = refs[i].RefLength;
+
+	// contig field must have a value (all ones) not used by any contig
+	_ctgBits = std::max( bitsFor( refs.size() ), 1U );
+	_startBits = std::min( bitsFor( maxLength ), 62 - _ctgBits );
+	_lenBits = 63 - _ctgBits - _startBits;
+}
+
+ReadPacking::ReadPacking( uint32_t ctgBits, uint32_t startBits ) :
+	_ctgBits(ctgBits), _startBits(startBits), _lenBits(63 - ctgBits - startBits)
+{
+	if( ctgBits < 1 || ctgBits > 32 || ctgBits + startBits > 63 )
+		throw std::logic_error( "ReadPacking: invalid field widths" );
+}
+
+bool ReadPacking::pack( const Read &read, uint64_t &word ) const
+{
+	int32_t ctg = read.getContigId();
+	int32_t start = read.getStartPos();
+	int32_t len = read.getLength();
+
+	if( ctg < 0 || (uint64_t) ctg >= (1ULL << _ctgBits) - 1 ) return false;
+	if( start < 0 || (uint64_t) start >= (1ULL << _startBits) ) return false;
+	if( len < 0 || (uint64_t) len >= (1ULL << _lenBits) ) return false;
+
+	word = ( (uint64_t) ctg << (64 - _ctgBits) ) | ( (uint64_t) start << (_lenBits + 1) ) |
+	       ( (uint64_t) len << 1 ) | ( read.isReverse() ? 1 : 0 );
+
+	return true;
+}
+
+Read ReadPacking::unpack( uint64_t word ) const
+{
+	int32_t ctg = (int32_t)( word >> (64 - _ctgBits) );
+	int32_t start = (int32_t)( ( word >> (_lenBits + 1) ) & ( (1ULL << _startBits) - 1 ) );
+	int32_t len = (int32_t)( ( word >> 1 ) & ( (1ULL << _lenBits) - 1 ) );
+
+	return Read( ctg, start, start + len, (word & 1) != 0 );
+}
+
+
+template< int KEY_WORDS >
+HashedReadIndex<KEY_WORDS>::HashedReadIndex( const BamTools::RefVector &refs, const std::string &verifyFile ) :
+	_packing(refs), _capacity(0), _size(0), _mapped(NULL), _verifyFile(verifyFile), _verifyFd(-1), _verifyFlushed(0)
+{
+	if( _verifyFile != "" )
+	{
+		_verifyFd = open( _verifyFile.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644 );
+		if( _verifyFd < 0 )
+		{
+			std::cerr << "[error] unable to create read names file \"" << _verifyFile << "\"" << std::endl;
+			exit(1);
+		}
+	}
+
+	this->initSlots( READ_INDEX_INIT_CAPACITY );
+}
+
+template< int KEY_WORDS >
+HashedReadIndex<KEY_WORDS>::HashedReadIndex() :
+	_capacity(0), _size(0), _mapped(NULL), _verifyFd(-1), _verifyFlushed(0)
+{ }
+
+template< int KEY_WORDS >
+HashedReadIndex<KEY_WORDS>::~HashedReadIndex()
+{
+	this->clear();
+}
+
+template< int KEY_WORDS >
+void HashedReadIndex<KEY_WORDS>::initSlots( uint64_t capacity )
+{
+	Slot empty;
+	memset( &empty, 0, sizeof(Slot) );
+	empty.read = PACKED_READ_EMPTY;
+
+	_slots.assign( capacity, empty );
+	_capacity = capacity;
+
+	if( _verifyFd >= 0 ) _nameOffset.assign( capacity, 0 );
+}
+
+template< int KEY_WORDS >
+void HashedReadIndex<KEY_WORDS>::grow( uint64_t capacity )
+{
+	std::vector< Slot > oldSlots;
+	std::vector< uint64_t > oldOffset;
+
+	oldSlots.swap( _slots );
+	oldOffset.swap( _nameOffset );
+
+	this->initSlots( capacity );
+
+	for( uint64_t i=0; i < oldSlots.size(); i++ )
+	{
+		if( oldSlots[i].read == PACKED_READ_EMPTY ) continue;
+		this->placeSlot( oldSlots[i], _verifyFd >= 0 ? oldOffset[i] : 0, this->home(oldSlots[i].key[0]), 0 );
+	}
+}
+
+template< int KEY_WORDS >
+void HashedReadIndex<KEY_WORDS>::reserve( uint64_t reads )
+{
+	// smallest table keeping the load factor within 0.85
+	uint64_t capacity = ( reads * 20 + 16 ) / 17;
+
+	if( capacity <= _capacity ) return;
+
+	if( _size == 0 ) this->initSlots( capacity );
+	else this->grow( capacity );
+}
+
+template< int KEY_WORDS >
+uint64_t HashedReadIndex<KEY_WORDS>::tableBytes( uint64_t reads )
+{
+	return ( reads * 20 + 16 ) / 17 * sizeof(Slot);
+}
+
+template< int KEY_WORDS >
+void HashedReadIndex<KEY_WORDS>::setKey( Slot &slot, const ReadKey &key ) const
+{
+	slot.key[0] = key.hi;
+	if( KEY_WORDS > 1 ) slot.key[KEY_WORDS-1] = key.lo;
+}
+
+template< int KEY_WORDS >
+bool HashedReadIndex<KEY_WORDS>::matchKey( const Slot &slot, const ReadKey &key ) const
+{
+	return slot.key[0] == key.hi && ( KEY_WORDS == 1 || slot.key[KEY_WORDS-1] == key.lo );
+}
+
+template< int KEY_WORDS >
+void HashedReadIndex<KEY_WORDS>::flushNames()
+{
+	if( _verifyBuffer.empty() ) return;
+
+	if( pwrite( _verifyFd, _verifyBuffer.data(), _verifyBuffer.size(), _verifyFlushed ) != (ssize_t) _verifyBuffer.size() )
+	{
+		std::cerr << "[error] unable to write read names file \"" << _verifyFile << "\"" << std::endl;
+		exit(1);
+	}
+
+	_verifyFlushed += _verifyBuffer.size();
+	_verifyBuffer.clear();
+}
+
+template< int KEY_WORDS >
+uint64_t HashedReadIndex<KEY_WORDS>::appendName( const std::string &name )
+{
+	uint64_t offset = _verifyFlushed + _verifyBuffer.size();
+
+	_verifyBuffer.append( name.c_str(), name.size() + 1 );
+	if( _verifyBuffer.size() >= READ_INDEX_VERIFY_BUFFER ) this->flushNames();
+
+	return offset;
+}
+
+template< int KEY_WORDS >
+bool HashedReadIndex<KEY_WORDS>::matchName( uint64_t offset, const std::string &name ) const
+{
+	size_t len = name.size() + 1;
+
+	// name not flushed yet
+	if( offset >= _verifyFlushed )
+		return offset + len <= _verifyFlushed + _verifyBuffer.size() &&
+			memcmp( _verifyBuffer.data() + (offset - _verifyFlushed), name.c_str(), len ) == 0;
+
+	char buffer[256];
+	char *stored = ( len <= sizeof(buffer) ) ? buffer : new char[len];
+
+	bool match = ( pread( _verifyFd, stored, len, offset ) == (ssize_t) len ) && memcmp( stored, name.c_str(), len ) == 0;
+
+	if( stored != buffer ) delete[] stored;
+
+	return match;
+}
+
+template< int KEY_WORDS >
+typename HashedReadIndex<KEY_WORDS>::OverflowKey HashedReadIndex<KEY_WORDS>::overflowKey( const Slot &slot, uint64_t nameOffset ) const
+{
+	OverflowKey key;
+	key.hi = slot.key[0];
+	key.lo = KEY_WORDS > 1 ? slot.key[KEY_WORDS-1] : 0;
+	key.name = _verifyFd >= 0 ? nameOffset : 0;
+
+	return key;
+}
+
+template< int KEY_WORDS >
+void HashedReadIndex<KEY_WORDS>::setRead( Slot &slot, uint64_t nameOffset, const Read &read )
+{
+	uint64_t word;
+
+	if( _packing.pack(read,word) )
+	{
+		if( slot.read == PACKED_READ_OVERFLOW ) _overflow.erase( this->overflowKey(slot,nameOffset) );
+		slot.read = word;
+	}
+	else
+	{
+		slot.read = PACKED_READ_OVERFLOW;
+		_overflow[ this->overflowKey(slot,nameOffset) ] = read;
+	}
+}
+
+template< int KEY_WORDS >
+void HashedReadIndex<KEY_WORDS>::placeSlot( Slot slot, uint64_t nameOffset, uint64_t i, uint64_t dist )
+{
+	// Robin Hood: the slot takes the place of the first resident closer to its home
+	while( _slots[i].read != PACKED_READ_EMPTY )
+	{
+		uint64_t residentDist = this->distance( i, this->home(_slots[i].key[0]) );
+
+		if( residentDist < dist )
+		{
+			std::swap( slot, _slots[i] );
+			if( _verifyFd >= 0 ) std::swap( nameOffset, _nameOffset[i] );
+			dist = residentDist;
+		}
+
+		i = this->next(i);
+		dist++;
+	}
+
+	_slots[i] = slot;
+	if( _verifyFd >= 0 ) _nameOffset[i] = nameOffset;
+}
+
+template< int KEY_WORDS >
+void HashedReadIndex<KEY_WORDS>::insertRead( const ReadKey &key, const std::string *name, const Read &read )
+{
+	if( _mapped != NULL ) throw std::logic_error( "HashedReadIndex: cannot insert reads in an attached table" );
+
+	if( (_size + 1) * 20 > _capacity * 17 ) this->grow( std::max<uint64_t>( _capacity + _capacity / 2, READ_INDEX_INIT_CAPACITY ) );
+
+	uint64_t i = this->home( key.hi );
+	uint64_t dist = 0;
+
+	// same read: replace it (as a hash map would do)
+	while( _slots[i].read != PACKED_READ_EMPTY && this->distance( i, this->home(_slots[i].key[0]) ) >= dist )
+	{
+		if( this->matchKey(_slots[i],key) && (_verifyFd < 0 || this->matchName(_nameOffset[i],*name)) )
+		{
+			this->setRead( _slots[i], _verifyFd >= 0 ? _nameOffset[i] : 0, read );
+			return;
+		}
+
+		i = this->next(i);
+		dist++;
+	}
+
+	Slot slot;
+	this->setKey( slot, key );
+	slot.read = PACKED_READ_EMPTY;
+
+	uint64_t nameOffset = ( _verifyFd >= 0 ) ? this->appendName( *name ) : 0;
+	this->setRead( slot, nameOffset, read );
+
+	this->placeSlot( slot, nameOffset, i, dist );
+	_size++;
+}
+
+template< int KEY_WORDS >
+bool HashedReadIndex<KEY_WORDS>::findRead( const ReadKey &key, const std::string *name, Read &read ) const
+{
+	if( _size == 0 ) return false;
+
+	const Slot *slots = this->table();
+	uint64_t i = this->home( key.hi );
+	uint64_t dist = 0;
+
+	// residents closer to their home than the probe mean the read is not in the table
+	while( slots[i].read != PACKED_READ_EMPTY && this->distance( i, this->home(slots[i].key[0]) ) >= dist )
+	{
+		const Slot &slot = slots[i];
+
+		if( this->matchKey(slot,key) && (_verifyFd < 0 || this->matchName(_nameOffset[i],*name)) )
+		{
+			if( slot.read != PACKED_READ_OVERFLOW )
+			{
+				read = _packing.unpack( slot.read );
+				return true;
+			}
+
+			typename std::map< OverflowKey, Read >::const_iterator it =
+				_overflow.find( this->overflowKey( slot, _verifyFd >= 0 ? _nameOffset[i] : 0 ) );
+			if( it == _overflow.end() ) return false;
+
+			read = it->second;
+			return true;
+		}
+
+		i = this->next(i);
+		dist++;
+	}
+
+	return false;
+}
+
+template< int KEY_WORDS >
+void HashedReadIndex<KEY_WORDS>::insert( const std::string &name, bool firstMate, const Read &read )
+{
+	this->insertRead( ReadKey(name,firstMate), &name, read );
+}
+
+template< int KEY_WORDS >
+bool HashedReadIndex<KEY_WORDS>::find( const std::string &name, bool firstMate, Read &read ) const
+{
+	return this->findRead( ReadKey(name,firstMate), &name, read );
+}
+
+template< int KEY_WORDS >
+void HashedReadIndex<KEY_WORDS>::insert( const ReadKey &key, const Read &read )
+{
+	if( _verifyFd >= 0 ) throw std::logic_error( "HashedReadIndex: names are required to verify keys" );
+	this->insertRead( key, NULL, read );
+}
+
+template< int KEY_WORDS >
+bool HashedReadIndex<KEY_WORDS>::find( const ReadKey &key, Read &read ) const
+{
+	if( _verifyFd >= 0 ) throw std::logic_error( "HashedReadIndex: names are required to verify keys" );
+	return this->findRead( key, NULL, read );
+}
+
+template< int KEY_WORDS >
+uint64_t HashedReadIndex<KEY_WORDS>::size() const
+{
+	return _size;
+}
+
+template< int KEY_WORDS >
+uint64_t HashedReadIndex<KEY_WORDS>::memoryUsage() const
+{
+	// overflow reads: rough estimate of a map node
+	uint64_t overflow = _overflow.size() * ( sizeof(OverflowKey) + sizeof(Read) + 32 );
+
+	if( _mapped != NULL ) return _capacity * sizeof(Slot) + overflow;
+	return _slots.capacity() * sizeof(Slot) + _nameOffset.capacity() * sizeof(uint64_t) + overflow;
+}
+
+template< int KEY_WORDS >
+void HashedReadIndex<KEY_WORDS>::clear()
+{
+	std::vector< Slot >().swap( _slots );
+	std::vector< uint64_t >().swap( _nameOffset );
+	_overflow.clear();
+
+	_mapped = NULL;
+	_capacity = 0;
+	_size = 0;
+
+	if( _verifyFd >= 0 )
+	{
+		close( _verifyFd );
+		unlink( _verifyFile.c_str() );
+
+		_verifyFd = -1;
+		_verifyFlushed = 0;
+		_verifyBuffer.clear();
+	}
+}
+
+template< int KEY_WORDS >
+void HashedReadIndex<KEY_WORDS>::overflowReads( std::vector< OverflowRead > &reads ) const
+{
+	reads.clear();
+	reads.reserve( _overflow.size() );
+
+	for( typename std::map< OverflowKey, Read >::const_iterator it = _overflow.begin(); it != _overflow.end(); ++it )
+	{
+		OverflowRead rec;
+		rec.hi = it->first.hi;
+		rec.lo = it->first.lo;
+		rec.ctg = it->second.getContigId();
+		rec.start = it->second.getStartPos();
+		rec.end = it->second.getStartPos() + it->second.getLength();
+		rec.rev = it->second.isReverse() ? 1 : 0;
+
+		reads.push_back( rec );
+	}
+}
+
+template< int KEY_WORDS >
+void HashedReadIndex<KEY_WORDS>::attach( const void *slots, uint64_t slotsNum, uint64_t size, const ReadPacking &packing,
+                                         const OverflowRead *overflow, uint64_t overflowNum )
+{
+	if( _verifyFd >= 0 ) throw std::logic_error( "HashedReadIndex: cannot verify names of an attached table" );
+	if( slotsNum == 0 || size >= slotsNum ) throw std::logic_error( "HashedReadIndex: invalid number of slots" );
+
+	std::vector< Slot >().swap( _slots );
+	_overflow.clear();
+
+	for( uint64_t i=0; i < overflowNum; i++ )
+	{
+		OverflowKey key;
+		key.hi = overflow[i].hi;
+		key.lo = overflow[i].lo;
+		key.name = 0;
+
+		_overflow[key] = Read( overflow[i].ctg, overflow[i].start, overflow[i].end, overflow[i].rev != 0 );
+	}
+
+	_packing = packing;
+	_mapped = (const Slot*) slots;
+	_capacity = slotsNum;
+	_size = size;
+}
+
+template class HashedReadIndex<1>;
+template class HashedReadIndex<2>;
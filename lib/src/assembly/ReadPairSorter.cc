@@ -0,0 +1,149 @@
+/*
+ *  This file is part of GAM-NGS.
+ *  Copyright (c) 2011 by Riccardo Vicedomini <rvicedomini@appliedgenomics.org>,
+ *  Francesco Vezzi <vezzi@appliedgenomics.org>,
+ *  Simone Scalabrin <scalabrin@appliedgenomics.org>,
+ *  Lars Arverstad <lars.arvestad@scilifelab.se>,
+ *  Alberto Policriti <policriti@appliedgenomics.org>,
+ *  Alberto Casagrande <casagrande@appliedgenomics.org>
+ *
+ *  GAM-NGS is an evolution of a previous work (GAM) done by Alberto Casagrande,
+ *  Cristian Del Fabbro, Simone Scalabrin, and Alberto Policriti.
+ *  In particular, GAM-NGS has been adapted to work on NGS data sets and it has
+ *  been written using GAM's software as starting point. Thus, it shares part of
+ *  GAM's source code.
+ *
+ *  GAM-NGS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GAM-NGS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GAM-NGS.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <unistd.h>
+
+#include "assembly/ReadPairSorter.hpp"
+
+#define RUN_READ_BUFFER (1 << 20)
+
+ReadPairSorter::ReadPairSorter( const std::string &tmpPrefix, uint64_t maxMemory ) :
+	_tmpPrefix(tmpPrefix), _bufferPos(0), _size(0), _sorted(false)
+{
+	_bufferSize = std::max( (uint64_t) 1024, maxMemory / sizeof(ReadPair) );
+}
+
+
+ReadPairSorter::~ReadPairSorter()
+{
+	for( size_t i=0; i < _runs.size(); i++ ) if( _runs[i] != NULL ) fclose( _runs[i] );
+	for( size_t i=0; i < _runFiles.size(); i++ ) unlink( _runFiles[i].c_str() );
+}
+
+
+void ReadPairSorter::spill()
+{
+	std::sort( _buffer.begin(), _buffer.end() );
+
+	std::stringstream ss;
+	ss << _tmpPrefix << ".pairs." << _runFiles.size() << ".tmp";
+	std::string runFile = ss.str();
+
+	FILE *out = fopen( runFile.c_str(), "wb" );
+	if( out == NULL || fwrite( &_buffer[0], sizeof(ReadPair), _buffer.size(), out ) != _buffer.size() )
+	{
+		std::cerr << "[error] unable to write temporary file \"" << runFile << "\"" << std::endl;
+		exit(1);
+	}
+	fclose(out);
+
+	_runFiles.push_back( runFile );
+	_buffer.clear();
+}
+
+
+void ReadPairSorter::push( const ReadPair &pair )
+{
+	if( _buffer.size() >= _bufferSize ) this->spill();
+
+	_buffer.push_back( pair );
+	_size++;
+}
+
+
+bool ReadPairSorter::readPair( size_t run, ReadPair &pair )
+{
+	return fread( &pair, sizeof(ReadPair), 1, _runs[run] ) == 1;
+}
+
+
+void ReadPairSorter::sort()
+{
+	if( _sorted ) return;
+	_sorted = true;
+
+	// everything fits in memory
+	if( _runFiles.empty() )
+	{
+		std::sort( _buffer.begin(), _buffer.end() );
+		_bufferPos = 0;
+		return;
+	}
+
+	if( !_buffer.empty() ) this->spill();
+	std::vector< ReadPair >().swap( _buffer );
+
+	// open runs and load their first pair
+	_runs.resize( _runFiles.size(), NULL );
+
+	for( size_t i=0; i < _runFiles.size(); i++ )
+	{
+		_runs[i] = fopen( _runFiles[i].c_str(), "rb" );
+		if( _runs[i] == NULL )
+		{
+			std::cerr << "[error] unable to read temporary file \"" << _runFiles[i] << "\"" << std::endl;
+			exit(1);
+		}
+		setvbuf( _runs[i], NULL, _IOFBF, RUN_READ_BUFFER );
+
+		ReadPair pair;
+		if( this->readPair( i, pair ) ) _heads.push( RunHead(pair,i) );
+	}
+}
+
+
+bool ReadPairSorter::next( ReadPair &pair )
+{
+	if( !_sorted ) this->sort();
+
+	if( _runFiles.empty() )
+	{
+		if( _bufferPos >= _buffer.size() ) return false;
+
+		pair = _buffer[_bufferPos++];
+		return true;
+	}
+
+	if( _heads.empty() ) return false;
+
+	RunHead head = _heads.top();
+	_heads.pop();
+
+	pair = head.first;
+
+	ReadPair nextPair;
+	if( this->readPair( head.second, nextPair ) ) _heads.push( RunHead(nextPair,head.second) );
+
+	return true;
+}
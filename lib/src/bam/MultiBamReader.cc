@@ -32,51 +32,94 @@
 #include <fstream>
 #include <sstream>
 #include <math.h>
+#include <algorithm>
 
 #include "bam/MultiBamReader.hpp"
+#include "bam/PairEvidence.hpp"
 #include "UtilityFunctions.hpp"
 
 MultiBamReader::MultiBamReader() :
 	_is_open(false),
+	_sort_order(SORT_BY_COORDINATE),
+	_last_lib(0),
+	_decompression_threads(0),
 	_bam_readers(),
 	_bam_aligns(),
 	_valid_aligns(),
+	_first_aligns(),
+	_heap(),
+	_heap_valid(false),
 	_isize_mean(),
 	_isize_std(),
+	_isize_m2(),
 	_isize_count(),
 	_asm_size(0),
 	_reads_len(),
-	_coverage()
-{}
+	_coverage(),
+	_evidence_collector(NULL),
+	_evidence(NULL)
+{
+	pthread_mutex_init( &_pool_mutex, NULL );
+}
 
 
 MultiBamReader::~MultiBamReader()
 {
 	if(_is_open) this->Close();
+	pthread_mutex_destroy( &_pool_mutex );
 }
 
-bool MultiBamReader::Open( const std::vector< std::string > &filenames )
+void MultiBamReader::allocate( size_t bams )
 {
-	if(_is_open) this->Close();
-
-	size_t bams = filenames.size();
-	if( bams == 0 ) return false;
-
 	_bam_readers.resize( bams );
 	_bam_aligns.resize( bams );
 	_valid_aligns.resize( bams );
+	_first_aligns.resize( bams );
 
-	_bam_mutex.resize( bams );
+	_reader_pools.clear();
+	_reader_pools.resize( bams );
 
 	_minInsert.resize( bams );
 	_maxInsert.resize( bams );
 
 	_isize_mean.resize( bams, 0 );
 	_isize_std.resize( bams, 0 );
+	_isize_m2.resize( bams, 0 );
 	_isize_count.resize( bams, 1 );
 
 	_reads_len.resize( bams, 0 );
 	_coverage.resize( bams, 0 );
+}
+
+
+void MultiBamReader::startReading()
+{
+	size_t bams = _bam_readers.size();
+
+	// initialization of min/max inserts sizes
+	for( size_t i=0; i < bams; i++ ) _minInsert[i] = MIN_ISIZE;
+	for( size_t i=0; i < bams; i++ ) _maxInsert[i] = MAX_ISIZE;
+
+	// load first alignment from each bam file
+	for( size_t i=0; i < bams; i++ ) this->loadNextAlignment(i);
+	_first_aligns.assign( bams, true );
+	_heap_valid = false;
+
+	// compute assembly size
+	_asm_size = 0;
+	const RefVector& ref_data = _bam_readers[0]->GetReferenceData();
+	for( size_t i=0; i < ref_data.size(); i++ ) _asm_size += ref_data[i].RefLength;
+}
+
+
+bool MultiBamReader::Open( const std::vector< std::string > &filenames, bool loadIndex )
+{
+	if(_is_open) this->Close();
+
+	size_t bams = filenames.size();
+	if( bams == 0 ) return false;
+
+	this->allocate( bams );
 
 	std::string index_filename;
 	bool opened = true;
@@ -84,6 +127,7 @@ bool MultiBamReader::Open( const std::vector< std::string > &filenames )
 	for( size_t i=0; i < bams; i++ )
 	{
 		_bam_readers[i] = new BamReader();
+		_bam_readers[i]->SetDecompressionThreads( _decompression_threads );
 
 		if( not _bam_readers[i]->Open(filenames[i]) )
 		{
@@ -91,7 +135,7 @@ bool MultiBamReader::Open( const std::vector< std::string > &filenames )
 			delete _bam_readers[i];
 			std::cerr << "[bam] ERROR: unable to open BAM file:\n" << filenames[i] << std::endl;
 		}
-		else // if bam file opened successfully
+		else if( loadIndex ) // if bam file opened successfully
 		{
 			index_filename = filenames[i] + ".bai";
 
@@ -102,23 +146,12 @@ bool MultiBamReader::Open( const std::vector< std::string > &filenames )
 				std::cerr << "[bam] ERROR: unable to open BAM index file:\n" << index_filename << std::endl;
 			}
 		}
-
-		pthread_mutex_init( &(this->_bam_mutex[i]), NULL );
 	}
 
 	if(!opened) exit(EXIT_FAILURE); else _is_open = true;
 
-	// initialization of min/max inserts sizes
-	for( size_t i=0; i < bams; i++ ) _minInsert[i] = MIN_ISIZE;
-	for( size_t i=0; i < bams; i++ ) _maxInsert[i] = MAX_ISIZE;
-
-	// load first alignment from each bam file
-	for( size_t i=0; i < bams; i++ ) _valid_aligns[i] = _bam_readers[i]->GetNextAlignment( _bam_aligns[i] );
-
-	// compute assembly size
-	_asm_size = 0;
-	const RefVector& ref_data = _bam_readers[0]->GetReferenceData();
-	for( size_t i=0; i < ref_data.size(); i++ ) _asm_size += ref_data[i].RefLength;
+	_filenames = filenames;
+	this->startReading();
 
 	return opened;
 }
@@ -131,12 +164,55 @@ bool MultiBamReader::Open( const std::string &filename )
 }
 
 
+bool MultiBamReader::Open( const MultiBamReader &reader )
+{
+	if(_is_open) this->Close();
+
+	size_t bams = reader.size();
+	if( bams == 0 ) return false;
+
+	this->allocate( bams );
+	_decompression_threads = reader._decompression_threads;
+	_evidence_collector = reader._evidence_collector;
+	_evidence = reader._evidence;
+
+	// clones share header, index and file mapping with the readers of the other object
+	for( size_t i=0; i < bams; i++ )
+	{
+		_bam_readers[i] = reader._bam_readers[i]->Clone();
+
+		if( _bam_readers[i] == NULL )
+		{
+			std::cerr << "[bam] ERROR: " << reader._bam_readers[i]->GetErrorString() << std::endl;
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	_is_open = true;
+
+	_filenames = reader._filenames;
+	this->startReading();
+
+	_minInsert = reader._minInsert;
+	_maxInsert = reader._maxInsert;
+
+	return true;
+}
+
+
 void MultiBamReader::Close()
 {
 	if( _is_open )
 	{
 		for( size_t i=0; i < _bam_readers.size(); i++ )
 		{
+			for( size_t j=0; j < _reader_pools[i].size(); j++ )
+			{
+				_reader_pools[i][j]->Close();
+				delete _reader_pools[i][j];
+			}
+			_reader_pools[i].clear();
+
 			_bam_readers[i]->Close();
 			delete _bam_readers[i];
 		}
@@ -146,6 +222,43 @@ void MultiBamReader::Close()
 }
 
 
+void MultiBamReader::setSortOrder( sort_order_t order )
+{
+	_sort_order = order;
+	_heap_valid = false;
+}
+
+
+void MultiBamReader::setDecompressionThreads( int threads )
+{
+	_decompression_threads = threads > 0 ? threads : 0;
+
+	if( _is_open )
+	{
+		for( size_t i=0; i < _bam_readers.size(); i++ )
+		{
+			if( not _bam_readers[i]->SetDecompressionThreads( _decompression_threads ) )
+			{
+				std::cerr << "[bam] ERROR: " << _bam_readers[i]->GetErrorString() << std::endl;
+				exit(EXIT_FAILURE);
+			}
+		}
+	}
+}
+
+
+void MultiBamReader::setEvidenceCollector( PairEvidenceCollector *collector )
+{
+	_evidence_collector = collector;
+}
+
+
+void MultiBamReader::setEvidence( const PairEvidenceFile *evidence )
+{
+	_evidence = evidence;
+}
+
+
 void MultiBamReader::setMinMaxInsertSizes( const std::vector<int32_t> &minInsert, const std::vector<int32_t> &maxInsert )
 {
 	if( minInsert.size() != maxInsert.size() || minInsert.size() != _bam_readers.size() )
@@ -223,16 +336,42 @@ double MultiBamReader::getGlobCoverage()
 }
 
 
-void MultiBamReader::lockBamReader( uint32_t idx )
+BamReader* MultiBamReader::checkoutBamReader( uint32_t idx )
 {
-	if( idx >= (this->_bam_mutex).size() ) throw MultiBamReaderException( "MultiBamReader::lockBamReader index out of bound." );
-	pthread_mutex_lock(&(this->_bam_mutex[idx]));
+	if( idx >= _bam_readers.size() ) throw MultiBamReaderException( "MultiBamReader::checkoutBamReader index out of bound." );
+
+	BamReader* reader = NULL;
+
+	pthread_mutex_lock( &_pool_mutex );
+
+	if( not _reader_pools[idx].empty() )
+	{
+		reader = _reader_pools[idx].back();
+		_reader_pools[idx].pop_back();
+	}
+
+	pthread_mutex_unlock( &_pool_mutex );
+
+	// clones share header, index and file mapping with the main reader of the library
+	// (cloning does not block other threads: pools only keep idle readers, returned with checkinBamReader)
+	if( reader == NULL ) reader = _bam_readers[idx]->Clone();
+
+	if( reader == NULL )
+	{
+		std::cerr << "[bam] ERROR: " << _bam_readers[idx]->GetErrorString() << std::endl;
+		exit(EXIT_FAILURE);
+	}
+
+	return reader;
 }
 
-void MultiBamReader::unlockBamReader( uint32_t idx )
+void MultiBamReader::checkinBamReader( uint32_t idx, BamReader* reader )
 {
-	if( idx >= (this->_bam_mutex).size() ) throw MultiBamReaderException( "MultiBamReader::unlockBamReader index out of bound." );
-	pthread_mutex_unlock(&(this->_bam_mutex[idx]));
+	if( idx >= _bam_readers.size() ) throw MultiBamReaderException( "MultiBamReader::checkinBamReader index out of bound." );
+
+	pthread_mutex_lock( &_pool_mutex );
+	_reader_pools[idx].push_back( reader );
+	pthread_mutex_unlock( &_pool_mutex );
 }
 
 
@@ -242,16 +381,18 @@ bool MultiBamReader::Rewind()
 
 	for( size_t i=0; i < _bam_readers.size(); i++ )
 	{
-		if( not _bam_readers[i]->Rewind() )
+		if( _bam_readers[i]->Rewind() )
 		{
-			ret = false;
+			this->loadNextAlignment(i);
+			_first_aligns[i] = true;
 		}
-		else
+		else if( not _first_aligns[i] ) // streams that cannot seek (e.g. stdin) are fine until read past their first alignment
 		{
-			_valid_aligns[i] = _bam_readers[i]->GetNextAlignment( _bam_aligns[i] );
+			ret = false;
 		}
 	}
 
+	_heap_valid = false;
 	return ret;
 }
 
@@ -269,10 +410,11 @@ bool MultiBamReader::Jump( uint32_t refID, uint32_t position )
 		}
 		else
 		{
-			_valid_aligns[i] = _bam_readers[i]->GetNextAlignment( _bam_aligns[i] );
+			this->loadNextAlignment(i);
 		}
 	}
 
+	_heap_valid = false;
 	return ret;
 }
 
@@ -290,10 +432,11 @@ bool MultiBamReader::SetRegion ( const uint32_t &leftRefID, const uint32_t &left
 		}
 		else
 		{
-			_valid_aligns[i] = _bam_readers[i]->GetNextAlignment( _bam_aligns[i] );
+			this->loadNextAlignment(i);
 		}
 	}
 
+	_heap_valid = false;
 	return ret;
 }
 
@@ -305,43 +448,108 @@ const RefVector& MultiBamReader::GetReferenceData() const
 }
 
 
-bool MultiBamReader::GetNextAlignment( BamAlignment &align, bool update_stats )
+bool MultiBamReader::precedes( uint32_t a, uint32_t b ) const
 {
-	if( this->size() == 0 ) return false;
+	const BamAlignment &x = _bam_aligns[a];
+	const BamAlignment &y = _bam_aligns[b];
 
-	bool found = false;
-	size_t libId = 0;
+	if( _sort_order == SORT_BY_NAME )
+	{
+		int cmp = compareReadNames( x.Name, y.Name );
+		if( cmp != 0 ) return cmp < 0;
+	}
+	else
+	{
+		if( x.RefID != y.RefID ) return x.RefID < y.RefID;
+		if( x.Position != y.Position ) return x.Position < y.Position;
+	}
 
-	// retrieve next read
-	for( size_t i=0; i < _bam_readers.size(); i++ )
+	return a < b; // ties are resolved following libraries' order
+}
+
+
+void MultiBamReader::siftDown( size_t pos )
+{
+	size_t size = _heap.size();
+
+	while( true )
 	{
-		if( not found ) // if a valid alignment hasn't been found yet
-		{
-			if( not _valid_aligns[i] ) continue;
+		size_t min = pos, left = 2*pos+1, right = 2*pos+2;
 
-			found = true;
-			align = _bam_aligns[i];
-			libId = i;
-		}
-		else
-		{
-			if( _valid_aligns[i] )
-			{
-				if( (_bam_aligns[i].RefID == align.RefID && _bam_aligns[i].Position < align.Position) || _bam_aligns[i].RefID < align.RefID )
-				{
-					align = _bam_aligns[i];
-					libId = i;
-				}
-			}
-		}
+		if( left < size && this->precedes( _heap[left], _heap[min] ) ) min = left;
+		if( right < size && this->precedes( _heap[right], _heap[min] ) ) min = right;
+
+		if( min == pos ) break;
+
+		std::swap( _heap[pos], _heap[min] );
+		pos = min;
 	}
+}
+
+
+void MultiBamReader::buildHeap()
+{
+	_heap.clear();
+	for( uint32_t i=0; i < _bam_readers.size(); i++ ) if( _valid_aligns[i] ) _heap.push_back(i);
+
+	for( size_t i = _heap.size()/2; i > 0; i-- ) this->siftDown(i-1);
+
+	_heap_valid = true;
+}
+
+
+void MultiBamReader::loadNextAlignment( uint32_t lib )
+{
+	// only core fields and read name are decoded (the name is needed to merge name-sorted files)
+	_first_aligns[lib] = false;
+	_valid_aligns[lib] = _bam_readers[lib]->GetNextAlignmentCore( _bam_aligns[lib] );
+	if( _valid_aligns[lib] ) _bam_aligns[lib].BuildName();
+}
+
+
+bool MultiBamReader::GetNextAlignment( BamAlignment &align, bool update_stats )
+{
+	if( !this->GetNextAlignmentCore( align, update_stats ) ) return false;
+
+	// decode bases, qualities and tags
+	align.BuildCharData();
+	align.Filename = _filenames[_last_lib];
+
+	return true;
+}
+
+
+bool MultiBamReader::GetNextAlignmentCore( BamAlignment &align, bool update_stats )
+{
+	if( this->size() == 0 ) return false;
+
+	if( !_heap_valid ) this->buildHeap();
+
+	// retrieve next read (the first one of the heap)
+	bool found = !_heap.empty();
 
 	// if a valid alignment has been found
 	// update alignments vector retrieving a new one from the proper BamReader
 	if( found )
 	{
+		size_t libId = _heap[0];
+		_last_lib = libId;
+
+		// hand out the alignment without copying it; the caller's object is reused as buffer
+		align.Swap( _bam_aligns[libId] );
+
 		// load the read following the one extracted
-		_valid_aligns[libId] = _bam_readers[libId]->GetNextAlignment( _bam_aligns[libId] );
+		this->loadNextAlignment(libId);
+
+		if( !_valid_aligns[libId] )
+		{
+			_heap[0] = _heap.back();
+			_heap.pop_back();
+		}
+
+		if( !_heap.empty() ) this->siftDown(0);
+
+		if( update_stats && _evidence_collector != NULL ) _evidence_collector->add( libId, align );
 
 		if( update_stats && align.IsMapped() && !align.IsDuplicate() && align.IsPrimaryAlignment() && !align.IsFailedQC() )
 		{
@@ -369,16 +577,16 @@ bool MultiBamReader::GetNextAlignment( BamAlignment &align, bool update_stats )
 					if(_isize_count[libId] == 1)
 					{
 						_isize_mean[libId] = iSize;
-						_isize_std[libId] = 0;
+						_isize_m2[libId] = 0;
 						_isize_count[libId]++;
 					}
 					else
 					{
 						double oldMean = _isize_mean[libId];
-						double oldStd = _isize_std[libId];
+						double oldM2 = _isize_m2[libId];
 
 						_isize_mean[libId] = oldMean + (iSize - oldMean)/double(_isize_count[libId]);
-						_isize_std[libId] = oldStd + (_isize_count[libId]-1)*(iSize - oldMean)*(iSize - oldMean)/double(_isize_count[libId]);
+						_isize_m2[libId] = oldM2 + (_isize_count[libId]-1)*(iSize - oldMean)*(iSize - oldMean)/double(_isize_count[libId]);
 						_isize_count[libId]++;
 					}
 				}
@@ -394,16 +602,16 @@ bool MultiBamReader::GetNextAlignment( BamAlignment &align, bool update_stats )
 					if(_isize_count[libId] == 1)
 					{
 						_isize_mean[libId] = iSize;
-						_isize_std[libId] = 0;
+						_isize_m2[libId] = 0;
 						_isize_count[libId]++;
 					}
 					else
 					{
 						double oldMean = _isize_mean[libId];
-						double oldStd = _isize_std[libId];
+						double oldM2 = _isize_m2[libId];
 
 						_isize_mean[libId] = oldMean + (iSize - oldMean)/double(_isize_count[libId]);
-						_isize_std[libId] = oldStd + (_isize_count[libId]-1)*(iSize - oldMean)*(iSize - oldMean)/double(_isize_count[libId]);
+						_isize_m2[libId] = oldM2 + (_isize_count[libId]-1)*(iSize - oldMean)*(iSize - oldMean)/double(_isize_count[libId]);
 						_isize_count[libId]++;
 					}
 				}
@@ -413,14 +621,7 @@ bool MultiBamReader::GetNextAlignment( BamAlignment &align, bool update_stats )
 	else // the end of all bam files has been reached
 	{
 		// if needed, compute standard deviation
-		if( update_stats )
-		{
-			for( size_t i=0; i < _isize_std.size(); i++ )
-			{
-				_isize_std[i] = sqrt( _isize_std[i] / double(_isize_count[i]) );
-				_coverage[i] = (_asm_size != 0) ? _reads_len[i] / ((double)_asm_size) : 0.0;
-			}
-		}
+		if( update_stats ) this->finalizeStatistics();
 	}
 
 	return found;
@@ -440,7 +641,7 @@ bool MultiBamReader::computeStatistics()
 		_bam_readers[libId]->Rewind();
 
 		this->_isize_mean[libId] = 0;
-		this->_isize_std[libId] = 0;
+		this->_isize_m2[libId] = 0;
 		this->_isize_count[libId] = 1;
 
 		this->_reads_len[libId] = 0;
@@ -473,16 +674,16 @@ bool MultiBamReader::computeStatistics()
 						if(_isize_count[libId] == 1)
 						{
 							_isize_mean[libId] = iSize;
-							_isize_std[libId] = 0;
+							_isize_m2[libId] = 0;
 							_isize_count[libId]++;
 						}
 						else
 						{
 							double oldMean = _isize_mean[libId];
-							double oldStd = _isize_std[libId];
+							double oldM2 = _isize_m2[libId];
 
 							_isize_mean[libId] = oldMean + (iSize - oldMean)/double(_isize_count[libId]);
-							_isize_std[libId] = oldStd + (_isize_count[libId]-1)*(iSize - oldMean)*(iSize - oldMean)/double(_isize_count[libId]);
+							_isize_m2[libId] = oldM2 + (_isize_count[libId]-1)*(iSize - oldMean)*(iSize - oldMean)/double(_isize_count[libId]);
 							_isize_count[libId]++;
 						}
 					}
@@ -498,16 +699,16 @@ bool MultiBamReader::computeStatistics()
 						if(_isize_count[libId] == 1)
 						{
 							_isize_mean[libId] = iSize;
-							_isize_std[libId] = 0;
+							_isize_m2[libId] = 0;
 							_isize_count[libId]++;
 						}
 						else
 						{
 							double oldMean = _isize_mean[libId];
-							double oldStd = _isize_std[libId];
+							double oldM2 = _isize_m2[libId];
 
 							_isize_mean[libId] = oldMean + (iSize - oldMean)/double(_isize_count[libId]);
-							_isize_std[libId] = oldStd + (_isize_count[libId]-1)*(iSize - oldMean)*(iSize - oldMean)/double(_isize_count[libId]);
+							_isize_m2[libId] = oldM2 + (_isize_count[libId]-1)*(iSize - oldMean)*(iSize - oldMean)/double(_isize_count[libId]);
 							_isize_count[libId]++;
 						}
 					}
@@ -516,7 +717,7 @@ bool MultiBamReader::computeStatistics()
 		}
 
 		// compute standard deviation
-		this->_isize_std[libId] = sqrt( _isize_std[libId] / double(_isize_count[libId]) );
+		this->_isize_std[libId] = sqrt( _isize_m2[libId] / double(_isize_count[libId]) );
 
 		// compute library's mean coverage
 		this->_coverage[libId] = (this->_asm_size != 0) ? this->_reads_len[libId] / ((double)this->_asm_size) : 0.0;
@@ -529,6 +730,71 @@ bool MultiBamReader::computeStatistics()
 }
 
 
+void MultiBamReader::resetStatistics()
+{
+	for( size_t i=0; i < _bam_readers.size(); i++ )
+	{
+		_isize_mean[i] = _isize_std[i] = _isize_m2[i] = 0;
+		_isize_count[i] = 1;
+		_reads_len[i] = 0;
+		_coverage[i] = 0;
+	}
+}
+
+
+void MultiBamReader::finalizeStatistics()
+{
+	for( size_t i=0; i < _isize_std.size(); i++ )
+	{
+		_isize_std[i] = sqrt( _isize_m2[i] / double(_isize_count[i]) );
+		_coverage[i] = (_asm_size != 0) ? _reads_len[i] / ((double)_asm_size) : 0.0;
+	}
+}
+
+
+void MultiBamReader::getStatistics( LibStatistics &stats ) const
+{
+	stats.isize_mean = _isize_mean;
+	stats.isize_m2 = _isize_m2;
+	stats.isize_count = _isize_count;
+	stats.reads_len = _reads_len;
+}
+
+
+void MultiBamReader::mergeStatistics( const LibStatistics &stats )
+{
+	if( stats.isize_count.size() != _bam_readers.size() )
+		throw MultiBamReaderException( "MultiBamReader::mergeStatistics number of libraries mismatch." );
+
+	for( size_t i=0; i < _bam_readers.size(); i++ )
+	{
+		_reads_len[i] += stats.reads_len[i];
+
+		// counters start from 1: the number of inserts is count-1
+		double n_a = double(_isize_count[i] - 1);
+		double n_b = double(stats.isize_count[i] - 1);
+
+		if( n_b == 0 ) continue;
+
+		if( n_a == 0 )
+		{
+			_isize_mean[i] = stats.isize_mean[i];
+			_isize_m2[i] = stats.isize_m2[i];
+			_isize_count[i] = stats.isize_count[i];
+			continue;
+		}
+
+		// combine partial means and squared deviations (Chan et al.)
+		double n = n_a + n_b;
+		double delta = stats.isize_mean[i] - _isize_mean[i];
+
+		_isize_mean[i] = _isize_mean[i] + delta * (n_b / n);
+		_isize_m2[i] = _isize_m2[i] + stats.isize_m2[i] + delta * delta * (n_a * n_b / n);
+		_isize_count[i] += stats.isize_count[i] - 1;
+	}
+}
+
+
 void MultiBamReader::writeStatsToFile( const std::string &filename ) const
 {
 	std::ofstream ofs( filename.c_str() );
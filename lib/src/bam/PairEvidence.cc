@@ -0,0 +1,476 @@
+/*
+ *  This file is part of GAM-NGS.
+ *  Copyright (c) 2011 by Riccardo Vicedomini <rvicedomini@appliedgenomics.org>,
+ *  Francesco Vezzi <vezzi@appliedgenomics.org>,
+ *  Simone Scalabrin <scalabrin@appliedgenomics.org>,
+ *  Lars Arverstad <lars.arvestad@scilifelab.se>,
+ *  Alberto Policriti <policriti@appliedgenomics.org>,
+ *  Alberto Casagrande <casagrande@appliedgenomics.org>
+ *
+ *  GAM-NGS is an evolution of a previous work (GAM) done by Alberto Casagrande,
+ *  Cristian Del Fabbro, Simone Scalabrin, and Alberto Policriti.
+ *  In particular, GAM-NGS has been adapted to work on NGS data sets and it has
+ *  been written using GAM's software as starting point. Thus, it shares part of
+ *  GAM's source code.
+ *
+ *  GAM-NGS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GAM-NGS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GAM-NGS.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <iostream>
+#include <algorithm>
+#include <limits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "bam/PairEvidence.hpp"
+#include "bam/MultiBamReader.hpp"
+
+static void writeData( FILE *out, const void *data, size_t size, const std::string &filename )
+{
+	if( size > 0 && fwrite( data, 1, size, out ) != size )
+	{
+		std::cerr << "[error] unable to write pair evidence \"" << filename << "\"" << std::endl;
+		exit(1);
+	}
+}
+
+static void writeString( FILE *out, const std::string &str, const std::string &filename )
+{
+	uint32_t len = str.size();
+	writeData( out, &len, sizeof(uint32_t), filename );
+	writeData( out, str.data(), len, filename );
+}
+
+// pads the file to a multiple of 8 bytes, so that every column is aligned
+static void writePadding( FILE *out, uint64_t &pos, const std::string &filename )
+{
+	static const char zeros[8] = { 0 };
+	uint64_t padding = (8 - pos % 8) % 8;
+
+	writeData( out, zeros, padding, filename );
+	pos += padding;
+}
+
+static void bamFileInfo( const std::string &bamFile, uint64_t &size, int64_t &mtime )
+{
+	struct stat st;
+	size = 0;
+	mtime = 0;
+
+	if( stat( bamFile.c_str(), &st ) == 0 )
+	{
+		size = st.st_size;
+		mtime = st.st_mtime;
+	}
+}
+
+
+// orders alignments of a contig by position
+class PositionLess
+{
+	const std::vector< int32_t > &_position;
+
+public:
+	PositionLess( const std::vector< int32_t > &position ) : _position(position) {}
+
+	inline bool operator()( uint32_t a, uint32_t b ) const { return _position[a] < _position[b]; }
+};
+
+template< class T > static void permute( std::vector< T > &column, const std::vector< uint32_t > &order )
+{
+	std::vector< T > sorted( column.size() );
+	for( size_t i=0; i < order.size(); i++ ) sorted[i] = column[ order[i] ];
+	column.swap( sorted );
+}
+
+
+void PairEvidenceCollector::init( uint32_t libs, const RefVector &refs )
+{
+	_columns.clear();
+	_columns.resize( libs, std::vector< Columns >( refs.size() ) );
+}
+
+
+void PairEvidenceCollector::add( uint32_t lib, const BamAlignment &align )
+{
+	if( (align.AlignmentFlag & BAD_ALIGNMENT_FLAGS) || align.Position < 0 ) return;
+	if( lib >= _columns.size() || align.RefID < 0 || (size_t) align.RefID >= _columns[lib].size() ) return;
+
+	Columns &columns = _columns[lib][align.RefID];
+
+	int32_t endPosition = align.GetEndPosition();
+	uint16_t flag = align.AlignmentFlag & EVIDENCE_SAM_FLAGS;
+
+	if( align.MateRefID != align.RefID ) flag |= EVIDENCE_MATE_OTHER_REF;
+	if( hasUniqueMapping( align ) ) flag |= EVIDENCE_UNIQUE_MAPPING;
+
+	columns.position.push_back( align.Position );
+	columns.endPosition.push_back( endPosition );
+	columns.matePosition.push_back( align.MatePosition );
+	columns.flag.push_back( flag );
+
+	if( endPosition - align.Position > columns.maxSpan ) columns.maxSpan = endPosition - align.Position;
+}
+
+
+uint64_t PairEvidenceCollector::size() const
+{
+	uint64_t alignments = 0;
+
+	for( size_t lib=0; lib < _columns.size(); lib++ )
+		for( size_t ref=0; ref < _columns[lib].size(); ref++ ) alignments += _columns[lib][ref].position.size();
+
+	return alignments;
+}
+
+
+void PairEvidenceCollector::clear()
+{
+	_columns.clear();
+}
+
+
+void PairEvidenceCollector::write( const std::string &filename, const MultiBamReader &bamReader )
+{
+	const RefVector& refs = bamReader.GetReferenceData();
+
+	if( _columns.size() != bamReader.size() || ( !_columns.empty() && _columns[0].size() != refs.size() ) )
+	{
+		std::cerr << "[error] pair evidence does not match the BAM files it should be saved with" << std::endl;
+		exit(1);
+	}
+
+	PairEvidenceFile::Header header;
+
+	memset( &header, 0, sizeof(PairEvidenceFile::Header) );
+	strncpy( header.magic, PAIR_EVIDENCE_MAGIC, sizeof(header.magic) );
+	header.version = PAIR_EVIDENCE_VERSION;
+	header.libs = bamReader.size();
+	header.refs = refs.size();
+	header.alignments = this->size();
+
+	FILE *out = fopen( filename.c_str(), "wb" );
+	if( out == NULL )
+	{
+		std::cerr << "[error] unable to create pair evidence \"" << filename << "\"" << std::endl;
+		exit(1);
+	}
+
+	writeData( out, &header, sizeof(PairEvidenceFile::Header), filename ); // rewritten at the end
+	uint64_t pos = sizeof(PairEvidenceFile::Header);
+
+	// libraries
+	for( uint32_t i=0; i < header.libs; i++ )
+	{
+		std::string bamFile = bamReader.at(i).GetFilename();
+		uint64_t bamSize;
+		int64_t bamTime;
+
+		bamFileInfo( bamFile, bamSize, bamTime );
+
+		writeString( out, bamFile, filename );
+		writeData( out, &bamSize, sizeof(uint64_t), filename );
+		writeData( out, &bamTime, sizeof(int64_t), filename );
+		pos += sizeof(uint32_t) + bamFile.size() + sizeof(uint64_t) + sizeof(int64_t);
+	}
+
+	// references
+	for( uint32_t i=0; i < header.refs; i++ )
+	{
+		writeString( out, refs[i].RefName, filename );
+		writeData( out, &refs[i].RefLength, sizeof(int32_t), filename );
+		pos += sizeof(uint32_t) + refs[i].RefName.size() + sizeof(int32_t);
+	}
+
+	// table of contigs (columns follow in the same order)
+	writePadding( out, pos, filename );
+	header.contigsOffset = pos;
+
+	std::vector< PairEvidenceFile::ContigEntry > contigs( uint64_t(header.libs) * header.refs );
+	pos += contigs.size() * sizeof(PairEvidenceFile::ContigEntry);
+
+	for( uint32_t lib=0; lib < header.libs; lib++ )
+	{
+		for( uint32_t ref=0; ref < header.refs; ref++ )
+		{
+			PairEvidenceFile::ContigEntry &entry = contigs[ uint64_t(lib) * header.refs + ref ];
+			const Columns &columns = _columns[lib][ref];
+
+			entry.offset = pos;
+			entry.alignments = columns.position.size();
+			entry.maxSpan = columns.maxSpan;
+			entry.reserved = 0;
+
+			pos += entry.alignments * (3 * sizeof(int32_t) + sizeof(uint16_t));
+			pos += (8 - pos % 8) % 8;
+		}
+	}
+
+	writeData( out, contigs.empty() ? NULL : &contigs[0], contigs.size() * sizeof(PairEvidenceFile::ContigEntry), filename );
+	pos = header.contigsOffset + contigs.size() * sizeof(PairEvidenceFile::ContigEntry);
+
+	// columns (alignments read in any order are sorted by position)
+	for( uint32_t lib=0; lib < header.libs; lib++ )
+	{
+		for( uint32_t ref=0; ref < header.refs; ref++ )
+		{
+			Columns &columns = _columns[lib][ref];
+			size_t num = columns.position.size();
+
+			bool sorted = true;
+			for( size_t i=1; sorted && i < num; i++ ) sorted = ( columns.position[i-1] <= columns.position[i] );
+
+			if( !sorted )
+			{
+				std::vector< uint32_t > order( num );
+				for( size_t i=0; i < num; i++ ) order[i] = i;
+				std::stable_sort( order.begin(), order.end(), PositionLess( columns.position ) );
+
+				permute( columns.position, order );
+				permute( columns.endPosition, order );
+				permute( columns.matePosition, order );
+				permute( columns.flag, order );
+			}
+
+			if( num > 0 )
+			{
+				writeData( out, &columns.position[0], num * sizeof(int32_t), filename );
+				writeData( out, &columns.endPosition[0], num * sizeof(int32_t), filename );
+				writeData( out, &columns.matePosition[0], num * sizeof(int32_t), filename );
+				writeData( out, &columns.flag[0], num * sizeof(uint16_t), filename );
+			}
+
+			pos += num * (3 * sizeof(int32_t) + sizeof(uint16_t));
+			writePadding( out, pos, filename );
+		}
+	}
+
+	header.fileSize = pos;
+
+	fseeko( out, 0, SEEK_SET );
+	writeData( out, &header, sizeof(PairEvidenceFile::Header), filename );
+
+	if( fclose(out) != 0 )
+	{
+		std::cerr << "[error] unable to write pair evidence \"" << filename << "\"" << std::endl;
+		exit(1);
+	}
+}
+
+
+PairEvidenceFile::PairEvidenceFile() :
+	_data(NULL), _size(0), _libs(0), _refs(0), _alignments(0), _contigs(NULL)
+{}
+
+
+PairEvidenceFile::~PairEvidenceFile()
+{
+	this->close();
+}
+
+
+void PairEvidenceFile::close()
+{
+	if( _data != NULL ) munmap( _data, _size );
+
+	_data = NULL;
+	_size = 0;
+	_libs = _refs = 0;
+	_alignments = 0;
+	_contigs = NULL;
+}
+
+
+// sequential reader of the mapped file, checking bounds
+class EvidenceCursor
+{
+	const char *_data;
+	uint64_t _size;
+	uint64_t _pos;
+
+public:
+	EvidenceCursor( const void *data, uint64_t size ) : _data((const char*)data), _size(size), _pos(0) {}
+
+	bool get( uint64_t len, const void* &ptr )
+	{
+		if( _pos + len > _size ) return false;
+
+		ptr = _data + _pos;
+		_pos += len;
+		return true;
+	}
+
+	template< class T > bool read( T &value )
+	{
+		const void *ptr;
+		if( !this->get( sizeof(T), ptr ) ) return false;
+
+		memcpy( &value, ptr, sizeof(T) );
+		return true;
+	}
+
+	bool readString( std::string &str )
+	{
+		uint32_t len;
+		const void *ptr;
+		if( !this->read(len) || !this->get( len, ptr ) ) return false;
+
+		str.assign( (const char*) ptr, len );
+		return true;
+	}
+};
+
+
+bool PairEvidenceFile::load( const std::string &filename, const MultiBamReader &bamReader )
+{
+	this->close();
+	_filename = filename;
+
+	int fd = open( filename.c_str(), O_RDONLY );
+	struct stat st;
+
+	if( fd < 0 || fstat( fd, &st ) != 0 )
+	{
+		if( fd >= 0 ) ::close(fd);
+		std::cerr << "[warning] unable to open pair evidence \"" << filename << "\"" << std::endl;
+		return false;
+	}
+
+	_size = st.st_size;
+	_data = ( _size > 0 ) ? mmap( NULL, _size, PROT_READ, MAP_SHARED, fd, 0 ) : MAP_FAILED;
+	::close(fd);
+
+	if( _data == MAP_FAILED )
+	{
+		_data = NULL;
+		_size = 0;
+		std::cerr << "[warning] unable to map pair evidence \"" << filename << "\"" << std::endl;
+		return false;
+	}
+
+	EvidenceCursor cursor( _data, _size );
+	Header header;
+	std::string problem = "";
+
+	if( !cursor.read(header) || strncmp( header.magic, PAIR_EVIDENCE_MAGIC, sizeof(header.magic) ) != 0 )
+		problem = "is not a pair-evidence file";
+	else if( header.version != PAIR_EVIDENCE_VERSION )
+		problem = "has a different version; please rebuild it";
+	else if( header.fileSize != _size )
+		problem = "is truncated";
+	else if( header.libs != bamReader.size() )
+		problem = "refers to a different number of libraries";
+
+	// check libraries
+	for( uint32_t i=0; problem == "" && i < header.libs; i++ )
+	{
+		std::string bamFile;
+		uint64_t bamSize, curSize;
+		int64_t bamTime, curTime;
+
+		if( !cursor.readString(bamFile) || !cursor.read(bamSize) || !cursor.read(bamTime) )
+		{
+			problem = "is truncated";
+			break;
+		}
+
+		bamFileInfo( bamReader.at(i).GetFilename(), curSize, curTime );
+
+		if( bamFile != bamReader.at(i).GetFilename() || bamSize != curSize || bamTime != curTime )
+			problem = "was built from different (or modified) BAM files";
+	}
+
+	// check references
+	const RefVector& refs = bamReader.GetReferenceData();
+
+	if( problem == "" && header.refs != refs.size() ) problem = "has different references";
+
+	for( uint32_t i=0; problem == "" && i < header.refs; i++ )
+	{
+		std::string name;
+		int32_t length;
+
+		if( !cursor.readString(name) || !cursor.read(length) ) problem = "is truncated";
+		else if( name != refs[i].RefName || length != refs[i].RefLength ) problem = "has different references";
+	}
+
+	// check table of contigs and columns' bounds
+	uint64_t contigsNum = uint64_t(header.libs) * header.refs;
+
+	if( problem == "" && ( header.contigsOffset % 8 != 0 ||
+		header.contigsOffset + contigsNum * sizeof(ContigEntry) > _size ) ) problem = "is truncated";
+
+	if( problem == "" )
+	{
+		const ContigEntry *contigs = (const ContigEntry*) ((const char*)_data + header.contigsOffset);
+
+		for( uint64_t i=0; problem == "" && i < contigsNum; i++ )
+		{
+			if( contigs[i].offset % 8 != 0 || contigs[i].alignments > _size ||
+				contigs[i].offset + contigs[i].alignments * (3 * sizeof(int32_t) + sizeof(uint16_t)) > _size )
+				problem = "is truncated";
+		}
+
+		_contigs = contigs;
+	}
+
+	if( problem != "" )
+	{
+		std::cerr << "[warning] pair evidence \"" << filename << "\" " << problem << std::endl;
+		this->close();
+		return false;
+	}
+
+	_libs = header.libs;
+	_refs = header.refs;
+	_alignments = header.alignments;
+
+	return true;
+}
+
+
+EvidenceRegion PairEvidenceFile::getRegion( uint32_t lib, int32_t refID, int32_t begin, int32_t end ) const
+{
+	EvidenceRegion region;
+	memset( &region, 0, sizeof(EvidenceRegion) );
+	region.Left = begin;
+
+	if( lib >= _libs || refID < 0 || (uint32_t) refID >= _refs ) return region;
+
+	const ContigEntry &entry = _contigs[ uint64_t(lib) * _refs + refID ];
+	const char *columns = (const char*)_data + entry.offset;
+
+	region.Position = (const int32_t*) columns;
+	region.EndPosition = region.Position + entry.alignments;
+	region.MatePosition = region.EndPosition + entry.alignments;
+	region.Flag = (const uint16_t*) (region.MatePosition + entry.alignments);
+
+	// alignments starting before the region overlap it only if they start less than maxSpan bases before
+	int64_t first = ( entry.maxSpan > 0 ) ? int64_t(begin) - entry.maxSpan + 1 : begin;
+	first = std::max( first, (int64_t) std::numeric_limits< int32_t >::min() );
+
+	const int32_t *positionEnd = region.Position + entry.alignments;
+	region.Begin = std::lower_bound( region.Position, positionEnd, (int32_t) first ) - region.Position;
+	region.End = std::lower_bound( region.Position, positionEnd, end ) - region.Position;
+
+	if( region.End < region.Begin ) region.End = region.Begin;
+
+	return region;
+}
@@ -0,0 +1,200 @@
+/*
+ *  This file is part of GAM-NGS.
+ *  Copyright (c) 2011 by Riccardo Vicedomini <rvicedomini@appliedgenomics.org>,
+ *  Francesco Vezzi <vezzi@appliedgenomics.org>,
+ *  Simone Scalabrin <scalabrin@appliedgenomics.org>,
+ *  Lars Arverstad <lars.arvestad@scilifelab.se>,
+ *  Alberto Policriti <policriti@appliedgenomics.org>,
+ *  Alberto Casagrande <casagrande@appliedgenomics.org>
+ *
+ *  GAM-NGS is an evolution of a previous work (GAM) done by Alberto Casagrande,
+ *  Cristian Del Fabbro, Simone Scalabrin, and Alberto Policriti.
+ *  In particular, GAM-NGS has been adapted to work on NGS data sets and it has
+ *  been written using GAM's software as starting point. Thus, it shares part of
+ *  GAM's source code.
+ *
+ *  GAM-NGS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GAM-NGS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GAM-NGS.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "bam/RegionMetricsCache.hpp"
+
+
+// bookkeeping memory of a cached entry (list node and index node)
+#define REGION_CACHE_ENTRY_OVERHEAD 96
+
+
+bool RegionMetricsCache::Key::operator<( const Key &other ) const
+{
+	if( assembly != other.assembly ) return assembly < other.assembly;
+	if( lib != other.lib ) return lib < other.lib;
+
+	const RegionQuery &a = query, &b = other.query;
+
+	if( a.refID != b.refID ) return a.refID < b.refID;
+	if( a.start != b.start ) return a.start < b.start;
+	if( a.end != b.end ) return a.end < b.end;
+	if( a.metrics != b.metrics ) return a.metrics < b.metrics;
+	if( a.minInsert != b.minInsert ) return a.minInsert < b.minInsert;
+	if( a.maxInsert != b.maxInsert ) return a.maxInsert < b.maxInsert;
+	if( a.gapPos != b.gapPos ) return a.gapPos < b.gapPos;
+
+	return a.seqLen < b.seqLen;
+}
+
+
+RegionMetricsCache::RegionMetricsCache() :
+	_capacity(0)
+{
+	for( size_t i=0; i < SHARDS; i++ )
+	{
+		pthread_mutex_init( &_shards[i].mutex, NULL );
+		_shards[i].size = _shards[i].capacity = 0;
+		_shards[i].hits = _shards[i].misses = _shards[i].evictions = 0;
+	}
+}
+
+
+RegionMetricsCache::~RegionMetricsCache()
+{
+	for( size_t i=0; i < SHARDS; i++ ) pthread_mutex_destroy( &_shards[i].mutex );
+}
+
+
+RegionMetricsCache& RegionMetricsCache::instance()
+{
+	static RegionMetricsCache cache;
+	return cache;
+}
+
+
+uint64_t RegionMetricsCache::entryBytes()
+{
+	return sizeof(Entry) + REGION_CACHE_ENTRY_OVERHEAD;
+}
+
+
+void RegionMetricsCache::setCapacity( uint64_t bytes )
+{
+	_capacity = bytes / entryBytes();
+
+	for( size_t i=0; i < SHARDS; i++ )
+	{
+		Shard &shard = _shards[i];
+
+		pthread_mutex_lock( &shard.mutex );
+		shard.capacity = _capacity / SHARDS;
+		evict( shard );
+		pthread_mutex_unlock( &shard.mutex );
+	}
+}
+
+
+RegionMetricsCache::Shard& RegionMetricsCache::shardOf( const Key &key )
+{
+	uint64_t h = (uint64_t)key.query.start ^ ((uint64_t)key.query.end << 20) ^ ((uint64_t)key.query.refID << 40) ^ ((uint64_t)key.lib << 58);
+	h *= 0x9E3779B97F4A7C15ULL;
+
+	return _shards[ h >> 60 ];
+}
+
+
+// drops least recently used entries until the shard fits its capacity
+void RegionMetricsCache::evict( Shard &shard )
+{
+	while( shard.size > shard.capacity && !shard.entries.empty() )
+	{
+		shard.index.erase( shard.entries.back().key );
+		shard.entries.pop_back();
+		shard.size--;
+		shard.evictions++;
+	}
+}
+
+
+bool RegionMetricsCache::lookup( const MultiBamReader *assembly, uint32_t lib, const RegionQuery &query, RegionMetrics &metrics )
+{
+	Key key;
+	key.assembly = assembly;
+	key.lib = lib;
+	key.query = query;
+
+	Shard &shard = shardOf( key );
+	pthread_mutex_lock( &shard.mutex );
+
+	std::map< Key, EntryList::iterator >::iterator it = shard.index.find( key );
+
+	if( it == shard.index.end() )
+	{
+		shard.misses++;
+		pthread_mutex_unlock( &shard.mutex );
+		return false;
+	}
+
+	// move entry to the front of the LRU list
+	shard.entries.splice( shard.entries.begin(), shard.entries, it->second );
+
+	metrics = it->second->metrics;
+	shard.hits++;
+
+	pthread_mutex_unlock( &shard.mutex );
+	return true;
+}
+
+
+void RegionMetricsCache::insert( const MultiBamReader *assembly, uint32_t lib, const RegionQuery &query, const RegionMetrics &metrics )
+{
+	Key key;
+	key.assembly = assembly;
+	key.lib = lib;
+	key.query = query;
+
+	Shard &shard = shardOf( key );
+	pthread_mutex_lock( &shard.mutex );
+
+	// skip entries already cached (e.g. by another thread)
+	if( shard.capacity == 0 || shard.index.find( key ) != shard.index.end() )
+	{
+		pthread_mutex_unlock( &shard.mutex );
+		return;
+	}
+
+	shard.entries.push_front( Entry() );
+	shard.entries.front().key = key;
+	shard.entries.front().metrics = metrics;
+
+	shard.index[key] = shard.entries.begin();
+	shard.size++;
+	evict( shard );
+
+	pthread_mutex_unlock( &shard.mutex );
+}
+
+
+void RegionMetricsCache::getStatistics( uint64_t &hits, uint64_t &misses, uint64_t &evictions, uint64_t &bytes )
+{
+	hits = misses = evictions = bytes = 0;
+
+	for( size_t i=0; i < SHARDS; i++ )
+	{
+		Shard &shard = _shards[i];
+
+		pthread_mutex_lock( &shard.mutex );
+		hits += shard.hits;
+		misses += shard.misses;
+		evictions += shard.evictions;
+		bytes += shard.size * entryBytes();
+		pthread_mutex_unlock( &shard.mutex );
+	}
+}
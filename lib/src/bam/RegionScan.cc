@@ -0,0 +1,366 @@
+/*
+ *  This file is part of GAM-NGS.
+ *  Copyright (c) 2011 by Riccardo Vicedomini <rvicedomini@appliedgenomics.org>,
+ *  Francesco Vezzi <vezzi@appliedgenomics.org>,
+ *  Simone Scalabrin <scalabrin@appliedgenomics.org>,
+ *  Lars Arverstad <lars.arvestad@scilifelab.se>,
+ *  Alberto Policriti <policriti@appliedgenomics.org>,
+ *  Alberto Casagrande <casagrande@appliedgenomics.org>
+ *
+ *  GAM-NGS is an evolution of a previous work (GAM) done by Alberto Casagrande,
+ *  Cristian Del Fabbro, Simone Scalabrin, and Alberto Policriti.
+ *  In particular, GAM-NGS has been adapted to work on NGS data sets and it has
+ *  been written using GAM's software as starting point. Thus, it shares part of
+ *  GAM's source code.
+ *
+ *  GAM-NGS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GAM-NGS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GAM-NGS.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <cstdlib>
+#include <iostream>
+#include <algorithm>
+
+#include "bam/RegionScan.hpp"
+#include "bam/RegionMetricsCache.hpp"
+#include "bam/PairEvidence.hpp"
+
+#include "OptionsMerge.hpp"
+using namespace options;
+extern OptionsMerge g_options;
+
+
+RegionQuery::RegionQuery() :
+	refID(-1), start(0), end(-1), metrics(0), minInsert(0), maxInsert(0), gapPos(0), seqLen(0)
+{}
+
+
+RegionQuery::RegionQuery( int32_t refID, int32_t start, int32_t end, uint32_t metrics ) :
+	refID(refID), start(start), end(end), metrics(metrics), minInsert(0), maxInsert(0), gapPos(0), seqLen(0)
+{}
+
+
+RegionMetrics::RegionMetrics() :
+	reads(0), inserts(0), insertSum(0), expGapBases(0), goodGapBases(0), gapReads(0),
+	coverageSum(0), minCoverage(0), maxCoverage(0)
+{}
+
+
+// updates the insert statistics of a region with a read whose mate is aligned on the same contig
+static inline void addRegionInsert( const RegionQuery &q, RegionMetrics &m,
+									uint16_t flag, int32_t read_start, int32_t read_end_position, int32_t mate_start, bool is_uniq_mapped )
+{
+	int32_t read_end = read_end_position - 1;
+	int32_t read_len = read_end - read_start + 1;
+	int32_t mate_end = mate_start + read_len - 1;
+
+	if( read_start < q.start || read_end > q.end ) return;
+	if( mate_start < q.start || mate_end > q.end ) return;
+
+	if( !is_uniq_mapped ) return;
+
+	if( flag & Constants::BAM_ALIGNMENT_READ_1 )
+	{
+		int32_t i_size = ( read_start < mate_start ) ? (mate_start + read_len) - read_start : read_end - mate_start + 1;
+		if( i_size < q.minInsert || i_size > q.maxInsert ) return;
+
+		m.inserts++;
+		m.insertSum += i_size;
+	}
+}
+
+
+// updates the evidences about the gap following a region with a read
+static inline void addGapRead( const RegionQuery &q, RegionMetrics &m,
+							   uint16_t flag, int32_t startRead, int32_t endPosition, int32_t startMate, bool mateOtherRef, bool uniqMapRead )
+{
+	if( !(flag & Constants::BAM_ALIGNMENT_PAIRED) ) return;
+
+	if( !uniqMapRead ) return; // discard reads with multiplicity greater than 1
+
+	int32_t readLength = endPosition - startRead;
+	int32_t endRead = startRead + readLength - 1;
+	int32_t endMate = startMate + readLength - 1;
+
+	// don't count reads not completely included in the region
+	if( startRead < q.start || startRead > q.end ) return;
+
+	if( !(flag & Constants::BAM_ALIGNMENT_REVERSE_STRAND) )
+	{
+		int32_t maxInsertPos = startRead + q.maxInsert;
+		int32_t readOverlap = endRead > q.end ? q.end-startRead+1 : readLength;
+		bool mateReverse = (flag & Constants::BAM_ALIGNMENT_MATE_REVERSE_STRAND);
+
+		// unmapped mate
+		if( flag & Constants::BAM_ALIGNMENT_MATE_UNMAPPED ){ m.expGapBases += readOverlap; m.gapReads++; return; }
+		// mate is mapped in a different sequence while it should not be.
+		if( mateOtherRef ){ if( maxInsertPos < q.seqLen ) m.expGapBases += readOverlap; m.gapReads++; return; }
+		// mate mapped in the same sequence, crossing the gap, with wrong orientation
+		if( !mateReverse && endMate >= q.gapPos ){ m.expGapBases += readOverlap; m.gapReads++; }
+		// mate mapped in the same sequence, crossing the gap, with correct orientation
+		if( mateReverse && endMate >= q.gapPos ){ m.goodGapBases += readOverlap; m.expGapBases += readOverlap; m.gapReads++; }
+	}
+}
+
+
+// orders queries by contig and left bound
+class QueryLess
+{
+private:
+	const std::vector< RegionQuery > &_queries;
+
+public:
+	QueryLess( const std::vector< RegionQuery > &queries ) : _queries(queries) {}
+
+	inline bool operator()( size_t a, size_t b ) const
+	{
+		const RegionQuery &qa = _queries[a], &qb = _queries[b];
+		return qa.refID < qb.refID || ( qa.refID == qb.refID && qa.start < qb.start );
+	}
+};
+
+
+//! Visits the regions overlapped by alignments given in coordinate order.
+/*!
+ * Regions are activated when the first alignment overlapping them is met and dropped
+ * as soon as alignments start after them.
+ */
+struct RegionScanner::Sweep
+{
+	const std::vector< RegionQuery > &queries;
+	std::vector< RegionMetrics > &metrics;
+
+	std::vector< size_t > order;                        // non-empty queries, by contig and left bound
+	std::vector< std::vector< int32_t > > coverage;     // difference arrays (REGION_COVERAGE)
+	std::vector< size_t > active;
+	size_t next;
+	int32_t refID;
+
+	Sweep( const std::vector< RegionQuery > &q, std::vector< RegionMetrics > &m ) :
+		queries(q), metrics(m), next(0), refID(-1)
+	{
+		metrics.assign( queries.size(), RegionMetrics() );
+		coverage.resize( queries.size() );
+
+		for( size_t i=0; i < queries.size(); i++ )
+		{
+			if( queries[i].end < queries[i].start ) continue;
+
+			order.push_back(i);
+			if( queries[i].metrics & REGION_COVERAGE ) coverage[i].assign( queries[i].end - queries[i].start + 2, 0 );
+		}
+
+		std::sort( order.begin(), order.end(), QueryLess(queries) );
+	}
+
+	inline void add( int32_t readRefID, int32_t startRead, int32_t endPosition, int32_t startMate, uint16_t flag, bool mateOtherRef, bool uniqMapRead )
+	{
+		if( readRefID != refID )
+		{
+			refID = readRefID;
+			active.clear();
+			while( next < order.size() && queries[order[next]].refID < refID ) next++;
+		}
+
+		// alignments overlap the regions starting before their end (or their start, if they have no length)
+		int32_t readBound = std::max( endPosition, startRead+1 );
+
+		while( next < order.size() && queries[order[next]].refID == refID && queries[order[next]].start < readBound ) active.push_back( order[next++] );
+
+		size_t kept = 0;
+		for( size_t a=0; a < active.size(); a++ )
+		{
+			const size_t i = active[a];
+			const RegionQuery &q = queries[i];
+
+			if( q.end < startRead ) continue; // no later alignment overlaps the region
+
+			active[kept++] = i;
+
+			if( q.start >= readBound ) continue;
+
+			RegionMetrics &m = metrics[i];
+			m.reads++;
+
+			if( (q.metrics & REGION_INSERTS) && !(flag & Constants::BAM_ALIGNMENT_MATE_UNMAPPED) && !mateOtherRef )
+				addRegionInsert( q, m, flag, startRead, endPosition, startMate, uniqMapRead );
+
+			if( q.metrics & REGION_GAP )
+				addGapRead( q, m, flag, startRead, endPosition, startMate, mateOtherRef, uniqMapRead );
+
+			if( q.metrics & REGION_COVERAGE )
+			{
+				int32_t b = std::max( startRead, q.start );
+				int32_t e = std::min( endPosition, q.end+1 );
+				if( b < e ){ coverage[i][b-q.start]++; coverage[i][e-q.start]--; }
+			}
+		}
+		active.resize( kept );
+	}
+
+	void finish()
+	{
+		for( size_t i=0; i < coverage.size(); i++ )
+		{
+			if( coverage[i].empty() ) continue;
+
+			RegionMetrics &m = metrics[i];
+			int32_t cov = 0;
+
+			for( size_t j=0; j+1 < coverage[i].size(); j++ )
+			{
+				cov += coverage[i][j];
+
+				m.coverageSum += cov;
+				if( j == 0 || (uint32_t)cov < m.minCoverage ) m.minCoverage = cov;
+				if( (uint32_t)cov > m.maxCoverage ) m.maxCoverage = cov;
+			}
+
+			std::vector< int32_t >().swap( coverage[i] );
+		}
+	}
+};
+
+
+RegionScanner::RegionScanner( MultiBamReader &bamReader ) :
+	_bamReader( bamReader )
+{}
+
+
+void RegionScanner::scan( uint32_t lib, const std::vector< RegionQuery > &queries, std::vector< RegionMetrics > &metrics )
+{
+	RegionMetricsCache &cache = RegionMetricsCache::instance();
+
+	if( !cache.isEnabled() )
+	{
+		this->scanRegions( lib, queries, metrics );
+		return;
+	}
+
+	// scan only the regions whose statistics have not been memoized
+	std::vector< RegionQuery > missing;
+	std::vector< size_t > missingIdx;
+
+	metrics.assign( queries.size(), RegionMetrics() );
+
+	for( size_t i=0; i < queries.size(); i++ )
+	{
+		if( cache.lookup( &_bamReader, lib, queries[i], metrics[i] ) ) continue;
+
+		missing.push_back( queries[i] );
+		missingIdx.push_back( i );
+	}
+
+	if( missing.empty() ) return;
+
+	std::vector< RegionMetrics > missingMetrics;
+	this->scanRegions( lib, missing, missingMetrics );
+
+	for( size_t i=0; i < missing.size(); i++ )
+	{
+		metrics[ missingIdx[i] ] = missingMetrics[i];
+		cache.insert( &_bamReader, lib, missing[i], missingMetrics[i] );
+	}
+}
+
+
+void RegionScanner::scanRegions( uint32_t lib, const std::vector< RegionQuery > &queries, std::vector< RegionMetrics > &metrics )
+{
+	Sweep sweep( queries, metrics );
+	const std::vector< size_t > &order = sweep.order;
+
+	if( order.empty() ) return;
+
+	if( const PairEvidenceFile *evidence = _bamReader.getEvidence() )
+	{
+		size_t first = 0;
+
+		while( first < order.size() )
+		{
+			int32_t refID = queries[order[first]].refID;
+			int32_t maxEnd = queries[order[first]].end;
+
+			size_t last = first;
+			while( last < order.size() && queries[order[last]].refID == refID ) maxEnd = std::max( maxEnd, queries[order[last++]].end );
+
+			// alignments of the regions of the contig saved by gam-create (bad quality reads have been discarded)
+			EvidenceRegion reads = evidence->getRegion( lib, refID, queries[order[first]].start, maxEnd+1 );
+
+			for( size_t k = reads.Begin; k < reads.End; k++ )
+			{
+				if( !reads.overlaps(k) ) continue;
+
+				const uint16_t flag = reads.Flag[k];
+				bool uniqMapRead = g_options.noMultiplicityFilter || (flag & EVIDENCE_UNIQUE_MAPPING);
+
+				sweep.add( refID, reads.Position[k], reads.EndPosition[k], reads.MatePosition[k], flag, (flag & EVIDENCE_MATE_OTHER_REF), uniqMapRead );
+			}
+
+			first = last;
+		}
+	}
+	else
+	{
+		std::vector< BamRegion > regions;
+		regions.reserve( order.size() );
+
+		for( size_t i=0; i < order.size(); i++ )
+		{
+			const RegionQuery &q = queries[ order[i] ];
+			regions.push_back( BamRegion( q.refID, q.start, q.refID, q.end+1 ) );
+		}
+
+		// check out a reader of the library and read every region in a single forward pass
+		PooledBamReader reader( _bamReader, lib );
+
+		if( !reader->SetRegions( regions ) )
+		{
+			std::cerr << "[bam] ERROR: " << reader->GetErrorString() << std::endl;
+			exit(1);
+		}
+
+		BamAlignmentBatch batch;
+		selectUniqueMappingTags( batch );
+
+		while( reader->GetNextAlignmentBatch( batch, ALIGNMENT_BATCH_SIZE ) > 0 )
+		{
+			for( size_t k=0; k < batch.Size(); k++ )
+			{
+				const uint16_t flag = batch.AlignmentFlag[k];
+
+				// discard bad quality reads
+				if( (flag & BAD_ALIGNMENT_FLAGS) || batch.Position[k] < 0 ) continue;
+
+				// if not defined, I assume read's multiplicity is 1
+				bool uniqMapRead = g_options.noMultiplicityFilter || hasUniqueMapping( batch, k );
+
+				sweep.add( batch.RefID[k], batch.Position[k], batch.EndPosition[k], batch.MatePosition[k], flag,
+						   batch.RefID[k] != batch.MateRefID[k], uniqMapRead );
+			}
+		}
+	}
+
+	sweep.finish();
+}
+
+
+RegionMetrics RegionScanner::scan( uint32_t lib, const RegionQuery &query )
+{
+	std::vector< RegionQuery > queries( 1, query );
+	std::vector< RegionMetrics > metrics;
+
+	this->scan( lib, queries, metrics );
+
+	return metrics.front();
+}
@@ -0,0 +1,269 @@
+/*
+ *  This file is part of GAM-NGS.
+ *  Copyright (c) 2011 by Riccardo Vicedomini <rvicedomini@appliedgenomics.org>,
+ *  Francesco Vezzi <vezzi@appliedgenomics.org>,
+ *  Simone Scalabrin <scalabrin@appliedgenomics.org>,
+ *  Lars Arverstad <lars.arvestad@scilifelab.se>,
+ *  Alberto Policriti <policriti@appliedgenomics.org>,
+ *  Alberto Casagrande <casagrande@appliedgenomics.org>
+ *
+ *  GAM-NGS is an evolution of a previous work (GAM) done by Alberto Casagrande,
+ *  Cristian Del Fabbro, Simone Scalabrin, and Alberto Policriti.
+ *  In particular, GAM-NGS has been adapted to work on NGS data sets and it has
+ *  been written using GAM's software as starting point. Thus, it shares part of
+ *  GAM's source code.
+ *
+ *  GAM-NGS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GAM-NGS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GAM-NGS.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <algorithm>
+
+#include "graphs/EdgeWeightPlanner.hpp"
+
+
+EdgeWeightPlanner::EdgeWeightPlanner( MultiBamReader &masterBamReader, MultiBamReader &masterMpBamReader,
+									  MultiBamReader &slaveBamReader, MultiBamReader &slaveMpBamReader )
+{
+	_bamReaders[MASTER_PE] = &masterBamReader;
+	_bamReaders[MASTER_MP] = &masterMpBamReader;
+	_bamReaders[SLAVE_PE] = &slaveBamReader;
+	_bamReaders[SLAVE_MP] = &slaveMpBamReader;
+
+	for( int set=0; set < LIBRARY_SETS; set++ ) _windows[set].resize( _bamReaders[set]->size() );
+}
+
+
+void EdgeWeightPlanner::addGraph( CompactAssemblyGraph *graph )
+{
+	CompactAssemblyGraph::EdgeIterator ebegin,eend;
+	boost::tie(ebegin,eend) = boost::edges(*graph);
+
+	for( CompactAssemblyGraph::EdgeIterator e = ebegin; e != eend; e++ )
+	{
+		_edges.push_back( PlannedEdge() );
+
+		PlannedEdge &planned = _edges.back();
+		planned.graph = graph;
+		planned.edge = *e;
+		planned.kind = boost::get( boost::edge_kind_t(), *graph, *e ).kind;
+
+		if( planned.kind == MASTER_EDGE )
+		{
+			this->planWindows( _edges.size()-1, MASTER_PE, planned.scores[0] );
+			this->planWindows( _edges.size()-1, MASTER_MP, planned.scores[1] );
+		}
+		else if( planned.kind == SLAVE_EDGE )
+		{
+			this->planWindows( _edges.size()-1, SLAVE_PE, planned.scores[0] );
+			this->planWindows( _edges.size()-1, SLAVE_MP, planned.scores[1] );
+		}
+	}
+}
+
+
+void EdgeWeightPlanner::planWindows( size_t edgeIdx, int set, LibScores &scores )
+{
+	const PlannedEdge &planned = _edges[edgeIdx];
+	MultiBamReader &bamReader = *_bamReaders[set];
+
+	scores.included = false;
+	scores.score.assign( bamReader.size(), -4 );
+	scores.rnum.assign( bamReader.size(), 0 );
+
+	const std::list<Block> &b1 = planned.graph->getBlocks( boost::source( planned.edge, *planned.graph ) );
+	const std::list<Block> &b2 = planned.graph->getBlocks( boost::target( planned.edge, *planned.graph ) );
+
+	if( bamReader.size() == 0 || b1.size() == 0 || b2.size() == 0 ) return;
+
+	bool master = ( planned.kind == MASTER_EDGE );
+
+	const Frame& f1 = master ? b1.front().getMasterFrame() : b1.front().getSlaveFrame();
+	const Frame& f2 = master ? b2.front().getMasterFrame() : b2.front().getSlaveFrame();
+	const Frame& l1 = master ? b1.back().getMasterFrame() : b1.back().getSlaveFrame();
+	const Frame& l2 = master ? b2.back().getMasterFrame() : b2.back().getSlaveFrame();
+
+	int32_t r1_beg = std::min( f1.getBegin(), l1.getBegin() );
+	int32_t r1_end = std::max( f1.getEnd(), l1.getEnd() );
+	int32_t r2_beg = std::min( f2.getBegin(), l2.getBegin() );
+	int32_t r2_end = std::max( f2.getEnd(), l2.getEnd() );
+
+	// skip included frames
+	if( (r1_beg <= r2_beg && r1_end >= r2_end) ||
+		(r2_beg <= r1_beg && r2_end >= r1_end) )
+	{
+		scores.included = true;
+		return;
+	}
+
+	int32_t gap = (r1_beg <= r2_beg) ? (r2_beg - r1_end + 1) : (r1_beg - r2_end + 1);
+	const RefVector& ref = bamReader.GetReferenceData();
+
+	for( uint32_t lib=0; lib < bamReader.size(); lib++ )
+	{
+		int32_t isizeLibMean = bamReader.getISizeMean(lib);
+		int32_t isizeLibStd = bamReader.getISizeStd(lib);
+
+		int32_t maxInsert = isizeLibMean + 3*isizeLibStd;
+
+		int32_t seqLen = ref[ f1.getContigId() ].RefLength;
+
+		int32_t t = (r1_beg <= r2_beg) ? (gap >= 0 ? r2_beg : r1_end) : (gap >= 0 ? r1_beg : r2_end);
+		int32_t s1 = std::max( t - maxInsert, 0 );
+		int32_t s2 = (r1_beg <= r2_beg) ? (gap >= 0 ? r1_end : r2_beg) : (gap >= 0 ? r2_end : r1_beg);
+
+		// contig too short or gap too wide: no window (library keeps the initial score)
+		if( seqLen - s1 < maxInsert ) continue;
+		if( gap >= maxInsert || s2 < s1 ) continue;
+
+		GapWindow w;
+
+		w.query = RegionQuery( f1.getContigId(), s1, s2, REGION_GAP );
+		w.query.maxInsert = maxInsert;
+		w.query.gapPos = t;
+		w.query.seqLen = seqLen;
+		w.edge = edgeIdx;
+
+		_windows[set][lib].push_back( w );
+	}
+}
+
+
+uint64_t EdgeWeightPlanner::windows() const
+{
+	uint64_t num = 0;
+
+	for( int set=0; set < LIBRARY_SETS; set++ )
+		for( size_t lib=0; lib < _windows[set].size(); lib++ ) num += _windows[set][lib].size();
+
+	return num;
+}
+
+
+void EdgeWeightPlanner::scanLibrary( int set, uint32_t lib )
+{
+	std::vector< GapWindow > &windows = _windows[set][lib];
+
+	if( windows.empty() ) return;
+
+	std::vector< RegionQuery > queries;
+	std::vector< RegionMetrics > metrics;
+
+	queries.reserve( windows.size() );
+	for( size_t i=0; i < windows.size(); i++ ) queries.push_back( windows[i].query );
+
+	RegionScanner scanner( *_bamReaders[set] );
+	scanner.scan( lib, queries, metrics );
+
+	// scores of the library
+	for( size_t i=0; i < windows.size(); i++ )
+	{
+		const RegionMetrics &m = metrics[i];
+		LibScores &scores = _edges[ windows[i].edge ].scores[ (set == MASTER_MP || set == SLAVE_MP) ? 1 : 0 ];
+
+		if( m.gapReads < 10 || m.expGapBases == 0 )
+		{
+			scores.score[lib] = -5;
+			scores.rnum[lib] = 0;
+		}
+		else
+		{
+			scores.score[lib] = m.goodGapBases / ((double)m.expGapBases);
+			scores.rnum[lib] = m.gapReads;
+		}
+	}
+
+	std::vector< GapWindow >().swap( windows );
+}
+
+
+void EdgeWeightPlanner::libSetWeight( const LibScores &scores, double &weight, int32_t &rnum, bool &min_cov )
+{
+	weight = -4;
+	rnum = 0;
+	min_cov = false;
+
+	if( scores.included )
+	{
+		weight = -1;
+		return;
+	}
+
+	// output statistics gained with the library with most evidences
+	for( size_t i=0; i < scores.score.size(); i++ )
+	{
+		if( i==0 || scores.rnum[i] > rnum ){ weight = scores.score[i]; rnum = scores.rnum[i]; }
+	}
+}
+
+
+void EdgeWeightPlanner::combineScores( double pe_weight, int32_t pe_rnum, bool pe_min_cov,
+									   double mp_weight, int32_t mp_rnum, bool mp_min_cov,
+									   double &weight, int32_t &rnum, bool &min_cov )
+{
+	min_cov = (pe_min_cov || mp_min_cov);
+
+	// min number of evidences only for PE library
+	if( pe_rnum >= 10 && mp_rnum < 10 ){ weight = pe_weight; rnum = pe_rnum; return; }
+	// min number of evidences only for MP library
+	if( mp_rnum >= 10 && pe_rnum < 10 ){ weight = mp_weight; rnum = mp_rnum; return; }
+	// not enough evidences for both PE/MP libraries
+	if( pe_rnum < 10 && mp_rnum < 10 ){ weight = -5.0; rnum = 0; return; }
+
+	// enough evidences for both PE/MP libraries
+
+	if( pe_weight >= 0 && mp_weight < 0 ){ weight = pe_weight; rnum = pe_rnum; return; }
+	if( mp_weight >= 0 && pe_weight < 0 ){ weight = mp_weight; rnum = mp_rnum; return; }
+	if( pe_weight < 0 && mp_weight < 0 ){ weight = -10.0; rnum = 0; return; }
+
+	weight = pe_weight > mp_weight ? pe_weight : mp_weight;
+	rnum = pe_weight > mp_weight ? pe_rnum : mp_rnum;
+}
+
+
+void EdgeWeightPlanner::run()
+{
+	for( int set=0; set < LIBRARY_SETS; set++ )
+		for( uint32_t lib=0; lib < _windows[set].size(); lib++ ) this->scanLibrary( set, lib );
+
+	for( size_t e=0; e < _edges.size(); e++ )
+	{
+		PlannedEdge &planned = _edges[e];
+		EdgeProperty edge_prop = boost::get( boost::edge_kind_t(), *planned.graph, planned.edge );
+
+		if( planned.kind == MASTER_EDGE || planned.kind == SLAVE_EDGE )
+		{
+			double pe_weight, mp_weight;
+			int32_t pe_rnum, mp_rnum;
+			bool pe_min_cov, mp_min_cov;
+
+			libSetWeight( planned.scores[0], pe_weight, pe_rnum, pe_min_cov );
+			libSetWeight( planned.scores[1], mp_weight, mp_rnum, mp_min_cov );
+
+			combineScores( pe_weight, pe_rnum, pe_min_cov, mp_weight, mp_rnum, mp_min_cov,
+						   edge_prop.weight, edge_prop.rnum, edge_prop.min_cov );
+		}
+		else
+		{
+			edge_prop.weight = 0.0;
+			edge_prop.rnum = 0;
+			edge_prop.min_cov = false;
+		}
+
+		// put edge weight
+		boost::put( boost::edge_kind_t(), *planned.graph, planned.edge, edge_prop );
+	}
+
+	_edges.clear();
+}
@@ -33,6 +33,7 @@
 #include "OptionsMerge.hpp"
 
 #include "bam/MultiBamReader.hpp"
+#include "bam/RegionScan.hpp"
 #include "graphs/AssemblyGraph.hpp"
 #include "pctg/ThreadedBuildPctg.hpp"
 #include "pctg/BuildPctgFunctions.hpp"
@@ -200,7 +201,6 @@ ThreadedBuildPctg::run()
 double ThreadedBuildPctg::computeZScore( MultiBamReader &multiBamReader, int32_t refID, uint32_t start, uint32_t end,	bool isMaster )
 {
 	uint32_t libs,idx;
-	BamReader* bamReader;
 	double lib_isize_mean, lib_isize_std;
 
 	double z_score = 0;
@@ -236,66 +236,22 @@ double ThreadedBuildPctg::computeZScore( MultiBamReader &multiBamReader, int32_t
 	idx = 0;
 	lib_isize_mean = multiBamReader.getISizeMean(0);
 	lib_isize_std = multiBamReader.getISizeStd(0);
-	bamReader = multiBamReader.getBamReader(0);
 
 	if( lib_isize_std == 0 ) return double(0);
 
 	unsigned int times_std = 3;
-	uint32_t min_insert = ( lib_isize_mean > times_std*lib_isize_std ) ? lib_isize_mean - times_std*lib_isize_std : 0;
-	uint32_t max_insert = lib_isize_mean + times_std*lib_isize_std;
 
-	bamReader->SetRegion( refID, start, refID, end+1 );
+	RegionQuery query( refID, start, end, REGION_INSERTS );
+	query.minInsert = (uint32_t)( ( lib_isize_mean > times_std*lib_isize_std ) ? lib_isize_mean - times_std*lib_isize_std : 0 );
+	query.maxInsert = (uint32_t)( lib_isize_mean + times_std*lib_isize_std );
 
-	BamAlignment align;
-	uint64_t inserts=0, spanCov=0;
-	int32_t nh, xt; // molteplicità delle read (nh->standard, xt->bwa)
+	RegionScanner scanner( multiBamReader );
+	RegionMetrics metrics = scanner.scan( idx, query );
 
-	while( bamReader->GetNextAlignmentCore(align) ) // for each read in the region
+	if( metrics.inserts > minInsertNum )
 	{
-		if( !align.IsMapped() || align.Position < 0 || align.IsDuplicate() || !align.IsPrimaryAlignment() || align.IsFailedQC() ||
-			!align.IsMateMapped() || align.RefID != align.MateRefID ) continue;
-
-		int32_t read_start = align.Position;
-		int32_t read_end = align.GetEndPosition() - 1;
-		int32_t read_len = read_end - read_start + 1;
-		int32_t mate_start = align.MatePosition;
-		int32_t mate_end = align.MatePosition + read_len - 1;
-
-		if( read_start < start || read_end > end ) continue;
-		if( mate_start < start || mate_end > end ) continue;
-
-		align.BuildCharData();
-		if( !align.GetTag(std::string("NH"),nh) ) nh = 1;	// standard SAM format field
-        if( !align.GetTag(std::string("XT"),xt) ) xt = 'U'; // bwa field
-		bool is_uniq_mapped = g_options.noMultiplicityFilter || (nh == 1 && xt == 'U');
-
-		if( !is_uniq_mapped ) continue;
-
-		if( align.IsFirstMate() )
-		{
-			if( read_start < mate_start )
-			{
-				int32_t i_size = (mate_start + read_len) - read_start;
-				if( i_size < min_insert || i_size > max_insert ) continue;
-
-				inserts++;
-				spanCov += i_size;
-			}
-			else
-			{
-				int32_t i_size = read_end - mate_start + 1;
-				if( i_size < min_insert || i_size > max_insert ) continue;
-
-				inserts++;
-				spanCov += i_size;
-			}
-		}
-	}
-
-	if( inserts > minInsertNum )
-	{
-		double localMean = spanCov/(double)inserts;
-		z_score   = (localMean - lib_isize_mean)/(double)(lib_isize_std/sqrt(inserts));
+		double localMean = metrics.insertSum/(double)metrics.inserts;
+		z_score   = (localMean - lib_isize_mean)/(double)(lib_isize_std/sqrt(metrics.inserts));
 	}
 
 	return z_score;
@@ -48,7 +48,12 @@
 #include "api/BamAlignment.h"
 
 #include "bam/MultiBamReader.hpp"
+#include "bam/PairEvidence.hpp"
 #include "assembly/Read.hpp"
+#include "assembly/ReadIndex.hpp"
+#include "assembly/PartitionedReadIndex.hpp"
+#include "assembly/MasterIndexFile.hpp"
+#include "assembly/ReadPairSorter.hpp"
 #include "assembly/Block.hpp"
 #include "UtilityFunctions.hpp"
 
@@ -60,10 +65,122 @@ extern OptionsCreate g_options;
 namespace modules
 {
 
-void CreateBlocks::execute()
+// whether a BAM filename stands for the standard input
+static bool isStdinBamFile( const std::string &bamFile )
+{
+	return bamFile == "-" || bamFile == "stdin";
+}
+
+// loads BAM filenames (and min/max insert sizes) from a list file, checking their existence.
+// Files that are only read sequentially may be named pipes, or the standard input ("-").
+static void loadBamFiles(
+	const std::string &listFile,
+	const char *assembly,
+	std::vector< std::string > &bamFiles,
+	std::vector< int32_t > &minInsert,
+	std::vector< int32_t > &maxInsert,
+	bool sequential = false )
+{
+	loadBamFileNames( listFile, bamFiles, minInsert, maxInsert );
+
+	int stdinFiles = 0;
+
+	for( int i=0; i < bamFiles.size(); i++ )
+	{
+		if( sequential && isStdinBamFile( bamFiles[i] ) )
+		{
+			if( ++stdinFiles > 1 )
+			{
+				std::cerr << "[error] standard input can be used for a single " << assembly << " BAM file" << std::endl;
+				exit(1);
+			}
+			continue;
+		}
+
+		boost::filesystem::path p(bamFiles[i].c_str());
+		if( !boost::filesystem::exists(p) || boost::filesystem::is_directory(p) ||
+			( !sequential && !boost::filesystem::is_regular_file(p) ) )
+		{
+			std::cerr << "[error] " << assembly << " BAM file \"" << bamFiles[i] << "\" doesn't exist" << std::endl;
+			exit(1);
+		}
+	}
+}
+
+// opens the BAM files of a list (with their min/max insert sizes).
+// Sequential files are neither required to be sorted nor indexed.
+static void openBamFiles( const std::string &listFile, const char *assembly, MultiBamReader &bamReader, bool sequential = false )
+{
+	std::vector< std::string > bamFiles;
+	std::vector< int32_t > minInsert, maxInsert;
+
+	loadBamFiles( listFile, assembly, bamFiles, minInsert, maxInsert, sequential );
+
+	bamReader.setDecompressionThreads( g_options.ioThreadsNum );
+	bamReader.Open( bamFiles, !sequential );
+	bamReader.setMinMaxInsertSizes( minInsert, maxInsert );
+}
+
+// blocks' file of the i-th slave assembly
+static std::string blocksFileName( size_t slaveIdx )
 {
-	struct stat st;
+	if( g_options.slaveBamLists.size() <= 1 ) return g_options.outputFilePrefix + ".blocks";
+
+	std::stringstream ss;
+	ss << g_options.outputFilePrefix << ".slave" << slaveIdx+1 << ".blocks";
+	return ss.str();
+}
 
+// records the alignments read (with statistics) by a reader, if pair evidence has to be written
+static void collectPairEvidence( PairEvidenceCollector &evidence, MultiBamReader &bamReader )
+{
+	if( !g_options.writePairEvidence ) return;
+
+	evidence.init( bamReader.size(), bamReader.GetReferenceData() );
+	bamReader.setEvidenceCollector( &evidence );
+}
+
+// writes the pair evidence collected for an assembly (checked by gam-merge against its BAM files)
+static void writePairEvidence( PairEvidenceCollector &evidence, const MultiBamReader &bamReader, const std::string &bamList )
+{
+	if( !g_options.writePairEvidence ) return;
+
+	std::string evidenceFile = bamList + ".evidence";
+	std::cout << "[main] writing pair evidence (" << evidence.size() << " alignments) on file: " << getPathBaseName( evidenceFile ) << std::endl;
+
+	evidence.write( evidenceFile, bamReader );
+	evidence.clear();
+}
+
+// computes the coverage of the blocks found with a slave assembly and writes them with slave's statistics
+static void writeSlaveOutputs(
+	std::vector< Block > &blocks,
+	const CoverageTrack &masterCoverage,
+	const CoverageTrack &slaveCoverage,
+	MultiBamReader &masterBam,
+	MultiBamReader &slaveBam,
+	PairEvidenceCollector &slaveEvidence,
+	const std::string &slaveBamList,
+	const std::string &blocksFile )
+{
+	/* COMPUTE COVERAGE OF THE BLOCKS */
+	Block::updateCoverages( blocks, masterCoverage, slaveCoverage );
+
+	// output inserts statistcs (and pair evidence) for slave assembly
+	slaveBam.writeStatsToFile( slaveBamList + ".isize" );
+	writePairEvidence( slaveEvidence, slaveBam, slaveBamList );
+
+	std::cout << "[main] blocks found = " << blocks.size() << std::endl;
+
+	std::cout << "[main] writing blocks on file: " << getPathBaseName( blocksFile ) << std::endl;
+	Block::writeBlocks( blocksFile, blocks );
+
+	if( g_options.debug )
+		Block::writeBlocksVerbose( blocksFile + ".verbose.txt", blocks, masterBam, slaveBam );
+}
+
+void CreateBlocks::execute()
+{
 	time_t t1 = time(NULL);
 
 	if( g_options.noMultiplicityFilter ) 
@@ -71,94 +188,195 @@ void CreateBlocks::execute()
 
 	std::cout << "[main] opening BAM files" << std::endl;
 
-	// load master BAM filenames and min/max insert sizes
-	std::vector< std::string > masterBamFiles; // vector of master BAM filenames
-	std::vector< int32_t > master_minInsert, master_maxInsert;
-	loadBamFileNames( g_options.masterBamFile, masterBamFiles, master_minInsert, master_maxInsert );
+	// master alignments are read once, in any order (so they may be unsorted, unindexed or piped)
+	MultiBamReader masterBam; // master (multi) BAM reader
+	openBamFiles( g_options.masterBamFile, "master", masterBam, true );
 
-	// check master's BAM files existence
-	for( int i=0; i < masterBamFiles.size(); i++ )
+	CoverageTrack masterCoverage;
+	PairEvidenceCollector masterEvidence;
+	std::string isize_stats_file = g_options.masterBamFile + ".isize";
+
+	if( g_options.masterNameSortedBamFile != "" || g_options.maxMemory > 0 )
 	{
-		boost::filesystem::path p(masterBamFiles[i].c_str());
-		if( !boost::filesystem::exists(p) || !boost::filesystem::is_regular_file(p) )
+		// a single slave assembly (checked by options' parser)
+		MultiBamReader slaveBam;
+		openBamFiles( g_options.slaveBamFile, "slave", slaveBam );
+
+		std::vector<Block> blocks;
+		CoverageTrack slaveCoverage;
+		PairEvidenceCollector slaveEvidence;
+
+		if( g_options.masterNameSortedBamFile != "" )
 		{
-			std::cerr << "[error] master BAM file \"" << masterBamFiles[i] << "\" doesn't exist" << std::endl;
-			exit(1);
-		}
-	}
+			/* JOIN NAME-SORTED BAMS AND BUILD BLOCKS */
 
-	// load slaves BAM filenames and min/max insert sizes
-	std::vector< std::string > slaveBamFiles;
-	std::vector< int32_t > slave_minInsert, slave_maxInsert;
+			std::vector< std::string > masterNsFiles, slaveNsFiles;
+			std::vector< int32_t > masterNs_minInsert, masterNs_maxInsert, slaveNs_minInsert, slaveNs_maxInsert;
 
-	loadBamFileNames( g_options.slaveBamFile, slaveBamFiles, slave_minInsert, slave_maxInsert );
+			loadBamFiles( g_options.masterNameSortedBamFile, "master name-sorted", masterNsFiles, masterNs_minInsert, masterNs_maxInsert );
+			loadBamFiles( g_options.slaveNameSortedBamFile, "slave name-sorted", slaveNsFiles, slaveNs_minInsert, slaveNs_maxInsert );
 
-	// check slaves' BAM files existence
-	for( int i=0; i < slaveBamFiles.size(); i++ )
-	{
-		boost::filesystem::path p(slaveBamFiles[i].c_str());
-		if( !boost::filesystem::exists(p) || !boost::filesystem::is_regular_file(p) )
+			// statistics computed on name-sorted files are reported for the corresponding coordinate-sorted ones
+			if( masterNsFiles.size() != masterBam.size() || slaveNsFiles.size() != slaveBam.size() )
+			{
+				std::cerr << "[error] name-sorted and coordinate-sorted BAM lists must have the same number of libraries" << std::endl;
+				exit(1);
+			}
+
+			MultiBamReader masterNsBam, slaveNsBam;
+
+			masterNsBam.setDecompressionThreads( g_options.ioThreadsNum );
+			masterNsBam.Open( masterNsFiles, false );
+			masterNsBam.setSortOrder( MultiBamReader::SORT_BY_NAME );
+			masterNsBam.setMinMaxInsertSizes( masterNs_minInsert, masterNs_maxInsert );
+
+			slaveNsBam.setDecompressionThreads( g_options.ioThreadsNum );
+			slaveNsBam.Open( slaveNsFiles, false );
+			slaveNsBam.setSortOrder( MultiBamReader::SORT_BY_NAME );
+			slaveNsBam.setMinMaxInsertSizes( slaveNs_minInsert, slaveNs_maxInsert );
+
+			// pair evidence is saved for the coordinate-sorted files (as statistics)
+			collectPairEvidence( masterEvidence, masterNsBam );
+			collectPairEvidence( slaveEvidence, slaveNsBam );
+
+			std::cout << "[main] finding blocks from name-sorted alignments" << std::endl;
+
+			uint64_t sortMemory = ( g_options.maxMemory > 0 ) ? uint64_t(g_options.maxMemory) * 1024 * 1024 : READ_PAIR_SORTER_MEMORY;
+
+			Block::findBlocksByName( blocks, masterNsBam, slaveNsBam, g_options.minBlockSize, masterCoverage, slaveCoverage,
+									 g_options.noMultiplicityFilter, g_options.outputFilePrefix, sortMemory );
+
+			LibStatistics stats;
+
+			masterNsBam.getStatistics( stats );
+			masterBam.resetStatistics();
+			masterBam.mergeStatistics( stats );
+			masterBam.finalizeStatistics();
+
+			slaveNsBam.getStatistics( stats );
+			slaveBam.resetStatistics();
+			slaveBam.mergeStatistics( stats );
+			slaveBam.finalizeStatistics();
+
+			masterNsBam.Close();
+			slaveNsBam.Close();
+
+			// output inserts statistics (and pair evidence) for master assembly
+			masterBam.writeStatsToFile( isize_stats_file );
+			writePairEvidence( masterEvidence, masterBam, g_options.masterBamFile );
+		}
+		else
 		{
-			std::cerr << "[error] slave BAM file \"" << slaveBamFiles[i] << "\" doesn't exist" << std::endl;
-			exit(1);
+			/* PARTITION MASTER READS ON DISK */
+
+			// half of the memory for the index' groups, half for sorting joined reads
+			uint64_t memory = uint64_t(g_options.maxMemory) * 1024 * 1024 / 2;
+
+			std::cout << "[main] partitioning reads on disk (max memory = " << g_options.maxMemory << " MB)" << std::endl;
+
+			PartitionedReadIndex masterReadIndex( g_options.outputFilePrefix, memory, masterBam.GetReferenceData() );
+
+			collectPairEvidence( masterEvidence, masterBam );
+			collectPairEvidence( slaveEvidence, slaveBam );
+
+			// load uniquely mapped reads of the master, while updating master contig's coverage and inserts stats
+			Read::loadReadsMap( masterBam, masterReadIndex, masterCoverage, g_options.noMultiplicityFilter );
+			masterReadIndex.partition();
+
+			std::cout << "[main] master records partitioned = " << masterReadIndex.size() << " (" << masterReadIndex.groups() << " groups)" << std::endl;
+
+			// output inserts statistics (and pair evidence) for master assembly
+			masterBam.writeStatsToFile( isize_stats_file );
+			writePairEvidence( masterEvidence, masterBam, g_options.masterBamFile );
+
+			std::cout << "[main] finding blocks" << std::endl;
+
+			Block::findBlocksPartitioned( blocks, slaveBam, g_options.minBlockSize, masterReadIndex, slaveCoverage,
+										  g_options.noMultiplicityFilter, g_options.outputFilePrefix, memory );
 		}
+
+		writeSlaveOutputs( blocks, masterCoverage, slaveCoverage, masterBam, slaveBam, slaveEvidence, g_options.slaveBamFile, blocksFileName(0) );
+		slaveBam.Close();
 	}
+	else
+	{
+		/* LOAD MASTER READS IN MEMORY */
 
-	/* OPEN MASTER BAM AND LOAD READS IN MEMORY */
+		ReadIndex *masterReadIndex;
+		MasterIndexFile masterIndexFile; // keeps a loaded index mapped
 
-	MultiBamReader masterBam; // master (multi) BAM reader
-	masterBam.Open( masterBamFiles ); // open master BAM files
-	masterBam.setMinMaxInsertSizes( master_minInsert, master_maxInsert );
+		if( g_options.loadMasterIndexFile != "" )
+		{
+			std::cout << "[main] loading master reads' index: " << g_options.loadMasterIndexFile << std::endl;
 
-	std::cout << "[main] loading reads in memory" << std::endl;
+			// restores master contig's coverage and inserts stats as well
+			masterReadIndex = masterIndexFile.load( g_options.loadMasterIndexFile, masterBam, masterCoverage, g_options.noMultiplicityFilter );
 
-	std::vector< std::vector<uint32_t> > masterCoverage;
-	sparse_hash_map< std::string, Read > masterReadMap_1, masterReadMap_2;
+			std::cout << "[main] master reads indexed = " << masterReadIndex->size() << std::endl;
+		}
+		else
+		{
+			std::cout << "[main] loading reads in memory" << std::endl;
 
-	// load uniquely mapped reads of the master, while updating master contig's coverage and inserts stats
-	Read::loadReadsMap( masterBam, masterReadMap_1, masterReadMap_2, masterCoverage, g_options.noMultiplicityFilter );
+			// index of master's reads (full names or fixed-width name fingerprints)
+			std::string verifyFile = "";
+			if( g_options.readKeyBits != 0 && g_options.verifyReadKeys ) verifyFile = g_options.outputFilePrefix + ".readnames.tmp";
 
-	// output inserts statistics for master assembly
-	std::string isize_stats_file = g_options.masterBamFile + ".isize";
-	masterBam.writeStatsToFile( isize_stats_file );
+			masterReadIndex = ReadIndex::create( (ReadIndex::key_type_t) g_options.readKeyBits, masterBam.GetReferenceData(), verifyFile );
+			collectPairEvidence( masterEvidence, masterBam );
 
-	time_t t2 = time(NULL);
-	std::cout << "[main] reads loaded in " << formatTime(t2-t1) << std::endl;
+			// load uniquely mapped reads of the master, while updating master contig's coverage and inserts stats
+			Read::loadReadsMap( masterBam, *masterReadIndex, masterCoverage, g_options.noMultiplicityFilter );
 
-	std::cout << "[main] finding blocks" << std::endl;
+			std::cout << "[main] master reads indexed = " << masterReadIndex->size()
+				<< " (~" << masterReadIndex->memoryUsage() / (1024*1024) << " MB)" << std::endl;
 
-	std::vector<Block> blocks;
+			if( g_options.saveMasterIndexFile != "" )
+			{
+				std::cout << "[main] saving master reads' index: " << g_options.saveMasterIndexFile << std::endl;
+				MasterIndexFile::save( g_options.saveMasterIndexFile, *masterReadIndex, masterBam, masterCoverage, g_options.noMultiplicityFilter );
+			}
+		}
 
-	/* OPEN SLAVE BAM AND BUILD BLOCKS */
+		// output inserts statistics for master assembly (pair evidence only if its alignments have been read)
+		masterBam.writeStatsToFile( isize_stats_file );
+		if( g_options.loadMasterIndexFile == "" ) writePairEvidence( masterEvidence, masterBam, g_options.masterBamFile );
 
-	MultiBamReader slaveBam; // slave (multi) BAM reader
-	slaveBam.Open( slaveBamFiles ); // open slave BAM files
-	slaveBam.setMinMaxInsertSizes( slave_minInsert, slave_maxInsert );
+		time_t t2 = time(NULL);
+		std::cout << "[main] reads loaded in " << formatTime(t2-t1) << std::endl;
 
-	std::vector< std::vector<uint32_t> > slaveCoverage;
+		/* BUILD BLOCKS READING EACH SLAVE BAM */
 
-	// build blocks, compute slave contig's coverage and inserts stats
-	Block::findBlocks( blocks, slaveBam, g_options.minBlockSize,
-					   masterReadMap_1, masterReadMap_2, slaveCoverage, g_options.noMultiplicityFilter );
+		// the index is only read while finding blocks, so it is shared by every slave assembly
+		for( size_t i=0; i < g_options.slaveBamLists.size(); i++ )
+		{
+			const std::string &slaveBamList = g_options.slaveBamLists[i];
 
+			if( g_options.slaveBamLists.size() > 1 )
+				std::cout << "[main] slave assembly " << i+1 << "/" << g_options.slaveBamLists.size() << ": " << getPathBaseName( slaveBamList ) << std::endl;
 
-	/* COMPUTE COVERAGE OF THE BLOCKS */
-	Block::updateCoverages( blocks, masterCoverage, slaveCoverage );
+			MultiBamReader slaveBam; // slave (multi) BAM reader
+			openBamFiles( slaveBamList, "slave", slaveBam );
 
-	// output inserts statistcs for slave assembly
-	isize_stats_file = g_options.slaveBamFile + ".isize";
-	slaveBam.writeStatsToFile( isize_stats_file );
+			std::vector<Block> blocks;
+			CoverageTrack slaveCoverage;
+			PairEvidenceCollector slaveEvidence;
+			collectPairEvidence( slaveEvidence, slaveBam );
 
-	std::cout << "[main] blocks found = " << blocks.size() << std::endl;
+			std::cout << "[main] finding blocks using " << g_options.threadsNum << " thread(s)" << std::endl;
+
+			// build blocks, compute slave contig's coverage and inserts stats
+			Block::findBlocks( blocks, slaveBam, g_options.minBlockSize,
+							   *masterReadIndex, slaveCoverage, g_options.noMultiplicityFilter, g_options.threadsNum );
 
-	std::cout << "[main] writing blocks on file: " << getPathBaseName( g_options.outputFilePrefix ) << std::endl;
-	Block::writeBlocks( g_options.outputFilePrefix + ".blocks", blocks );
-	
-	if( g_options.debug ) 
-		Block::writeBlocksVerbose( g_options.outputFilePrefix + ".blocks.verbose.txt", blocks, masterBam, slaveBam );
+			writeSlaveOutputs( blocks, masterCoverage, slaveCoverage, masterBam, slaveBam, slaveEvidence, slaveBamList, blocksFileName(i) );
+			slaveBam.Close();
+		}
+
+		delete masterReadIndex;
+	}
 
 	masterBam.Close(); // close master bam (no longer needed)
-	slaveBam.Close(); // close current slave (no longer needed)
 
 	std::cout << "[main] total execution time = " << formatTime( time(NULL)-t1 ) << std::endl;
 }
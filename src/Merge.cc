@@ -57,6 +57,8 @@
 #include "assembly/RefSequence.hpp"
 #include "assembly/io_contig.hpp"
 #include "bam/MultiBamReader.hpp"
+#include "bam/PairEvidence.hpp"
+#include "bam/RegionMetricsCache.hpp"
 #include "graphs/PairingEvidencesGraph.hpp"
 #include "graphs/CompactAssemblyGraph.hpp"
 #include "pctg/PairedContig.hpp"
@@ -85,6 +87,28 @@ MultiBamReader masterMpBam;
 MultiBamReader slaveBam;
 MultiBamReader slaveMpBam;
 
+// pair evidence written by gam-create, answering region queries in place of BAM files
+static PairEvidenceFile masterEvidence;
+static PairEvidenceFile masterMpEvidence;
+static PairEvidenceFile slaveEvidence;
+static PairEvidenceFile slaveMpEvidence;
+
+// uses the pair evidence of an assembly (<bam list>.evidence), if it exists and matches its BAM files
+static void loadPairEvidence( MultiBamReader &bamReader, PairEvidenceFile &evidence, const std::string &bamList )
+{
+    struct stat st;
+    std::string evidenceFile = bamList + ".evidence";
+
+    if( stat(evidenceFile.c_str(), &st) != 0 ) return;
+
+    if( evidence.load(evidenceFile, bamReader) )
+    {
+        bamReader.setEvidence(&evidence);
+        std::cout << "[bam] Pair evidence " << getPathBaseName(evidenceFile) << " loaded (" << evidence.size()
+            << " alignments); region queries will not read BAM files" << std::endl;
+    }
+}
+
 namespace modules {
 
     void Merge::execute() {
@@ -112,6 +136,17 @@ namespace modules {
 
         std::cout << "[main] Loading BAMs data" << std::endl;
 
+        // region queries on every library read indexes from memory
+        BamReader::SetSharedIndexData( true );
+
+        // blocks visited by several region queries are decompressed once
+        if( g_options.blockCacheSize > 0 )
+            BamReader::SetBlockCacheSize( static_cast<uint64_t>(g_options.blockCacheSize) << 20 );
+
+        // statistics of regions queried several times (by edge weights or z-scores) are computed once
+        if( g_options.regionCacheSize > 0 )
+            RegionMetricsCache::instance().setCapacity( static_cast<uint64_t>(g_options.regionCacheSize) << 20 );
+
         std::vector< int32_t > minInsert, maxInsert;
 
         /* OPEN MASTER BAM FILES */
@@ -136,6 +171,7 @@ namespace modules {
         }
 
         masterBam.readStatsFromFile(g_options.masterISizeFile);
+        loadPairEvidence(masterBam, masterEvidence, g_options.masterBamFile);
 
         std::cout << "[bam] Master PE-alignments file " << getPathBaseName(g_options.masterBamFile) << " successfully opened:" << std::endl;
         for (size_t i = 0; i < masterBam.size(); i++)
@@ -166,6 +202,7 @@ namespace modules {
             }
 
             masterMpBam.readStatsFromFile(g_options.masterMpISizeFile); // open inserts statistics
+            loadPairEvidence(masterMpBam, masterMpEvidence, g_options.masterMpBamFile);
 
             std::cout << "[bam] Master MP-alignments file " << getPathBaseName(g_options.masterMpBamFile) << " successfully opened:" << std::endl;
             for (size_t i = 0; i < masterMpBam.size(); i++)
@@ -194,6 +231,7 @@ namespace modules {
         }
 
         slaveBam.readStatsFromFile(g_options.slaveISizeFile); // open inserts statistics
+        loadPairEvidence(slaveBam, slaveEvidence, g_options.slaveBamFile);
 
         std::cout << "[bam] Slave PE-alignments file " << getPathBaseName(g_options.slaveBamFile) << " successfully opened:" << std::endl;
         for (size_t i = 0; i < slaveBam.size(); i++)
@@ -223,6 +261,7 @@ namespace modules {
             }
 
             slaveMpBam.readStatsFromFile(g_options.slaveMpISizeFile); // open inserts statistics
+            loadPairEvidence(slaveMpBam, slaveMpEvidence, g_options.slaveMpBamFile);
 
             std::cout << "[bam] Slave MP-alignments file " << getPathBaseName(g_options.slaveMpBamFile) << " successfully opened:" << std::endl;
             for (size_t i = 0; i < slaveMpBam.size(); i++) std::cout << "      " << slaveMpBam[i].GetFilename()
@@ -306,13 +345,8 @@ namespace modules {
 
         std::cout << "[main] Loading contig sequences" << std::endl;
 
-        std::map< std::string, int32_t > masterCtg2Id; // master contig Name => ID
-        std::map< std::string, int32_t > slaveCtg2Id; // slave contig Name => ID
-
-        for (size_t i = 0; i < masterRef.size(); i++) masterCtg2Id[ masterRef[i].RefName ] = i;
-        for (size_t i = 0; i < slaveRef.size(); i++) slaveCtg2Id[ slaveRef[i].RefName ] = i;
-
-        size_t m_num = loadSequences(g_options.masterFastaFile, masterRef, masterCtg2Id);
+        // contig IDs are looked up in the (hashed) reference data of bam headers
+        size_t m_num = loadSequences(g_options.masterFastaFile, masterRef, masterBam.at(0));
 		std::cout << "       master sequences loaded = " << m_num << std::endl;
 		
 		if( m_num != masterRef.size() )
@@ -321,7 +355,7 @@ namespace modules {
 			exit(1);
 		}
 		
-        size_t s_num = loadSequences(g_options.slaveFastaFile, slaveRef, slaveCtg2Id);
+        size_t s_num = loadSequences(g_options.slaveFastaFile, slaveRef, slaveBam.at(0));
 		std::cout << "       slave sequences loaded  = " << s_num << std::endl;
 		
 		if( s_num != slaveRef.size() )
@@ -386,6 +420,23 @@ namespace modules {
 
         std::cout << "[merge] Paired contigs built = " << pctg_id << std::endl;
 
+        if( g_options.blockCacheSize > 0 )
+        {
+            uint64_t hits, misses, evictions, bytes;
+            BamReader::GetBlockCacheStatistics( hits, misses, evictions, bytes );
+            std::cout << "[bam] Block cache: hits = " << hits << ", misses = " << misses
+                << ", evictions = " << evictions << ", size = " << (bytes >> 20) << " MB" << std::endl;
+        }
+
+        if( g_options.regionCacheSize > 0 )
+        {
+            uint64_t hits, misses, evictions, bytes;
+            RegionMetricsCache::instance().getStatistics( hits, misses, evictions, bytes );
+            double hitRate = (hits + misses > 0) ? 100.0 * hits / (hits + misses) : 0.0;
+            std::cout << "[merge] Region cache: hits = " << hits << ", misses = " << misses
+                << " (hit rate = " << hitRate << "%), evictions = " << evictions << ", size = " << (bytes >> 20) << " MB" << std::endl;
+        }
+
         // TODO: sistemare codice commentato qui sotto
         // output assemblies made exclusively by contigs involved in merging
         /*std::fstream masterMergeFile( (options.outputFilePrefix + ".onlymaster.fasta").c_str(), std::fstream::out );
@@ -40,8 +40,17 @@ void Options::set_defaults()
 	// input options
 	minBlockSize = 50;
 	threadsNum = 1;
+	ioThreadsNum = 0;
 	coverageThreshold = 0.75;
 	noMultiplicityFilter = false;
+	blockCacheSize = 0;
+	regionCacheSize = 0;
+	maxMemory = 0;
+	readKeyBits = 0;
+	verifyReadKeys = false;
+	saveMasterIndexFile = "";
+	loadMasterIndexFile = "";
+	writePairEvidence = false;
 
 	debug = false;
 
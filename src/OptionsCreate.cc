@@ -50,15 +50,22 @@ bool OptionsCreate::process(int argc, char *argv[])
 		//("version", "print version and exit")
 
 		// input
-		("master-bam", po::value< std::string >(), "coordinate-sorted PE alignments of the master assembly")
-		("slave-bam", po::value< std::string >(), "coordinate-sorted PE alignments of the slave assembly")
+		("master-bam", po::value< std::string >(), "PE alignments of the master assembly, in any order and without index (\"-\" in the list reads a BAM from stdin)")
+		("slave-bam", po::value< std::vector< std::string > >()->composing(), "coordinate-sorted PE alignments of the slave assembly (may be repeated to process several slaves)")
 
-		//("master-namesorted-bam", po::value< std::string >(), "name sorted BAM file of the master assembly")
-		//("slave-namesorted-bam", po::value< std::string >(), "name sorted BAM file of the slave assembly")
+		("master-namesorted-bam", po::value< std::string >(), "name-sorted PE alignments of the master assembly (optional)")
+		("slave-namesorted-bam", po::value< std::string >(), "name-sorted PE alignments of the slave assembly (optional)")
 
         ("min-block-size", po::value<int>(), "minimum number of reads needed to build a block (optional) [default=50]")
         ("no-mult-filter", "force all reads to be processed as if they had unique mapping (optional)")
-		//("threads", po::value<int>(), "number of threads [default 1]")
+        ("max-memory", po::value<int>(), "memory (MB) for master reads' index and sorting; if set, reads are partitioned on disk (optional)")
+        ("read-keys", po::value< std::string >(), "keys of master reads' index: names, hash64 or hash128 (optional) [default=names]")
+        ("verify-read-keys", "check hashed read keys against the read names, stored in a temporary file (optional)")
+        ("save-master-index", po::value< std::string >(), "save master reads' index on file, to be reused by later runs (optional)")
+        ("load-master-index", po::value< std::string >(), "use a master reads' index previously saved instead of reading master BAM files (optional)")
+        ("pair-evidence", "write pair-evidence files (<bam list>.evidence) that gam-merge uses instead of BAM region queries; alignments are kept in memory, ~14 bytes each (optional)")
+		("threads", po::value<int>(), "number of threads used to build blocks (optional) [default=1]")
+		("io-threads", po::value<int>(), "number of threads decompressing each BAM file ahead of its reader (optional) [default=0]")
 
 		// output
 		("output", po::value< std::string >(), "output-file's prefix (optional) [default=out]")
@@ -109,7 +116,8 @@ bool OptionsCreate::process(int argc, char *argv[])
 	}
 
 	masterBamFile = vm["master-bam"].as< std::string >();
-	slaveBamFile = vm["slave-bam"].as< std::string >();
+	slaveBamLists = vm["slave-bam"].as< std::vector< std::string > >();
+	slaveBamFile = slaveBamLists.front();
 
 	// Check for master bam file existence */
 	if( stat(masterBamFile.c_str(),&st) != 0 )
@@ -119,10 +127,38 @@ bool OptionsCreate::process(int argc, char *argv[])
 	}
 
 	// Check for slave bam files existence */
-	if( stat(slaveBamFile.c_str(),&st) != 0 )
+	for( size_t i=0; i < slaveBamLists.size(); i++ )
 	{
-		std::cerr << "Slave BAM file " << slaveBamFile << " does not exist" << std::endl;
-		exit(1);
+		if( stat(slaveBamLists[i].c_str(),&st) != 0 )
+		{
+			std::cerr << "Slave BAM file " << slaveBamLists[i] << " does not exist" << std::endl;
+			exit(1);
+		}
+	}
+
+	// name-sorted alignments (both or none)
+	if( vm.count("master-namesorted-bam") or vm.count("slave-namesorted-bam") )
+	{
+		if( not( vm.count("master-namesorted-bam") and vm.count("slave-namesorted-bam") ) )
+		{
+			std::cerr << "Both --master-namesorted-bam and --slave-namesorted-bam options are required to use name-sorted alignments." << std::endl;
+			exit(1);
+		}
+
+		masterNameSortedBamFile = vm["master-namesorted-bam"].as< std::string >();
+		slaveNameSortedBamFile = vm["slave-namesorted-bam"].as< std::string >();
+
+		if( stat(masterNameSortedBamFile.c_str(),&st) != 0 )
+		{
+			std::cerr << "Master name-sorted BAM file " << masterNameSortedBamFile << " does not exist." << std::endl;
+			exit(1);
+		}
+
+		if( stat(slaveNameSortedBamFile.c_str(),&st) != 0 )
+		{
+			std::cerr << "Slave name-sorted BAM file " << slaveNameSortedBamFile << " does not exist." << std::endl;
+			exit(1);
+		}
 	}
 
 	if( vm.count("min-block-size") )
@@ -136,6 +172,100 @@ bool OptionsCreate::process(int argc, char *argv[])
 		noMultiplicityFilter = true;
 	}
 
+	if( vm.count("threads") )
+	{
+		threadsNum = vm["threads"].as<int>();
+		if( threadsNum < 1 ) threadsNum = 1;
+	}
+
+	if( vm.count("io-threads") )
+	{
+		ioThreadsNum = vm["io-threads"].as<int>();
+		if( ioThreadsNum < 0 ) ioThreadsNum = 0;
+	}
+
+	if( vm.count("max-memory") )
+	{
+		maxMemory = vm["max-memory"].as<int>();
+		if( maxMemory < 0 ) maxMemory = 0;
+	}
+
+	if( vm.count("read-keys") )
+	{
+		std::string readKeys = vm["read-keys"].as< std::string >();
+
+		if( readKeys == "names" ) readKeyBits = 0;
+		else if( readKeys == "hash64" ) readKeyBits = 64;
+		else if( readKeys == "hash128" ) readKeyBits = 128;
+		else
+		{
+			std::cerr << "Invalid --read-keys value \"" << readKeys << "\" (allowed: names, hash64, hash128)." << std::endl;
+			exit(1);
+		}
+	}
+
+	if( vm.count("verify-read-keys") )
+	{
+		verifyReadKeys = true;
+	}
+
+	if( vm.count("pair-evidence") )
+	{
+		writePairEvidence = true;
+	}
+
+	if( vm.count("save-master-index") ) saveMasterIndexFile = vm["save-master-index"].as< std::string >();
+
+	if( vm.count("load-master-index") )
+	{
+		loadMasterIndexFile = vm["load-master-index"].as< std::string >();
+
+		if( stat(loadMasterIndexFile.c_str(),&st) != 0 )
+		{
+			std::cerr << "Master index file " << loadMasterIndexFile << " does not exist." << std::endl;
+			exit(1);
+		}
+	}
+
+	// several slaves share the index of master reads, which is kept in memory
+	if( slaveBamLists.size() > 1 && ( masterNameSortedBamFile != "" || maxMemory > 0 ) )
+	{
+		std::cerr << "Several slave assemblies can be processed only when master reads are kept in memory (no --max-memory or name-sorted BAMs)." << std::endl;
+		exit(1);
+	}
+
+	if( saveMasterIndexFile != "" || loadMasterIndexFile != "" )
+	{
+		if( saveMasterIndexFile != "" && loadMasterIndexFile != "" )
+		{
+			std::cerr << "Options --save-master-index and --load-master-index cannot be used together." << std::endl;
+			exit(1);
+		}
+
+		if( masterNameSortedBamFile != "" || maxMemory > 0 )
+		{
+			std::cerr << "A master index can be saved/loaded only when master reads are kept in memory (no --max-memory or name-sorted BAMs)." << std::endl;
+			exit(1);
+		}
+
+		// only fingerprint tables can be saved
+		if( saveMasterIndexFile != "" && readKeyBits == 0 )
+		{
+			std::cerr << "WARNING: --save-master-index requires hashed read keys; using hash128" << std::endl;
+			readKeyBits = 128;
+		}
+
+		if( verifyReadKeys )
+		{
+			std::cerr << "WARNING: --verify-read-keys is ignored when saving/loading a master index" << std::endl;
+			verifyReadKeys = false;
+		}
+
+		// master alignments are not read at all
+		if( writePairEvidence && loadMasterIndexFile != "" )
+			std::cerr << "WARNING: pair evidence of the master is not written when a master index is loaded" << std::endl;
+	}
+
 	// OUTPUT
 	if( vm.count("output") )
 	{
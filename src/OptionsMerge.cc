@@ -67,6 +67,8 @@ bool OptionsMerge::process(int argc, char *argv[])
 		//("reads-prefix", po::value< std::string >(), "common prefix of all reads" )
 		("min-block-size", po::value<int>(), "minimum number of reads of blocks to be loaded (optional) [default=5]")
 		("threads", po::value<int>(), "number of threads (optional) [default=1]")
+		("block-cache", po::value<int>(), "MB of decompressed BAM blocks cached and shared by all readers (optional) [default=0]")
+		("region-cache", po::value<int>(), "MB of region statistics (z-scores, edge weights) memoized and shared by all threads (optional) [default=0]")
 		("coverage-filter", po::value<double>(), "coverage filter threshold (optional) [default=0.75]")
 		("no-mult-filter", "force all reads to be processed as if they had unique mapping (optional)")
 
@@ -237,6 +239,18 @@ bool OptionsMerge::process(int argc, char *argv[])
 		if( threadsNum < 1 ) threadsNum = 1;
 	}
 
+	if( vm.count("block-cache") )
+	{
+		blockCacheSize = vm["block-cache"].as<int>();
+		if( blockCacheSize < 0 ) blockCacheSize = 0;
+	}
+
+	if( vm.count("region-cache") )
+	{
+		regionCacheSize = vm["region-cache"].as<int>();
+		if( regionCacheSize < 0 ) regionCacheSize = 0;
+	}
+
 
 	if( vm.count("coverage-filter") )
 	{
@@ -0,0 +1,178 @@
+/*
+ *  This file is part of GAM-NGS.
+ *  Copyright (c) 2011 by Riccardo Vicedomini <rvicedomini@appliedgenomics.org>,
+ *  Francesco Vezzi <vezzi@appliedgenomics.org>,
+ *  Simone Scalabrin <scalabrin@appliedgenomics.org>,
+ *  Lars Arverstad <lars.arvestad@scilifelab.se>,
+ *  Alberto Policriti <policriti@appliedgenomics.org>,
+ *  Alberto Casagrande <casagrande@appliedgenomics.org>
+ *
+ *  GAM-NGS is an evolution of a previous work (GAM) done by Alberto Casagrande,
+ *  Cristian Del Fabbro, Simone Scalabrin, and Alberto Policriti.
+ *  In particular, GAM-NGS has been adapted to work on NGS data sets and it has
+ *  been written using GAM's software as starting point. Thus, it shares part of
+ *  GAM's source code.
+ *
+ *  GAM-NGS is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  GAM-NGS is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with GAM-NGS.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * bgzf-bench: measures the decompression speed of the BGZF blocks of a BAM file
+ * with every inflate backend compiled in (with and without CRC32 checks).
+ *
+ * usage: bgzf-bench <file.bam> [rounds]
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <sys/time.h>
+
+#include "zlib.h"
+
+#include "api/BamConstants.h"
+#include "api/internal/io/BgzfInflater_p.h"
+#include "api/internal/io/BgzfStream_p.h"
+#include "api/internal/utils/BamException_p.h"
+
+using namespace BamTools;
+using namespace BamTools::Internal;
+
+static double now()
+{
+	struct timeval tv;
+	gettimeofday( &tv, NULL );
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+// decompression as done before inflaters were introduced (zlib state set up for every block)
+static size_t inflateBlockOnce( const char *compressed, size_t blockLength, char *uncompressed )
+{
+	z_stream zs;
+	zs.zalloc    = NULL;
+	zs.zfree     = NULL;
+	zs.next_in   = (Bytef*)compressed + Constants::BGZF_BLOCK_HEADER_LENGTH;
+	zs.avail_in  = blockLength - Constants::BGZF_BLOCK_HEADER_LENGTH - Constants::BGZF_BLOCK_FOOTER_LENGTH;
+	zs.next_out  = (Bytef*)uncompressed;
+	zs.avail_out = Constants::BGZF_DEFAULT_BLOCK_SIZE;
+
+	if( inflateInit2( &zs, Constants::GZIP_WINDOW_BITS ) != Z_OK ) return 0;
+	int status = inflate( &zs, Z_FINISH );
+	inflateEnd( &zs );
+
+	return status == Z_STREAM_END ? zs.total_out : 0;
+}
+
+static void report( const std::string &name, double seconds, uint64_t compressed, uint64_t uncompressed )
+{
+	std::cout << std::left << std::setw(24) << name << std::right << std::fixed << std::setprecision(1)
+	          << std::setw(10) << uncompressed / 1048576.0 / seconds << " MB/s"
+	          << std::setw(10) << compressed / 1048576.0 / seconds << " MB/s (compressed)"
+	          << std::setw(10) << std::setprecision(3) << seconds << " s" << std::endl;
+}
+
+int main( int argc, char *argv[] )
+{
+	if( argc < 2 )
+	{
+		std::cerr << "usage: " << argv[0] << " <file.bam> [rounds]" << std::endl;
+		return 1;
+	}
+
+	int rounds = argc > 2 ? atoi(argv[2]) : 3;
+	if( rounds < 1 ) rounds = 1;
+
+	// load the whole file
+	std::ifstream ifs( argv[1], std::ios::binary );
+	if( !ifs )
+	{
+		std::cerr << "[error] cannot open " << argv[1] << std::endl;
+		return 1;
+	}
+	std::vector< char > data( (std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>() );
+
+	// find blocks' offsets and lengths
+	std::vector< size_t > offsets, lengths;
+	size_t pos = 0;
+
+	while( pos + Constants::BGZF_BLOCK_HEADER_LENGTH <= data.size() )
+	{
+		char *header = &data[pos];
+		size_t blockLength = BamTools::UnpackUnsignedShort( &header[16] ) + 1;
+
+		if( !BgzfStream::CheckBlockHeader(header) || pos + blockLength > data.size() )
+		{
+			std::cerr << "[error] invalid BGZF block at offset " << pos << std::endl;
+			return 1;
+		}
+
+		offsets.push_back( pos );
+		lengths.push_back( blockLength );
+		pos += blockLength;
+	}
+
+	std::cout << "[bgzf-bench] " << offsets.size() << " blocks, " << data.size() / 1048576.0 << " MB compressed, "
+	          << rounds << " round(s)" << std::endl;
+
+	std::vector< char > output( Constants::BGZF_DEFAULT_BLOCK_SIZE );
+	uint64_t compressed = uint64_t(data.size()) * rounds;
+	uint64_t uncompressed = 0;
+
+	// baseline
+	double start = now();
+	for( int r=0; r < rounds; r++ )
+		for( size_t i=0; i < offsets.size(); i++ )
+			uncompressed += inflateBlockOnce( &data[offsets[i]], lengths[i], &output[0] );
+	report( "zlib (init per block)", now() - start, compressed, uncompressed );
+
+	const BgzfInflater::Backend backends[] = { BgzfInflater::ZLIB, BgzfInflater::LIBDEFLATE };
+
+	for( size_t b=0; b < sizeof(backends)/sizeof(backends[0]); b++ )
+	{
+		if( !BgzfInflater::IsAvailable( backends[b] ) ) continue;
+
+		for( int crc=0; crc <= 1; crc++ )
+		{
+			BgzfInflater *inflater = BgzfInflater::Create( backends[b] );
+			inflater->SetCheckCrc( crc == 1 );
+
+			std::string name = std::string( inflater->Name() ) + ( crc == 1 ? " + crc" : "" );
+			uncompressed = 0;
+
+			try
+			{
+				start = now();
+				for( int r=0; r < rounds; r++ )
+					for( size_t i=0; i < offsets.size(); i++ )
+						uncompressed += inflater->InflateBlock( &data[offsets[i]], lengths[i], &output[0] );
+				report( name, now() - start, compressed, uncompressed );
+			}
+			catch( BamException &e )
+			{
+				std::cerr << "[error] " << name << ": " << e.what() << std::endl;
+			}
+
+			delete inflater;
+		}
+	}
+
+	return 0;
+}